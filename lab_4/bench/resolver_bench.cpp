@@ -0,0 +1,113 @@
+#include "normalizer.h"
+#include "parser/expr_parser.h"
+#include "resolver.h"
+#include <benchmark/benchmark.h>
+#include <chrono>
+#include <string>
+#include <vector>
+
+// набор бенчмарков метода резолюций на классических задачах (задачи
+// Пеллетье и примеры лекций), записанных в синтаксисе выражений lab_4.
+//
+// Каждая задача решается при каждом правиле выбора атомов (Selection).
+// Время одного поиска ограничено, поэтому задачи, не решаемые при каком-либо
+// правиле выбора, тоже измеряются. Для каждого бенчмарка печатаются:
+//   solved     - доля найденных опровержений;
+//   given      - число заданных дизъюнктов за поиск;
+//   generated  - число построенных резольвент за поиск;
+//   kept       - число резольвент, сохраненных после проверки поглощения.
+//
+// Результаты имеют смысл только для сборки с оптимизацией
+// (-DLAB4_BENCHMARKS=ON -DCMAKE_BUILD_TYPE=Release)
+
+namespace {
+
+struct Problem {
+  const char *name;
+  const char *axioms; // пустая строка - нет аксиом
+  const char *goal;
+};
+
+const Problem problems[] = {
+    {"pel01", "", "(P -> Q) = (~Q -> ~P)"},
+    {"pel08", "", "((P -> Q) -> P) -> P"},
+    {"pel12", "", "((P = Q) = R) = (P = (Q = R))"},
+    {"pel17", "", "((P & (Q -> R)) -> S) = ((~P + Q + S) & (~P + ~R + S))"},
+    {"pel18", "", "\\exists(y) \\forall(x) (F(y) -> F(x))"},
+    {"pel19", "",
+     "\\exists(x) \\forall(y, z) ((P(y) -> Q(z)) -> (P(x) -> Q(x)))"},
+    {"pel20", "",
+     "(\\forall(x, y) \\exists(z) \\forall(w) ((P(x) & Q(y)) -> "
+     "(R(z) & S(w)))) -> ((\\exists(x, y) (P(x) & Q(y))) -> "
+     "\\exists(z) R(z))"},
+    {"pel35", "", "\\exists(x, y) (P(x, y) -> (\\forall(x, y) P(x, y)))"},
+    {"pel39", "", "~(\\exists(x) \\forall(y) (F(y, x) = ~F(y, y)))"},
+    {"pel43", "\\forall(x, y) (Q(x, y) = (\\forall(z) (F(z, x) = F(z, y))))",
+     "\\forall(x, y) (Q(x, y) = Q(y, x))"},
+    {"lection/transitive",
+     "(\\forall(x, y, z) ((P(x, z) & P(z, y)) -> P(x, y))) & "
+     "P(1, 2) & P(2, 3) & P(3, 4) & P(4, 5) & P(5, 6)",
+     "P(1, 6)"},
+    {"lection/ex1",
+     "(\\forall(x) (S(x) + M(x))) & ~(\\exists(x) (M(x) & L(x, Lena))) & "
+     "(\\forall(x) (S(x) -> L(x, Snow))) & "
+     "(\\forall(y) (L(Lena, y) = ~L(Petya, y))) & "
+     "L(Petya, Rain) & L(Petya, Snow)",
+     "\\exists(x) (M(x) & ~S(x))"},
+    {"lection/list_len",
+     "\\forall(x, y, z) (Len(x, y) -> Len(cons(z, x), succ(y))) & "
+     "Len(Nil, 0)",
+     "\\exists(x) Len(x, succ(succ(succ(0))))"},
+};
+
+const std::chrono::milliseconds timeout(1000);
+
+void runBenchmark(benchmark::State &state, const Problem &problem,
+                  Selection selection) {
+  std::vector<Disjunct> axioms;
+  if (*problem.axioms)
+    axioms = ExprNormalizer().scolemForm(ExprParser().Parse(problem.axioms));
+  auto target = ExprNormalizer().scolemForm(
+      Expr::createInverse(ExprParser().Parse(problem.goal)));
+  ResolverLimits limits;
+  limits.timeout = timeout;
+  size_t solved = 0;
+  ResolverStats stats;
+  for (auto _ : state) {
+    Resolver resolver(limits, selection);
+    if (resolver.resolve(axioms, target))
+      ++solved;
+    stats = resolver.getStats();
+  }
+  using benchmark::Counter;
+  state.counters["solved"] = Counter(solved, Counter::kAvgIterations);
+  state.counters["given"] = stats.given;
+  state.counters["generated"] = stats.generated;
+  state.counters["kept"] = stats.kept;
+}
+
+void registerAll() {
+  for (auto &problem : problems)
+    for (auto [suffix, selection] :
+         {std::pair{"/all", Selection::all},
+          std::pair{"/negative", Selection::negative},
+          std::pair{"/ordered", Selection::ordered}})
+      benchmark::RegisterBenchmark(
+          (std::string(problem.name) + suffix).c_str(),
+          [&problem, selection = selection](benchmark::State &state) {
+            runBenchmark(state, problem, selection);
+          })
+          ->Unit(benchmark::kMillisecond);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  registerAll();
+  benchmark::Initialize(&argc, argv);
+  if (benchmark::ReportUnrecognizedArguments(argc, argv))
+    return 1;
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  return 0;
+}
@@ -1,10 +1,14 @@
+#include "batch.h"
 #include "normalizer.h"
 #include "parser/expr.h"
 #include "parser/expr_parser.h"
 #include "resolver.h"
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
 #include <exception>
+#include <fstream>
 #include <iostream>
-#include <sstream>
 
 auto unify(Expr::ptr leftExpr, Expr::ptr rightExpr) {
   rightExpr = Expr::createInverse(rightExpr);
@@ -22,27 +26,18 @@ bool implies(std::list<Expr::ptr> axiomExprs, Expr::ptr targetExpr) {
   auto axiomExpr =
       Expr::createConjunction(axiomExprs.begin(), axiomExprs.end());
 
-  auto axioms = ExprNormalizer().scolemForm(axiomExpr);
-  auto target = ExprNormalizer().scolemForm(targetExpr);
+  ExprNormalizer normalizer;
+  auto axioms = normalizer.scolemForm(axiomExpr);
+  auto target = normalizer.scolemForm(targetExpr);
 
-  auto res = Resolver().resolve(axioms, target);
+  Resolver resolver;
+  auto res = resolver.resolve(axioms, target);
+  // output resolution steps
+  resolver.printResolutionChain(std::cout);
 
   return res.has_value();
 }
 
-std::list<Expr::ptr> parseRules(const std::string &line) {
-  if (line.empty())
-    return {};
-  std::list<Expr::ptr> rules;
-  std::string ruleString;
-  std::istringstream ss(line);
-  while (ss.good()) {
-    std::getline(ss, ruleString, ';');
-    rules.push_back(ExprParser().Parse(ruleString.c_str()));
-  }
-  return rules;
-}
-
 void replResolve() {
   std::string line;
   ExprParser parser;
@@ -123,7 +118,82 @@ void repl() {
   }
 }
 
+int runBatch(const char *filename, size_t threads, ResolverLimits limits,
+             Selection selection) {
+  std::vector<BatchProblem> problems;
+  if (!strcmp(filename, "-")) {
+    problems = readProblems(std::cin);
+  } else {
+    std::ifstream file(filename);
+    if (!file) {
+      std::cerr << "failed to open problems file \"" << filename << "\""
+                << std::endl;
+      return 1;
+    }
+    problems = readProblems(file);
+  }
+  solveBatch(problems, threads, limits, selection,
+             [](const BatchResult &res) {
+               std::cout << toJson(res) << std::endl;
+             });
+  return 0;
+}
+
 int main(int argc, char **argv) {
+  const char *batchFilename = nullptr;
+  size_t threads = 0;
+  ResolverLimits limits;
+  limits.timeout = std::chrono::milliseconds(10000);
+  Selection selection = Selection::all;
+
+  constexpr auto helpMessage =
+      R"( [-h] [-b problems.txt] [-j threads] [-t timeout] [-s selection]
+
+    without -b starts interactive repl
+    -h, --help      print this message
+    -b problems.txt solve problems from file ('-' for stdin) and print
+                    results as JSON lines. Each line holds axioms and goal
+                    separated by ';', goal last; '#' starts a comment line
+    -j threads      number of worker threads (default: hardware threads)
+    -t timeout      time limit per problem including parsing, ms
+                    (default: 10000)
+    -s selection    literal selection: all, negative or ordered
+                    (default: all)
+)";
+
+  for (int i = 1; i < argc; ++i) {
+    if (!strcmp(argv[i], "-b") && i + 1 < argc) {
+      batchFilename = argv[++i];
+    } else if (!strcmp(argv[i], "-j") && i + 1 < argc) {
+      threads = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "-t") && i + 1 < argc) {
+      limits.timeout = std::chrono::milliseconds(atoi(argv[++i]));
+    } else if (!strcmp(argv[i], "-s") && i + 1 < argc) {
+      ++i;
+      if (!strcmp(argv[i], "all"))
+        selection = Selection::all;
+      else if (!strcmp(argv[i], "negative"))
+        selection = Selection::negative;
+      else if (!strcmp(argv[i], "ordered"))
+        selection = Selection::ordered;
+      else {
+        std::cerr << argv[0] << helpMessage;
+        return 1;
+      }
+    } else if (!strcmp(argv[i], "-h") || !strcmp(argv[i], "--help")) {
+      std::cout << argv[0] << helpMessage;
+      return 0;
+    } else {
+      // unknown flag or a flag without its value
+      std::cerr << "unknown or incomplete flag " << argv[i] << "\n"
+                << argv[0] << helpMessage;
+      return 1;
+    }
+  }
+
+  if (batchFilename)
+    return runBatch(batchFilename, threads, limits, selection);
+
   std::cout << "repl for resolution method:\n";
   repl();
   return 0;
@@ -0,0 +1,159 @@
+#include "batch.h"
+#include "normalizer.h"
+#include "parser/expr_parser.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+std::list<Expr::ptr> parseRules(const std::string &line) {
+  if (line.empty())
+    return {};
+  std::list<Expr::ptr> rules;
+  std::string ruleString;
+  std::istringstream ss(line);
+  while (ss.good()) {
+    std::getline(ss, ruleString, ';');
+    rules.push_back(ExprParser().Parse(ruleString.c_str()));
+  }
+  return rules;
+}
+
+std::vector<BatchProblem> readProblems(std::istream &stream) {
+  std::vector<BatchProblem> problems;
+  std::string line;
+  for (size_t number = 1; std::getline(stream, line); ++number) {
+    auto first = line.find_first_not_of(" \t\r");
+    if (first == std::string::npos || line[first] == '#')
+      continue;
+    if (line.back() == '\r')
+      line.pop_back();
+    problems.push_back({number, std::move(line)});
+  }
+  return problems;
+}
+
+BatchResult solveProblem(const BatchProblem &problem, ResolverLimits limits,
+                         Selection selection) {
+  auto start = std::chrono::steady_clock::now();
+  // ограничение времени отсчитывается от начала разбора задачи
+  auto deadline = start + limits.timeout;
+  BatchResult res;
+  res.line = problem.line;
+  try {
+    auto rules = parseRules(problem.text);
+    if (rules.empty())
+      throw std::runtime_error("goal expected");
+    auto goal = Expr::createInverse(rules.back());
+    rules.pop_back();
+
+    // один нормализатор для аксиом и цели: функции Сколема не совпадают
+    ExprNormalizer normalizer;
+    std::vector<Disjunct> axioms;
+    if (!rules.empty())
+      axioms = normalizer.scolemForm(
+          Expr::createConjunction(rules.begin(), rules.end()));
+    auto target = normalizer.scolemForm(goal);
+    res.axiomClauses = axioms.size();
+    res.targetClauses = target.size();
+
+    // поиску остается время, не израсходованное разбором и нормализацией
+    auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+        deadline - std::chrono::steady_clock::now());
+    if (limits.timeout.count() != 0 && left.count() <= 0) {
+      res.stats.stop = ResolverStop::timeout;
+    } else {
+      if (limits.timeout.count() != 0)
+        limits.timeout = left;
+      Resolver resolver(limits, selection);
+      res.proved = resolver.resolve(axioms, target).has_value();
+      res.stats = resolver.getStats();
+    }
+  } catch (const std::exception &err) {
+    res.error = err.what();
+  }
+  res.millis = std::chrono::duration<double, std::milli>(
+                   std::chrono::steady_clock::now() - start)
+                   .count();
+  return res;
+}
+
+static std::string quoted(const std::string &str) {
+  std::ostringstream res;
+  res << '"';
+  for (char c : str) {
+    if (c == '"' || c == '\\')
+      res << '\\' << c;
+    else if (c == '\n')
+      res << "\\n";
+    else if (static_cast<unsigned char>(c) < 0x20) {
+      const char *hex = "0123456789abcdef";
+      res << "\\u00" << hex[c >> 4] << hex[c & 0xf];
+    } else
+      res << c;
+  }
+  res << '"';
+  return res.str();
+}
+
+static const char *statusName(const BatchResult &result) {
+  if (!result.error.empty())
+    return "error";
+  switch (result.stats.stop) {
+  case ResolverStop::refuted:
+    return "proved";
+  case ResolverStop::saturated:
+    return "saturated";
+  case ResolverStop::clauseLimit:
+    return "clause_limit";
+  case ResolverStop::timeout:
+    return "timeout";
+  }
+  return "unknown";
+}
+
+std::string toJson(const BatchResult &result) {
+  std::ostringstream res;
+  res << "{\"line\": " << result.line
+      << ", \"status\": " << quoted(statusName(result))
+      << ", \"time_ms\": " << result.millis;
+  if (!result.error.empty()) {
+    res << ", \"error\": " << quoted(result.error) << "}";
+    return res.str();
+  }
+  res << ", \"axiom_clauses\": " << result.axiomClauses
+      << ", \"target_clauses\": " << result.targetClauses
+      << ", \"given\": " << result.stats.given
+      << ", \"generated\": " << result.stats.generated
+      << ", \"kept\": " << result.stats.kept << "}";
+  return res.str();
+}
+
+void solveBatch(const std::vector<BatchProblem> &problems, size_t threads,
+                ResolverLimits limits, Selection selection,
+                const std::function<void(const BatchResult &)> &onResult) {
+  if (threads == 0)
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  threads = std::min(threads, problems.size());
+
+  std::atomic<size_t> next = 0;
+  std::mutex mutex;
+  auto work = [&]() {
+    for (size_t i; (i = next++) < problems.size();) {
+      auto res = solveProblem(problems[i], limits, selection);
+      std::lock_guard lock(mutex);
+      onResult(res);
+    }
+  };
+  // вызывающий поток тоже решает задачи
+  std::vector<std::thread> workers;
+  for (size_t i = 1; i < threads; ++i)
+    workers.emplace_back(work);
+  work();
+  for (auto &worker : workers)
+    worker.join();
+}
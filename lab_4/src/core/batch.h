@@ -0,0 +1,51 @@
+#pragma once
+
+#include "parser/expr.h"
+#include "resolver.h"
+#include <cstddef>
+#include <functional>
+#include <istream>
+#include <list>
+#include <string>
+#include <vector>
+
+// формулы строки, разделенные ';'
+std::list<Expr::ptr> parseRules(const std::string &line);
+
+// задача пакетного режима - строка файла задач: аксиомы и цель последней
+// формулой, разделенные ';'. Пустые строки и строки, начинающиеся с '#',
+// задачами не являются
+struct BatchProblem {
+  size_t line; // номер строки файла, начиная с 1
+  std::string text;
+};
+
+std::vector<BatchProblem> readProblems(std::istream &stream);
+
+// результат решения задачи
+struct BatchResult {
+  size_t line;
+  bool proved = false;
+  // ошибка разбора задачи. Если она не пуста, поиск не выполнялся
+  std::string error;
+  double millis = 0; // время разбора, нормализации и поиска
+  size_t axiomClauses = 0;
+  size_t targetClauses = 0;
+  ResolverStats stats;
+};
+
+// решение задачи: выводима ли цель из аксиом. Ограничение времени limits
+// относится ко всему решению: разбору, нормализации и поиску опровержения
+BatchResult solveProblem(const BatchProblem &problem, ResolverLimits limits,
+                         Selection selection = Selection::all);
+
+// результат строкой JSON без перевода строки
+std::string toJson(const BatchResult &result);
+
+// решение задач в threads потоках (0 - по числу аппаратных потоков). Каждый
+// поток берет следующую нерешенную задачу, пока они не закончатся.
+// onResult вызывается по мере решения задач (не в порядке их следования) и
+// никогда не вызывается одновременно из нескольких потоков
+void solveBatch(const std::vector<BatchProblem> &problems, size_t threads,
+                ResolverLimits limits, Selection selection,
+                const std::function<void(const BatchResult &)> &onResult);
@@ -0,0 +1,92 @@
+#include "literal_index.h"
+#include <tuple>
+
+bool LiteralIndex::Key::operator<(const Key &other) const {
+  return std::tie(kind, arity, name) <
+         std::tie(other.kind, other.arity, other.name);
+}
+
+void LiteralIndex::insert(int id, const Disjunct &disj) {
+  for (size_t i = 0; i < disj.size(); ++i)
+    insert(id, disj[i], i);
+}
+
+void LiteralIndex::insert(int id, const Atom &atom, size_t literal) {
+  Node *node = &m_root;
+  for (auto &key : flatten(atom, atom.isInverse()).keys) {
+    auto &child = node->children[key];
+    if (!child)
+      child = std::make_unique<Node>();
+    node = child.get();
+  }
+  node->entries.push_back({id, literal});
+}
+
+std::vector<LiteralIndex::Entry>
+LiteralIndex::findComplementary(const Atom &atom) const {
+  std::vector<Entry> res;
+  find(m_root, 0, flatten(atom, !atom.isInverse()), res);
+  return res;
+}
+
+LiteralIndex::Query LiteralIndex::flatten(const Atom &atom, bool inverse) {
+  Query query;
+  const auto &args = atom.getArguments();
+  query.keys.push_back({inverse ? Key::Negative : Key::Positive,
+                        atom.getName(), args.size()});
+  query.ends.push_back(0);
+  for (auto &arg : args)
+    flatten(arg, query);
+  query.ends[0] = query.keys.size();
+  return query;
+}
+
+void LiteralIndex::flatten(const Variable::ptr &term, Query &query) {
+  size_t pos = query.keys.size();
+  if (term->isVariable())
+    query.keys.push_back({Key::Var, "", 0});
+  else
+    query.keys.push_back(
+        {Key::Term, term->getValue(), term->getArguments().size()});
+  query.ends.push_back(0);
+  for (auto &arg : term->getArguments())
+    flatten(arg, query);
+  query.ends[pos] = query.keys.size();
+}
+
+/**
+ * Метод поиска кандидатов в поддереве node для символов запроса начиная с
+ * pos.
+ *
+ * Переменная дерева сопоставляется с термом запроса, начинающимся с pos,
+ * переменная запроса - с любым термом дерева (см. skip), остальные символы
+ * должны совпадать.
+ */
+void LiteralIndex::find(const Node &node, size_t pos, const Query &query,
+                        std::vector<Entry> &res) const {
+  if (pos == query.keys.size()) {
+    res.insert(res.end(), node.entries.begin(), node.entries.end());
+    return;
+  }
+  const auto &key = query.keys[pos];
+  if (key.kind == Key::Var) {
+    skip(node, 1, query.ends[pos], query, res);
+    return;
+  }
+  if (auto iter = node.children.find({Key::Var, "", 0});
+      iter != node.children.end())
+    find(*iter->second, query.ends[pos], query, res);
+  if (auto iter = node.children.find(key); iter != node.children.end())
+    find(*iter->second, pos + 1, query, res);
+}
+
+// пропустить terms термов дерева и продолжить поиск с символа запроса pos
+void LiteralIndex::skip(const Node &node, size_t terms, size_t pos,
+                        const Query &query, std::vector<Entry> &res) const {
+  if (terms == 0) {
+    find(node, pos, query, res);
+    return;
+  }
+  for (auto &[key, child] : node.children)
+    skip(*child, terms - 1 + key.arity, pos, query, res);
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "disjunct.h"
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+// индекс атомов дизъюнктов (дерево распознавания) для поиска пар резолюции.
+//
+// Атом записывается последовательностью символов в прямом порядке обхода:
+// знак и имя предиката, затем имена и арности символов аргументов, причем
+// все переменные заменяются одним символом. Последовательности хранятся в
+// префиксном дереве. При поиске атомов, которые могут унифицироваться с
+// отрицанием атома запроса, переменная запроса пропускает целый терм дерева,
+// а переменная дерева - целый терм запроса. Найденные атомы - кандидаты:
+// согласованность переменных проверяется унификацией
+class LiteralIndex {
+public:
+  // атом literal дизъюнкта id
+  struct Entry {
+    int id;
+    size_t literal;
+  };
+
+  void insert(int id, const Disjunct &disj);
+  // добавить только атом literal дизъюнкта id
+  void insert(int id, const Atom &atom, size_t literal);
+
+  // атомы индекса, которые могут быть унифицированы с отрицанием atom
+  std::vector<Entry> findComplementary(const Atom &atom) const;
+
+private:
+  struct Key {
+    enum Kind { Positive, Negative, Term, Var } kind;
+    std::string name;
+    size_t arity;
+
+    bool operator<(const Key &other) const;
+  };
+
+  struct Node {
+    std::map<Key, std::unique_ptr<Node>> children;
+    std::vector<Entry> entries;
+  };
+
+  // запрос: символы атома и для каждого символа - конец его терма
+  struct Query {
+    std::vector<Key> keys;
+    std::vector<size_t> ends;
+  };
+
+  static Query flatten(const Atom &atom, bool inverse);
+  static void flatten(const Variable::ptr &term, Query &query);
+
+  void find(const Node &node, size_t pos, const Query &query,
+            std::vector<Entry> &res) const;
+  void skip(const Node &node, size_t terms, size_t pos, const Query &query,
+            std::vector<Entry> &res) const;
+
+  Node m_root;
+};
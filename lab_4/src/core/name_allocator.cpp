@@ -5,34 +5,18 @@
 
 bool NameAllocator::allocateName(std::string name) {
   auto [base, index] = splitIndexed(std::move(name));
-  if (m_allocated.count(base) == 0) {
-    m_allocated[base] = std::list{index};
-    return true;
-  }
-  auto &indexList = m_allocated[base];
-  auto pos = std::lower_bound(indexList.begin(), indexList.end(), index);
-  if (pos != indexList.end() && *pos == index)
-    return false;
-  indexList.insert(pos, index);
-  return true;
+  return insertIndex(m_allocated[base], index);
 }
 
 std::string NameAllocator::allocateRenaming(std::string original) {
   if (m_working.count(original) != 0)
     return m_working[original];
   auto [base, index] = splitIndexed(original);
-  if (m_allocated.count(base) == 0) {
-    auto newName = joinIndexed(base, ++index);
-    m_allocated[base] = std::list{index};
-    m_working[original] = newName;
-    return newName;
-  }
-  auto &indexList = m_allocated[base];
-  std::list<int>::iterator pos;
-  do {
-    pos = std::lower_bound(indexList.begin(), indexList.end(), ++index);
-  } while (pos != indexList.end() && *pos == index);
-  indexList.insert(pos, index);
+  // первый свободный индекс после index
+  auto &runs = m_allocated[base];
+  if (auto run = findRun(runs, ++index); run != runs.end())
+    index = run->second + 1;
+  insertIndex(runs, index);
   auto newName = joinIndexed(base, index);
   m_working[original] = newName;
   return newName;
@@ -44,25 +28,23 @@ void NameAllocator::deallocate(std::string name) {
   auto [base, index] = splitIndexed(std::move(name));
   if (m_allocated.count(base) == 0)
     return;
-  auto &indexList = m_allocated[base];
-  auto pos = std::find(indexList.begin(), indexList.end(), index);
-  if (pos != indexList.end()) {
-    indexList.erase(pos);
-    if (indexList.empty())
-      m_allocated.erase(base);
-  }
+  auto &runs = m_allocated[base];
+  eraseIndex(runs, index);
+  if (runs.empty())
+    m_allocated.erase(base);
 }
 
 std::string NameAllocator::toString() const {
   std::string res = "{";
   bool first = true;
-  for (auto &[base, indexList] : m_allocated) {
+  for (auto &[base, runs] : m_allocated) {
     if (!first)
       res += " ";
     first = false;
     res += base + ":";
-    for (auto &index : indexList)
-      res += std::to_string(index) + ";";
+    for (auto &[from, to] : runs)
+      for (int index = from; index <= to; ++index)
+        res += std::to_string(index) + ";";
   }
   res += "}";
   if (!m_working.empty()) {
@@ -93,3 +75,39 @@ std::pair<std::string, int> NameAllocator::splitIndexed(std::string name) {
 std::string NameAllocator::joinIndexed(std::string name, int index) {
   return name + std::to_string(index);
 }
+
+// отрезок занятых индексов, содержащий index, или runs.end()
+NameAllocator::Runs::iterator NameAllocator::findRun(Runs &runs, int index) {
+  auto run = runs.upper_bound(index);
+  if (run == runs.begin())
+    return runs.end();
+  --run;
+  return run->second >= index ? run : runs.end();
+}
+
+bool NameAllocator::insertIndex(Runs &runs, int index) {
+  if (findRun(runs, index) != runs.end())
+    return false;
+  // присоединение к соседним отрезкам
+  auto next = runs.find(index + 1);
+  int last = next != runs.end() ? next->second : index;
+  if (next != runs.end())
+    runs.erase(next);
+  if (auto prev = findRun(runs, index - 1); prev != runs.end())
+    prev->second = last;
+  else
+    runs.emplace(index, last);
+  return true;
+}
+
+void NameAllocator::eraseIndex(Runs &runs, int index) {
+  auto run = findRun(runs, index);
+  if (run == runs.end())
+    return;
+  auto [first, last] = *run;
+  runs.erase(run);
+  if (first < index)
+    runs.emplace(first, index - 1);
+  if (index < last)
+    runs.emplace(index + 1, last);
+}
@@ -1,6 +1,5 @@
 #pragma once
 
-#include <list>
 #include <map>
 #include <string>
 
@@ -16,9 +15,16 @@ public:
   std::string toString() const;
 
 private:
+  // занятые индексы имени: отрезки [first, last] без общих и соседних точек
+  using Runs = std::map<int, int>;
+
   std::pair<std::string, int> splitIndexed(std::string name);
   std::string joinIndexed(std::string name, int index);
 
-  std::map<std::string, std::list<int>> m_allocated;
+  static Runs::iterator findRun(Runs &runs, int index);
+  static bool insertIndex(Runs &runs, int index);
+  static void eraseIndex(Runs &runs, int index);
+
+  std::map<std::string, Runs> m_allocated;
   std::map<std::string, std::string> m_working;
 };
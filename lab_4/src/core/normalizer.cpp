@@ -1,11 +1,18 @@
 #include "normalizer.h"
 #include "utils.h"
 #include <algorithm>
+#include <atomic>
 #include <memory>
 #include <stdexcept>
+#include <unordered_set>
 #include <vector>
 
-std::vector<Disjunct> ExprNormalizer::scolemForm(Expr::ptr expr) {
+ExprNormalizer::ExprNormalizer(size_t definitionThreshold)
+    : m_definitionThreshold(definitionThreshold) {}
+
+std::vector<Disjunct> ExprNormalizer::scolemForm(Expr::ptr expr,
+                                                 CnfMode mode) {
+  m_mode = mode;
   expr = normalForm(std::move(expr));
   std::vector<Disjunct> disjunctions;
 
@@ -14,13 +21,15 @@ std::vector<Disjunct> ExprNormalizer::scolemForm(Expr::ptr expr) {
          expr->getType() == Expr::Type::forall) {
     Expr::ptr next = expr->getOperands()[0];
     if (expr->getType() == Expr::Type::exists) {
-      for (auto var : expr->getVars()) {
-        next = next->withReplacedVariable(
-            var, Expr::createTerm("F" + std::to_string(m_funcCounter), vars));
+      std::map<std::string, Expr::ptr> terms;
+      for (const auto &var : expr->getVars()) {
+        terms[var] =
+            Expr::createTerm("F" + std::to_string(m_funcCounter), vars);
         ++m_funcCounter;
       }
+      next = next->withReplacedVariables(terms);
     } else {
-      auto exprVars = expr->getVars();
+      const auto &exprVars = expr->getVars();
       vars.insert(vars.end(), exprVars.begin(), exprVars.end());
     }
     expr = std::move(next);
@@ -35,112 +44,234 @@ std::vector<Disjunct> ExprNormalizer::scolemForm(Expr::ptr expr) {
 }
 
 Expr::ptr ExprNormalizer::normalForm(Expr::ptr expr) {
+  std::vector<Task> stack;
+  stack.push_back(expand(std::move(expr)));
+  while (true) {
+    auto &task = stack.back();
+    if (task.results.size() < task.operands.size()) {
+      auto operand = task.operands[task.results.size()];
+      stack.push_back(expand(std::move(operand)));
+      continue;
+    }
+    auto res = combine(std::move(task));
+    stack.pop_back();
+    if (stack.empty())
+      return res;
+    stack.back().results.push_back(std::move(res));
+  }
+}
+
+ExprNormalizer::Task ExprNormalizer::expand(Expr::ptr expr) {
+  auto leaf = [](Expr::ptr res) {
+    return Task{Expr::Type::constant, {}, {}, {std::move(res)}};
+  };
+  auto clause = [](Expr::ptr literal) {
+    return Expr::create(
+        Expr::Type::conjunction,
+        std::vector{Expr::create(Expr::Type::disjunction,
+                                 std::vector{std::move(literal)})});
+  };
   switch (expr->getType()) {
   case Expr::Type::constant:
-    return std::move(expr);
+    return leaf(std::move(expr));
   case Expr::Type::atom:
-    return std::make_shared<Expr>(
-        Expr::Type::conjunction,
-        std::vector{std::make_shared<Expr>(Expr::Type::disjunction,
-                                           std::vector{std::move(expr)})});
-  case Expr::Type::inverse:
-    return inverseToNormalForm(std::move(expr));
+    return leaf(clause(std::move(expr)));
   case Expr::Type::conjunction:
-    return conjunctionToNormalForm(std::move(expr));
   case Expr::Type::disjunction:
-    return disjunctionToNormalForm(std::move(expr));
+    return Task{expr->getType(),
+                {},
+                flatten(expr->getType(), expr->getOperands(), false),
+                {}};
+  case Expr::Type::exists:
+  case Expr::Type::forall:
+    return Task{expr->getType(), expr->getVars(), expr->getOperands(), {}};
+  case Expr::Type::inverse:
+    break;
+  }
+
+  const auto &operand = expr->getOperands()[0];
+  switch (operand->getType()) {
+  case Expr::Type::constant:
+    if (operand->getValue() == "1")
+      return leaf(Expr::createFalse());
+    else
+      return leaf(Expr::createTrue());
+  case Expr::Type::atom:
+    return leaf(clause(std::move(expr)));
+  case Expr::Type::inverse: {
+    // a chain of double negations is dropped at once
+    auto inner = operand->getOperands()[0];
+    while (inner->getType() == Expr::Type::inverse &&
+           inner->getOperands()[0]->getType() == Expr::Type::inverse)
+      inner = inner->getOperands()[0]->getOperands()[0];
+    return expand(std::move(inner));
+  }
+  case Expr::Type::disjunction:
+  case Expr::Type::conjunction: {
+    auto dual = operand->getType() == Expr::Type::disjunction
+                    ? Expr::Type::conjunction
+                    : Expr::Type::disjunction;
+    return Task{dual, {}, flatten(dual, operand->getOperands(), true), {}};
+  }
   case Expr::Type::exists:
+    return Task{Expr::Type::forall,
+                operand->getVars(),
+                {Expr::createInverse(operand->getOperands()[0])},
+                {}};
   case Expr::Type::forall:
-    return quantifierToNormalForm(std::move(expr));
+    return Task{Expr::Type::exists,
+                operand->getVars(),
+                {Expr::createInverse(operand->getOperands()[0])},
+                {}};
   }
   throw std::runtime_error("unhandled case expression");
-  return nullptr;
+  return {};
 }
 
-Expr::ptr ExprNormalizer::inverseToNormalForm(Expr::ptr expr) {
-  auto operands = expr->getOperands();
-  switch (operands[0]->getType()) {
+/**
+ * Operands of a chain of the given type. Operands of nested nodes of the
+ * same type are spliced in: parentheses and right-nested implications
+ * produce such nodes, and normalizing them level by level copies the
+ * growing clause list on every level. With inverse set the operands are
+ * negated, so nested nodes of the dual type are spliced in through the
+ * negation (~(A + (B + C)) gives ~A, ~B, ~C).
+ */
+std::vector<Expr::ptr>
+ExprNormalizer::flatten(Expr::Type type, const std::vector<Expr::ptr> &operands,
+                        bool inverse) {
+  auto dual = type == Expr::Type::conjunction ? Expr::Type::disjunction
+                                              : Expr::Type::conjunction;
+  std::vector<Expr::ptr> res;
+  std::vector<std::pair<Expr::ptr, bool>> stack;
+  for (auto iter = operands.rbegin(); iter != operands.rend(); ++iter)
+    stack.emplace_back(*iter, inverse);
+  while (!stack.empty()) {
+    auto [expr, negated] = std::move(stack.back());
+    stack.pop_back();
+    while (expr->getType() == Expr::Type::inverse) {
+      expr = expr->getOperands()[0];
+      negated = !negated;
+    }
+    if (expr->getType() == (negated ? dual : type)) {
+      const auto &nested = expr->getOperands();
+      for (auto iter = nested.rbegin(); iter != nested.rend(); ++iter)
+        stack.emplace_back(*iter, negated);
+    } else
+      res.push_back(negated ? Expr::createInverse(std::move(expr))
+                            : std::move(expr));
+  }
+  return res;
+}
+
+Expr::ptr ExprNormalizer::combine(Task task) {
+  switch (task.type) {
   case Expr::Type::constant:
-    if (operands[0]->getValue() == "1")
-      return Expr::createFalse();
-    else
-      return Expr::createTrue();
   case Expr::Type::atom:
-    return std::make_shared<Expr>(
-        Expr::Type::conjunction,
-        std::vector{std::make_shared<Expr>(Expr::Type::disjunction,
-                                           std::vector{std::move(expr)})});
   case Expr::Type::inverse:
-    return normalForm(operands[0]->getOperands()[0]);
-  case Expr::Type::disjunction:
-    return normalForm(Expr::createConjunction(
-        Expr::createInverse(operands[0]->getOperands()[0]),
-        Expr::createInverse(operands[0]->getOperands()[1])));
+    return std::move(task.results[0]);
   case Expr::Type::conjunction:
-    return normalForm(Expr::createDisjunction(
-        Expr::createInverse(operands[0]->getOperands()[0]),
-        Expr::createInverse(operands[0]->getOperands()[1])));
+    return conjunctionToNormalForm(std::move(task.results));
+  case Expr::Type::disjunction:
+    return disjunctionToNormalForm(std::move(task.results));
   case Expr::Type::exists:
-    return normalForm(
-        Expr::createForAll(operands[0]->getVars(),
-                           Expr::createInverse(operands[0]->getOperands()[0])));
   case Expr::Type::forall:
-    return normalForm(
-        Expr::createExists(operands[0]->getVars(),
-                           Expr::createInverse(operands[0]->getOperands()[0])));
+    return quantifierToNormalForm(task.type, task.vars,
+                                  std::move(task.results[0]));
   }
   throw std::runtime_error("unhandled case expression");
   return nullptr;
 }
 
-Expr::ptr ExprNormalizer::conjunctionToNormalForm(Expr::ptr expr) {
-  auto operands = expr->getOperands();
-  auto left = normalForm(operands[0]);
-  auto right = normalForm(operands[1]);
-
+Expr::ptr
+ExprNormalizer::conjunctionToNormalForm(std::vector<Expr::ptr> operands) {
   // constant propagation
-  if (left->getType() == Expr::Type::constant)
-    return left->getValue() == "0" ? left : right;
-  if (right->getType() == Expr::Type::constant)
-    return right->getValue() == "0" ? right : left;
+  std::vector<Expr::ptr> parts;
+  for (auto &operand : operands) {
+    if (operand->getType() != Expr::Type::constant)
+      parts.push_back(std::move(operand));
+    else if (operand->getValue() == "0")
+      return operand;
+  }
+  if (parts.empty())
+    return Expr::createTrue();
+  if (parts.size() == 1)
+    return parts[0];
 
-  // extract all quantifiers from both operands (with optional renaming)
+  // extract all quantifiers from operands (with optional renaming) and drag
+  // all elementary disjunctions. Expressions are hash-consed, so equal
+  // disjunctions are the same node
   std::map<std::string, std::string> renamings;
   std::vector<std::pair<Expr::Type, std::set<std::string>>> quantifiers;
-  left = extractFrontQuantifiers(renamings, quantifiers, left);
-  right = extractFrontQuantifiers(renamings, quantifiers, right);
-
-  // drag all elementary disjunctions from both paths
-  auto disjunctions = left->getOperands();
-  auto rightOps = right->getOperands();
-  std::copy_if(rightOps.begin(), rightOps.end(),
-               std::back_inserter(disjunctions), [&disjunctions](auto x) {
-                 return std::all_of(disjunctions.begin(), disjunctions.end(),
-                                    [&x](auto d) { return *x != *d; });
-               });
-  Expr::ptr res = std::make_shared<Expr>(Expr::Type::conjunction, disjunctions);
+  std::vector<Expr::ptr> disjunctions;
+  std::unordered_set<const Expr *> seen;
+  for (auto &part : parts) {
+    part = extractFrontQuantifiers(renamings, quantifiers, part);
+    for (const auto &disjunction : part->getOperands())
+      if (seen.insert(disjunction.get()).second)
+        disjunctions.push_back(disjunction);
+  }
+  return applyQuantifiers(
+      quantifiers,
+      Expr::create(Expr::Type::conjunction, std::move(disjunctions)));
+}
 
-  // apply quantifiers if any
-  for (int i = quantifiers.size() - 1; i >= 0; --i) {
-    if (quantifiers[i].first == Expr::Type::exists)
-      res = Expr::createExists(quantifiers[i].second, res);
-    else
-      res = Expr::createForAll(quantifiers[i].second, res);
+/**
+ * Operands are distributed pairwise from the right, as if the chain was
+ * nested. Runs of single clauses without quantifiers are joined in one pass
+ * beforehand: distributing them one by one gives the same clause, but copies
+ * it on every step.
+ */
+Expr::ptr
+ExprNormalizer::disjunctionToNormalForm(std::vector<Expr::ptr> operands) {
+  std::vector<Expr::ptr> parts;
+  std::vector<Expr::ptr> literals;
+  auto flush = [&]() {
+    if (literals.empty())
+      return true;
+    auto clause = disjunctReduction(
+        Expr::create(Expr::Type::disjunction, std::move(literals)));
+    literals.clear();
+    if (clause->getType() == Expr::Type::constant)
+      return false;
+    parts.push_back(
+        Expr::create(Expr::Type::conjunction, std::vector{std::move(clause)}));
+    return true;
+  };
+  for (auto &operand : operands) {
+    // constants propagation
+    if (operand->getType() == Expr::Type::constant) {
+      if (operand->getValue() == "1")
+        return operand;
+      continue;
+    }
+    if (operand->getType() == Expr::Type::conjunction &&
+        operand->getOperands().size() == 1) {
+      const auto &clause = operand->getOperands()[0]->getOperands();
+      literals.insert(literals.end(), clause.begin(), clause.end());
+      continue;
+    }
+    if (!flush())
+      return Expr::createTrue();
+    parts.push_back(std::move(operand));
   }
+  if (!flush())
+    return Expr::createTrue();
+  if (parts.empty())
+    return Expr::createFalse();
 
+  auto res = parts.back();
+  for (size_t i = parts.size() - 1; i-- > 0;)
+    res = disjunctionToNormalForm(parts[i], res);
   return res;
 }
 
-Expr::ptr ExprNormalizer::disjunctionToNormalForm(Expr::ptr expr) {
-  auto operands = expr->getOperands();
-  auto left = normalForm(operands[0]);
-  auto right = normalForm(operands[1]);
-
+Expr::ptr ExprNormalizer::disjunctionToNormalForm(Expr::ptr left,
+                                                  Expr::ptr right) {
   // constants propagation
   if (left->getType() == Expr::Type::constant)
     return left->getValue() == "1" ? left : right;
   if (right->getType() == Expr::Type::constant)
-    return right->getValue() == "1" ? left : right;
+    return right->getValue() == "1" ? right : left;
 
   // extract all quantifiers
   std::map<std::string, std::string> renamings;
@@ -148,24 +279,36 @@ Expr::ptr ExprNormalizer::disjunctionToNormalForm(Expr::ptr expr) {
   left = extractFrontQuantifiers(renamings, quantifiers, left);
   right = extractFrontQuantifiers(renamings, quantifiers, right);
 
-  auto left_dsj = left->getOperands();
-  auto right_dsj = right->getOperands();
+  const auto &left_dsj = left->getOperands();
+  const auto &right_dsj = right->getOperands();
   std::vector<Expr::ptr> disjunctions;
-  for (size_t i = 0; i < left_dsj.size(); ++i) {
-    for (size_t j = 0; j < right_dsj.size(); ++j) {
-      auto args = left_dsj[i]->getOperands();
-      auto right_dsj_ops = right_dsj[j]->getOperands();
-      std::copy_if(right_dsj_ops.begin(), right_dsj_ops.end(),
-                   std::back_inserter(args), [&args](auto x) {
-                     return std::all_of(
-                         args.begin(), args.end(),
-                         [&x](const Expr::ptr &d) { return *x != *d; });
-                   });
-      auto newRule = std::make_shared<Expr>(Expr::Type::disjunction, args);
-      if (std::all_of(disjunctions.begin(), disjunctions.end(),
-                      [&newRule](auto d) { return *d != *newRule; }))
-        disjunctions.push_back(newRule);
-    }
+  std::unordered_set<const Expr *> seen;
+  auto join = [&](const Expr::ptr &first, const Expr::ptr &second) {
+    auto args = first->getOperands();
+    std::unordered_set<const Expr *> argSet;
+    for (const auto &arg : args)
+      argSet.insert(arg.get());
+    for (const auto &arg : second->getOperands())
+      if (argSet.insert(arg.get()).second)
+        args.push_back(arg);
+    auto newRule = Expr::create(Expr::Type::disjunction, std::move(args));
+    if (seen.insert(newRule.get()).second)
+      disjunctions.push_back(newRule);
+  };
+  if (needsDefinition(left_dsj.size(), right_dsj.size())) {
+    // L + R becomes (D + R) & (~D + L) for a fresh predicate D
+    auto atom = definitionAtom(left);
+    auto positive = Expr::create(Expr::Type::disjunction, std::vector{atom});
+    auto negative = Expr::create(Expr::Type::disjunction,
+                                 std::vector{Expr::createInverse(atom)});
+    for (const auto &disjunction : right_dsj)
+      join(positive, disjunction);
+    for (const auto &disjunction : left_dsj)
+      join(negative, disjunction);
+  } else {
+    for (const auto &leftDisjunction : left_dsj)
+      for (const auto &rightDisjunction : right_dsj)
+        join(leftDisjunction, rightDisjunction);
   }
 
   // check contrary disjunctions
@@ -177,29 +320,40 @@ Expr::ptr ExprNormalizer::disjunctionToNormalForm(Expr::ptr expr) {
   if (disjunctions.empty())
     return Expr::createTrue();
 
-  auto res = std::make_shared<Expr>(Expr::Type::conjunction, disjunctions);
-
-  // apply quantifiers if any
-  for (int i = quantifiers.size() - 1; i >= 0; --i) {
-    if (quantifiers[i].first == Expr::Type::exists)
-      res = Expr::createExists(quantifiers[i].second, res);
-    else
-      res = Expr::createForAll(quantifiers[i].second, res);
-  }
-
-  return res;
+  return applyQuantifiers(
+      quantifiers,
+      Expr::create(Expr::Type::conjunction, std::move(disjunctions)));
 }
 
-Expr::ptr ExprNormalizer::quantifierToNormalForm(Expr::ptr expr) {
-  auto rule = normalForm(expr->getOperands()[0]);
+Expr::ptr
+ExprNormalizer::quantifierToNormalForm(Expr::Type type,
+                                       const std::set<std::string> &vars,
+                                       Expr::ptr rule) {
   auto ruleVars = rule->getFreeVars();
   std::set<std::string> newVars;
-  for (const auto &var : expr->getVars())
+  for (const auto &var : vars)
     if (ruleVars.count(var) > 0)
       newVars.insert(var);
   if (newVars.empty())
     return rule;
-  return std::make_shared<Expr>(expr->getType(), std::vector{rule}, newVars);
+  return Expr::create(type, std::vector{rule}, newVars);
+}
+
+Expr::ptr ExprNormalizer::applyQuantifiers(
+    const std::vector<std::pair<Expr::Type, std::set<std::string>>>
+        &quantifiers,
+    Expr::ptr rule) {
+  for (size_t i = quantifiers.size(); i-- > 0;) {
+    // adjacent quantifiers of the same kind are merged, so the prefix does
+    // not grow with the number of quantified operands
+    auto type = quantifiers[i].first;
+    auto vars = quantifiers[i].second;
+    for (; i > 0 && quantifiers[i - 1].first == type; --i)
+      vars.insert(quantifiers[i - 1].second.begin(),
+                  quantifiers[i - 1].second.end());
+    rule = Expr::create(type, std::vector{std::move(rule)}, std::move(vars));
+  }
+  return rule;
 }
 
 Expr::ptr ExprNormalizer::extractFrontQuantifiers(
@@ -215,11 +369,18 @@ Expr::ptr ExprNormalizer::extractFrontQuantifiers(
       rule = rule->getOperands()[0];
     }
   } else {
+    // a new name must not clash with any variable of the rule: the names of
+    // the whole prefix and the free ones occur in the matrix
+    auto matrix = rule;
+    while (matrix->getType() == Expr::Type::forall ||
+           matrix->getType() == Expr::Type::exists)
+      matrix = matrix->getOperands()[0];
+    auto used = matrix->getFreeVars();
     while (rule->getType() == Expr::Type::forall ||
            rule->getType() == Expr::Type::exists) {
       // check for renaming
       std::set<std::string> newVars;
-      auto ruleVars = rule->getVars();
+      const auto &ruleVars = rule->getVars();
       auto next = rule->getOperands()[0];
       for (auto var : ruleVars) {
         int count = renamings.count(var);
@@ -228,7 +389,7 @@ Expr::ptr ExprNormalizer::extractFrontQuantifiers(
           newVars.insert(var);
         } else {
           auto newName = nextIndexed(var);
-          while (renamings.count(newName) > 0 && ruleVars.count(newName) > 0)
+          while (renamings.count(newName) > 0 || used.count(newName) > 0)
             newName = nextIndexed(newName);
           renamings[newName] = var;
           next = next->withRenamedVariable(var, newName);
@@ -243,18 +404,47 @@ Expr::ptr ExprNormalizer::extractFrontQuantifiers(
   return rule;
 }
 
-Expr::ptr ExprNormalizer::disjunctReduction(Expr::ptr expr) {
-  std::vector<Expr::ptr> terms = expr->getOperands();
-  for (int i = terms.size() - 1; i >= 0; --i) {
-    for (int j = i - 1; j >= 0; --j) {
-      if (terms[i]->toString() == terms[j]->toString()) {
-        terms.erase(terms.begin() + i);
-        break;
-      } else if (contraryPair(*terms[i], *terms[j]))
-        return Expr::createTrue();
-    }
+bool ExprNormalizer::needsDefinition(size_t leftCount,
+                                     size_t rightCount) const {
+  // a single clause on either side is distributed without growth
+  if (leftCount < 2 || rightCount < 2)
+    return false;
+  switch (m_mode) {
+  case CnfMode::distribute:
+    return false;
+  case CnfMode::definitional:
+    return true;
+  case CnfMode::automatic:
+    return leftCount * rightCount > m_definitionThreshold;
   }
-  return std::make_shared<Expr>(Expr::Type::disjunction, terms);
+  return false;
+}
+
+// fresh predicate over the free variables of expr. The counter is shared by
+// all normalizers, so clauses of separately normalized formulas never share
+// a definition symbol; the underscore keeps it apart from parsed names
+Expr::ptr ExprNormalizer::definitionAtom(const Expr::ptr &expr) {
+  static std::atomic<int> definitionCounter = 0;
+  std::vector<Expr::ptr> args;
+  for (const auto &var : expr->getFreeVars())
+    args.push_back(Expr::createAtom(var));
+  return Expr::createPredicate("_D" + std::to_string(definitionCounter++),
+                               std::move(args));
+}
+
+// removes repeated literals; a disjunction with contrary literals is true
+Expr::ptr ExprNormalizer::disjunctReduction(Expr::ptr expr) {
+  std::vector<Expr::ptr> terms;
+  std::unordered_set<const Expr *> seen;
+  for (const auto &term : expr->getOperands())
+    if (seen.insert(term.get()).second)
+      terms.push_back(term);
+  for (const auto &term : terms)
+    if (term->getType() == Expr::Type::inverse &&
+        term->getOperands()[0]->getType() == Expr::Type::atom &&
+        seen.count(term->getOperands()[0].get()) != 0)
+      return Expr::createTrue();
+  return Expr::create(Expr::Type::disjunction, std::move(terms));
 }
 
 Atom ExprNormalizer::transformAtomExpr(Expr::ptr expr) {
@@ -265,14 +455,13 @@ Atom ExprNormalizer::transformAtomExpr(Expr::ptr expr) {
   if (expr->getType() != Expr::Type::atom)
     throw std::runtime_error("invalid expr type");
   std::vector<Variable::ptr> operands;
-  for (auto op : expr->getOperands())
+  for (const auto &op : expr->getOperands())
     operands.push_back(transformVarExpr(op));
   return Atom(false, expr->getValue(), std::move(operands));
 }
 
 Variable::ptr ExprNormalizer::transformVarExpr(Expr::ptr expr) {
-  auto exprOps = expr->getOperands();
-  if (exprOps.empty()) {
+  if (expr->getOperands().empty()) {
     char firstSym = expr->getValue()[0];
     bool isConst = !std::isalpha(firstSym) || std::isupper(firstSym);
     return std::make_shared<Variable>(isConst, expr->getValue());
@@ -5,23 +5,63 @@
 
 class ExprNormalizer {
 public:
-  std::vector<Disjunct> scolemForm(Expr::ptr expr);
+  // how a disjunction of two conjunctions is brought to CNF. distribute
+  // multiplies the clauses out, definitional replaces the left operand with
+  // a fresh predicate over its free variables and adds the clauses defining
+  // it, which keeps the result linear in formula size but only
+  // equisatisfiable. automatic distributes unless the product of clause
+  // counts exceeds the threshold
+  enum class CnfMode { distribute, definitional, automatic };
+
+  explicit ExprNormalizer(size_t definitionThreshold = 64);
+
+  std::vector<Disjunct> scolemForm(Expr::ptr expr,
+                                   CnfMode mode = CnfMode::automatic);
 
 private:
+  // node being normalized: the operands to normalize and the way their
+  // normal forms are combined (inverse means the single result is taken as
+  // is, constant and atom mean the node is a leaf with a ready result)
+  struct Task {
+    Expr::Type type;
+    std::set<std::string> vars;
+    std::vector<Expr::ptr> operands;
+    std::vector<Expr::ptr> results;
+  };
+
+  // iterative post-order traversal with an explicit stack of tasks
   Expr::ptr normalForm(Expr::ptr expr);
-  Expr::ptr inverseToNormalForm(Expr::ptr expr);
-  Expr::ptr conjunctionToNormalForm(Expr::ptr expr);
-  Expr::ptr disjunctionToNormalForm(Expr::ptr expr);
-  Expr::ptr quantifierToNormalForm(Expr::ptr expr);
+  // pushes negation one level down and splits expr into a task
+  Task expand(Expr::ptr expr);
+  std::vector<Expr::ptr> flatten(Expr::Type type,
+                                 const std::vector<Expr::ptr> &operands,
+                                 bool inverse);
+  Expr::ptr combine(Task task);
+
+  Expr::ptr conjunctionToNormalForm(std::vector<Expr::ptr> operands);
+  Expr::ptr disjunctionToNormalForm(std::vector<Expr::ptr> operands);
+  Expr::ptr disjunctionToNormalForm(Expr::ptr left, Expr::ptr right);
+  Expr::ptr quantifierToNormalForm(Expr::Type type,
+                                   const std::set<std::string> &vars,
+                                   Expr::ptr rule);
+  Expr::ptr applyQuantifiers(
+      const std::vector<std::pair<Expr::Type, std::set<std::string>>>
+          &quantifiers,
+      Expr::ptr rule);
 
   Expr::ptr extractFrontQuantifiers(
       std::map<std::string, std::string> &renamings,
       std::vector<std::pair<Expr::Type, std::set<std::string>>> &quantifiers,
       Expr::ptr rule);
 
+  bool needsDefinition(size_t leftCount, size_t rightCount) const;
+  Expr::ptr definitionAtom(const Expr::ptr &expr);
+
   Expr::ptr disjunctReduction(Expr::ptr expr);
   Atom transformAtomExpr(Expr::ptr expr);
   Variable::ptr transformVarExpr(Expr::ptr expr);
 
   int m_funcCounter = 0;
+  CnfMode m_mode = CnfMode::automatic;
+  size_t m_definitionThreshold;
 };
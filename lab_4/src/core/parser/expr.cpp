@@ -5,73 +5,175 @@
 #include <list>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace {
+
+// live expression nodes by structural hash. The table is split into shards
+// with their own locks, so threads interning unrelated nodes rarely contend.
+// The shards are never destroyed, so nodes that outlive static destruction
+// can still unregister themselves
+struct InternShard {
+  std::mutex mutex;
+  std::unordered_multimap<size_t, Expr *> nodes;
+};
+
+constexpr size_t internShards = 64;
+
+InternShard &internShard(size_t hash) {
+  static auto *shards = new InternShard[internShards];
+  return shards[(hash * 0x9e3779b97f4a7c15ull >> 32) % internShards];
+}
+
+// nodes whose release is in progress on this thread, see Expr::intern
+thread_local std::vector<Expr *> *releasing = nullptr;
+
+void hashCombine(size_t &seed, size_t value) {
+  seed ^= value + 0x9e3779b97f4a7c15 + (seed << 6) + (seed >> 2);
+}
+
+} // namespace
 
 bool contraryPair(const Expr &left, const Expr &right) {
   if (left.type == Expr::Type::inverse && right.type == Expr::Type::atom)
-    return left.operands[0]->toString() == right.toString();
+    return left.operands[0].get() == &right;
   if (left.type == Expr::Type::atom && right.type == Expr::Type::inverse)
-    return left.toString() == right.operands[0]->toString();
+    return &left == right.operands[0].get();
   return false;
 }
 
 Expr::ptr disjunctReduction(Expr::ptr rule) {
-  std::vector<Expr::ptr> terms = rule->getOperands();
-  for (int i = terms.size() - 1; i >= 0; --i) {
-    for (int j = i - 1; j >= 0; --j) {
-      if (terms[i]->toString() == terms[j]->toString()) {
-        terms.erase(terms.begin() + i);
-        break;
-      } else if (contraryPair(*terms[i], *terms[j]))
-        return Expr::createTrue();
-    }
-  }
-  return std::make_shared<Expr>(Expr::Type::disjunction, terms);
+  std::vector<Expr::ptr> terms;
+  std::unordered_set<const Expr *> seen;
+  for (auto &term : rule->getOperands())
+    if (seen.insert(term.get()).second)
+      terms.push_back(term);
+  for (auto &term : terms)
+    if (term->getType() == Expr::Type::inverse &&
+        term->getOperands()[0]->getType() == Expr::Type::atom &&
+        seen.count(term->getOperands()[0].get()) != 0)
+      return Expr::createTrue();
+  return Expr::create(Expr::Type::disjunction, std::move(terms));
 }
 
 Expr::Expr(std::string name, std::vector<ptr> operands)
-    : type(Type::atom), value(std::move(name)), operands(std::move(operands)) {}
+    : type(Type::atom), value(std::move(name)), operands(std::move(operands)) {
+  hash = computeHash();
+}
 
 Expr::Expr(Type type, std::vector<ptr> operands, std::set<std::string> vars)
-    : type(type), vars(std::move(vars)), operands(std::move(operands)) {}
+    : type(type), vars(std::move(vars)), operands(std::move(operands)) {
+  hash = computeHash();
+}
 
-Expr::Expr(std::true_type) : type(Type::constant), value("1") {}
+Expr::Expr(std::true_type) : type(Type::constant), value("1") {
+  hash = computeHash();
+}
 
-Expr::Expr(std::false_type) : type(Type::constant), value("0") {}
+Expr::Expr(std::false_type) : type(Type::constant), value("0") {
+  hash = computeHash();
+}
 
-Expr::ptr Expr::createTrue() {
-  return std::make_shared<Expr>(std::true_type{});
+size_t Expr::computeHash() const {
+  size_t res = std::hash<int>()(static_cast<int>(type));
+  hashCombine(res, std::hash<std::string>()(value));
+  for (auto &var : vars)
+    hashCombine(res, std::hash<std::string>()(var));
+  for (auto &operand : operands)
+    hashCombine(res, operand->hash);
+  return res;
 }
 
-Expr::ptr Expr::createFalse() {
-  return std::make_shared<Expr>(std::false_type{});
+// Operands are interned already, so two nodes are structurally equal when
+// their own fields match and their operands are the same objects. A node
+// found in the table may be dying concurrently (its reference count already
+// reached zero, but the deleter has not unregistered it yet); such a node is
+// skipped and a new one is registered instead.
+//
+// Releasing a node may release its operands, so a deep formula would be
+// destroyed by a recursion as deep as the formula. Instead the outermost
+// deleter on a thread keeps a worklist: nested deleters only put their nodes
+// into it, and the outermost one frees them one by one
+Expr::ptr Expr::intern(Expr expr) {
+  auto &shard = internShard(expr.hash);
+  std::lock_guard lock(shard.mutex);
+  auto [begin, end] = shard.nodes.equal_range(expr.hash);
+  for (auto iter = begin; iter != end; ++iter) {
+    const Expr &node = *iter->second;
+    if (node.type == expr.type && node.value == expr.value &&
+        node.vars == expr.vars && node.operands == expr.operands)
+      if (auto res = node.weak_from_this().lock())
+        return std::const_pointer_cast<Expr>(res);
+  }
+  auto *node = new Expr(std::move(expr));
+  shard.nodes.emplace(node->hash, node);
+  return ptr(node, [](Expr *node) {
+    {
+      auto &shard = internShard(node->hash);
+      std::lock_guard lock(shard.mutex);
+      auto [begin, end] = shard.nodes.equal_range(node->hash);
+      for (auto iter = begin; iter != end; ++iter) {
+        if (iter->second == node) {
+          shard.nodes.erase(iter);
+          break;
+        }
+      }
+    }
+    if (releasing) {
+      releasing->push_back(node);
+      return;
+    }
+    std::vector<Expr *> nodes{node};
+    releasing = &nodes;
+    while (!nodes.empty()) {
+      auto *next = nodes.back();
+      nodes.pop_back();
+      // operands unregister themselves outside of the lock and are queued
+      next->operands.clear();
+      delete next;
+    }
+    releasing = nullptr;
+  });
+}
+
+Expr::ptr Expr::create(Type type, std::vector<ptr> operands,
+                       std::set<std::string> vars) {
+  return intern(Expr(type, std::move(operands), std::move(vars)));
 }
 
+Expr::ptr Expr::createTrue() { return intern(Expr(std::true_type{})); }
+
+Expr::ptr Expr::createFalse() { return intern(Expr(std::false_type{})); }
+
 Expr::ptr Expr::createAtom(std::string value) {
-  return std::make_shared<Expr>(std::move(value));
+  return intern(Expr(std::move(value)));
 }
 
 Expr::ptr Expr::createTerm(std::string func, std::vector<std::string> vars) {
   std::vector<ptr> operands;
   for (auto &var : vars)
     operands.push_back(createAtom(std::move(var)));
-  return std::make_shared<Expr>(std::move(func), std::move(operands));
+  return intern(Expr(std::move(func), std::move(operands)));
 }
 
 Expr::ptr Expr::createPredicate(std::string name, std::vector<ptr> operands) {
-  return std::make_shared<Expr>(std::move(name), std::move(operands));
+  return intern(Expr(std::move(name), std::move(operands)));
 }
 
 Expr::ptr Expr::createInverse(Expr::ptr rule) {
-  return std::make_shared<Expr>(Type::inverse, std::vector{rule});
+  return create(Type::inverse, std::vector{rule});
 }
 
 Expr::ptr Expr::createConjunction(Expr::ptr left, Expr::ptr right) {
-  return std::make_shared<Expr>(Type::conjunction, std::vector{left, right});
+  return create(Type::conjunction, std::vector{left, right});
 }
 
 Expr::ptr Expr::createDisjunction(Expr::ptr left, Expr::ptr right) {
-  return std::make_shared<Expr>(Type::disjunction, std::vector{left, right});
+  return create(Type::disjunction, std::vector{left, right});
 }
 
 Expr::ptr Expr::createImplication(Expr::ptr from, Expr::ptr to) {
@@ -84,36 +186,25 @@ Expr::ptr Expr::createEquality(ptr left, ptr right) {
 }
 
 Expr::ptr Expr::createExists(std::set<std::string> vars, Expr::ptr rule) {
-  return std::make_shared<Expr>(Type::exists, std::vector{rule},
-                                std::move(vars));
+  return create(Type::exists, std::vector{rule}, std::move(vars));
 }
 
 Expr::ptr Expr::createForAll(std::set<std::string> vars, Expr::ptr rule) {
-  return std::make_shared<Expr>(Type::forall, std::vector{rule},
-                                std::move(vars));
+  return create(Type::forall, std::vector{rule}, std::move(vars));
 }
 
+// structurally equal nodes are the same object. Besides that, a non-atom
+// node with a single operand (other than inverse) equals its operand
 bool Expr::operator==(const Expr &other) const {
   if (this == &other)
     return true;
-  if (type == Type::atom || other.type == Type::atom) {
-    if (type != other.type || value != other.value)
-      return false;
-    bool sameArgs = operands.size() == other.operands.size();
-    for (int i = 0; sameArgs && i < operands.size(); ++i)
-      sameArgs = sameArgs && operands[i] == other.operands[i];
-    return sameArgs;
-  }
+  if (type == Type::atom || other.type == Type::atom)
+    return false;
   if (type != Type::inverse && operands.size() == 1)
     return *operands[0] == other;
   if (other.type != Type::inverse && other.operands.size() == 1)
     return *this == *other.operands[0];
-  if (type != other.type || operands.size() != other.operands.size())
-    return false;
-  bool opEqual = true;
-  for (int i = 0; opEqual && i < operands.size(); ++i)
-    opEqual = opEqual && operands[i] == other.operands[i];
-  return opEqual;
+  return false;
 }
 
 bool Expr::operator!=(const Expr &other) const { return !(*this == other); }
@@ -254,7 +345,7 @@ Expr::ptr Expr::withRenamedVariable(const std::string &oldName,
   case Type::disjunction:
     for (auto &op : operands)
       newOperands.push_back(op->withRenamedVariable(oldName, newName));
-    return std::make_shared<Expr>(type, std::move(newOperands));
+    return create(type, std::move(newOperands));
   case Type::exists:
   case Type::forall:
     newVars = vars;
@@ -265,12 +356,17 @@ Expr::ptr Expr::withRenamedVariable(const std::string &oldName,
     }
     for (auto &op : operands)
       newOperands.push_back(op->withRenamedVariable(oldName, newName));
-    return std::make_shared<Expr>(type, std::move(newOperands), newVars);
+    return create(type, std::move(newOperands), newVars);
   }
   return nullptr;
 }
 
 Expr::ptr Expr::withReplacedVariable(const std::string &varName, ptr term) {
+  return withReplacedVariables({{varName, std::move(term)}});
+}
+
+Expr::ptr
+Expr::withReplacedVariables(const std::map<std::string, ptr> &terms) {
   std::vector<ptr> newOperands;
   switch (type) {
   case Type::constant:
@@ -280,10 +376,11 @@ Expr::ptr Expr::withReplacedVariable(const std::string &varName, ptr term) {
       return shared_from_this();
     else {
       for (auto &op : operands) {
-        if (op->operands.empty() && op->value == varName)
-          newOperands.push_back(term);
+        auto iter = op->operands.empty() ? terms.find(op->value) : terms.end();
+        if (iter != terms.end())
+          newOperands.push_back(iter->second);
         else
-          newOperands.push_back(op->withReplacedVariable(varName, term));
+          newOperands.push_back(op->withReplacedVariables(terms));
       }
       return createPredicate(value, std::move(newOperands));
     }
@@ -292,17 +389,21 @@ Expr::ptr Expr::withReplacedVariable(const std::string &varName, ptr term) {
   case Type::conjunction:
   case Type::disjunction:
     for (auto &op : operands)
-      newOperands.push_back(op->withReplacedVariable(varName, term));
-    return std::make_shared<Expr>(type, std::move(newOperands));
+      newOperands.push_back(op->withReplacedVariables(terms));
+    return create(type, std::move(newOperands));
   case Type::exists:
-  case Type::forall:
-    if (vars.count(varName) == 0) {
-      for (auto &op : operands)
-        newOperands.push_back(op->withReplacedVariable(varName, term));
-    } else {
+  case Type::forall: {
+    // bound variables are not replaced
+    auto freeTerms = terms;
+    for (auto &var : vars)
+      freeTerms.erase(var);
+    if (freeTerms.empty())
       newOperands = operands;
-    }
-    return std::make_shared<Expr>(type, std::move(newOperands), vars);
+    else
+      for (auto &op : operands)
+        newOperands.push_back(op->withReplacedVariables(freeTerms));
+    return create(type, std::move(newOperands), vars);
+  }
   }
   return nullptr;
 }
@@ -314,10 +415,9 @@ Expr::ptr Expr::toNormalForm() {
   case Type::constant:
     return shared_from_this();
   case Type::atom:
-    return std::make_shared<Expr>(
-        Type::conjunction,
-        std::vector{std::make_shared<Expr>(Type::disjunction,
-                                           std::vector{shared_from_this()})});
+    return create(Type::conjunction,
+                  std::vector{create(Type::disjunction,
+                                     std::vector{shared_from_this()})});
   case Type::inverse:
     return inverseToNormalForm();
   case Type::conjunction:
@@ -339,20 +439,20 @@ Expr::ptr Expr::inverseToNormalForm() {
     else
       return createTrue();
   case Type::atom:
-    return std::make_shared<Expr>(
-        Type::conjunction,
-        std::vector{std::make_shared<Expr>(Type::disjunction,
-                                           std::vector{shared_from_this()})});
+    return create(Type::conjunction,
+                  std::vector{create(Type::disjunction,
+                                     std::vector{shared_from_this()})});
   case Type::inverse:
     return operands[0]->operands[0]->toNormalForm();
   case Type::disjunction:
-    return createConjunction(createInverse(operands[0]->operands[0]),
-                             createInverse(operands[0]->operands[1]))
-        ->toNormalForm();
-  case Type::conjunction:
-    return createDisjunction(createInverse(operands[0]->operands[0]),
-                             createInverse(operands[0]->operands[1]))
-        ->toNormalForm();
+  case Type::conjunction: {
+    std::vector<ptr> inverted;
+    for (auto &operand : operands[0]->operands)
+      inverted.push_back(createInverse(operand));
+    auto dual = operands[0]->type == Type::disjunction ? Type::conjunction
+                                                       : Type::disjunction;
+    return create(dual, std::move(inverted))->toNormalForm();
+  }
   case Type::exists:
     return createForAll(
         operands[0]->vars,
@@ -365,9 +465,15 @@ Expr::ptr Expr::inverseToNormalForm() {
   return nullptr;
 }
 
+// n-ary chains are folded from the right, as if they were nested
 Expr::ptr Expr::conjunctionToNormalForm() {
-  auto left = operands[0]->toNormalForm();
-  auto right = operands[1]->toNormalForm();
+  auto res = operands.back()->toNormalForm();
+  for (size_t i = operands.size() - 1; i-- > 0;)
+    res = conjunctionToNormalForm(operands[i]->toNormalForm(), res);
+  return res;
+}
+
+Expr::ptr Expr::conjunctionToNormalForm(ptr left, ptr right) {
 
   // constant propagation
   if (left->type == Type::constant)
@@ -383,12 +489,13 @@ Expr::ptr Expr::conjunctionToNormalForm() {
 
   // drag all elementary disjunctions from both paths
   auto disjunctions = left->operands;
-  std::copy_if(right->operands.begin(), right->operands.end(),
-               std::back_inserter(disjunctions), [&disjunctions](auto x) {
-                 return std::all_of(disjunctions.begin(), disjunctions.end(),
-                                    [&x](auto d) { return *x != *d; });
-               });
-  ptr res = std::make_shared<Expr>(Type::conjunction, disjunctions);
+  std::unordered_set<const Expr *> seen;
+  for (auto &disjunction : disjunctions)
+    seen.insert(disjunction.get());
+  for (auto &disjunction : right->operands)
+    if (seen.insert(disjunction.get()).second)
+      disjunctions.push_back(disjunction);
+  ptr res = create(Type::conjunction, std::move(disjunctions));
 
   // apply quantifiers if any
   for (int i = quantifiers.size() - 1; i >= 0; --i) {
@@ -402,8 +509,13 @@ Expr::ptr Expr::conjunctionToNormalForm() {
 }
 
 Expr::ptr Expr::disjunctionToNormalForm() {
-  auto left = operands[0]->toNormalForm();
-  auto right = operands[1]->toNormalForm();
+  auto res = operands.back()->toNormalForm();
+  for (size_t i = operands.size() - 1; i-- > 0;)
+    res = disjunctionToNormalForm(operands[i]->toNormalForm(), res);
+  return res;
+}
+
+Expr::ptr Expr::disjunctionToNormalForm(ptr left, ptr right) {
 
   // constants propagation
   if (left->type == Type::constant)
@@ -417,21 +529,21 @@ Expr::ptr Expr::disjunctionToNormalForm() {
   left = extractFrontQuantifiers(renamings, quantifiers, left);
   right = extractFrontQuantifiers(renamings, quantifiers, right);
 
-  auto left_dsj = left->operands;
-  auto right_dsj = right->operands;
+  const auto &left_dsj = left->operands;
+  const auto &right_dsj = right->operands;
   std::vector<ptr> disjunctions;
+  std::unordered_set<const Expr *> seen;
   for (size_t i = 0; i < left_dsj.size(); ++i) {
     for (size_t j = 0; j < right_dsj.size(); ++j) {
       auto args = left_dsj[i]->operands;
-      std::copy_if(right_dsj[j]->operands.begin(), right_dsj[j]->operands.end(),
-                   std::back_inserter(args), [&args](auto x) {
-                     return std::all_of(
-                         args.begin(), args.end(),
-                         [&x](const Expr::ptr &d) { return *x != *d; });
-                   });
-      auto newRule = std::make_shared<Expr>(Type::disjunction, args);
-      if (std::all_of(disjunctions.begin(), disjunctions.end(),
-                      [&newRule](auto d) { return *d != *newRule; }))
+      std::unordered_set<const Expr *> argSet;
+      for (auto &arg : args)
+        argSet.insert(arg.get());
+      for (auto &arg : right_dsj[j]->operands)
+        if (argSet.insert(arg.get()).second)
+          args.push_back(arg);
+      auto newRule = create(Type::disjunction, std::move(args));
+      if (seen.insert(newRule.get()).second)
         disjunctions.push_back(newRule);
     }
   }
@@ -445,7 +557,7 @@ Expr::ptr Expr::disjunctionToNormalForm() {
   if (disjunctions.empty())
     return createTrue();
 
-  auto res = std::make_shared<Expr>(Type::conjunction, disjunctions);
+  auto res = create(Type::conjunction, disjunctions);
 
   // apply quantifiers if any
   for (int i = quantifiers.size() - 1; i >= 0; --i) {
@@ -467,7 +579,7 @@ Expr::ptr Expr::quantifierToNormalForm() {
       newVars.insert(var);
   if (newVars.empty())
     return rule;
-  return std::make_shared<Expr>(type, std::vector{rule}, newVars);
+  return create(type, std::vector{rule}, newVars);
 }
 
 Expr::ptr Expr::toScolemForm(int *replacementCounter) {
@@ -503,13 +615,20 @@ Expr::ptr Expr::extractFrontQuantifiers(
     while (rule->type == Type::forall || rule->type == Type::exists) {
       for (const auto &var : rule->vars)
         renamings[var] = var;
-      quantifiers.emplace_back(rule->type, std::move(rule->vars));
+      quantifiers.emplace_back(rule->type, rule->vars);
       rule = rule->operands[0];
     }
   } else {
+    // a new name must not clash with any variable of the rule: the names of
+    // the whole prefix and the free ones occur in the matrix
+    auto matrix = rule;
+    while (matrix->type == Type::forall || matrix->type == Type::exists)
+      matrix = matrix->operands[0];
+    auto used = matrix->getFreeVars();
     while (rule->type == Type::forall || rule->type == Type::exists) {
       // check for renaming
       std::set<std::string> newVars;
+      auto next = rule->operands[0];
       for (auto var : rule->vars) {
         int count = renamings.count(var);
         if (count == 0) {
@@ -517,17 +636,16 @@ Expr::ptr Expr::extractFrontQuantifiers(
           newVars.insert(var);
         } else {
           auto newName = nextIndexed(var);
-          while (renamings.count(newName) > 0 && rule->vars.count(newName) > 0)
+          while (renamings.count(newName) > 0 || used.count(newName) > 0)
             newName = nextIndexed(newName);
           renamings[newName] = var;
-          rule->operands[0] =
-              rule->operands[0]->withRenamedVariable(var, newName);
+          next = next->withRenamedVariable(var, newName);
           newVars.insert(newName);
         }
       }
       if (!newVars.empty())
         quantifiers.emplace_back(rule->type, std::move(newVars));
-      rule = rule->operands[0];
+      rule = std::move(next);
     }
   }
   return rule;
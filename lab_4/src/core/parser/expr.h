@@ -8,6 +8,11 @@
 #include <type_traits>
 #include <vector>
 
+// Expressions are immutable and hash-consed: every node is created through
+// the static factories, which return the single live node for given type,
+// value, vars and operands. Identical subformulas are therefore shared, and
+// structurally equal nodes are the same object, so equality is a pointer
+// comparison and nodes can be deduplicated by address
 class Expr : public std::enable_shared_from_this<Expr> {
 public:
   enum class Type {
@@ -22,16 +27,9 @@ public:
 
   using ptr = std::shared_ptr<Expr>;
 
-  // general constructor for operators
-  Expr(Type type, std::vector<ptr> operands, std::set<std::string> vars = {});
-
-  // constants
-  Expr(std::true_type);
-  Expr(std::false_type);
-
-  // atom/predicate constructor
-  Expr(std::string name, std::vector<ptr> operands = {});
-
+  // general factory for operators
+  static ptr create(Type type, std::vector<ptr> operands,
+                    std::set<std::string> vars = {});
   static ptr createTrue();
   static ptr createFalse();
   static ptr createAtom(std::string value);
@@ -39,18 +37,19 @@ public:
   static ptr createPredicate(std::string name, std::vector<ptr> operands);
   static ptr createInverse(ptr rule);
   static ptr createConjunction(ptr left, ptr right);
+  // n-ary node for a range of operands (the operand itself if it is single)
   template <typename Iter> static ptr createConjunction(Iter begin, Iter end) {
-    auto first = *begin++;
-    return begin == end ? std::move(first)
-                        : createConjunction(std::move(first),
-                                            createConjunction(begin, end));
+    std::vector<ptr> operands(begin, end);
+    if (operands.size() == 1)
+      return std::move(operands.front());
+    return create(Type::conjunction, std::move(operands));
   }
   static ptr createDisjunction(ptr left, ptr right);
   template <typename Iter> static ptr createDisjunction(Iter begin, Iter end) {
-    auto first = *begin++;
-    return begin == end ? std::move(first)
-                        : createDisjunction(std::move(first),
-                                            createDisjunction(begin, end));
+    std::vector<ptr> operands(begin, end);
+    if (operands.size() == 1)
+      return std::move(operands.front());
+    return create(Type::disjunction, std::move(operands));
   }
   static ptr createImplication(ptr from, ptr to);
   static ptr createEquality(ptr left, ptr right);
@@ -73,6 +72,7 @@ public:
   std::list<ptr> getDisjunctionsList() const;
 
   Type getType() const { return type; }
+  size_t getHash() const { return hash; }
   const std::string &getValue() const { return value; }
   const std::set<std::string> &getVars() const { return vars; }
   const std::vector<ptr> &getOperands() const { return operands; }
@@ -84,13 +84,32 @@ public:
   ptr withRenamedVariable(const std::string &oldName,
                           const std::string &newName);
   ptr withReplacedVariable(const std::string &varName, ptr term);
+  // replace several free variables in one pass
+  ptr withReplacedVariables(const std::map<std::string, ptr> &terms);
 
   friend bool contraryPair(const Expr &left, const Expr &right);
 
 private:
+  // general constructor for operators
+  Expr(Type type, std::vector<ptr> operands, std::set<std::string> vars = {});
+
+  // constants
+  Expr(std::true_type);
+  Expr(std::false_type);
+
+  // atom/predicate constructor
+  Expr(std::string name, std::vector<ptr> operands = {});
+
+  // returns the live node equal to expr or registers expr as a new one
+  static ptr intern(Expr expr);
+  size_t computeHash() const;
+
   ptr inverseToNormalForm();
   ptr conjunctionToNormalForm();
   ptr disjunctionToNormalForm();
+  // combine operands already in normal form
+  ptr conjunctionToNormalForm(ptr left, ptr right);
+  ptr disjunctionToNormalForm(ptr left, ptr right);
   ptr quantifierToNormalForm();
 
   // extracts quantifiers at front with possible renamings
@@ -107,6 +126,8 @@ private:
   // arguments for this predicate. For actual atom it is empty
   std::vector<ptr> operands;
   bool isCNF = false;
+  // structural hash, computed once from operand hashes
+  size_t hash = 0;
 
   friend class Substitution;
 };
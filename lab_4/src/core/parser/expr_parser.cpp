@@ -1,110 +1,156 @@
 #include "expr_parser.h"
 #include <cstring>
+#include <iterator>
 #include <stdexcept>
 
-/*
-
-Expr Grammar in EBNF:
-
-<expr>      ::= <equ-expr>
-<equ-expr>  ::= <disj-expr> [<eq-sign> <equ-expr>]
-<disj-expr> ::= <impl-expr> ['+' <disj-expr>]
-<impl-expr> ::= <conj-expr> ['->' <impl-expr>]
-<conj-expr> ::= <term-expr> ['&' <conj-expr>]
-<term-expr> ::= '(' <equ-expr> ')' | <neg> | <atom>
-<neg>       ::= '~' <term-expr>
-<equ-sign>  ::= '==' | '=' | '<=>' | '<->'
-<neg>       ::= '~' <term-expr>
-<equ-sign>  ::= '==' | '=' | '<=>' | '<->'
-<atom>      ::= string [ '(' <atom-list> ')' | <atom-list> ]
-<atom-list> ::= <atom> [ ',' <atom-list> ]
-
-*/
-
 Expr::ptr ExprParser::Parse(const char *str) {
   m_Source = str;
   m_pos = 0;
-  auto res = ParseEquExpr();
+  auto res = ParseExpr();
   if (SkipWhitespace())
     RaiseError("expr not fully parsed");
   m_Source = nullptr;
   return res;
 }
 
-Expr::ptr ExprParser::ParseEquExpr() {
-  auto left = ParseDisjExpr();
-  if (!Eat("==") && !Eat("=") && !Eat("<=>") && !Eat("<->"))
-    return left;
-  auto right = ParseEquExpr();
-  return Expr::createEquality(left, right);
-}
-
-Expr::ptr ExprParser::ParseDisjExpr() {
-  auto left = ParseImplExpr();
-  if (!Eat("+"))
-    return left;
-  auto right = ParseDisjExpr();
-  return Expr::createDisjunction(left, right);
-}
-
-Expr::ptr ExprParser::ParseImplExpr() {
-  auto left = ParseConjExpr();
-  if (!Eat("->"))
-    return left;
-  auto right = ParseImplExpr();
-  return Expr::createImplication(left, right);
+Expr::ptr ExprParser::ParseExpr() {
+  // one group per open parenthesis
+  std::vector<Group> groups(1);
+  while (true) {
+    // prefix operators and the operand itself
+    while (true) {
+      if (!SkipWhitespace())
+        RaiseError("quantifier non-term expected");
+      if (Eat("\\exists"))
+        groups.back().operators.push_back({Operator::exists, ParseVarList()});
+      else if (Eat("\\forall"))
+        groups.back().operators.push_back({Operator::forall, ParseVarList()});
+      else if (Eat("~"))
+        groups.back().operators.push_back({Operator::inverse, {}});
+      else if (Eat("("))
+        groups.emplace_back();
+      else
+        break;
+    }
+    PushOperand(groups.back(), ParseAtom());
+
+    // binary operator or end of groups
+    std::optional<Operator> op;
+    while (!(op = ParseOperator())) {
+      if (groups.size() == 1) {
+        // the rest of input (if any) is reported by the caller
+        Reduce(groups.back(), std::nullopt);
+        return groups.back().operands.back();
+      }
+      if (!Eat(")"))
+        RaiseError("unmatched parenthesis");
+      Reduce(groups.back(), std::nullopt);
+      auto operand = std::move(groups.back().operands.back());
+      groups.pop_back();
+      PushOperand(groups.back(), std::move(operand));
+    }
+    Reduce(groups.back(), *op);
+    groups.back().operators.push_back({*op, {}});
+  }
 }
 
-Expr::ptr ExprParser::ParseConjExpr() {
-  auto left = ParseQuantExpr();
-  if (!Eat("&"))
-    return left;
-  auto right = ParseConjExpr();
-  return Expr::createConjunction(left, right);
+std::optional<ExprParser::Operator> ExprParser::ParseOperator() {
+  if (Eat("==") || Eat("=") || Eat("<=>") || Eat("<->"))
+    return Operator::equality;
+  if (Eat("+"))
+    return Operator::disjunction;
+  if (Eat("->"))
+    return Operator::implication;
+  if (Eat("&"))
+    return Operator::conjunction;
+  return std::nullopt;
 }
 
-Expr::ptr ExprParser::ParseQuantExpr() {
-  if (!SkipWhitespace())
-    RaiseError("quantifier non-term expected");
-  if (Eat("\\exists")) {
-    auto vars = ParseVarList();
-    auto expr = ParseQuantExpr();
-    return Expr::createExists(std::move(vars), std::move(expr));
-  } else if (Eat("\\forall")) {
-    auto vars = ParseVarList();
-    auto expr = ParseQuantExpr();
-    return Expr::createForAll(std::move(vars), std::move(expr));
+Expr::ptr ExprParser::ParseAtom() {
+  // names and parsed arguments of enclosing function terms
+  std::vector<std::pair<std::string, std::vector<Expr::ptr>>> terms;
+  while (true) {
+    auto name = ParseIdent();
+    if (!name)
+      RaiseError("atom expected");
+    SkipWhitespace();
+    // parse predicate arguments
+    if (Eat("(")) {
+      terms.emplace_back(std::move(*name), std::vector<Expr::ptr>{});
+      continue;
+    }
+    auto atom = Expr::createPredicate(std::move(*name), {});
+    while (!terms.empty()) {
+      terms.back().second.push_back(std::move(atom));
+      if (Eat(","))
+        break;
+      if (!Eat(")"))
+        RaiseError("')' expected");
+      atom = Expr::createPredicate(std::move(terms.back().first),
+                                   std::move(terms.back().second));
+      terms.pop_back();
+    }
+    if (terms.empty())
+      return atom;
   }
-  return ParseTermExpr();
 }
 
-Expr::ptr ExprParser::ParseTermExpr() {
-  if (Eat("(")) {
-    auto expr = ParseEquExpr();
-    if (!Eat(")"))
-      RaiseError("unmatched parenthesis");
-    return expr;
-  } else if (Eat("~"))
-    return Expr::createInverse(ParseTermExpr());
-  return ParseAtom();
+void ExprParser::PushOperand(Group &group, Expr::ptr operand) {
+  while (!group.operators.empty() &&
+         group.operators.back().op >= Operator::inverse) {
+    auto &pending = group.operators.back();
+    if (pending.op == Operator::inverse)
+      operand = Expr::createInverse(std::move(operand));
+    else if (pending.op == Operator::exists)
+      operand = Expr::createExists(std::move(pending.vars), std::move(operand));
+    else
+      operand = Expr::createForAll(std::move(pending.vars), std::move(operand));
+    group.operators.pop_back();
+  }
+  group.operands.push_back(std::move(operand));
 }
 
-Expr::ptr ExprParser::ParseAtom() {
-  auto name = ParseIdent();
-  if (!name)
-    RaiseError("atom expected");
-  SkipWhitespace();
-  std::vector<Expr::ptr> operands;
-  // parse predicate arguments
-  if (Eat("(")) {
-    do {
-      auto operand = ParseAtom();
-      operands.push_back(std::move(operand));
-    } while (Eat(","));
-    if (!Eat(")"))
-      RaiseError("')' expected");
+/**
+ * Equal operators are never applied one by one: all of them are kept on the
+ * stack and a whole chain is taken at once, which gives n-ary nodes for
+ * '&' and '+' and right associativity for the rest.
+ */
+void ExprParser::Reduce(Group &group, std::optional<Operator> bound) {
+  while (!group.operators.empty() &&
+         (!bound || group.operators.back().op > *bound)) {
+    auto op = group.operators.back().op;
+    size_t count = 1;
+    while (!group.operators.empty() && group.operators.back().op == op) {
+      group.operators.pop_back();
+      ++count;
+    }
+    auto first = group.operands.end() - count;
+    std::vector<Expr::ptr> operands(
+        std::make_move_iterator(first),
+        std::make_move_iterator(group.operands.end()));
+    group.operands.erase(first, group.operands.end());
+
+    Expr::ptr res;
+    switch (op) {
+    case Operator::conjunction:
+      res = Expr::create(Expr::Type::conjunction, std::move(operands));
+      break;
+    case Operator::disjunction:
+      res = Expr::create(Expr::Type::disjunction, std::move(operands));
+      break;
+    case Operator::implication:
+    case Operator::equality:
+      res = std::move(operands.back());
+      for (size_t i = operands.size() - 1; i-- > 0;)
+        res = op == Operator::implication
+                  ? Expr::createImplication(std::move(operands[i]), res)
+                  : Expr::createEquality(std::move(operands[i]), res);
+      break;
+    default:
+      throw std::logic_error("prefix operator left on stack");
+    }
+    group.operands.push_back(std::move(res));
   }
-  return Expr::createPredicate(std::move(*name), std::move(operands));
 }
 
 std::set<std::string> ExprParser::ParseVarList() {
@@ -3,16 +3,18 @@
 #include "expr.h"
 #include <optional>
 #include <set>
+#include <string>
+#include <vector>
 
 /*
 
 Expr Grammar in EBNF:
 
 <expr>       ::= <equ-expr>
-<equ-expr>   ::= <disj-expr> <eq-sign> <equ-expr>
-<disj-expr>  ::= <impl-expr> '+' <disj-expr>
-<impl-expr>  ::= <conj-expr> '->' <impl-expr>
-<conj-expr>  ::= <quant-expr> '&' <conj-expr>
+<equ-expr>   ::= <disj-expr> [ <eq-sign> <equ-expr> ]
+<disj-expr>  ::= <impl-expr> { '+' <impl-expr> }
+<impl-expr>  ::= <conj-expr> [ '->' <impl-expr> ]
+<conj-expr>  ::= <quant-expr> { '&' <quant-expr> }
 <quant-expr> ::= [ <quant-list> ] <term-expr>
 <term-expr>  ::= '(' <expr> ')' | <neg> | <atom>
 <neg>        ::= '~' <quant-expr>
@@ -24,20 +26,49 @@ Expr Grammar in EBNF:
                | '\exists' '(' <var-list> ')'
 <var-list>   ::= string [ ',' <var-list> ]
 
+Chains of '&' and '+' become single n-ary nodes, '->' and equality are
+right associative. The parser is iterative (operator precedence with
+explicit stacks), so nesting depth is limited only by available memory.
+
 */
 class ExprParser {
 public:
   Expr::ptr Parse(const char *str);
 
 private:
-  Expr::ptr ParseEquExpr();
-  Expr::ptr ParseDisjExpr();
-  Expr::ptr ParseImplExpr();
-  Expr::ptr ParseConjExpr();
-  Expr::ptr ParseQuantExpr();
-  Expr::ptr ParseTermExpr();
+  // operators ordered by binding strength
+  enum class Operator {
+    equality,
+    disjunction,
+    implication,
+    conjunction,
+    // prefix operators, applied as soon as their operand is parsed
+    inverse,
+    exists,
+    forall,
+  };
+
+  struct PendingOperator {
+    Operator op;
+    std::set<std::string> vars; // for quantifiers only
+  };
+
+  // operands and operators of one parenthesized group
+  struct Group {
+    std::vector<Expr::ptr> operands;
+    std::vector<PendingOperator> operators;
+  };
+
+  Expr::ptr ParseExpr();
+  // binary operator at current position, if any
+  std::optional<Operator> ParseOperator();
   Expr::ptr ParseAtom();
 
+  // pushes operand and applies pending prefix operators to it
+  void PushOperand(Group &group, Expr::ptr operand);
+  // applies binary operators binding tighter than bound (all if no bound)
+  void Reduce(Group &group, std::optional<Operator> bound);
+
   // (var1, var2, ...) with parentheses
   std::set<std::string> ParseVarList();
 
@@ -1,6 +1,39 @@
 #include "resolver.h"
+#include "literal_index.h"
 #include "subst.h"
-#include <iostream>
+#include "subsumption.h"
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <queue>
+#include <set>
+#include <utility>
+
+// вес терма - число символов в нем
+static size_t weight(const Variable::ptr &term) {
+  size_t res = 1;
+  for (auto &arg : term->getArguments())
+    res += weight(arg);
+  return res;
+}
+
+static size_t weight(const Atom &atom) {
+  size_t res = 1;
+  for (auto &arg : atom.getArguments())
+    res += weight(arg);
+  return res;
+}
+
+// вес дизъюнкта - число символов во всех его атомах
+static size_t weight(const Disjunct &disj) {
+  size_t res = 0;
+  for (auto &atom : disj)
+    res += weight(atom);
+  return res;
+}
+
+Resolver::Resolver(ResolverLimits limits, Selection selection)
+    : m_limits(limits), m_selection(selection) {}
 
 std::optional<Subst> Resolver::unify(const Variable::ptr &left,
                                      const Variable::ptr &right) {
@@ -79,56 +112,145 @@ std::optional<Disjunct> Resolver::resolve(const Disjunct &left,
 std::optional<ExtendedDisjunct> Resolver::resolve(const ExtendedDisjunct &left,
                                                   const ExtendedDisjunct &right,
                                                   int nextID) {
-  for (int i = 0; i < left.disjunct.size(); ++i) {
-    for (int j = 0; j < right.disjunct.size(); ++j) {
-      if (auto subst = unify(left.disjunct[i], right.disjunct[j])) {
-        auto disj = subst->apply(left.disjunct.withoutNth(i) +
-                                 right.disjunct.withoutNth(j));
-        return ExtendedDisjunct{nextID, disj, *subst, {left.id, right.id}};
-      }
-    }
+  return allResolvents(left, right, nextID).next();
+}
+
+ResolventStream Resolver::allResolvents(const ExtendedDisjunct &left,
+                                        const ExtendedDisjunct &right,
+                                        int nextID) {
+  return ResolventStream(*this, left, right, nextID);
+}
+
+std::optional<ExtendedDisjunct> Resolver::resolve(const ExtendedDisjunct &left,
+                                                  size_t i,
+                                                  const ExtendedDisjunct &right,
+                                                  size_t j, int nextID) {
+  auto subst = unify(left.disjunct[i], right.disjunct[j]);
+  if (!subst)
+    return std::nullopt;
+  auto disj =
+      subst->apply(left.disjunct.withoutNth(i) + right.disjunct.withoutNth(j));
+  return ExtendedDisjunct{nextID, disj, *subst, {left.id, right.id}};
+}
+
+std::optional<ExtendedDisjunct> Resolver::factor(const ExtendedDisjunct &disj,
+                                                 size_t i, size_t j,
+                                                 int nextID) {
+  const auto &left = disj.disjunct[i];
+  const auto &right = disj.disjunct[j];
+  if (i == j || left.isInverse() != right.isInverse())
+    return std::nullopt;
+  // атомы одного знака унифицируются как противоположные
+  auto subst = unify(left, Atom(!right.isInverse(), right.getName(),
+                                right.getArguments()));
+  if (!subst)
+    return std::nullopt;
+  return ExtendedDisjunct{nextID, subst->apply(disj.disjunct.withoutNth(j)),
+                          *subst, {disj.id, disj.id}};
+}
+
+/**
+ * Метод выбора атомов для резолюции.
+ *
+ * При правилах negative и ordered выбирается самый тяжелый отрицательный
+ * атом. Если отрицательных атомов нет, правило ordered разрешает только атомы
+ * с наибольшим именем предиката: порядок по именам предикатов не меняется при
+ * подстановках, поэтому упорядоченная резолюция с ним остается полной. Полнота
+ * при этом не сохраняется в сочетании с множеством поддержки.
+ */
+std::vector<size_t> Resolver::eligibleLiterals(const Disjunct &disj) const {
+  std::vector<size_t> res;
+  if (m_selection != Selection::all) {
+    for (size_t i = 0; i < disj.size(); ++i)
+      if (disj[i].isInverse() &&
+          (res.empty() || weight(disj[i]) > weight(disj[res[0]])))
+        res = {i};
+    if (!res.empty())
+      return res;
   }
-  return std::nullopt;
+  const std::string *maxName = nullptr;
+  if (m_selection == Selection::ordered)
+    for (auto &atom : disj)
+      if (!maxName || atom.getName() > *maxName)
+        maxName = &atom.getName();
+  for (size_t i = 0; i < disj.size(); ++i)
+    if (!maxName || disj[i].getName() == *maxName)
+      res.push_back(i);
+  return res;
 }
 
 void Resolver::populateIndexes(const std::vector<ExtendedDisjunct> &disjuncts,
                                std::set<int> &set, int index) {
   if (index == -1)
     index = disjuncts.size() - 1;
-  set.insert(index);
+  // общие предки обходятся один раз
+  if (!set.insert(index).second)
+    return;
   if (disjuncts[index].parent_id[0] != -1) {
     populateIndexes(disjuncts, set, disjuncts[index].parent_id[0]);
     populateIndexes(disjuncts, set, disjuncts[index].parent_id[1]);
   }
 }
 
-void Resolver::printResolutionChain(
-    const std::vector<ExtendedDisjunct> &disjuncts) {
+void Resolver::storeRefutation(const std::vector<ExtendedDisjunct> &disjuncts,
+                               int last) {
   std::set<int> indexSet;
-  populateIndexes(disjuncts, indexSet);
+  populateIndexes(disjuncts, indexSet, last);
 
+  // родители выведены раньше потомков, поэтому уже перенумерованы
   std::map<int, int> renum;
+  m_refutation.clear();
   for (auto index : indexSet) {
-    int num = renum.size() + 1;
-    renum[index] = num;
-    if (disjuncts[index].parent_id[0] == -1) {
+    auto disj = disjuncts[index];
+    disj.id = renum.size();
+    renum[index] = disj.id;
+    if (disj.parent_id[0] != -1) {
+      disj.parent_id[0] = renum[disj.parent_id[0]];
+      disj.parent_id[1] = renum[disj.parent_id[1]];
+    }
+    m_refutation.push_back(std::move(disj));
+  }
+}
+
+const std::vector<ExtendedDisjunct> &Resolver::getRefutation() const {
+  return m_refutation;
+}
+
+void Resolver::printResolutionChain(std::ostream &stream) const {
+  for (auto &disj : m_refutation) {
+    if (disj.parent_id[0] == -1) {
       // axiom, used
-      std::cout << num << ") " << disjuncts[index].disjunct.toString()
-                << std::endl;
+      stream << disj.id + 1 << ") " << disj.disjunct.toString() << std::endl;
     } else {
-      std::cout << num << ") " << disjuncts[index].disjunct.toString() << " ("
-                << renum[disjuncts[index].parent_id[0]] << " + "
-                << renum[disjuncts[index].parent_id[1]] << ") "
-                << disjuncts[index].subst.toString() << "\n";
+      stream << disj.id + 1 << ") " << disj.disjunct.toString() << " ("
+             << disj.parent_id[0] + 1 << " + " << disj.parent_id[1] + 1
+             << ") " << disj.subst.toString() << "\n";
     }
   }
 }
 
+// Поиск опровержения циклом заданного дизъюнкта (given-clause). Без
+// ограничения выбора атомов (Selection::all) используется множество
+// поддержки: его образуют дизъюнкты отрицания цели и их потомки, и только они
+// становятся заданными. На каждом шаге из очереди необработанных дизъюнктов
+// выбирается заданный дизъюнкт - самый легкий или, через каждые weightRatio
+// выборов, самый старый. Строятся его склейки и резольвенты со всеми
+// обработанными дизъюнктами, аксиомами и с самим собой по парам
+// разрешенных атомов, найденным индексом атомов (см. LiteralIndex); они
+// попадают в очередь.
+// Тавтологии и дизъюнкты, поглощенные имеющимися, отбрасываются, а
+// дизъюнкты, поглощенные новым, удаляются (см. SubsumptionIndex). Поиск
+// прекращается при выводе пустого дизъюнкта, опустошении очереди или
+// исчерпании ограничений
 std::optional<Subst> Resolver::resolve(std::list<ExtendedDisjunct> axioms,
                                        std::list<ExtendedDisjunct> target) {
+  m_stats = {};
+  m_refutation.clear();
   // combine all disjuncts in single vector
   std::vector<ExtendedDisjunct> disjuncts(target.begin(), target.end());
   std::copy(axioms.begin(), axioms.end(), std::back_inserter(disjuncts));
+  if (disjuncts.empty())
+    return std::nullopt;
 
   // rename variables
   NameAllocator allocator;
@@ -140,29 +262,160 @@ std::optional<Subst> Resolver::resolve(std::list<ExtendedDisjunct> axioms,
   for (int i = 0; i < disjuncts.size(); ++i)
     disjuncts[i].id = i;
 
-  // combinations loop
+  // индекс необработанных и обработанных дизъюнктов для проверки поглощения
+  SubsumptionIndex index;
+  for (auto &disj : disjuncts)
+    index.insert(disj.id, disj.disjunct);
+  std::vector<bool> deleted(disjuncts.size(), false);
+
+  // очереди необработанных дизъюнктов по весу и по возрасту
+  using Weighted = std::pair<size_t, int>;
+  std::priority_queue<Weighted, std::vector<Weighted>, std::greater<>> light;
+  std::queue<int> old;
+  auto enqueue = [&](int id) {
+    light.emplace(weight(disjuncts[id].disjunct), id);
+    old.push(id);
+  };
+  // индекс разрешенных атомов обработанных дизъюнктов: вначале - аксиом.
+  // При ограничении выбора атомов множество поддержки не используется: все
+  // исходные дизъюнкты становятся заданными, иначе поиск неполон (см.
+  // Selection)
+  LiteralIndex active;
+  auto activate = [&](int id) {
+    const auto &disj = disjuncts[id].disjunct;
+    for (size_t i : eligibleLiterals(disj))
+      active.insert(id, disj[i], i);
+  };
+  for (size_t id = 0; id < disjuncts.size(); ++id) {
+    if (id < target.size() || m_selection != Selection::all)
+      enqueue(id);
+    else
+      activate(id);
+  }
+  std::vector<bool> selected(disjuncts.size(), false);
+
+  auto deadline = std::chrono::steady_clock::now() + m_limits.timeout;
+  auto outOfTime = [&]() {
+    return m_limits.timeout.count() != 0 &&
+           std::chrono::steady_clock::now() > deadline;
+  };
+  // выбрать следующий заданный дизъюнкт или вернуть -1
+  int picks = 0;
+  auto pick = [&]() {
+    bool byAge = m_limits.weightRatio <= 0 ||
+                 picks++ % (m_limits.weightRatio + 1) == m_limits.weightRatio;
+    while (!light.empty() || !old.empty()) {
+      int id;
+      if (byAge && !old.empty()) {
+        id = old.front();
+        old.pop();
+      } else if (!light.empty()) {
+        id = light.top().second;
+        light.pop();
+      } else {
+        id = old.front();
+        old.pop();
+      }
+      if (!selected[id]) {
+        selected[id] = true;
+        return id;
+      }
+    }
+    return -1;
+  };
+
+  // сохранить построенный дизъюнкт, если он не избыточен
   std::optional<Subst> result;
-  constexpr auto max_iter = 100;
-  for (int right_id = 1;
-       right_id < disjuncts.size() && right_id < max_iter && !result;
-       ++right_id) {
-    for (int left_id = 0; left_id < right_id; ++left_id) {
-      auto res =
-          resolve(disjuncts[left_id], disjuncts[right_id], disjuncts.size());
-      if (!res)
-        continue;
-      res->disjunct = res->disjunct.renamedVars(allocator);
-      disjuncts.push_back(*res);
-      if (res->disjunct.size() == 0) {
-        result = res->subst;
-        break;
+  auto keep = [&](ExtendedDisjunct res) {
+    m_stats.generated++;
+    res.disjunct = withoutDuplicates(res.disjunct);
+    // тавтологии и поглощенные дизъюнкты отбрасываются
+    if (res.disjunct.size() != 0 &&
+        (isTautology(res.disjunct) || index.findSubsuming(res.disjunct) != -1))
+      return;
+    res.id = disjuncts.size();
+    res.disjunct = res.disjunct.renamedVars(allocator);
+    disjuncts.push_back(res);
+    m_stats.kept++;
+    selected.push_back(false);
+    deleted.push_back(false);
+    if (res.disjunct.size() == 0) {
+      result = res.subst;
+      return;
+    }
+    // удаление дизъюнктов, поглощенных новым
+    for (int id : index.findSubsumed(res.disjunct)) {
+      index.erase(id);
+      deleted[id] = true;
+      selected[id] = true;
+    }
+    index.insert(res.id, res.disjunct);
+    enqueue(res.id);
+  };
+  auto exhausted = [&]() {
+    if (disjuncts.size() >= m_limits.maxClauses)
+      m_stats.stop = ResolverStop::clauseLimit;
+    else if (outOfTime())
+      m_stats.stop = ResolverStop::timeout;
+    else
+      return false;
+    return true;
+  };
+
+  for (int given = pick(); given != -1 && !result; given = pick()) {
+    if (disjuncts[given].disjunct.size() == 0) {
+      // отрицание цели уже содержит пустой дизъюнкт
+      m_stats.stop = ResolverStop::refuted;
+      storeRefutation(disjuncts, given);
+      return disjuncts[given].subst;
+    }
+    m_stats.given++;
+    auto literals = eligibleLiterals(disjuncts[given].disjunct);
+    // склейки заданного дизъюнкта по разрешенным атомам
+    for (size_t i : literals) {
+      for (size_t j = 0; j < disjuncts[given].disjunct.size(); ++j) {
+        if (exhausted())
+          return std::nullopt;
+        if (result || deleted[given])
+          break;
+        if (auto res = factor(disjuncts[given], i, j, -1))
+          keep(*res);
       }
     }
+    // заданный дизъюнкт становится обработанным до построения резольвент,
+    // чтобы резольвенты строились и с его копией. Пары резолюции: атомы
+    // обработанных дизъюнктов, которые могут быть унифицированы с
+    // отрицаниями атомов заданного дизъюнкта. Удаленные поглощением
+    // дизъюнкты остаются в индексе и пропускаются
+    if (!deleted[given])
+      activate(given);
+    std::vector<std::pair<LiteralIndex::Entry, size_t>> pairs;
+    for (size_t j : literals)
+      for (auto entry : active.findComplementary(disjuncts[given].disjunct[j]))
+        pairs.emplace_back(entry, j);
+    for (auto [entry, j] : pairs) {
+      if (exhausted())
+        return std::nullopt;
+      if (result || deleted[given])
+        break;
+      if (deleted[entry.id])
+        continue;
+      if (entry.id == given) {
+        // резолюция дизъюнкта с собой - с копией с новыми переменными
+        auto copy = disjuncts[given];
+        copy.disjunct = copy.disjunct.renamedVars(allocator);
+        if (auto res = resolve(copy, entry.literal, disjuncts[given], j, -1))
+          keep(*res);
+      } else if (auto res = resolve(disjuncts[entry.id], entry.literal,
+                                    disjuncts[given], j, -1))
+        keep(*res);
+    }
   }
 
-  // output resolution steps
-  if (result)
-    printResolutionChain(disjuncts);
+  if (result) {
+    m_stats.stop = ResolverStop::refuted;
+    storeRefutation(disjuncts, disjuncts.size() - 1);
+  }
 
   return result;
 }
@@ -179,3 +432,26 @@ std::optional<Subst> Resolver::resolve(const std::vector<Disjunct> &axioms,
     extTarget.push_back({-1, tar, {}, {-1, -1}});
   return resolve(std::move(extAxioms), std::move(extTarget));
 }
+
+const ResolverStats &Resolver::getStats() const { return m_stats; }
+
+ResolventStream::ResolventStream(Resolver &resolver, ExtendedDisjunct left,
+                                 ExtendedDisjunct right, int nextID)
+    : m_resolver(resolver), m_left(std::move(left)), m_right(std::move(right)),
+      m_leftLiterals(resolver.eligibleLiterals(m_left.disjunct)),
+      m_rightLiterals(resolver.eligibleLiterals(m_right.disjunct)),
+      m_nextID(nextID) {}
+
+std::optional<ExtendedDisjunct> ResolventStream::next() {
+  for (; m_i < m_leftLiterals.size(); ++m_i, m_j = 0) {
+    while (m_j < m_rightLiterals.size()) {
+      auto res = m_resolver.resolve(m_left, m_leftLiterals[m_i], m_right,
+                                    m_rightLiterals[m_j++], m_nextID);
+      if (res) {
+        m_nextID++;
+        return res;
+      }
+    }
+  }
+  return std::nullopt;
+}
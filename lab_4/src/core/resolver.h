@@ -4,8 +4,11 @@
 #include "disjunct.h"
 #include "subst.h"
 #include "variable.h"
+#include <chrono>
+#include <cstddef>
 #include <list>
 #include <optional>
+#include <ostream>
 #include <set>
 #include <vector>
 
@@ -17,8 +20,52 @@ struct ExtendedDisjunct {
   int parent_id[2];
 };
 
+// ограничения поиска опровержения
+struct ResolverLimits {
+  // наибольшее число дизъюнктов (исходных и выведенных)
+  size_t maxClauses = 10000;
+  // ограничение времени поиска, нулевое значение - без ограничения
+  std::chrono::milliseconds timeout{0};
+  // на weightRatio выборов самого легкого дизъюнкта приходится один выбор
+  // самого старого
+  int weightRatio = 4;
+};
+
+// правило выбора атомов дизъюнкта, по которым разрешена резолюция.
+// Ограничение выбора несовместимо с множеством поддержки: атом цели может
+// разрешаться только с неразрешенным атомом аксиомы. Поэтому при negative и
+// ordered заданными становятся и аксиомы, и поиск на задачах с большим числом
+// аксиом бывает дольше, чем при all (так, pel43 из bench/resolver_bench.cpp
+// при negative за секунду не решается)
+enum class Selection {
+  all,      // любые атомы
+  negative, // самый тяжелый отрицательный атом, а при их отсутствии - любые
+  ordered,  // как negative, но вместо любых атомов - атомы с наибольшим в
+            // порядке имен предикатом (упорядоченная резолюция)
+};
+
+// причина завершения поиска опровержения
+enum class ResolverStop {
+  refuted,     // выведен пустой дизъюнкт
+  saturated,   // необработанных дизъюнктов не осталось
+  clauseLimit, // достигнуто наибольшее число дизъюнктов
+  timeout,     // истекло время поиска
+};
+
+// счетчики поиска опровержения
+struct ResolverStats {
+  size_t given = 0;     // выбрано заданных дизъюнктов
+  size_t generated = 0; // построено резольвент
+  size_t kept = 0;      // резольвент сохранено после проверки поглощения
+  ResolverStop stop = ResolverStop::saturated;
+};
+
+class ResolventStream;
+
 class Resolver {
 public:
+  Resolver(ResolverLimits limits = {}, Selection selection = Selection::all);
+
   std::optional<Subst> unify(const Variable::ptr &left,
                              const Variable::ptr &right);
 
@@ -29,15 +76,67 @@ public:
   std::optional<ExtendedDisjunct> resolve(const ExtendedDisjunct &left,
                                           const ExtendedDisjunct &right,
                                           int nextID);
+  // ленивый перебор всех резольвент пары дизъюнктов по разрешенным атомам
+  ResolventStream allResolvents(const ExtendedDisjunct &left,
+                                const ExtendedDisjunct &right, int nextID);
+  // резольвента по атому i дизъюнкта left и атому j дизъюнкта right
+  std::optional<ExtendedDisjunct> resolve(const ExtendedDisjunct &left,
+                                          size_t i,
+                                          const ExtendedDisjunct &right,
+                                          size_t j, int nextID);
+  // склейка дизъюнкта: атом j удаляется после унификации с атомом i
+  std::optional<ExtendedDisjunct> factor(const ExtendedDisjunct &disj,
+                                         size_t i, size_t j, int nextID);
+
+  // номера атомов дизъюнкта, разрешенных правилом выбора
+  std::vector<size_t> eligibleLiterals(const Disjunct &disj) const;
 
   void populateIndexes(const std::vector<ExtendedDisjunct> &disjuncts,
                        std::set<int> &set, int index = -1);
 
-  void printResolutionChain(const std::vector<ExtendedDisjunct> &disjuncts);
 
   std::optional<Subst> resolve(std::list<ExtendedDisjunct> axioms,
                                std::list<ExtendedDisjunct> target);
 
   std::optional<Subst> resolve(const std::vector<Disjunct> &axioms,
                                const std::vector<Disjunct> &target);
+
+  // счетчики последнего поиска опровержения
+  const ResolverStats &getStats() const;
+
+  // вывод пустого дизъюнкта последним поиском опровержения: использованные
+  // дизъюнкты в порядке вывода, номера которых (и номера родителей) - их
+  // позиции в списке. Пуст, если опровержение не найдено
+  const std::vector<ExtendedDisjunct> &getRefutation() const;
+  void printResolutionChain(std::ostream &stream) const;
+
+private:
+  void storeRefutation(const std::vector<ExtendedDisjunct> &disjuncts,
+                       int last);
+
+  ResolverLimits m_limits;
+  Selection m_selection;
+  ResolverStats m_stats;
+  std::vector<ExtendedDisjunct> m_refutation;
+};
+
+// ленивый перебор резольвент пары дизъюнктов: каждый вызов next строит
+// следующую резольвенту по паре разрешенных атомов
+class ResolventStream {
+public:
+  ResolventStream(Resolver &resolver, ExtendedDisjunct left,
+                  ExtendedDisjunct right, int nextID);
+
+  // следующая резольвента или std::nullopt, если резольвент больше нет
+  std::optional<ExtendedDisjunct> next();
+
+private:
+  Resolver &m_resolver;
+  ExtendedDisjunct m_left;
+  ExtendedDisjunct m_right;
+  std::vector<size_t> m_leftLiterals;
+  std::vector<size_t> m_rightLiterals;
+  size_t m_i = 0;
+  size_t m_j = 0;
+  int m_nextID;
 };
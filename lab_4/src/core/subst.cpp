@@ -2,106 +2,75 @@
 #include "resolver.h"
 #include <algorithm>
 
-template <typename T>
-static bool set_overlaps(const std::set<T> &set1, const std::set<T> &set2) {
-  std::set<T> ref;
-  std::set_intersection(set1.begin(), set1.end(), set2.begin(), set2.end(),
-                        std::inserter(ref, ref.end()), std::less());
-  return !ref.empty();
+static bool sameValue(const Variable::ptr &left, const Variable::ptr &right) {
+  return left == right || left->equals(*right);
 }
 
 std::optional<Subst> Subst::operator+(const Subst &other) const {
-  if (m_pairs.empty() && m_links.empty())
+  if (m_nodes.empty())
     return other;
-  if (other.m_pairs.empty() && other.m_links.empty())
+  if (other.m_nodes.empty())
     return *this;
   // start building combined substitution
   Subst newSubst = *this;
-  for (const auto &[var, value] : other.m_pairs) {
-    if (m_pairs.count(var) != 0 &&
-        m_pairs.at(var)->toString() != value->toString()) {
+  for (std::uint32_t i = 0; i < other.m_nodes.size(); ++i) {
+    const auto &var = other.m_nodes[i].var;
+    const auto &value = other.m_nodes[other.find(i)].value;
+    if (!value)
+      continue;
+    auto mine = findSlot(var);
+    if (mine && m_nodes[find(*mine)].value &&
+        !sameValue(m_nodes[find(*mine)].value, value)) {
       // попытка унификации двух термов с возможной генерацией новой
       // подстановки
-      auto auxSubst = Resolver().unify(m_pairs.at(var), value);
+      auto auxSubst = Resolver().unify(m_nodes[find(*mine)].value, value);
       if (!auxSubst) // унификация невозможна - конфликт
         return std::nullopt;
       newSubst.insert(var, auxSubst->apply(value));
     } else if (!newSubst.insert(var, value))
       return std::nullopt;
   }
-  for (const auto &otherRing : other.m_links) {
-    bool intersected = false;
-    for (auto &ring : newSubst.m_links) {
-      if (set_overlaps(ring, otherRing)) {
-        ring.insert(otherRing.begin(), otherRing.end());
-        if (!ringValid(ring))
-          return std::nullopt;
-        intersected = true;
-        break;
-      }
-    }
-    if (!intersected) {
-      if (!ringValid(otherRing))
-        return std::nullopt;
-      newSubst.m_links.push_back(otherRing);
-    }
+  // объединяем классы связанных переменных
+  for (std::uint32_t i = 0; i < other.m_nodes.size(); ++i) {
+    auto root = other.find(i);
+    if (root != i &&
+        !newSubst.link(other.m_nodes[i].var, other.m_nodes[root].var))
+      return std::nullopt;
   }
   // solve recursive references
-  for (auto &[var, value] : newSubst.m_pairs)
-    newSubst.solveRecursion(value);
+  for (auto &node : newSubst.m_nodes)
+    if (node.value)
+      newSubst.solveRecursion(node.value);
   return newSubst;
 }
 
 bool Subst::insert(const std::string &var, Variable::ptr value) {
-  if (m_pairs.count(var) > 0) {
-    return m_pairs[var]->toString() == value->toString();
-  }
-  m_pairs[var] = value;
-  // to avoid check assigment does not conflicts with linked variables
-  // propagate value to all linked variables
-  for (auto &ring : m_links)
-    if (ring.count(var) > 0)
-      for (const auto &linkedVar : ring)
-        m_pairs[linkedVar] = value;
+  auto &current = m_nodes[find(slot(var))].value;
+  if (current)
+    return sameValue(current, value);
+  // значение хранится в корне и сразу относится ко всем связанным переменным
+  current = std::move(value);
   return true;
 }
 
 bool Subst::link(const std::string &var1, const std::string &var2) {
-  if (m_pairs.count(var1) > 0 && m_pairs.count(var2) > 0) {
-    if (m_pairs.at(var1) != m_pairs.at(var2))
-      return false;
-  }
-  for (auto ring : m_links) {
-    if (ring.count(var1) > 0) {
-      ring.insert(var2);
-      if (m_pairs.count(var1) > 0)
-        m_pairs[var2] = m_pairs[var1];
-      return true;
-    } else if (ring.count(var2) > 0) {
-      ring.insert(var1);
-      if (m_pairs.count(var2) > 0)
-        m_pairs[var1] = m_pairs[var2];
-      return true;
-    }
-  }
-  m_links.push_back({var1, var2});
-  if (m_pairs.count(var1) > 0)
-    m_pairs[var2] = m_pairs[var1];
-  else if (m_pairs.count(var2) > 0)
-    m_pairs[var1] = m_pairs[var2];
-  return true;
+  auto slot1 = slot(var1);
+  return unite(slot1, slot(var2));
 }
 
 Variable::ptr Subst::apply(const Variable::ptr &term) {
   if (term->isConst())
     return term;
   if (term->isVariable()) {
-    if (m_pairs.count(term->getValue()) > 0)
-      return m_pairs[term->getValue()];
-    // проверяем наличие переменной в связанном кольце неозначенных переменных
-    for (auto &ring : m_links)
-      if (ring.count(term->getValue()) > 0)
-        return std::make_shared<Variable>(false, *ring.begin());
+    auto slot = findSlot(term->getValue());
+    if (!slot)
+      return term;
+    const auto &root = m_nodes[find(*slot)];
+    if (root.value)
+      return root.value;
+    // неозначенная связанная переменная заменяется представителем класса
+    if (root.size > 1)
+      return std::make_shared<Variable>(false, m_nodes[root.first].var);
     return term;
   }
   // если term - функциональный символ - выполняем все остальное
@@ -129,49 +98,92 @@ Disjunct Subst::apply(const Disjunct &disj) {
 }
 
 std::string Subst::toString() const {
-  std::set<std::string> accounted;
+  // классы связанных переменных по наименьшему имени и одиночные переменные
+  std::map<std::string, std::pair<std::uint32_t, std::set<std::string>>> rings;
+  std::map<std::string, const Variable::ptr *> pairs;
+  for (std::uint32_t i = 0; i < m_nodes.size(); ++i) {
+    auto root = find(i);
+    const auto &name = m_nodes[i].var;
+    if (m_nodes[root].size > 1) {
+      auto &ring = rings[m_nodes[m_nodes[root].first].var];
+      ring.first = root;
+      ring.second.insert(name);
+    } else if (m_nodes[root].value)
+      pairs.emplace(name, &m_nodes[root].value);
+  }
   std::string res = "{";
   bool first = true;
-  for (const auto &ring : m_links) {
+  for (const auto &[key, ring] : rings) {
     if (!first)
       res += ", ";
     first = false;
-    for (const auto &var : ring) {
+    for (const auto &var : ring.second)
       res += var + "=";
-      accounted.insert(var);
-    }
-    if (m_pairs.count(*ring.begin()) > 0)
-      res += m_pairs.at(*ring.begin())->toString();
+    if (const auto &value = m_nodes[ring.first].value)
+      res += value->toString();
   }
-  first = true;
-  for (const auto &[var, value] : m_pairs) {
-    if (accounted.count(var) == 0) {
-      if (!first)
-        res += ", ";
-      first = false;
-      res += var + "=" + value->toString();
-    }
+  for (const auto &[var, value] : pairs) {
+    if (!first)
+      res += ", ";
+    first = false;
+    res += var + "=" + (*value)->toString();
   }
   res += "}";
   return res;
 }
 
-bool Subst::ringValid(const std::set<std::string> &ring) const {
-  if (m_pairs.count(*ring.begin()) == 0) {
-    // all other items also must not have value
-    for (const auto &item : ring) {
-      if (m_pairs.count(item) != 0)
-        return false;
-    }
-    return true;
-  }
-  auto firstValue = m_pairs.at(*ring.begin())->toString();
-  for (const auto &item : ring) {
-    if (m_pairs.count(item) == 0)
-      return false;
-    if (m_pairs.at(item)->toString() != firstValue)
-      return false;
+std::optional<std::uint32_t> Subst::findSlot(const std::string &var) const {
+  auto iter = m_slots.find(var);
+  if (iter == m_slots.end())
+    return std::nullopt;
+  return iter->second;
+}
+
+// номер переменной в подстановке; новая переменная образует отдельный класс
+std::uint32_t Subst::slot(const std::string &var) {
+  auto [iter, inserted] = m_slots.emplace(var, m_nodes.size());
+  if (inserted)
+    m_nodes.push_back({var, iter->second, 0, 1, iter->second, nullptr});
+  return iter->second;
+}
+
+// корень класса переменной со сжатием пути
+std::uint32_t Subst::find(std::uint32_t slot) const {
+  auto root = slot;
+  while (m_nodes[root].parent != root)
+    root = m_nodes[root].parent;
+  while (m_nodes[slot].parent != root) {
+    auto next = m_nodes[slot].parent;
+    m_nodes[slot].parent = root;
+    slot = next;
   }
+  return root;
+}
+
+// объединение классов по рангу. Классы с различными значениями не
+// объединяются
+bool Subst::unite(std::uint32_t slot1, std::uint32_t slot2) {
+  auto root1 = find(slot1);
+  auto root2 = find(slot2);
+  if (root1 == root2)
+    return true;
+  auto &value1 = m_nodes[root1].value;
+  auto &value2 = m_nodes[root2].value;
+  if (value1 && value2 && !sameValue(value1, value2))
+    return false;
+  if (m_nodes[root1].rank < m_nodes[root2].rank)
+    std::swap(root1, root2);
+  auto &parent = m_nodes[root1];
+  auto &child = m_nodes[root2];
+  child.parent = root1;
+  if (parent.rank == child.rank)
+    ++parent.rank;
+  parent.size += child.size;
+  if (m_nodes[child.first].var < m_nodes[parent.first].var)
+    parent.first = child.first;
+  if (!parent.value)
+    parent.value = std::move(child.value);
+  child.value = nullptr;
   return true;
 }
 
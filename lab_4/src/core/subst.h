@@ -3,12 +3,21 @@
 #include "atom.h"
 #include "disjunct.h"
 #include "variable.h"
-#include <list>
+#include <cstdint>
 #include <map>
 #include <optional>
 #include <set>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
+// класс подстановки.
+//
+// Связанные между собой переменные образуют классы эквивалентности, которые
+// хранятся в системе непересекающихся множеств (union-find) со сжатием путей и
+// объединением по рангу. Каждой переменной при первом появлении в подстановке
+// выдается номер, значение класса хранится только в его корне. Поэтому
+// связывание переменных и поиск значения выполняются почти за константное время
 class Subst {
 public:
   std::optional<Subst> operator+(const Subst &other) const;
@@ -23,10 +32,22 @@ public:
   std::string toString() const;
 
 private:
-  bool ringValid(const std::set<std::string> &ring) const;
+  struct Node {
+    std::string var;
+    mutable std::uint32_t parent; // родитель в дереве класса
+    std::uint32_t rank = 0;       // ранг корня
+    std::uint32_t size = 1;       // число переменных в классе (в корне)
+    std::uint32_t first;          // переменная класса с наименьшим именем
+    Variable::ptr value;          // значение класса (в корне)
+  };
+
+  std::optional<std::uint32_t> findSlot(const std::string &var) const;
+  std::uint32_t slot(const std::string &var);
+  std::uint32_t find(std::uint32_t slot) const;
+  bool unite(std::uint32_t slot1, std::uint32_t slot2);
   void solveRecursion(Variable::ptr &value, int depth = 0);
 
 private:
-  std::map<std::string, Variable::ptr> m_pairs;
-  std::list<std::set<std::string>> m_links;
+  std::vector<Node> m_nodes;
+  std::unordered_map<std::string, std::uint32_t> m_slots;
 };
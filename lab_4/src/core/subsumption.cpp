@@ -0,0 +1,218 @@
+#include "subsumption.h"
+#include <algorithm>
+#include <functional>
+#include <string>
+
+using Bindings = std::map<std::string, Variable::ptr>;
+
+static bool equal(const Variable::ptr &left, const Variable::ptr &right) {
+  if (left->isConst() != right->isConst() ||
+      left->getValue() != right->getValue())
+    return false;
+  const auto &args1 = left->getArguments();
+  const auto &args2 = right->getArguments();
+  if (args1.size() != args2.size())
+    return false;
+  for (size_t i = 0; i < args1.size(); ++i)
+    if (!equal(args1[i], args2[i]))
+      return false;
+  return true;
+}
+
+static bool equalArgs(const Atom &left, const Atom &right) {
+  if (left.getName() != right.getName())
+    return false;
+  const auto &args1 = left.getArguments();
+  const auto &args2 = right.getArguments();
+  if (args1.size() != args2.size())
+    return false;
+  for (size_t i = 0; i < args1.size(); ++i)
+    if (!equal(args1[i], args2[i]))
+      return false;
+  return true;
+}
+
+// сопоставление с образцом: переменные term считаются константами
+static bool match(const Variable::ptr &pattern, const Variable::ptr &term,
+                  Bindings &bindings) {
+  if (pattern->isVariable()) {
+    auto [iter, inserted] = bindings.emplace(pattern->getValue(), term);
+    return inserted || equal(iter->second, term);
+  }
+  if (pattern->isConst())
+    return term->isConst() && pattern->getValue() == term->getValue();
+  if (!term->isFuncSym() || pattern->getValue() != term->getValue())
+    return false;
+  const auto &args1 = pattern->getArguments();
+  const auto &args2 = term->getArguments();
+  if (args1.size() != args2.size())
+    return false;
+  for (size_t i = 0; i < args1.size(); ++i)
+    if (!match(args1[i], args2[i], bindings))
+      return false;
+  return true;
+}
+
+static bool match(const Atom &pattern, const Atom &atom, Bindings &bindings) {
+  if (pattern.isInverse() != atom.isInverse() ||
+      pattern.getName() != atom.getName())
+    return false;
+  const auto &args1 = pattern.getArguments();
+  const auto &args2 = atom.getArguments();
+  if (args1.size() != args2.size())
+    return false;
+  for (size_t i = 0; i < args1.size(); ++i)
+    if (!match(args1[i], args2[i], bindings))
+      return false;
+  return true;
+}
+
+// поиск с возвратом образов атомов left начиная с i-го
+static bool subsumes(const Disjunct &left, const Disjunct &right, size_t i,
+                     std::vector<bool> &used, const Bindings &bindings) {
+  if (i == left.size())
+    return true;
+  for (size_t j = 0; j < right.size(); ++j) {
+    if (used[j])
+      continue;
+    Bindings next = bindings;
+    if (!match(left[i], right[j], next))
+      continue;
+    used[j] = true;
+    if (subsumes(left, right, i + 1, used, next))
+      return true;
+    used[j] = false;
+  }
+  return false;
+}
+
+// число непеременных символов в терме
+static size_t symbolsCount(const Variable::ptr &term) {
+  if (term->isVariable())
+    return 0;
+  size_t res = 1;
+  for (auto &arg : term->getArguments())
+    res += symbolsCount(arg);
+  return res;
+}
+
+bool isTautology(const Disjunct &disj) {
+  for (size_t i = 0; i < disj.size(); ++i)
+    for (size_t j = i + 1; j < disj.size(); ++j)
+      if (disj[i].isInverse() != disj[j].isInverse() &&
+          equalArgs(disj[i], disj[j]))
+        return true;
+  return false;
+}
+
+Disjunct withoutDuplicates(const Disjunct &disj) {
+  std::vector<Atom> atoms;
+  for (auto &atom : disj) {
+    bool duplicate = false;
+    for (auto &other : atoms)
+      if (atom.isInverse() == other.isInverse() && equalArgs(atom, other))
+        duplicate = true;
+    if (!duplicate)
+      atoms.push_back(atom);
+  }
+  return Disjunct(std::move(atoms));
+}
+
+bool subsumes(const Disjunct &left, const Disjunct &right) {
+  if (left.size() > right.size())
+    return false;
+  std::vector<bool> used(right.size(), false);
+  return subsumes(left, right, 0, used, {});
+}
+
+void SubsumptionIndex::insert(int id, const Disjunct &disj) {
+  auto feats = features(disj);
+  Node *node = &m_root;
+  for (auto value : feats) {
+    auto &child = node->children[value];
+    if (!child)
+      child = std::make_unique<Node>();
+    node = child.get();
+  }
+  node->ids.push_back(id);
+  m_entries.insert_or_assign(id, Entry{disj, feats});
+}
+
+void SubsumptionIndex::erase(int id) {
+  auto iter = m_entries.find(id);
+  if (iter == m_entries.end())
+    return;
+  Node *node = &m_root;
+  for (auto value : iter->second.features)
+    node = node->children.at(value).get();
+  node->ids.erase(std::remove(node->ids.begin(), node->ids.end(), id),
+                  node->ids.end());
+  m_entries.erase(iter);
+}
+
+int SubsumptionIndex::findSubsuming(const Disjunct &disj) const {
+  return findSubsuming(m_root, 0, features(disj), disj);
+}
+
+std::vector<int> SubsumptionIndex::findSubsumed(const Disjunct &disj) const {
+  std::vector<int> res;
+  findSubsumed(m_root, 0, features(disj), disj, res);
+  return res;
+}
+
+size_t SubsumptionIndex::size() const { return m_entries.size(); }
+
+SubsumptionIndex::Features SubsumptionIndex::features(const Disjunct &disj) {
+  Features res{};
+  for (auto &atom : disj) {
+    size_t group = std::hash<std::string>()(atom.getName()) % predicateGroups;
+    if (atom.isInverse()) {
+      res[1]++;
+      res[3 + predicateGroups + group]++;
+    } else {
+      res[0]++;
+      res[3 + group]++;
+    }
+    for (auto &arg : atom.getArguments())
+      res[2] += symbolsCount(arg);
+  }
+  return res;
+}
+
+/**
+ * Метод поиска поглощающего дизъюнкта.
+ *
+ * На уровне level обходятся только ветви, значение признака которых не
+ * больше значения признака disj: дизъюнкты остальных ветвей не могут
+ * поглощать disj.
+ */
+int SubsumptionIndex::findSubsuming(const Node &node, size_t level,
+                                    const Features &feats,
+                                    const Disjunct &disj) const {
+  if (level == featuresCount) {
+    for (int id : node.ids)
+      if (subsumes(m_entries.at(id).disjunct, disj))
+        return id;
+    return -1;
+  }
+  auto end = node.children.upper_bound(feats[level]);
+  for (auto iter = node.children.begin(); iter != end; ++iter)
+    if (int id = findSubsuming(*iter->second, level + 1, feats, disj);
+        id != -1)
+      return id;
+  return -1;
+}
+
+void SubsumptionIndex::findSubsumed(const Node &node, size_t level,
+                                    const Features &feats, const Disjunct &disj,
+                                    std::vector<int> &res) const {
+  if (level == featuresCount) {
+    for (int id : node.ids)
+      if (subsumes(disj, m_entries.at(id).disjunct))
+        res.push_back(id);
+    return;
+  }
+  for (auto iter = node.children.lower_bound(feats[level]);
+       iter != node.children.end(); ++iter)
+    findSubsumed(*iter->second, level + 1, feats, disj, res);
+}
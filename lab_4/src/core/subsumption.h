@@ -0,0 +1,65 @@
+#pragma once
+
+#include "disjunct.h"
+#include <array>
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+// является ли дизъюнкт тавтологией (содержит атом вместе с его отрицанием)
+bool isTautology(const Disjunct &disj);
+
+// дизъюнкт без повторяющихся атомов
+Disjunct withoutDuplicates(const Disjunct &disj);
+
+// поглощает ли дизъюнкт left дизъюнкт right: существует подстановка s,
+// переводящая атомы left в попарно различные атомы right
+bool subsumes(const Disjunct &left, const Disjunct &right);
+
+// индекс дизъюнктов для проверки поглощения.
+//
+// Каждому дизъюнкту сопоставляется вектор признаков: числа положительных и
+// отрицательных атомов, число непеременных символов в аргументах и числа атомов
+// по группам предикатов. Если left поглощает right, то каждый признак left не
+// больше признака right, поэтому векторы хранятся в префиксном дереве, и при
+// поиске обходятся только ветви с подходящими значениями признаков. Полная
+// проверка поглощения выполняется лишь для дизъюнктов найденных листьев
+class SubsumptionIndex {
+public:
+  void insert(int id, const Disjunct &disj);
+  void erase(int id);
+
+  // номер дизъюнкта индекса, поглощающего disj, или -1
+  int findSubsuming(const Disjunct &disj) const;
+  // номера дизъюнктов индекса, поглощаемых disj
+  std::vector<int> findSubsumed(const Disjunct &disj) const;
+
+  size_t size() const;
+
+private:
+  static constexpr size_t predicateGroups = 4;
+  static constexpr size_t featuresCount = 3 + 2 * predicateGroups;
+  using Features = std::array<size_t, featuresCount>;
+
+  struct Node {
+    std::map<size_t, std::unique_ptr<Node>> children;
+    std::vector<int> ids; // дизъюнкты листа
+  };
+
+  struct Entry {
+    Disjunct disjunct;
+    Features features;
+  };
+
+  static Features features(const Disjunct &disj);
+
+  int findSubsuming(const Node &node, size_t level, const Features &feats,
+                    const Disjunct &disj) const;
+  void findSubsumed(const Node &node, size_t level, const Features &feats,
+                    const Disjunct &disj, std::vector<int> &res) const;
+
+  Node m_root;
+  std::unordered_map<int, Entry> m_entries;
+};
@@ -56,6 +56,29 @@ void Variable::updateArgument(size_t i, Variable::ptr value) {
   m_arguments[i] = value;
 }
 
+bool Variable::equals(const Variable &other) const {
+  return equals(other, nullptr, nullptr);
+}
+
+// рекурсивные ссылки печатаются как "...", поэтому равны друг другу
+bool Variable::equals(const Variable &other, const VariableListNode *vlist,
+                      const VariableListNode *otherVlist) const {
+  bool self = hasSelf(vlist);
+  bool otherSelf = other.hasSelf(otherVlist);
+  if (self || otherSelf)
+    return self && otherSelf;
+  if (m_isConst != other.m_isConst || m_value != other.m_value ||
+      m_arguments.size() != other.m_arguments.size())
+    return false;
+  VariableListNode next = {this, vlist};
+  VariableListNode otherNext = {&other, otherVlist};
+  for (size_t i = 0; i < m_arguments.size(); ++i)
+    if (m_arguments[i] != other.m_arguments[i] &&
+        !m_arguments[i]->equals(*other.m_arguments[i], &next, &otherNext))
+      return false;
+  return true;
+}
+
 std::string Variable::toString() const { return toString(nullptr); }
 
 std::string Variable::toString(const VariableListNode *vlist) const {
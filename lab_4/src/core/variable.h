@@ -32,10 +32,15 @@ public:
 
   void updateArgument(size_t i, Variable::ptr value);
 
+  // структурное равенство термов, согласованное с методом toString()
+  bool equals(const Variable &other) const;
+
   std::string toString() const;
 
 private:
   std::string toString(const VariableListNode *vlist) const;
+  bool equals(const Variable &other, const VariableListNode *vlist,
+              const VariableListNode *otherVlist) const;
 
   bool hasSelf(const VariableListNode *list) const;
 
@@ -116,3 +116,34 @@ TEST(ParserTest, MultipleVarsInQuantifiers) {
 
   EXPECT_EQ(expected, actual);
 }
+
+TEST(ParserTest, Chains) {
+  auto text = "A & B & C + D + E -> F -> G";
+  Expr::ptr rule;
+
+  EXPECT_NO_THROW(rule = ExprParser().Parse(text));
+
+  auto expected = "(A & B & C) + D + (~E + (~F + G))";
+  EXPECT_EQ(expected, rule->toString());
+  EXPECT_EQ(3, rule->getOperands()[0]->getOperands().size());
+}
+
+TEST(ParserTest, DeepNesting) {
+  const int depth = 100000;
+  auto text = std::string(depth, '(') + "~A" + std::string(depth, ')');
+  for (int i = 0; i < depth; ++i)
+    text += " & B" + std::to_string(i);
+  Expr::ptr rule;
+
+  EXPECT_NO_THROW(rule = ExprParser().Parse(text.c_str()));
+
+  EXPECT_EQ(depth + 1, rule->getOperands().size());
+  EXPECT_EQ("~A", rule->getOperands()[0]->toString());
+}
+
+TEST(ParserTest, Errors) {
+  EXPECT_THROW(ExprParser().Parse("(A & B"), std::runtime_error);
+  EXPECT_THROW(ExprParser().Parse("A & B)"), std::runtime_error);
+  EXPECT_THROW(ExprParser().Parse("A &"), std::runtime_error);
+  EXPECT_THROW(ExprParser().Parse("P(x, f(y)"), std::runtime_error);
+}
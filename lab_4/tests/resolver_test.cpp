@@ -1,8 +1,15 @@
+#include "batch.h"
+#include "literal_index.h"
 #include "normalizer.h"
 #include "parser/expr_parser.h"
 #include "resolver.h"
+#include "subsumption.h"
+#include <algorithm>
+#include <chrono>
 #include <gtest/gtest.h>
 #include <memory>
+#include <set>
+#include <sstream>
 
 Atom parseAtom(const char *text) {
   auto disj = ExprNormalizer().scolemForm(ExprParser().Parse(text));
@@ -68,6 +75,18 @@ TEST(SubstTest, conflictingRings) {
   }
 }
 
+TEST(SubstTest, structuralValues) {
+  auto term = [](bool isConst) {
+    return std::make_shared<Variable>(
+        false, "f", std::vector{std::make_shared<Variable>(isConst, "A")});
+  };
+  Subst subst;
+  ASSERT_TRUE(subst.insert("x", term(true)));
+  EXPECT_TRUE(subst.insert("x", term(true)));
+  // константа и переменная с одинаковым именем печатаются одинаково
+  EXPECT_FALSE(subst.insert("x", term(false)));
+}
+
 TEST(SubstTest, hardCase) {
   Subst left;
   left.insert(
@@ -233,3 +252,300 @@ TEST(ResolverNewTest, listLen2) {
 
   EXPECT_TRUE(res);
 }
+
+TEST(ResolverNewTest, longChain) {
+  // цепочка A0 -> A1 -> ... -> A40, к которой добавлены посторонние аксиомы
+  std::string text = "A0";
+  for (int i = 0; i < 40; ++i)
+    text += " & (A" + std::to_string(i) + " -> A" + std::to_string(i + 1) +
+            ") & (B" + std::to_string(i) + " + ~A" + std::to_string(i) + ")";
+  auto axioms = parseDisjuncts(text.c_str());
+  auto target = parseDisjuncts("~A40");
+
+  auto res = Resolver().resolve(axioms, target);
+
+  EXPECT_TRUE(res);
+}
+
+TEST(ResolverNewTest, clausesLimit) {
+  auto axioms = parseDisjuncts("\\forall(x) (N(x) -> N(succ(x))) & N(0)");
+  auto target = parseDisjuncts("~N(Nil)");
+
+  ResolverLimits limits;
+  limits.maxClauses = 200;
+  auto res = Resolver(limits).resolve(axioms, target);
+
+  EXPECT_FALSE(res);
+}
+
+TEST(SubsumptionTest, tautology) {
+  // нормализатор сам удаляет тавтологии и повторы, поэтому дизъюнкты
+  // собираются из частей
+  auto disj = parseDisjunct("P(f(A)) + Q");
+
+  EXPECT_TRUE(isTautology(disj + parseDisjunct("~P(f(A))")));
+  EXPECT_FALSE(isTautology(disj + parseDisjunct("~P(A)")));
+  EXPECT_EQ(withoutDuplicates(disj + parseDisjunct("P(f(A))")).size(), 2);
+}
+
+TEST(SubsumptionTest, subsumes) {
+  auto general = parseDisjunct("\\forall(x, y) (P(x, y) + ~Q(x))");
+  auto special = parseDisjunct("\\forall(z) (P(A, f(z)) + R(z) + ~Q(A))");
+
+  EXPECT_TRUE(subsumes(general, special));
+  EXPECT_FALSE(subsumes(special, general));
+  EXPECT_FALSE(subsumes(general, parseDisjunct("P(A, B) + ~Q(B)")));
+}
+
+TEST(SubsumptionTest, index) {
+  SubsumptionIndex index;
+  index.insert(0, parseDisjunct("\\forall(x) (P(x) + Q(x))"));
+  index.insert(1, parseDisjunct("R(A) + ~S"));
+  index.insert(2, parseDisjunct("P(A) + Q(A) + R(B)"));
+
+  EXPECT_EQ(index.findSubsuming(parseDisjunct("P(B) + Q(B) + S")), 0);
+  EXPECT_EQ(index.findSubsuming(parseDisjunct("P(B) + Q(A)")), -1);
+  EXPECT_EQ(index.findSubsumed(parseDisjunct("R(A)")), std::vector<int>{1});
+
+  index.erase(0);
+  EXPECT_EQ(index.findSubsuming(parseDisjunct("P(A) + Q(A) + R(B)")), 2);
+  EXPECT_EQ(index.findSubsuming(parseDisjunct("P(B) + Q(B) + S")), -1);
+  EXPECT_EQ(index.size(), 2);
+}
+
+TEST(LiteralIndexTest, findComplementary) {
+  LiteralIndex index;
+  index.insert(0, parseDisjunct("\\forall(x) (P(x, f(x)) + ~Q(x))"));
+  index.insert(1, parseDisjunct("P(A, B) + ~P(A, f(B))"));
+  index.insert(2, parseDisjunct("\\forall(y) (~P(g(y), A) + Q(y))"));
+
+  auto found = [&](const char *text) {
+    std::vector<std::pair<int, size_t>> res;
+    for (auto entry : index.findComplementary(parseAtom(text)))
+      res.emplace_back(entry.id, entry.literal);
+    std::sort(res.begin(), res.end());
+    return res;
+  };
+  using Found = std::vector<std::pair<int, size_t>>;
+
+  EXPECT_EQ(found("~P(A, B)"), (Found{{1, 0}}));
+  EXPECT_EQ(found("\\forall(z) ~P(z, f(B))"), (Found{{0, 0}}));
+  EXPECT_EQ(found("\\forall(z) P(z, A)"), (Found{{2, 0}}));
+  EXPECT_EQ(found("\\forall(z) P(A, z)"), (Found{{1, 1}}));
+  EXPECT_EQ(found("Q(C)"), (Found{{0, 1}}));
+  EXPECT_EQ(found("R(A)"), Found{});
+}
+
+TEST(ResolverNewTest, allResolvents) {
+  ExtendedDisjunct left{0, parseDisjunct("P(A) + P(B) + Q"), {}, {-1, -1}};
+  ExtendedDisjunct right{1, parseDisjunct("\\forall(x) (~P(x) + ~Q)"),
+                         {},
+                         {-1, -1}};
+
+  std::vector<std::string> resolvents;
+  auto stream = Resolver().allResolvents(left, right, 2);
+  while (auto res = stream.next()) {
+    EXPECT_EQ(res->id, 2 + resolvents.size());
+    resolvents.push_back(res->disjunct.toString());
+  }
+
+  EXPECT_EQ(resolvents,
+            (std::vector<std::string>{"P(B) + Q + ~Q", "P(A) + Q + ~Q",
+                                      "P(A) + P(B) + ~P(x)"}));
+}
+
+TEST(ResolverNewTest, factoring) {
+  // без склейки опровержение не строится
+  auto target = parseDisjuncts("\\forall(x, y) (P(x) + P(y)) & "
+                               "\\forall(x, y) (~P(x) + ~P(y))");
+
+  for (auto selection :
+       {Selection::all, Selection::negative, Selection::ordered})
+    EXPECT_TRUE(Resolver({}, selection).resolve({}, target));
+}
+
+TEST(ResolverNewTest, selection) {
+  // с множеством поддержки при negative и ordered опровержение не строится:
+  // атом ~P(3, 6) разрешается только с неразрешенным атомом P(x, y) правила
+  auto axioms =
+      parseDisjuncts("(\\forall(x, y, z) ((P(x, z) & P(z, y)) -> P(x, y))) & "
+                     "P(3, 4) & P(4, 5) & P(5, 6)");
+  auto target = parseDisjuncts("~P(3, 6)");
+
+  for (auto selection :
+       {Selection::all, Selection::negative, Selection::ordered}) {
+    Resolver resolver({}, selection);
+    EXPECT_TRUE(resolver.resolve(axioms, target));
+    EXPECT_GT(resolver.getStats().given, 0);
+  }
+}
+
+TEST(ResolverNewTest, supportSet) {
+  // pel43: множество поддержки при Selection::all сокращает поиск
+  auto axioms = parseDisjuncts(
+      "\\forall(x, y) (Q(x, y) = (\\forall(z) (F(z, x) = F(z, y))))");
+  auto target = ExprNormalizer().scolemForm(Expr::createInverse(
+      ExprParser().Parse("\\forall(x, y) (Q(x, y) = Q(y, x))")));
+
+  ResolverLimits limits;
+  limits.timeout = std::chrono::milliseconds(5000);
+  Resolver resolver(limits);
+  EXPECT_TRUE(resolver.resolve(axioms, target));
+  EXPECT_LT(resolver.getStats().given, 100);
+}
+
+TEST(NormalizerTest, definitionalCnf) {
+  // (A1 & B1) + ... + (A10 & B10): 2^10 дизъюнктов при дистрибуции
+  std::string text = "(A1 & B1)";
+  std::string target = "~A1";
+  for (int i = 2; i <= 10; ++i) {
+    text += " + (A" + std::to_string(i) + " & B" + std::to_string(i) + ")";
+    target += " & ~A" + std::to_string(i);
+  }
+  auto expr = ExprParser().Parse(text.c_str());
+  using Mode = ExprNormalizer::CnfMode;
+
+  EXPECT_EQ(ExprNormalizer().scolemForm(expr, Mode::distribute).size(), 1024);
+  auto axioms = ExprNormalizer().scolemForm(expr, Mode::definitional);
+  EXPECT_LE(axioms.size(), 2 * 10);
+  EXPECT_LT(ExprNormalizer().scolemForm(expr).size(), 1024);
+  EXPECT_EQ(ExprNormalizer(2048).scolemForm(expr).size(), 1024);
+
+  EXPECT_TRUE(Resolver().resolve(axioms, parseDisjuncts(target.c_str())));
+}
+
+TEST(NormalizerTest, longConjunction) {
+  const int count = 5000;
+  std::string text = "\\forall(x) P(x)";
+  for (int i = 0; i < count; ++i)
+    text += " & (A" + std::to_string(i) + " + ~A" + std::to_string(i + 1) +
+            " + \\exists(y" + std::to_string(i) + ") Q(y" + std::to_string(i) +
+            "))";
+  auto disj = parseDisjuncts(text.c_str());
+
+  EXPECT_EQ(disj.size(), count + 1);
+  for (size_t i = 1; i < disj.size(); ++i)
+    EXPECT_EQ(disj[i].size(), 3);
+}
+
+TEST(NormalizerTest, deepNesting) {
+  // вложенные скобками и цепочками импликаций операции одного типа
+  // нормализуются за линейное время без рекурсии по глубине
+  const int depth = 100000;
+  std::string conjunction = std::string(depth, '(') + "A0";
+  std::string disjunction = conjunction;
+  std::string chain = "A0";
+  for (int i = 1; i <= depth; ++i) {
+    conjunction += " & A" + std::to_string(i) + ")";
+    disjunction += " + A" + std::to_string(i) + ")";
+    chain += " -> A" + std::to_string(i);
+  }
+  auto negation = std::string(depth + 1, '~') + "A";
+
+  auto start = std::chrono::steady_clock::now();
+  EXPECT_EQ(parseDisjuncts(conjunction.c_str()).size(), depth + 1);
+  auto clauses = parseDisjuncts(disjunction.c_str());
+  ASSERT_EQ(clauses.size(), 1);
+  EXPECT_EQ(clauses[0].size(), depth + 1);
+  clauses = parseDisjuncts(chain.c_str());
+  ASSERT_EQ(clauses.size(), 1);
+  EXPECT_EQ(clauses[0].size(), depth + 1);
+  clauses = parseDisjuncts(negation.c_str());
+  ASSERT_EQ(clauses.size(), 1);
+  EXPECT_EQ(clauses[0].toString(), "~A");
+  EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(30));
+}
+
+TEST(NormalizerTest, quantifierRenaming) {
+  // каждая переменная существования получает свою функцию Сколема
+  auto disj = parseDisjuncts(
+      "(\\exists(y) P(y)) & (\\exists(y) Q(y)) & (\\exists(y) R(y))");
+
+  ASSERT_EQ(disj.size(), 3);
+  std::set<std::string> constants;
+  for (auto &d : disj)
+    constants.insert(d.begin()->getArguments()[0]->getValue());
+  EXPECT_EQ(constants.size(), 3);
+}
+
+TEST(ResolverNewTest, refutation) {
+  auto axioms = parseDisjuncts("(A -> B) & (B -> C) & A");
+  auto target = parseDisjuncts("~C");
+
+  Resolver resolver;
+  ASSERT_TRUE(resolver.resolve(axioms, target));
+
+  const auto &chain = resolver.getRefutation();
+  ASSERT_FALSE(chain.empty());
+  EXPECT_EQ(chain.back().disjunct.size(), 0);
+  EXPECT_EQ(resolver.getStats().stop, ResolverStop::refuted);
+  for (auto &disj : chain)
+    for (int parent : disj.parent_id)
+      EXPECT_LT(parent, disj.id);
+  std::ostringstream stream;
+  resolver.printResolutionChain(stream);
+  EXPECT_NE(stream.str().find(std::to_string(chain.size()) + ") "),
+            std::string::npos);
+}
+
+TEST(ResolverNewTest, selfResolution) {
+  // резольвента ~P(x) + P(f(f(x))) дизъюнкта цели с собой сокращает вывод
+  auto axioms = parseDisjuncts("P(A) & ~P(f(f(f(f(f(f(f(f(A)))))))))");
+  auto target = parseDisjuncts("\\forall(x) (~P(x) + P(f(x)))");
+
+  Resolver resolver;
+  ASSERT_TRUE(resolver.resolve(axioms, target));
+
+  const auto &chain = resolver.getRefutation();
+  EXPECT_TRUE(std::any_of(chain.begin(), chain.end(), [](auto &disj) {
+    return disj.parent_id[0] >= 0 && disj.parent_id[0] == disj.parent_id[1];
+  }));
+}
+
+TEST(BatchTest, solveBatch) {
+  std::istringstream file("# problems\n"
+                          "A; A -> B; B\n"
+                          "\n"
+                          "P(X); \\exists(x) Q(x)\n"
+                          "A & ; B\n"
+                          "\\forall(x) (N(x) -> N(s(x))); N(0); N(s(s(0)))\n");
+  auto problems = readProblems(file);
+  ASSERT_EQ(problems.size(), 4);
+  EXPECT_EQ(problems[0].line, 2);
+  EXPECT_EQ(problems[3].line, 6);
+
+  std::vector<BatchResult> results;
+  solveBatch(problems, 3, {}, Selection::all,
+             [&](const BatchResult &res) { results.push_back(res); });
+  ASSERT_EQ(results.size(), 4);
+  std::sort(results.begin(), results.end(),
+            [](auto &left, auto &right) { return left.line < right.line; });
+
+  EXPECT_TRUE(results[0].proved);
+  EXPECT_FALSE(results[1].proved);
+  EXPECT_EQ(results[1].stats.stop, ResolverStop::saturated);
+  EXPECT_FALSE(results[2].error.empty());
+  EXPECT_TRUE(results[3].proved);
+
+  auto json = toJson(results[0]);
+  EXPECT_EQ(json.find("{\"line\": 2, \"status\": \"proved\""), 0);
+  EXPECT_NE(toJson(results[2]).find("\"status\": \"error\""),
+            std::string::npos);
+}
+
+TEST(BatchTest, timeoutIncludesParsing) {
+  // разбор и нормализация длинной формулы занимают больше 1 мс, и на поиск
+  // времени не остается
+  std::string text = "A0";
+  for (int i = 1; i < 20000; ++i)
+    text += " & A" + std::to_string(i);
+  ResolverLimits limits;
+  limits.timeout = std::chrono::milliseconds(1);
+
+  auto res = solveProblem({1, text + "; A0"}, limits);
+
+  EXPECT_TRUE(res.error.empty());
+  EXPECT_FALSE(res.proved);
+  EXPECT_EQ(res.stats.stop, ResolverStop::timeout);
+  EXPECT_NE(toJson(res).find("\"status\": \"timeout\""), std::string::npos);
+}
@@ -1,6 +1,8 @@
 #include "parser/expr.h"
 #include "parser/expr_parser.h"
 #include <gtest/gtest.h>
+#include <thread>
+#include <vector>
 
 using namespace std::string_literals;
 
@@ -234,3 +236,45 @@ TEST(ExprTests, toScolemForm) {
 
   EXPECT_EQ(ruleBefore, ruleAfter);
 }
+
+TEST(ExprTests, hashConsing) {
+  auto left = ExprParser().Parse("(A & P(x)) + ~(A & P(x))");
+  auto right = Expr::createConjunction(
+      Expr::createAtom("A"),
+      Expr::createPredicate("P", {Expr::createAtom("x")}));
+
+  EXPECT_EQ(Expr::createAtom("A").get(), Expr::createAtom("A").get());
+  EXPECT_EQ(left->getOperands()[0].get(), right.get());
+  EXPECT_EQ(left->getOperands()[0]->getHash(), right->getHash());
+  EXPECT_NE(left->getOperands()[1].get(), right.get());
+}
+
+TEST(ExprTests, deepRelease) {
+  // a formula is released without a recursion as deep as the formula
+  auto rule = Expr::createAtom("A");
+  for (int i = 0; i < 200000; ++i)
+    rule = Expr::createInverse(rule);
+  rule.reset();
+
+  auto atom = Expr::createAtom("A");
+  EXPECT_EQ(atom.get(), Expr::createAtom("A").get());
+}
+
+TEST(ExprTests, concurrentInterning) {
+  std::vector<std::thread> threads;
+  std::vector<Expr::ptr> rules(4);
+  for (size_t i = 0; i < rules.size(); ++i)
+    threads.emplace_back([&rules, i]() {
+      for (int round = 0; round < 200; ++round) {
+        auto rule = Expr::createAtom("A");
+        for (int j = 0; j < 100; ++j)
+          rule = Expr::createConjunction(
+              rule, Expr::createPredicate("P", {Expr::createAtom("x")}));
+        rules[i] = rule;
+      }
+    });
+  for (auto &thread : threads)
+    thread.join();
+  for (auto &rule : rules)
+    EXPECT_EQ(rule.get(), rules.front().get());
+}
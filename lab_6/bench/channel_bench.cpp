@@ -0,0 +1,100 @@
+#include "channel.h"
+#include "subst.h"
+#include "variable.h"
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+// микробенчмарк каналов: передача подстановок от писателей к читателям.
+//
+// Для каждого канала и числа писателей/читателей печатается среднее время
+// передачи одной подстановки и пропускная способность
+
+static constexpr size_t itemsCount = 20000;
+static constexpr size_t batchSize = 32;
+
+static Subst makeSubst(size_t i) {
+  Subst subst;
+  subst.insert("x", Variable::createFuncSym(
+                        "cons", {Variable::createConst(std::to_string(i % 16)),
+                                 Variable::createVariable("t")}));
+  return subst;
+}
+
+// передать itemsCount подстановок через канал; возвращает время в секундах
+template <typename Chan>
+static double run(Chan &chan, size_t producers, size_t consumers, bool batched) {
+  std::vector<Subst> items;
+  for (size_t i = 0; i < itemsCount / producers; ++i)
+    items.push_back(makeSubst(i));
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> writers, readers;
+  for (size_t p = 0; p < producers; ++p)
+    writers.emplace_back([&]() {
+      if constexpr (requires { chan.putMany(items); }) {
+        if (batched) {
+          for (size_t i = 0; i < items.size(); i += batchSize)
+            chan.putMany(std::vector<Subst>(
+                items.begin() + i,
+                items.begin() + std::min(items.size(), i + batchSize)));
+          return;
+        }
+      }
+      for (auto &item : items)
+        chan.put(item);
+    });
+  for (size_t c = 0; c < consumers; ++c)
+    readers.emplace_back([&]() {
+      if constexpr (requires { chan.getMany(batchSize); }) {
+        if (batched) {
+          while (!chan.getMany(batchSize).empty())
+            ;
+          return;
+        }
+      }
+      while (chan.get().second)
+        ;
+    });
+  for (auto &writer : writers)
+    writer.join();
+  chan.close();
+  for (auto &reader : readers)
+    reader.join();
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return elapsed.count();
+}
+
+static void report(const char *name, size_t producers, size_t consumers,
+                   const std::function<double()> &bench) {
+  double seconds = bench();
+  size_t items = itemsCount / producers * producers;
+  std::printf("%-22s %zuP/%zuC %10.1f ns/item %12.0f items/s\n", name,
+              producers, consumers, seconds * 1e9 / items, items / seconds);
+}
+
+int main() {
+  for (auto [producers, consumers] :
+       std::vector<std::pair<size_t, size_t>>{{1, 1}, {4, 4}}) {
+    report("Channel", producers, consumers, [&]() {
+      Channel<Subst> chan;
+      return run(chan, producers, consumers, false);
+    });
+    report("ChannelBuf(64)", producers, consumers, [&]() {
+      ChannelBuf<Subst> chan(64);
+      return run(chan, producers, consumers, false);
+    });
+    report("RingChannel(64)", producers, consumers, [&]() {
+      RingChannel<Subst> chan(64);
+      return run(chan, producers, consumers, false);
+    });
+    report("RingChannel(64) batch", producers, consumers, [&]() {
+      RingChannel<Subst> chan(64);
+      return run(chan, producers, consumers, true);
+    });
+  }
+  return 0;
+}
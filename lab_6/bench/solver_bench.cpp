@@ -0,0 +1,339 @@
+#include "atom_hook.h"
+#include "database.h"
+#include "mgraph_solver.h"
+#include "parser.h"
+#include "wam_solver.h"
+#include <atomic>
+#include <benchmark/benchmark.h>
+#include <dlfcn.h>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <pthread.h>
+#include <string>
+#include <system_error>
+#include <vector>
+
+// набор бенчмарков решателя на примерах баз правил и синтетических базах.
+//
+// Каждая итерация выполняет запрос до исчерпания решений. Для каждого
+// бенчмарка печатаются:
+//   solutions/s    - число решений в секунду;
+//   s/solution     - среднее время получения одного решения;
+//   peak_rss_kb    - пиковый объем резидентной памяти процесса;
+//   threads        - число потоков, созданных за одну итерацию.
+//
+// Результаты имеют смысл только для сборки с оптимизацией
+// (-DCMAKE_BUILD_TYPE=Release)
+
+namespace {
+
+std::atomic<size_t> threadsCreated = 0;
+
+} // namespace
+
+// подсчет созданных потоков: вызовы pthread_create из стандартной библиотеки
+// разрешаются в эту функцию, которая передает их настоящей реализации
+extern "C" int pthread_create(pthread_t *thread, const pthread_attr_t *attr,
+                              void *(*start)(void *), void *arg) {
+  using Create = int (*)(pthread_t *, const pthread_attr_t *,
+                         void *(*)(void *), void *);
+  static auto create =
+      reinterpret_cast<Create>(dlsym(RTLD_NEXT, "pthread_create"));
+  ++threadsCreated;
+  return create(thread, attr, start, arg);
+}
+
+namespace {
+
+// сбросить пиковый объем резидентной памяти процесса (Linux)
+void resetPeakRss() { std::ofstream("/proc/self/clear_refs") << "5"; }
+
+// пиковый объем резидентной памяти процесса в килобайтах
+double peakRssKb() {
+  std::ifstream status("/proc/self/status");
+  std::string line;
+  while (std::getline(status, line))
+    if (line.starts_with("VmHWM:"))
+      return std::stod(line.substr(6));
+  return 0;
+}
+
+std::map<std::string, std::shared_ptr<AtomHook>> buildPredefinedHooks() {
+  return {
+      {"write", std::make_shared<WriteHook>()},
+      {"add", std::make_shared<IntAddHook>()},
+      {"mul", std::make_shared<IntMulHook>()},
+      {"leq", std::make_shared<LeqHook>()},
+      {"in_range", std::make_shared<InRangeHook>()},
+  };
+}
+
+std::shared_ptr<Database> loadDatabase(const std::string &name) {
+  auto path = std::string(LAB6_SOURCE_DIR) + "/" + name;
+  return std::make_shared<Database>(path.c_str());
+}
+
+std::shared_ptr<Database> parseDatabase(const std::vector<std::string> &rules) {
+  auto database = std::make_shared<Database>();
+  for (auto &rule : rules)
+    database->addRule(RuleParser().ParseRule(rule.c_str()));
+  return database;
+}
+
+// база правил, в которой каждое правило записано в отдельной строке без
+// завершающей точки (как в pinguin.txt)
+std::shared_ptr<Database> loadLines(const std::string &name) {
+  std::ifstream file(std::string(LAB6_SOURCE_DIR) + "/" + name);
+  std::vector<std::string> rules;
+  std::string line;
+  while (std::getline(file, line))
+    if (!line.empty() && line[0] != '#')
+      rules.push_back(line);
+  return parseDatabase(rules);
+}
+
+// цепочка edge(N0, N1), ..., edge(Nn-1, Nn) и ее транзитивное замыкание
+std::shared_ptr<Database> chainDatabase(size_t n) {
+  std::vector<std::string> rules = {
+      "path(x, y) :- edge(x, y)",
+      "path(x, y) :- edge(x, z), path(z, y)",
+  };
+  for (size_t i = 0; i < n; ++i)
+    rules.push_back("edge(N" + std::to_string(i) + ", N" +
+                    std::to_string(i + 1) + ")");
+  return parseDatabase(rules);
+}
+
+// то же замыкание леворекурсивным табулируемым правилом
+std::shared_ptr<Database> tabledChainDatabase(size_t n) {
+  auto database = chainDatabase(n);
+  database->addRule(
+      RuleParser().ParseRule("left_path(x, z) :- left_path(x, y), edge(y, z)"));
+  database->addRule(RuleParser().ParseRule("left_path(x, y) :- edge(x, y)"));
+  database->setTabled("left_path", 2);
+  return database;
+}
+
+// наивное обращение списка - глубокая рекурсия
+std::shared_ptr<Database> nrevDatabase() {
+  return parseDatabase({
+      "app(Nil, x, x)",
+      "app(cons(h, t), y, cons(h, r)) :- app(t, y, r)",
+      "nrev(Nil, Nil)",
+      "nrev(cons(h, t), r) :- nrev(t, rt), app(rt, cons(h, Nil), r)",
+  });
+}
+
+std::string listTerm(size_t n) {
+  std::string res = "Nil";
+  for (size_t i = n; i-- > 0;)
+    res = "cons(E" + std::to_string(i) + ", " + res + ")";
+  return res;
+}
+
+// широкое ветвление: n * n решений из двух таблиц по n фактов
+std::shared_ptr<Database> fanOutDatabase(size_t n) {
+  std::vector<std::string> rules = {"pair(x, y) :- left(x), right(y)"};
+  for (size_t i = 0; i < n; ++i) {
+    rules.push_back("left(L" + std::to_string(i) + ")");
+    rules.push_back("right(R" + std::to_string(i) + ")");
+  }
+  return parseDatabase(rules);
+}
+
+// соединение большого отношения с маленьким: n заказов и 10 избранных
+// покупателей. Правило записано в неудачном порядке - большое отношение
+// первым
+std::shared_ptr<Database> joinDatabase(size_t n) {
+  std::vector<std::string> rules = {"flagged(x) :- order(x, p), vip(p)"};
+  for (size_t i = 0; i < n; ++i)
+    rules.push_back("order(O" + std::to_string(i) + ", P" + std::to_string(i) +
+                    ")");
+  for (size_t i = 0; i < 10; ++i)
+    rules.push_back("vip(P" + std::to_string(i * n / 10) + ")");
+  return parseDatabase(rules);
+}
+
+enum class Mode { Backward, OrParallel, Forward, Wam };
+
+// выполнить запрос до исчерпания решений, вернуть число решений
+size_t runQuery(const std::shared_ptr<Database> &database, const Atom &target,
+                Mode mode) {
+  if (mode == Mode::Wam) {
+    auto solver = std::make_shared<WamSolver>(database, buildPredefinedHooks());
+    solver->solveBackward(target);
+    size_t count = 0;
+    while (solver->next())
+      ++count;
+    solver->done();
+    return count;
+  }
+  auto solver =
+      std::make_shared<MGraphSolver>(database, buildPredefinedHooks());
+  if (mode == Mode::OrParallel)
+    solver->setOrParallel(MGraphSolver::OrParallel::Ordered);
+  if (mode == Mode::Forward)
+    solver->solveForward(target);
+  else
+    solver->solveBackward(target);
+  size_t count = 0;
+  while (solver->next())
+    ++count;
+  solver->done();
+  return count;
+}
+
+void runBenchmark(benchmark::State &state,
+                  const std::shared_ptr<Database> &database,
+                  const std::string &query, Mode mode) {
+  auto target = RuleParser().ParseRule(query.c_str()).getOutput();
+  resetPeakRss();
+  size_t solutions = 0;
+  size_t threads = threadsCreated;
+  for (auto _ : state)
+    solutions += runQuery(database, target, mode);
+  threads = threadsCreated - threads;
+  using benchmark::Counter;
+  state.counters["solutions/s"] = Counter(solutions, Counter::kIsRate);
+  state.counters["s/solution"] =
+      Counter(solutions, Counter::kIsRate | Counter::kInvert);
+  state.counters["peak_rss_kb"] = peakRssKb();
+  state.counters["threads"] = Counter(threads, Counter::kAvgIterations);
+}
+
+void registerQuery(const std::string &name,
+                   std::function<std::shared_ptr<Database>()> build,
+                   std::string query, std::vector<Mode> modes) {
+  // база правил строится один раз при первом запуске бенчмарка
+  auto database = std::make_shared<std::shared_ptr<Database>>();
+  for (auto mode : modes) {
+    const char *suffix = mode == Mode::Backward     ? "/backward"
+                         : mode == Mode::OrParallel ? "/or_parallel"
+                         : mode == Mode::Wam        ? "/wam"
+                                                    : "/forward";
+    benchmark::RegisterBenchmark(
+        (name + suffix).c_str(),
+        [=](benchmark::State &state) {
+          if (!*database)
+            *database = build();
+          runBenchmark(state, *database, query, mode);
+        })
+        ->Unit(benchmark::kMillisecond);
+  }
+}
+
+// временные файлы бенчмарков загрузки удаляются вместе с
+// зарегистрированными бенчмарками, которые их разделяют
+struct LoadFiles {
+  std::string text;
+  std::string snapshot;
+  bool prepared = false;
+
+  ~LoadFiles() {
+    std::error_code error;
+    std::filesystem::remove(text, error);
+    std::filesystem::remove(snapshot, error);
+  }
+};
+
+// загрузка базы из n фактов из текстового файла и из двоичного снимка.
+// Файлы создаются во временном каталоге при первом запуске бенчмарка
+void registerLoad(size_t n) {
+  auto dir = std::filesystem::temp_directory_path();
+  auto name = "lab6_load_" + std::to_string(n);
+  auto files = std::make_shared<LoadFiles>();
+  files->text = (dir / (name + ".txt")).string();
+  files->snapshot = (dir / (name + ".snap")).string();
+  auto prepare = [files, n]() {
+    if (files->prepared)
+      return;
+    files->prepared = true;
+    std::ofstream file(files->text);
+    for (size_t i = 0; i < n; ++i)
+      file << "edge(N" << i << ", N" << (i * 7 + 1) % n << ", \"w" << i % 10
+           << "\").\n";
+    file.close();
+    Database(files->text.c_str()).saveSnapshot(files->snapshot.c_str());
+  };
+  for (auto [suffix, path] : {std::pair{"/text", files->text},
+                              std::pair{"/snapshot", files->snapshot}})
+    benchmark::RegisterBenchmark(
+        ("load/" + std::to_string(n) + suffix).c_str(),
+        [=](benchmark::State &state) {
+          prepare();
+          for (auto _ : state)
+            benchmark::DoNotOptimize(Database(path.c_str()).rulesCount());
+          state.counters["facts/s"] = benchmark::Counter(
+              n * state.iterations(), benchmark::Counter::kIsRate);
+        })
+        ->Unit(benchmark::kMillisecond);
+}
+
+void registerAll() {
+  const std::vector<Mode> backward = {Mode::Backward, Mode::OrParallel,
+                                      Mode::Wam};
+  const std::vector<Mode> all = {Mode::Backward, Mode::OrParallel, Mode::Wam,
+                                 Mode::Forward};
+
+  // примеры баз правил
+  registerQuery(
+      "lists/reverse", []() { return loadDatabase("lists.txt"); },
+      "reverse(cons(A, cons(B, cons(C, cons(D, Nil)))), x)", backward);
+  registerQuery(
+      "lists/concat", []() { return loadDatabase("lists.txt"); },
+      "concat(x, y, cons(A, cons(B, cons(C, cons(D, Nil)))))", backward);
+  registerQuery(
+      "maze/way", []() { return loadDatabase("maze.txt"); }, "way(x, y)",
+      all);
+  registerQuery(
+      "nums/prime", []() { return loadDatabase("nums.txt"); }, "prime(97)",
+      backward);
+  registerQuery(
+      "pinguin/can_swim", []() { return loadLines("pinguin.txt"); },
+      "CanSwim(x)", all);
+  registerQuery(
+      "sudoku/solve", []() { return loadDatabase("sudoku.txt"); }, "solve",
+      backward);
+
+  // синтетические базы
+  for (size_t n : {50, 100, 200})
+    registerQuery(
+        "closure/" + std::to_string(n), [n]() { return chainDatabase(n); },
+        "path(N0, x)", all);
+  // машина WAM доказывает цели табулируемых баз решателем MGraphSolver
+  for (size_t n : {50, 100, 200})
+    registerQuery(
+        "tabled_closure/" + std::to_string(n),
+        [n]() { return tabledChainDatabase(n); }, "left_path(N0, x)", all);
+  for (size_t n : {30, 60, 120})
+    registerQuery(
+        "nrev/" + std::to_string(n), []() { return nrevDatabase(); },
+        "nrev(" + listTerm(n) + ", x)", backward);
+  for (size_t n : {30, 100})
+    registerQuery(
+        "fan_out/" + std::to_string(n), [n]() { return fanOutDatabase(n); },
+        "pair(x, y)", all);
+  for (size_t n : {1000, 10000})
+    registerQuery(
+        "join/" + std::to_string(n), [n]() { return joinDatabase(n); },
+        "flagged(x)", {Mode::Forward});
+  registerLoad(100000);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  registerAll();
+  benchmark::Initialize(&argc, argv);
+  if (benchmark::ReportUnrecognizedArguments(argc, argv))
+    return 1;
+  benchmark::RunSpecifiedBenchmarks();
+  // бенчмарки загрузки удаляют свои временные файлы
+  benchmark::ClearRegisteredBenchmarks();
+  benchmark::Shutdown();
+  return 0;
+}
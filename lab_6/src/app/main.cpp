@@ -2,9 +2,12 @@
 #include "database.h"
 #include "mgraph_solver.h"
 #include "parser.h"
+#include "snapshot.h"
+#include "wam_solver.h"
 #include <iostream>
 #include <memory>
 #include <optional>
+#include <string>
 #include <utility>
 
 // pre-defined atom hooks
@@ -18,6 +21,32 @@ std::map<std::string, std::shared_ptr<AtomHook>> buildPredefinedHooks() {
   };
 }
 
+void printRule(const Rule &rule) {
+  std::cout << ">> " << rule.toString() << std::endl;
+}
+
+int printUsage(const char *program) {
+  std::cerr << "usage: " << program
+            << " [--rete] [--or-parallel] [--ordered] [--wam] [database]\n"
+            << "       " << program << " --snapshot database.txt database.snap"
+            << std::endl;
+  return -1;
+}
+
+// режим преобразования текстовой базы в двоичный снимок
+int convertToSnapshot(const char *source, const char *snapshot) {
+  try {
+    Database database(source);
+    database.saveSnapshot(snapshot);
+    std::cout << database.rulesCount() << " rules saved to " << snapshot
+              << std::endl;
+  } catch (std::exception &err) {
+    std::cerr << "error: " << err.what() << std::endl;
+    return -1;
+  }
+  return 0;
+}
+
 std::pair<std::optional<Atom>, bool> inputTarget(bool &run,
                                                  Database &database) {
   std::cout << "?- ";
@@ -27,10 +56,26 @@ std::pair<std::optional<Atom>, bool> inputTarget(bool &run,
     return std::make_pair(std::nullopt, false);
   }
   if (!line.empty() && line[0] == '+') {
-    // insert mode - add new rule to database
+    // insert mode - add new rule or directive to database
+    try {
+      if (line.starts_with("+:-"))
+        database.addDirective(RuleParser().ParseDirective(line.c_str() + 1));
+      else
+        printRule(database.addRule(RuleParser().ParseRule(line.c_str() + 1)));
+    } catch (std::exception &err) {
+      std::cerr << "parse error: " << err.what() << std::endl;
+      return std::make_pair(std::nullopt, false);
+    }
+    return inputTarget(run, database);
+  }
+  if (!line.empty() && line[0] == '-') {
+    // remove mode - remove fact from database
     try {
       auto rule = RuleParser().ParseRule(line.c_str() + 1);
-      database.addRule(rule);
+      if (!rule.isFact())
+        std::cerr << "fact expected, got rule" << std::endl;
+      else if (!database.removeFact(rule.getOutput()))
+        std::cerr << "no such fact: " << rule.toString() << std::endl;
     } catch (std::exception &err) {
       std::cerr << "parse error: " << err.what() << std::endl;
       return std::make_pair(std::nullopt, false);
@@ -53,13 +98,53 @@ std::pair<std::optional<Atom>, bool> inputTarget(bool &run,
 }
 
 int main(int argc, char **argv) {
-  auto database = std::make_shared<Database>();
-  if (argc == 2)
-    database = std::make_shared<Database>(argv[1]);
-  else if (argc != 1) {
-    std::cout << "usage: " << argv[0] << " [database.txt]" << std::endl;
-    return -1;
+  // флаг --rete включает инкрементальный прямой вывод, флаг --or-parallel -
+  // ИЛИ-параллельный обратный вывод, --ordered - ИЛИ-параллельный обратный
+  // вывод с сохранением порядка решений, а --wam - обратный вывод на
+  // абстрактной машине Уоррена. Флаг --snapshot преобразует текстовую базу в
+  // двоичный снимок, который загружается вместо нее без разбора текста
+  bool rete = false;
+  bool wam = false;
+  bool snapshot = false;
+  auto orParallel = MGraphSolver::OrParallel::Off;
+  const char *program = argv[0];
+  for (; argc > 1 && std::string(argv[1]).starts_with("--"); argc--, argv++) {
+    std::string flag = argv[1];
+    if (flag == "--rete")
+      rete = true;
+    else if (flag == "--wam")
+      wam = true;
+    else if (flag == "--snapshot")
+      snapshot = true;
+    else if (flag == "--or-parallel" &&
+             orParallel == MGraphSolver::OrParallel::Off)
+      orParallel = MGraphSolver::OrParallel::Unordered;
+    else if (flag == "--ordered")
+      orParallel = MGraphSolver::OrParallel::Ordered;
+    else if (flag != "--or-parallel") {
+      std::cerr << "unknown flag " << flag << std::endl;
+      return printUsage(program);
+    }
   }
+  if (snapshot && argc == 3)
+    return convertToSnapshot(argv[1], argv[2]);
+  auto database = std::make_shared<Database>();
+  if (argc == 2 && !snapshot) {
+    try {
+      database = std::make_shared<Database>(argv[1]);
+    } catch (std::exception &err) {
+      // файл базы не удалось отобразить в память (например, это каталог)
+      std::cerr << "error: " << err.what() << std::endl;
+      return -1;
+    }
+    // правила снимка не выводятся, чтобы загрузка больших баз была быстрой
+    if (!SnapshotReader::isSnapshot(argv[1]))
+      for (auto &rule : database->getRules())
+        printRule(rule);
+  } else if (argc != 1 || snapshot)
+    return printUsage(program);
+  if (rete)
+    database->enableRete();
 
   // start repl
   bool run = true;
@@ -67,8 +152,15 @@ int main(int argc, char **argv) {
     auto [target, forward] = inputTarget(run, *database);
     if (!target)
       continue;
-    auto solver =
-        std::make_shared<MGraphSolver>(database, buildPredefinedHooks());
+    std::shared_ptr<Solver> solver;
+    if (wam && !forward) {
+      solver = std::make_shared<WamSolver>(database, buildPredefinedHooks());
+    } else {
+      auto mgraph =
+          std::make_shared<MGraphSolver>(database, buildPredefinedHooks());
+      mgraph->setOrParallel(orParallel);
+      solver = mgraph;
+    }
     if (forward)
       solver->solveForward(*target);
     else
@@ -2,12 +2,25 @@
 #include "variable.h"
 
 Atom::Atom(std::string name, std::vector<Variable::ptr> arguments)
-    : m_name(std::move(name)), m_arguments(std::move(arguments)) {}
+    : m_name(name), m_arguments(std::move(arguments)) {}
 
-Atom Atom::renamedVars(NameAllocator &allocator) const {
+Atom::Atom(Symbol name, std::vector<Variable::ptr> arguments)
+    : m_name(name), m_arguments(std::move(arguments)) {}
+
+Atom Atom::numberedVars(
+    std::unordered_map<Symbol, Symbol::id_type> &numbers) const {
   std::vector<Variable::ptr> args;
-  for (auto arg : m_arguments)
-    args.push_back(arg->renamedVars(allocator));
+  args.reserve(m_arguments.size());
+  for (auto &arg : m_arguments)
+    args.push_back(arg->numberedVars(numbers));
+  return Atom(m_name, std::move(args));
+}
+
+Atom Atom::shiftedVars(Symbol::id_type offset) const {
+  std::vector<Variable::ptr> args;
+  args.reserve(m_arguments.size());
+  for (auto &arg : m_arguments)
+    args.push_back(arg->shiftedVars(offset));
   return Atom(m_name, std::move(args));
 }
 
@@ -18,8 +31,26 @@ std::set<std::string> Atom::getAllVars() const {
   return vars;
 }
 
+size_t Atom::hash() const {
+  size_t res = std::hash<Symbol>()(m_name);
+  for (auto &arg : m_arguments)
+    res = res * 1000003 ^ arg->hash();
+  return res;
+}
+
+bool Atom::operator==(const Atom &other) const {
+  if (m_name != other.m_name ||
+      m_arguments.size() != other.m_arguments.size())
+    return false;
+  for (size_t i = 0; i < m_arguments.size(); ++i)
+    if (m_arguments[i] != other.m_arguments[i] &&
+        !m_arguments[i]->equals(*other.m_arguments[i]))
+      return false;
+  return true;
+}
+
 std::string Atom::toString() const {
-  std::string res = m_name;
+  std::string res = m_name.str();
   if (!m_arguments.empty()) {
     res += '(';
     bool first = true;
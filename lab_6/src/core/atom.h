@@ -4,27 +4,32 @@
 #include "variable.h"
 #include <set>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 class Atom {
 public:
   Atom(std::string name = "?", std::vector<Variable::ptr> arguments = {});
+  Atom(Symbol name, std::vector<Variable::ptr> arguments);
 
-  const std::string &getName() const { return m_name; }
+  const std::string &getName() const { return m_name.str(); }
+  Symbol getSymbol() const { return m_name; }
   const std::vector<Variable::ptr> &getArguments() const { return m_arguments; }
 
-  // возвращает новый атом с переименованными переменными
-  Atom renamedVars(NameAllocator &allocator) const;
+  // атом с пронумерованными переменными (см. Variable::numberedVars)
+  Atom numberedVars(std::unordered_map<Symbol, Symbol::id_type> &numbers) const;
+  // атом со сдвинутыми номерами переменных (см. Variable::shiftedVars)
+  Atom shiftedVars(Symbol::id_type offset) const;
   std::set<std::string> getAllVars() const;
 
   std::string toString() const;
 
-  inline bool operator==(const Atom &other) const {
-    return m_name == other.m_name && m_arguments == other.m_arguments;
-  }
+  // структурные хеш и равенство атомов
+  size_t hash() const;
+  bool operator==(const Atom &other) const;
 
 private:
-  std::string m_name;
+  Symbol m_name;
   std::vector<Variable::ptr> m_arguments;
 };
 
@@ -1,6 +1,6 @@
 #pragma once
 
-#include "channel.h"
+#include "generator.h"
 #include "solver.h"
 #include "subst.h"
 #include "variable.h"
@@ -8,6 +8,7 @@
 #include <functional>
 #include <iostream>
 #include <memory>
+#include <mutex>
 #include <sstream>
 #include <string>
 
@@ -21,22 +22,10 @@ public:
 
   const char *getName() const { return m_name; }
 
-  // Метод доказательства специальной процедуры в отдельном потоке
-  TaskChanPair<Subst> prove(std::vector<Variable::ptr> args, Subst subst) {
-    auto output = std::make_shared<Channel<Subst>>();
-    std::jthread worker(
-        [this, args = std::move(args), subst = std::move(subst), output]() {
-          proveThreaded(std::move(args), std::move(subst), output);
-          output->close();
-        });
-    return std::make_pair(std::move(worker), output);
-  }
-
-protected:
-  // виртуальный метод доказательства специальной процедуры, реализуемый в
-  // классах-наследниках
-  virtual void proveThreaded(std::vector<Variable::ptr> args, Subst subst,
-                             std::shared_ptr<Channel<Subst>> output) = 0;
+  // Метод доказательства специальной процедуры. Возвращает генератор
+  // подстановок, реализуемый в классах-наследниках в виде сопрограммы
+  virtual Generator<Subst> prove(std::vector<Variable::ptr> args,
+                                 Subst subst) = 0;
 
 private:
   const char *m_name; // имя специальной процедуры
@@ -44,14 +33,15 @@ private:
 
 // класс обработчика процедуры write(...).
 //
-// Выводит на экран значения переменных и генерирует одну подстановку
+// Выводит на экран значения переменных и генерирует одну подстановку. При
+// ИЛИ-параллельном поиске процедура вызывается из потоков пула, поэтому строки
+// выводятся под общим мьютексом и не перемешиваются
 class WriteHook : public AtomHook {
 public:
   WriteHook() : AtomHook("write") {}
 
-protected:
-  virtual void proveThreaded(std::vector<Variable::ptr> args, Subst subst,
-                             std::shared_ptr<Channel<Subst>> output) override {
+  virtual Generator<Subst> prove(std::vector<Variable::ptr> args,
+                                 Subst subst) override {
     bool first = true;
     std::stringstream s;
     for (auto &arg : args) {
@@ -60,9 +50,18 @@ protected:
       first = false;
       s << arg->toString();
     }
-    s << std::endl;
-    std::cout << s.str();
-    output->put(subst);
+    s << '\n';
+    {
+      std::lock_guard lock(outputMutex());
+      std::cout << s.str() << std::flush;
+    }
+    co_yield subst;
+  }
+
+private:
+  static std::mutex &outputMutex() {
+    static std::mutex mutex;
+    return mutex;
   }
 };
 
@@ -80,29 +79,28 @@ public:
       : AtomHook(name), m_op(opRes), m_opInvFirst(opInvFirst),
         m_opInvSecond(opInvSecond) {}
 
-protected:
-  virtual void proveThreaded(std::vector<Variable::ptr> args, Subst subst,
-                             std::shared_ptr<Channel<Subst>> output) override {
+  virtual Generator<Subst> prove(std::vector<Variable::ptr> args,
+                                 Subst subst) override {
     // there must be exactly 3 arguments
     if (args.size() != 3)
-      return;
+      co_return;
     // two of three arguments must be bound to a constant
     int numBound = int(args[0]->isConst()) + int(args[1]->isConst()) +
                    int(args[2]->isConst());
     if (numBound < 2)
-      return;
+      co_return;
     try {
       if (numBound == 3) {
         if (verifyResult(args[0], args[1], args[2]))
-          output->put(std::move(subst));
-        return;
+          co_yield std::move(subst);
+        co_return;
       } else if (args[2]->isVariable()) // if result is not bound - compute it
         computeResult(args[0], args[1], args[2], subst);
       else if (args[0]->isVariable()) // if first arg is not bound - compute it
         computeFirstInput(args[0], args[1], args[2], subst);
       else // if second args is not bound - compute it
         computeSecondInput(args[0], args[1], args[2], subst);
-      output->put(std::move(subst));
+      co_yield std::move(subst);
     } catch (std::exception &err) {
       std::cerr << getName() << ": " << err.what() << std::endl;
     }
@@ -171,22 +169,21 @@ class LeqHook : public AtomHook {
 public:
   LeqHook() : AtomHook("leq") {}
 
-protected:
-  virtual void proveThreaded(std::vector<Variable::ptr> args, Subst subst,
-                             std::shared_ptr<Channel<Subst>> output) override {
+  virtual Generator<Subst> prove(std::vector<Variable::ptr> args,
+                                 Subst subst) override {
     // there must be exactly 2 arguments
     if (args.size() != 2)
-      return;
+      co_return;
     // both arguments must be bound to a constant value (we do not support
     // constraint programming for now)
     if (!args[0]->isConst() || !args[1]->isConst())
-      return;
+      co_return;
     // both constants must be numerical values
     try {
       int left = std::stoi(args[0]->getValue());
       int right = std::stoi(args[1]->getValue());
       if (left <= right)
-        output->put(subst);
+        co_yield subst;
     } catch (...) {
     }
   }
@@ -200,42 +197,38 @@ class InRangeHook : public AtomHook {
 public:
   InRangeHook() : AtomHook("in_range") {}
 
-protected:
-  virtual void proveThreaded(std::vector<Variable::ptr> args, Subst subst,
-                             std::shared_ptr<Channel<Subst>> output) override {
+  virtual Generator<Subst> prove(std::vector<Variable::ptr> args,
+                                 Subst subst) override {
     // there must be exactly 3 arguments
     if (args.size() != 3)
-      return;
+      co_return;
     // second and third arguments must be bound to constant value
     if (!args[1]->isConst() || !args[2]->isConst())
-      return;
+      co_return;
     // second and third arguments must be numerical values
     try {
       int start = std::stoi(args[1]->getValue());
       int end = std::stoi(args[2]->getValue());
-      doRange(start, end, std::move(args[0]), std::move(subst),
-              std::move(output));
+      auto range = doRange(start, end, std::move(args[0]), std::move(subst));
+      while (auto newSubst = range.next())
+        co_yield std::move(*newSubst);
     } catch (...) {
     }
   }
 
 private:
-  void doRange(int start, int end, Variable::ptr var, Subst subst,
-               std::shared_ptr<Channel<Subst>> output) {
+  Generator<Subst> doRange(int start, int end, Variable::ptr var,
+                           Subst subst) {
     if (var->isConst()) {
-      try {
-        int value = std::stoi(var->getValue());
-        if (start <= value && value < end)
-          output->put(std::move(subst));
-      } catch (...) {
-      }
+      int value = std::stoi(var->getValue());
+      if (start <= value && value < end)
+        co_yield std::move(subst);
     } else if (var->isVariable()) {
       for (int value = start; value < end; ++value) {
         Subst newSubst = subst;
         newSubst.insert(var->getValue(),
                         Variable::createConst(std::to_string(value)));
-        if (!output->put(std::move(newSubst)))
-          break;
+        co_yield std::move(newSubst);
       }
     }
   }
@@ -1,9 +1,15 @@
 #pragma once
 
+#include <atomic>
 #include <condition_variable>
+#include <cstddef>
 #include <deque>
+#include <memory>
 #include <mutex>
+#include <optional>
 #include <stdexcept>
+#include <thread>
+#include <vector>
 
 // класс представляющий буферизированный канал. Не используется в данной работе.
 template <typename T> class ChannelBuf {
@@ -120,3 +126,289 @@ private:
   std::mutex m_mutex;
   std::condition_variable m_cond;
 };
+
+// класс буферизированного канала без блокировок на кольцевом буфере.
+//
+// Канал допускает несколько писателей и несколько читателей (MPMC). Каждая
+// ячейка буфера хранит счетчик последовательности, по которому писатель и
+// читатель определяют, свободна ли ячейка или заполнена (очередь Вьюкова).
+// Позиции записи и чтения захватываются атомарным сравнением с обменом,
+// поэтому при непустом и неполном буфере запись и чтение не блокируются.
+//
+// Поток, которому не удалось записать или прочитать значение, сначала
+// повторяет попытку в цикле ожидания, а затем засыпает на атомарном счетчике
+// событий (std::atomic::wait) до очередного чтения, записи или закрытия.
+//
+// Семантика закрытия совпадает с ChannelBuf: запись в закрытый канал
+// неуспешна, а чтение возвращает оставшиеся в буфере значения и лишь затем
+// сообщает о закрытии
+template <typename T> class RingChannel {
+public:
+  // емкость округляется вверх до степени двойки
+  RingChannel(size_t capacity = 64) {
+    if (capacity == 0)
+      throw std::runtime_error("zero capacity for buffered channel");
+    size_t size = 1;
+    while (size < capacity)
+      size *= 2;
+    m_mask = size - 1;
+    m_cells = std::make_unique<Cell[]>(size);
+    for (size_t i = 0; i < size; ++i)
+      m_cells[i].sequence.store(i, std::memory_order_relaxed);
+  }
+
+  ~RingChannel() { close(); }
+
+  bool isClosed() const { return m_closed.load(std::memory_order_acquire); }
+
+  void close() {
+    m_closed.store(true, std::memory_order_seq_cst);
+    signal(m_putEvents, m_putWaiters, true);
+    signal(m_getEvents, m_getWaiters, true);
+  }
+
+  size_t getCapacity() const { return m_mask + 1; }
+
+  std::pair<T, bool> get() {
+    while (true) {
+      auto seen = m_putEvents.load();
+      if (auto object = tryGet())
+        return {std::move(*object), true};
+      if (isClosed()) {
+        // значение могло быть записано до закрытия
+        if (auto object = tryGet())
+          return {std::move(*object), true};
+        return {T(), false};
+      }
+      if (!spinFor([this]() { return !empty() || isClosed(); }))
+        park(m_putEvents, m_getWaiters, seen);
+    }
+  }
+
+  bool put(T object) {
+    while (true) {
+      if (isClosed())
+        return false;
+      auto seen = m_getEvents.load();
+      if (tryPut(object))
+        return true;
+      if (!spinFor([this]() { return !full() || isClosed(); }))
+        park(m_getEvents, m_putWaiters, seen);
+    }
+  }
+
+  // записать все значения по порядку. Возвращает число записанных значений,
+  // которое меньше размера пачки, только если канал был закрыт.
+  //
+  // Свободные ячейки подряд захватываются одним сравнением с обменом позиции
+  // записи, а читатели будятся один раз на захваченную часть пачки
+  size_t putMany(std::vector<T> objects) {
+    size_t count = 0;
+    while (count < objects.size()) {
+      if (isClosed())
+        break;
+      auto seen = m_getEvents.load();
+      if (size_t written = tryPutMany(objects, count)) {
+        count += written;
+        continue;
+      }
+      if (!spinFor([this]() { return !full() || isClosed(); }))
+        park(m_getEvents, m_putWaiters, seen);
+    }
+    return count;
+  }
+
+  // прочитать от одного до maxCount значений. Блокируется до появления хотя бы
+  // одного значения; пустая пачка означает, что канал закрыт и пуст.
+  // Заполненные ячейки подряд захватываются одним сравнением с обменом
+  // позиции чтения
+  std::vector<T> getMany(size_t maxCount) {
+    std::vector<T> objects;
+    if (maxCount == 0)
+      return objects;
+    while (true) {
+      auto seen = m_putEvents.load();
+      if (tryGetMany(objects, maxCount) > 0)
+        return objects;
+      if (isClosed()) {
+        // значения могли быть записаны до закрытия
+        tryGetMany(objects, maxCount);
+        return objects;
+      }
+      if (!spinFor([this]() { return !empty() || isClosed(); }))
+        park(m_putEvents, m_getWaiters, seen);
+    }
+  }
+
+  // неблокирующая запись. При неуспехе значение не перемещается
+  bool tryPut(T &object) {
+    size_t pos = m_putPos.load(std::memory_order_relaxed);
+    while (true) {
+      auto &cell = m_cells[pos & m_mask];
+      size_t sequence = cell.sequence.load(std::memory_order_acquire);
+      auto diff = static_cast<std::ptrdiff_t>(sequence - pos);
+      if (diff == 0) {
+        if (m_putPos.compare_exchange_weak(pos, pos + 1,
+                                           std::memory_order_relaxed)) {
+          cell.value = std::move(object);
+          cell.sequence.store(pos + 1, std::memory_order_release);
+          signal(m_putEvents, m_getWaiters);
+          return true;
+        }
+      } else if (diff < 0)
+        return false; // буфер заполнен
+      else
+        pos = m_putPos.load(std::memory_order_relaxed);
+    }
+  }
+
+  // неблокирующее чтение
+  std::optional<T> tryGet() {
+    size_t pos = m_getPos.load(std::memory_order_relaxed);
+    while (true) {
+      auto &cell = m_cells[pos & m_mask];
+      size_t sequence = cell.sequence.load(std::memory_order_acquire);
+      auto diff = static_cast<std::ptrdiff_t>(sequence - (pos + 1));
+      if (diff == 0) {
+        if (m_getPos.compare_exchange_weak(pos, pos + 1,
+                                           std::memory_order_relaxed)) {
+          std::optional<T> object = std::move(cell.value);
+          cell.value.reset();
+          cell.sequence.store(pos + m_mask + 1, std::memory_order_release);
+          signal(m_getEvents, m_putWaiters);
+          return object;
+        }
+      } else if (diff < 0)
+        return std::nullopt; // буфер пуст
+      else
+        pos = m_getPos.load(std::memory_order_relaxed);
+    }
+  }
+
+private:
+  // неблокирующая запись значений objects, начиная с from, в свободные
+  // ячейки, идущие подряд от позиции записи. Возвращает число записанных
+  // значений. Ячейка позиции pos + i свободна, если ее счетчик равен pos + i.
+  // Изменить его может только писатель, захвативший эту позицию, поэтому
+  // проверенные ячейки остаются свободными до сравнения с обменом
+  size_t tryPutMany(std::vector<T> &objects, size_t from) {
+    size_t pos = m_putPos.load(std::memory_order_relaxed);
+    while (true) {
+      size_t count = 0;
+      while (from + count < objects.size() &&
+             m_cells[(pos + count) & m_mask].sequence.load(
+                 std::memory_order_acquire) == pos + count)
+        ++count;
+      if (count == 0) {
+        size_t sequence =
+            m_cells[pos & m_mask].sequence.load(std::memory_order_acquire);
+        if (static_cast<std::ptrdiff_t>(sequence - pos) < 0)
+          return 0; // буфер заполнен
+        pos = m_putPos.load(std::memory_order_relaxed);
+        continue;
+      }
+      if (!m_putPos.compare_exchange_weak(pos, pos + count,
+                                          std::memory_order_relaxed))
+        continue;
+      for (size_t i = 0; i < count; ++i) {
+        auto &cell = m_cells[(pos + i) & m_mask];
+        cell.value = std::move(objects[from + i]);
+        cell.sequence.store(pos + i + 1, std::memory_order_release);
+      }
+      signal(m_putEvents, m_getWaiters);
+      return count;
+    }
+  }
+
+  // неблокирующее чтение заполненных ячеек, идущих подряд от позиции чтения,
+  // в конец objects, пока их не станет maxCount. Возвращает число
+  // прочитанных значений
+  size_t tryGetMany(std::vector<T> &objects, size_t maxCount) {
+    size_t pos = m_getPos.load(std::memory_order_relaxed);
+    while (objects.size() < maxCount) {
+      size_t count = 0;
+      while (objects.size() + count < maxCount &&
+             m_cells[(pos + count) & m_mask].sequence.load(
+                 std::memory_order_acquire) == pos + count + 1)
+        ++count;
+      if (count == 0) {
+        size_t sequence =
+            m_cells[pos & m_mask].sequence.load(std::memory_order_acquire);
+        if (static_cast<std::ptrdiff_t>(sequence - (pos + 1)) < 0)
+          return 0; // буфер пуст
+        pos = m_getPos.load(std::memory_order_relaxed);
+        continue;
+      }
+      if (!m_getPos.compare_exchange_weak(pos, pos + count,
+                                          std::memory_order_relaxed))
+        continue;
+      for (size_t i = 0; i < count; ++i) {
+        auto &cell = m_cells[(pos + i) & m_mask];
+        objects.push_back(std::move(*cell.value));
+        cell.value.reset();
+        cell.sequence.store(pos + i + m_mask + 1, std::memory_order_release);
+      }
+      signal(m_getEvents, m_putWaiters);
+      return count;
+    }
+    return 0;
+  }
+
+  struct Cell {
+    std::atomic<size_t> sequence;
+    std::optional<T> value;
+  };
+
+  static constexpr int spinCount = 64;
+
+  bool empty() const {
+    return m_getPos.load(std::memory_order_relaxed) >=
+           m_putPos.load(std::memory_order_relaxed);
+  }
+
+  bool full() const {
+    return m_putPos.load(std::memory_order_relaxed) -
+               m_getPos.load(std::memory_order_relaxed) >
+           m_mask;
+  }
+
+  // короткое активное ожидание условия перед засыпанием
+  template <typename Pred> static bool spinFor(Pred pred) {
+    for (int i = 0; i < spinCount; ++i) {
+      if (pred())
+        return true;
+      std::this_thread::yield();
+    }
+    return false;
+  }
+
+  // засыпание до изменения счетчика событий. Число ожидающих увеличивается до
+  // повторной проверки счетчика, поэтому сигнал не может быть потерян
+  static void park(std::atomic<unsigned> &events, std::atomic<int> &waiters,
+                   unsigned seen) {
+    waiters.fetch_add(1);
+    if (events.load() == seen)
+      events.wait(seen);
+    waiters.fetch_sub(1);
+  }
+
+  // системный вызов пробуждения делается, только если есть ожидающие
+  static void signal(std::atomic<unsigned> &events, std::atomic<int> &waiters,
+                     bool force = false) {
+    events.fetch_add(1);
+    if (force || waiters.load() > 0)
+      events.notify_all();
+  }
+
+  size_t m_mask;
+  std::unique_ptr<Cell[]> m_cells;
+  // позиции записи и чтения на разных строках кэша
+  alignas(64) std::atomic<size_t> m_putPos = 0;
+  alignas(64) std::atomic<size_t> m_getPos = 0;
+  alignas(64) std::atomic<bool> m_closed = false;
+  // счетчики записей и чтений, на которых засыпают ожидающие потоки
+  std::atomic<unsigned> m_putEvents = 0;
+  std::atomic<unsigned> m_getEvents = 0;
+  std::atomic<int> m_getWaiters = 0; // читатели, ждущие записи
+  std::atomic<int> m_putWaiters = 0; // писатели, ждущие чтения
+};
@@ -0,0 +1,127 @@
+#pragma once
+
+#include "atom.h"
+#include "variable.h"
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// класс индекса предложений по предикату и первому аргументу (аналог
+// индексации по первому аргументу в WAM).
+//
+// Предложения группируются по имени и арности предиката заголовка, а внутри
+// группы - по главному функтору или константе первого аргумента. Предложения,
+// первый аргумент которых является переменной, попадают во все группы, поэтому
+// результат поиска всегда сохраняет порядок добавления предложений
+template <typename T> class ClauseIndex {
+public:
+  // ключ из номера символа и арности
+  using Key = std::uint64_t;
+
+  // добавить предложение с заданным заголовком в конец индекса
+  void insert(const Atom &head, const T *item) {
+    auto &pred = m_predicates[predicateKey(head)];
+    pred.all.push_back(item);
+    auto key = firstArgKey(head);
+    if (!key) {
+      // первый аргумент - переменная: предложение подходит для любого ключа
+      pred.wildcard.push_back(item);
+      for (auto &[_, bucket] : pred.byFirstArg)
+        bucket.push_back(item);
+      return;
+    }
+    // новая группа начинается со всех ранее добавленных предложений с
+    // переменной первым аргументом
+    auto iter = pred.byFirstArg.try_emplace(*key, pred.wildcard).first;
+    iter->second.push_back(item);
+  }
+
+  // получить предложения, заголовок которых может быть унифицирован с целью
+  const std::vector<const T *> &lookup(const Atom &target) const {
+    return lookup(predicateKey(target), firstArgKey(target));
+  }
+
+  // получить предложения предиката с ключом predicate, первый аргумент
+  // которых может быть унифицирован с термом с ключом firstArg (std::nullopt
+  // для переменной)
+  const std::vector<const T *> &lookup(Key predicate,
+                                       std::optional<Key> firstArg) const {
+    auto predIter = m_predicates.find(predicate);
+    if (predIter == m_predicates.end())
+      return m_empty;
+    const auto &pred = predIter->second;
+    if (!firstArg)
+      return pred.all;
+    auto bucketIter = pred.byFirstArg.find(*firstArg);
+    return bucketIter == pred.byFirstArg.end() ? pred.wildcard
+                                               : bucketIter->second;
+  }
+
+  // удалить предложение с заданным заголовком из индекса
+  void erase(const Atom &head, const T *item) {
+    auto predIter = m_predicates.find(predicateKey(head));
+    if (predIter == m_predicates.end())
+      return;
+    auto &pred = predIter->second;
+    std::erase(pred.all, item);
+    std::erase(pred.wildcard, item);
+    for (auto &[_, bucket] : pred.byFirstArg)
+      std::erase(bucket, item);
+  }
+
+  void clear() { m_predicates.clear(); }
+
+  // ключ предиката name/arity
+  static Key predicateKey(const Atom &atom) {
+    return predicateKey(atom.getSymbol(), atom.getArguments().size());
+  }
+  static Key predicateKey(Symbol symbol, size_t arity) {
+    return makeKey(symbol, arity);
+  }
+
+  // ключ первого аргумента. Для переменной (и для атома без аргументов)
+  // ключа нет
+  static std::optional<Key> firstArgKey(const Atom &atom) {
+    if (atom.getArguments().empty())
+      return std::nullopt;
+    return argKey(*atom.getArguments().front());
+  }
+
+  // ключ терма - аргумента (для переменной ключа нет)
+  static std::optional<Key> argKey(const Variable &arg) {
+    if (arg.isVariable())
+      return std::nullopt;
+    if (arg.isFuncSym())
+      return functorKey(arg.getSymbol(), arg.getArguments().size());
+    return constantKey(arg.getSymbol(), arg.isQuoted());
+  }
+
+  // ключи аргумента - функционального символа и константы
+  static Key functorKey(Symbol symbol, size_t arity) {
+    return makeKey(symbol, arity);
+  }
+  static Key constantKey(Symbol symbol, bool quoted) {
+    // строки в кавычках не должны совпадать с одноименными константами
+    return makeKey(symbol, quoted ? quotedTag : 0);
+  }
+
+private:
+  // арность функциональных символов не меньше 1, поэтому значения 0 и
+  // quotedTag однозначно обозначают константу и строку
+  static constexpr Key quotedTag = 0xffffffff;
+
+  static Key makeKey(Symbol symbol, Key tag) {
+    return static_cast<Key>(symbol.id()) << 32 | tag;
+  }
+
+  struct Predicate {
+    std::vector<const T *> all;      // все предложения предиката
+    std::vector<const T *> wildcard; // предложения с переменной первым аргументом
+    std::unordered_map<Key, std::vector<const T *>> byFirstArg;
+  };
+
+  std::unordered_map<Key, Predicate> m_predicates;
+  std::vector<const T *> m_empty;
+};
@@ -1,12 +1,14 @@
 #include "database.h"
 #include "name_allocator.h"
 #include "parser.h"
+#include "snapshot.h"
 #include "variable.h"
 #include <algorithm>
 #include <cmath>
 #include <fstream>
 #include <iostream>
 #include <iterator>
+#include <stdexcept>
 
 Database::Database(const char *filename) {
   if (filename == nullptr)
@@ -16,25 +18,30 @@ Database::Database(const char *filename) {
     std::cerr << "warning: failed to open database " << filename << std::endl;
     return;
   }
-  int lineNumber = 0;
-  std::string line, ruleStr;
-  while (std::getline(file, line)) {
-    lineNumber++;
-    // пропустить пустые строки и комментарии, начинающиеся с символа '#'
-    if (line.empty() || line[0] == '#')
-      continue;
-    ruleStr += line;
-    if (line[line.size() - 1] != '.')
-      continue;
+  if (SnapshotReader::isSnapshot(filename)) {
     try {
-      auto rule = RuleParser().ParseRule(ruleStr.c_str());
-      ruleStr = "";
-      addRule(rule);
-    } catch (std::exception &errRule) {
-      std::cerr << filename << ":" << lineNumber
-                << ": parse error: " << errRule.what() << std::endl;
+      loadSnapshot(filename);
+    } catch (std::exception &err) {
+      std::cerr << filename << ": " << err.what() << std::endl;
     }
+    return;
   }
+  // предложения разбираются параллельно, а добавляются в базу в порядке
+  // файла, поэтому переименование переменных не зависит от разбиения файла
+  RuleFileParser(filename).parse([&](RuleFileParser::Clause &clause) {
+    auto error = std::move(clause.error);
+    try {
+      if (clause.directive)
+        addDirective(*clause.directive);
+      else if (clause.rule)
+        addRule(*clause.rule);
+    } catch (std::exception &errRule) {
+      error = errRule.what();
+    }
+    if (!error.empty())
+      std::cerr << filename << ":" << clause.line
+                << ": parse error: " << error << std::endl;
+  });
 }
 
 size_t Database::rulesCount() const { return m_rules.size(); }
@@ -53,21 +60,132 @@ const Rule &Database::addRule(const Rule &rule) {
     inputs[i] = renameVars(inputs[i]);
   auto output = renameVars(rule.getOutput());
   m_allocator.commit();
-  auto newRule = Rule(std::move(inputs), std::move(output));
-  std::cout << ">> " << newRule.toString() << std::endl;
-  m_rules.push_back(std::move(newRule));
+  return insertRule(Rule(std::move(inputs), std::move(output)));
+}
+
+const Rule &Database::insertRule(Rule rule) {
+  m_rules.push_back(std::move(rule));
+  m_index.insert(m_rules.back().getOutput(), &m_rules.back());
+  invalidateProgram();
+  if (m_rete)
+    m_rete->addRule(m_rules.back());
   return m_rules.back();
 }
 
+bool Database::removeFact(const Atom &fact) {
+  const Rule *removed = nullptr;
+  bool duplicate = false; // в базе есть еще один такой же факт
+  for (auto rule : m_index.lookup(fact)) {
+    if (!rule->isFact() || !(rule->getOutput() == fact))
+      continue;
+    if (removed) {
+      duplicate = true;
+      break;
+    }
+    removed = rule;
+  }
+  if (!removed)
+    return false;
+  m_index.erase(fact, removed);
+  // правило не уничтожается: на него могут ссылаться списки кандидатов
+  // незавершенных генераторов поиска
+  auto it = std::find_if(m_rules.begin(), m_rules.end(), [removed](auto &rule) {
+    return &rule == removed;
+  });
+  m_removed.splice(m_removed.end(), m_rules, it);
+  invalidateProgram();
+  if (m_rete && !duplicate)
+    m_rete->retractFact(fact);
+  return true;
+}
+
+void Database::addDirective(const Directive &directive) {
+  if (directive.name != "table")
+    throw std::runtime_error("unknown directive " + directive.name);
+  for (auto &[name, arity] : directive.predicates)
+    setTabled(name, arity);
+}
+
+void Database::setTabled(const std::string &name, size_t arity) {
+  m_tabled.insert(ClauseIndex<Rule>::predicateKey(Symbol(name), arity));
+}
+
+bool Database::isTabled(const Atom &atom) const {
+  return !m_tabled.empty() &&
+         m_tabled.count(ClauseIndex<Rule>::predicateKey(atom)) != 0;
+}
+
+void Database::saveSnapshot(const char *filename) const {
+  SnapshotWriter writer;
+  for (auto &rule : m_rules)
+    writer.addRule(rule);
+  for (auto key : m_tabled)
+    writer.addTabled(Symbol::fromId(key >> 32), key & 0xffffffff);
+  writer.write(filename);
+}
+
+void Database::loadSnapshot(const char *filename) {
+  SnapshotReader reader(filename);
+  reader.forEachRule([&](Rule rule) {
+    // имена переменных правил снимка считаются занятыми, чтобы правила,
+    // добавленные позже, получали другие имена
+    for (auto &arg : rule.getOutput().getArguments())
+      if (!arg->isGround())
+        arg->commitVarNames(m_allocator);
+    for (auto &input : rule.getInputs())
+      for (auto &arg : input.getArguments())
+        if (!arg->isGround())
+          arg->commitVarNames(m_allocator);
+    insertRule(std::move(rule));
+  });
+  reader.forEachTabled([&](Symbol name, size_t arity) {
+    m_tabled.insert(ClauseIndex<Rule>::predicateKey(name, arity));
+  });
+}
+
+void Database::enableRete() {
+  if (m_rete)
+    return;
+  m_rete = std::make_unique<ReteNetwork>();
+  for (auto &rule : m_rules)
+    m_rete->addRule(rule);
+}
+
+std::shared_ptr<const WamProgram> Database::getProgram() const {
+  std::lock_guard lock(m_programMutex);
+  if (!m_program)
+    m_program = std::make_shared<WamProgram>(m_rules);
+  return m_program;
+}
+
+void Database::invalidateProgram() {
+  std::lock_guard lock(m_programMutex);
+  m_program = nullptr;
+}
+
+const std::vector<const Rule *> &
+Database::getCandidates(const Atom &target) const {
+  return m_index.lookup(target);
+}
+
+const std::vector<const Rule *> &
+Database::getCandidates(const Atom &target, const TrailSubst &bindings) const {
+  if (target.getArguments().empty())
+    return m_index.lookup(target);
+  auto first = bindings.deref(target.getArguments().front());
+  return m_index.lookup(ClauseIndex<Rule>::predicateKey(target),
+                        ClauseIndex<Rule>::argKey(*first));
+}
+
 Atom Database::renameVars(const Atom &atom) {
   std::vector<Variable::ptr> args;
   for (auto &arg : atom.getArguments())
     args.push_back(renameVars(arg));
-  return Atom(atom.getName(), std::move(args));
+  return Atom(atom.getSymbol(), std::move(args));
 }
 
 Variable::ptr Database::renameVars(const Variable::ptr &var) {
-  if (var->isConst())
+  if (var->isGround())
     return var;
   if (var->isVariable())
     return Variable::createVariable(
@@ -75,23 +193,177 @@ Variable::ptr Database::renameVars(const Variable::ptr &var) {
   std::vector<Variable::ptr> args;
   for (auto &arg : var->getArguments())
     args.push_back(renameVars(arg));
-  return Variable::createFuncSym(var->getValue(), std::move(args));
+  return Variable::createFuncSym(var->getSymbol(), std::move(args));
 }
 
-void WorkingDataset::addFact(Atom fact) {
-  m_facts[fact.getName()].push_back({std::move(fact), m_iteration});
+bool WorkingDataset::addFact(Atom fact) {
+  auto key = ClauseIndex<Atom>::predicateKey(fact);
+  auto iter = m_relations.find(key);
+  if (iter == m_relations.end())
+    iter = m_relations
+               .emplace(std::move(key), Relation(fact.getArguments().size()))
+               .first;
+  if (!iter->second.insert(std::move(fact), m_iteration))
+    return false;
+  m_factsCount++;
+  return true;
 }
 
-bool WorkingDataset::hasFact(Atom fact) {
-  const auto &factList = m_facts[fact.getName()];
-  return std::find(factList.begin(), factList.end(), fact) != factList.end();
+bool WorkingDataset::hasFact(const Atom &fact) const {
+  auto iter = m_relations.find(ClauseIndex<Atom>::predicateKey(fact));
+  return iter != m_relations.end() && iter->second.contains(fact);
 }
+
 void WorkingDataset::nextIteration() { m_iteration++; }
 
 bool WorkingDataset::hasNewFactFor(const Atom &atom) const {
-  if (m_facts.count(atom.getName()) != 0)
-    for (auto &fact : m_facts.at(atom.getName()))
-      if (fact.getGen() + 1 >= m_iteration)
-        return true;
-  return false;
+  auto iter = m_relations.find(ClauseIndex<Atom>::predicateKey(atom));
+  if (iter == m_relations.end())
+    return false;
+  auto [begin, end] = rangeBounds(iter->second, Range::delta);
+  return begin < end;
+}
+
+WorkingDataset::Range WorkingDataset::joinRange(size_t pos, size_t deltaPos) {
+  return pos < deltaPos    ? Range::old
+         : pos == deltaPos ? Range::delta
+                           : Range::full;
+}
+
+size_t WorkingDataset::relationSize(const Atom &atom) const {
+  auto iter = m_relations.find(ClauseIndex<Atom>::predicateKey(atom));
+  return iter == m_relations.end() ? 0 : iter->second.size();
+}
+
+size_t WorkingDataset::rangeSize(const Atom &atom, Range range) const {
+  auto iter = m_relations.find(ClauseIndex<Atom>::predicateKey(atom));
+  if (iter == m_relations.end())
+    return 0;
+  auto [begin, end] = rangeBounds(iter->second, range);
+  return begin < end ? end - begin : 0;
+}
+
+double WorkingDataset::estimateMatches(const Atom &pattern,
+                                       const std::vector<bool> &bound,
+                                       Range range) const {
+  auto iter = m_relations.find(ClauseIndex<Atom>::predicateKey(pattern));
+  if (iter == m_relations.end())
+    return 0;
+  const auto &relation = iter->second;
+  double estimate = rangeSize(pattern, range);
+  for (size_t i = 0; i < bound.size(); ++i)
+    if (bound[i])
+      estimate /= std::max<size_t>(1, relation.distinctValues(i));
+  return estimate;
+}
+
+bool WorkingDataset::forEachFact(const Atom &pattern, Range range,
+                                 const FactHandler &handler) const {
+  return forEachFact(pattern, range, handler, Part());
+}
+
+bool WorkingDataset::forEachFact(const Atom &pattern, Range range,
+                                 const FactHandler &handler,
+                                 Part part) const {
+  auto iter = m_relations.find(ClauseIndex<Atom>::predicateKey(pattern));
+  if (iter == m_relations.end())
+    return true;
+  auto [begin, end] = rangeBounds(iter->second, range);
+  if (begin >= end)
+    return true;
+  size_t size = end - begin;
+  end = begin + size * (part.index + 1) / part.count;
+  begin += size * part.index / part.count;
+  return iter->second.forEach(pattern, begin, end, handler);
+}
+
+std::pair<size_t, size_t> WorkingDataset::rangeBounds(const Relation &relation,
+                                                      Range range) const {
+  // факты текущей итерации в соединении не участвуют
+  size_t prev = m_iteration == 0 ? 0 : m_iteration - 1;
+  switch (range) {
+  case Range::old:
+    return {0, relation.genStart(prev)};
+  case Range::delta:
+    return {relation.genStart(prev), relation.genStart(m_iteration)};
+  default:
+    return {0, relation.genStart(m_iteration)};
+  }
+}
+
+WorkingDataset::Relation::Relation(size_t arity)
+    : m_argIndex(arity), m_wildcards(arity) {}
+
+bool WorkingDataset::Relation::insert(Atom fact, size_t gen) {
+  if (contains(fact))
+    return false;
+  while (m_genStart.size() <= gen)
+    m_genStart.push_back(m_facts.size());
+  size_t pos = m_facts.size();
+  m_facts.emplace_back(std::move(fact), gen);
+  const auto &stored = m_facts.back();
+  m_set.insert(&stored);
+  const auto &args = stored.getArguments();
+  for (size_t i = 0; i < args.size(); ++i) {
+    if (args[i]->hasVars())
+      m_wildcards[i].push_back(pos);
+    else
+      m_argIndex[i][args[i]].push_back(pos);
+  }
+  return true;
+}
+
+bool WorkingDataset::Relation::contains(const Atom &fact) const {
+  return m_set.count(&fact) != 0;
+}
+
+size_t WorkingDataset::Relation::genStart(size_t gen) const {
+  return gen < m_genStart.size() ? m_genStart[gen] : m_facts.size();
+}
+
+bool WorkingDataset::Relation::forEach(const Atom &pattern, size_t begin,
+                                       size_t end,
+                                       const FactHandler &handler) const {
+  if (begin >= end)
+    return true;
+  // выбираем связанный аргумент шаблона с наименьшим числом кандидатов
+  const std::vector<size_t> *bucket = nullptr;
+  const std::vector<size_t> *wildcards = nullptr;
+  const auto &args = pattern.getArguments();
+  for (size_t i = 0; i < args.size() && i < m_argIndex.size(); ++i) {
+    if (args[i]->hasVars())
+      continue;
+    static const std::vector<size_t> empty;
+    auto iter = m_argIndex[i].find(args[i]);
+    const auto *found = iter == m_argIndex[i].end() ? &empty : &iter->second;
+    if (bucket == nullptr || found->size() + m_wildcards[i].size() <
+                                 bucket->size() + wildcards->size()) {
+      bucket = found;
+      wildcards = &m_wildcards[i];
+    }
+  }
+  if (bucket == nullptr) {
+    // в шаблоне нет связанных аргументов - перебираем весь диапазон
+    for (size_t pos = begin; pos < end; ++pos)
+      if (!handler(m_facts[pos]))
+        return false;
+    return true;
+  }
+  // слияние двух упорядоченных списков позиций в пределах диапазона.
+  // Обработчик может добавлять новые факты, поэтому обращение к спискам идет
+  // по индексам
+  size_t i = std::lower_bound(bucket->begin(), bucket->end(), begin) -
+             bucket->begin();
+  size_t j = std::lower_bound(wildcards->begin(), wildcards->end(), begin) -
+             wildcards->begin();
+  while (true) {
+    size_t pos1 = i < bucket->size() ? (*bucket)[i] : end;
+    size_t pos2 = j < wildcards->size() ? (*wildcards)[j] : end;
+    size_t pos = std::min(pos1, pos2);
+    if (pos >= end)
+      return true;
+    (pos == pos1 ? i : j)++;
+    if (!handler(m_facts[pos]))
+      return false;
+  }
 }
@@ -1,13 +1,26 @@
 #pragma once
 
+#include "clause_index.h"
 #include "name_allocator.h"
+#include "parser.h"
+#include "rete.h"
 #include "rule.h"
+#include "trail_subst.h"
 #include "variable.h"
+#include "wam_program.h"
+#include <deque>
+#include <functional>
 #include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
 
 // класс, хранящий базу правил.
 //
-// Загружает базу из файла при указании имени файла в конструкторе
+// Загружает базу из файла при указании имени файла в конструкторе. Строки
+// файла, начинающиеся с ':-', являются директивами (см. addDirective). Файл
+// двоичного снимка базы (см. saveSnapshot) загружается без разбора текста
 class Database {
 public:
   explicit Database(const char *filename = nullptr);
@@ -16,19 +29,78 @@ public:
   const Rule &getRule(size_t index) const;
   const std::list<Rule> &getRules() const;
 
+  // получить правила, выход которых может быть унифицирован с целью. Правила
+  // выбираются по индексу предиката и первого аргумента в порядке добавления
+  const std::vector<const Rule *> &getCandidates(const Atom &target) const;
+  // то же для цели, переменные которой связаны в хранилище bindings: первый
+  // аргумент цели разыменовывается перед поиском по индексу
+  const std::vector<const Rule *> &
+  getCandidates(const Atom &target, const TrailSubst &bindings) const;
+
   // добавить правило в базу данных, переименовывая переменные
   const Rule &addRule(const Rule &rule);
 
+  // удалить факт из базы данных. Возвращает false, если такого факта нет.
+  // Удаленный факт остается в памяти до уничтожения базы
+  bool removeFact(const Atom &fact);
+
+  // выполнить директиву базы правил. Поддерживается директива
+  // ':- table name/N, ...', объявляющая предикаты табулируемыми. Для
+  // неизвестной директивы выбрасывает std::runtime_error
+  void addDirective(const Directive &directive);
+
+  // объявить предикат name/arity табулируемым: при обратном выводе решения
+  // его целей запоминаются в таблицах, что обеспечивает завершение
+  // леворекурсивных правил
+  void setTabled(const std::string &name, size_t arity);
+  bool isTabled(const Atom &atom) const;
+  // в базе есть табулируемые предикаты
+  bool hasTabled() const { return !m_tabled.empty(); }
+
+  // включить инкрементальный прямой вывод: правила базы компилируются в сеть
+  // Rete, которая далее обновляется при добавлении и удалении фактов
+  void enableRete();
+
+  // сеть Rete базы правил или nullptr, если она не включена
+  const ReteNetwork *getRete() const { return m_rete.get(); }
+
+  // сохранить правила и табулируемые предикаты базы в двоичный снимок. При
+  // ошибке записи выбрасывает std::runtime_error
+  void saveSnapshot(const char *filename) const;
+  // добавить в базу правила и табулируемые предикаты из снимка. Переменные
+  // правил снимка уже переименованы, поэтому правила добавляются как есть.
+  // Для поврежденного снимка выбрасывает std::runtime_error
+  void loadSnapshot(const char *filename);
+
+  // программа абстрактной машины Уоррена, в которую скомпилированы правила
+  // базы. Компилируется при первом обращении после изменения базы
+  std::shared_ptr<const WamProgram> getProgram() const;
+
 private:
   Atom renameVars(const Atom &atom);
   Variable::ptr renameVars(const Variable::ptr &var);
+  const Rule &insertRule(Rule rule);
+  void invalidateProgram();
 
   std::list<Rule> m_rules;   // список правил базы
+  std::list<Rule> m_removed; // удаленные факты
   NameAllocator m_allocator; // контейнер использованных имен переменных
+  ClauseIndex<Rule> m_index; // индекс правил по выходному атому
+  std::unordered_set<ClauseIndex<Rule>::Key> m_tabled; // табулируемые предикаты
+  std::unique_ptr<ReteNetwork> m_rete;
+  mutable std::mutex m_programMutex;
+  mutable std::shared_ptr<const WamProgram> m_program;
 };
 
 // класс, представляющий рабочее множество. Используется только при прямом
 // выводе.
+//
+// Факты хранятся по отношениям (предикат с арностью) в порядке вывода. Каждое
+// отношение имеет хеш-множество для проверки новизны факта и хеш-индексы по
+// значениям аргументов для поиска фактов, подходящих под шаблон. Номер
+// поколения факта позволяет выполнять семи-наивное соединение: на каждой
+// итерации хотя бы один вход правила сопоставляется только с фактами,
+// выведенными на предыдущей итерации.
 class WorkingDataset {
 public:
   // расширенный класс атома с номером поколения
@@ -42,21 +114,105 @@ public:
     size_t m_gen;
   };
 
-  void addFact(Atom fact);
-  bool hasFact(Atom fact);
+  // диапазон поколений фактов, используемый при соединении
+  enum class Range {
+    old,   // факты, выведенные до предыдущей итерации
+    delta, // факты, выведенные на предыдущей итерации
+    full,  // все факты, выведенные до текущей итерации
+  };
+
+  // часть диапазона фактов: диапазон делится на count частей почти равного
+  // размера, из которых берется часть с номером index
+  struct Part {
+    size_t index = 0;
+    size_t count = 1;
+  };
+
+  using FactHandler = std::function<bool(const AtomEx &)>;
+
+  // добавить факт в рабочее множество. Возвращает false, если такой факт уже
+  // есть
+  bool addFact(Atom fact);
+  bool hasFact(const Atom &fact) const;
   void nextIteration();
 
+  size_t getIteration() const { return m_iteration; }
+  size_t factsCount() const { return m_factsCount; }
+
+  // есть ли факты для предиката атома, выведенные на предыдущей итерации
   bool hasNewFactFor(const Atom &atom) const;
 
-  bool factIsNew(const AtomEx &atom) const {
-    return atom.getGen() + 1 >= m_iteration;
-  }
+  // диапазон, с фактами которого сопоставляется вход pos правила при
+  // семи-наивном соединении, в котором новые факты получает вход deltaPos
+  static Range joinRange(size_t pos, size_t deltaPos);
+
+  // число фактов предиката атома
+  size_t relationSize(const Atom &atom) const;
+  // число фактов предиката атома в диапазоне range
+  size_t rangeSize(const Atom &atom, Range range) const;
 
-  const std::list<AtomEx> &getFacts(const std::string &name) {
-    return m_facts[name];
-  }
+  // оценка числа фактов из диапазона range, подходящих под шаблон, значения
+  // аргументов которого с bound[i] == true известны: мощность диапазона,
+  // деленная на число различных значений каждого известного аргумента
+  double estimateMatches(const Atom &pattern, const std::vector<bool> &bound,
+                         Range range) const;
+
+  // перебрать факты из диапазона range, которые могут быть унифицированы с
+  // шаблоном. Связанные аргументы шаблона используются для поиска по
+  // индексу. Перебор прекращается, если обработчик вернул false; в этом
+  // случае метод также возвращает false. Перебираются только факты части
+  // part диапазона.
+  //
+  // Методы, не изменяющие рабочее множество, можно вызывать из нескольких
+  // потоков одновременно
+  bool forEachFact(const Atom &pattern, Range range,
+                   const FactHandler &handler) const;
+  bool forEachFact(const Atom &pattern, Range range,
+                   const FactHandler &handler, Part part) const;
 
 private:
-  std::map<std::string, std::list<AtomEx>> m_facts;
+  // факты одного предиката
+  class Relation {
+  public:
+    explicit Relation(size_t arity);
+
+    bool insert(Atom fact, size_t gen);
+    bool contains(const Atom &fact) const;
+
+    // индекс первого факта поколения gen или старше
+    size_t genStart(size_t gen) const;
+
+    size_t size() const { return m_facts.size(); }
+    // число различных основных значений аргумента arg
+    size_t distinctValues(size_t arg) const { return m_argIndex[arg].size(); }
+
+    bool forEach(const Atom &pattern, size_t begin, size_t end,
+                 const FactHandler &handler) const;
+
+  private:
+    struct FactHash {
+      size_t operator()(const Atom *atom) const { return atom->hash(); }
+    };
+    struct FactEqual {
+      bool operator()(const Atom *left, const Atom *right) const {
+        return *left == *right;
+      }
+    };
+    using ArgIndex = std::unordered_map<Variable::ptr, std::vector<size_t>,
+                                        TermHash, TermEqual>;
+
+    std::deque<AtomEx> m_facts; // факты в порядке вывода
+    std::unordered_set<const Atom *, FactHash, FactEqual> m_set;
+    std::vector<size_t> m_genStart;   // начала поколений в m_facts
+    std::vector<ArgIndex> m_argIndex; // индексы по значениям аргументов
+    // факты с переменными в данном аргументе подходят под любое значение
+    std::vector<std::vector<size_t>> m_wildcards;
+  };
+
+  std::pair<size_t, size_t> rangeBounds(const Relation &relation,
+                                        Range range) const;
+
+  std::unordered_map<ClauseIndex<Atom>::Key, Relation> m_relations;
   size_t m_iteration = 0;
+  size_t m_factsCount = 0;
 };
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <utility>
+
+// класс ленивого генератора на основе сопрограмм C++20.
+//
+// Сопрограмма, возвращающая Generator<T>, выбрасывает значения через co_yield.
+// Тело сопрограммы выполняется только при запросе очередного значения методом
+// next(), причем в потоке вызывающего. Уничтожение генератора прерывает
+// сопрограмму в точке последнего co_yield (аналог закрытия канала с
+// принимающей стороны)
+template <typename T> class Generator {
+public:
+  struct promise_type {
+    std::optional<T> value;
+    std::exception_ptr exception;
+
+    Generator get_return_object() {
+      return Generator(std::coroutine_handle<promise_type>::from_promise(*this));
+    }
+
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    std::suspend_always final_suspend() noexcept { return {}; }
+
+    std::suspend_always yield_value(const T &object) {
+      value = object;
+      return {};
+    }
+
+    std::suspend_always yield_value(T &&object) {
+      value = std::move(object);
+      return {};
+    }
+
+    void return_void() {}
+    void unhandled_exception() { exception = std::current_exception(); }
+  };
+
+  Generator() = default;
+  Generator(const Generator &) = delete;
+  Generator(Generator &&other) noexcept
+      : m_handle(std::exchange(other.m_handle, nullptr)) {}
+
+  ~Generator() {
+    if (m_handle)
+      m_handle.destroy();
+  }
+
+  Generator &operator=(const Generator &) = delete;
+  Generator &operator=(Generator &&other) noexcept {
+    if (this != &other) {
+      if (m_handle)
+        m_handle.destroy();
+      m_handle = std::exchange(other.m_handle, nullptr);
+    }
+    return *this;
+  }
+
+  // true, если генератор связан с сопрограммой
+  explicit operator bool() const { return static_cast<bool>(m_handle); }
+
+  // получить следующее значение. Возвращает std::nullopt, если сопрограмма
+  // завершилась и значений больше не будет
+  std::optional<T> next() {
+    if (!m_handle || m_handle.done())
+      return std::nullopt;
+    auto &promise = m_handle.promise();
+    promise.value.reset();
+    m_handle.resume();
+    if (promise.exception)
+      std::rethrow_exception(std::exchange(promise.exception, nullptr));
+    if (m_handle.done())
+      return std::nullopt;
+    return std::move(promise.value);
+  }
+
+private:
+  explicit Generator(std::coroutine_handle<promise_type> handle)
+      : m_handle(handle) {}
+
+  std::coroutine_handle<promise_type> m_handle = nullptr;
+};
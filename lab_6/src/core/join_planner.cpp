@@ -0,0 +1,102 @@
+#include "join_planner.h"
+#include <limits>
+#include <unordered_set>
+
+namespace {
+
+const Symbol &anonymousSymbol() {
+  static const Symbol symbol("_");
+  return symbol;
+}
+
+// известно ли значение терма при связанных переменных bound
+bool isBound(const Variable &term, const std::unordered_set<Symbol> &bound) {
+  if (term.isGround() || term.isConst())
+    return true;
+  if (term.isVariable())
+    return term.getSymbol() != anonymousSymbol() &&
+           bound.count(term.getSymbol()) != 0;
+  for (auto &arg : term.getArguments())
+    if (!isBound(*arg, bound))
+      return false;
+  return true;
+}
+
+void collectVars(const Variable &term, std::unordered_set<Symbol> &vars) {
+  if (term.isGround() || term.isConst())
+    return;
+  if (term.isVariable()) {
+    if (term.getSymbol() != anonymousSymbol())
+      vars.insert(term.getSymbol());
+    return;
+  }
+  for (auto &arg : term.getArguments())
+    collectVars(*arg, vars);
+}
+
+} // namespace
+
+const std::vector<size_t> &JoinPlanner::plan(const Rule &rule, size_t deltaPos,
+                                             const WorkingDataset &workset) {
+  auto &plans = m_plans[&rule];
+  if (plans.size() < rule.getInputs().size())
+    plans.resize(rule.getInputs().size());
+  auto &plan = plans[deltaPos];
+  if (plan.order.empty() || isStale(plan, rule, workset))
+    plan = build(rule, deltaPos, workset);
+  return plan.order;
+}
+
+bool JoinPlanner::isStale(const Plan &plan, const Rule &rule,
+                          const WorkingDataset &workset) {
+  const auto &inputs = rule.getInputs();
+  for (size_t i = 0; i < inputs.size(); ++i) {
+    size_t size = workset.relationSize(inputs[i]);
+    if (size > 2 * plan.sizes[i] || 2 * size < plan.sizes[i])
+      return true;
+  }
+  return false;
+}
+
+/**
+ * Метод построения плана соединения.
+ *
+ * На каждом шаге среди невыбранных входов выбирается вход с наименьшей
+ * оценкой числа подходящих фактов (при равных оценках - вход, стоящий раньше в
+ * правиле), после чего его переменные считаются связанными. Каждый вход
+ * сопоставляется с фактами своего диапазона поколений (WorkingDataset::
+ * joinRange), поэтому порядок соединения не меняет множество выводимых фактов.
+ */
+JoinPlanner::Plan JoinPlanner::build(const Rule &rule, size_t deltaPos,
+                                     const WorkingDataset &workset) {
+  const auto &inputs = rule.getInputs();
+  Plan plan;
+  for (auto &input : inputs)
+    plan.sizes.push_back(workset.relationSize(input));
+  std::vector<bool> placed(inputs.size(), false);
+  std::unordered_set<Symbol> bound;
+  std::vector<bool> boundArgs;
+  while (plan.order.size() < inputs.size()) {
+    size_t best = inputs.size();
+    double bestEstimate = std::numeric_limits<double>::infinity();
+    for (size_t i = 0; i < inputs.size(); ++i) {
+      if (placed[i])
+        continue;
+      const auto &args = inputs[i].getArguments();
+      boundArgs.assign(args.size(), false);
+      for (size_t j = 0; j < args.size(); ++j)
+        boundArgs[j] = isBound(*args[j], bound);
+      double estimate = workset.estimateMatches(
+          inputs[i], boundArgs, WorkingDataset::joinRange(i, deltaPos));
+      if (best == inputs.size() || estimate < bestEstimate) {
+        best = i;
+        bestEstimate = estimate;
+      }
+    }
+    placed[best] = true;
+    plan.order.push_back(best);
+    for (auto &arg : inputs[best].getArguments())
+      collectVars(*arg, bound);
+  }
+  return plan;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "database.h"
+#include "rule.h"
+#include <unordered_map>
+#include <vector>
+
+// класс планировщика соединения входов правил при прямом выводе.
+//
+// Для правила и входа, который сопоставляется только с новыми фактами (см.
+// Solver::joinInputs), строится порядок соединения входов: на каждом шаге
+// выбирается вход с наименьшей оценкой числа подходящих фактов при
+// переменных, связанных уже выбранными входами (WorkingDataset::
+// estimateMatches). Так маленькие и сильно ограниченные отношения
+// соединяются раньше больших.
+//
+// План запоминается и строится заново между итерациями вывода, когда число
+// фактов какого-либо отношения входов правила изменилось более чем вдвое
+class JoinPlanner {
+public:
+  // порядок соединения входов правила rule (номера входов), в котором вход
+  // deltaPos сопоставляется с новыми фактами
+  const std::vector<size_t> &plan(const Rule &rule, size_t deltaPos,
+                                  const WorkingDataset &workset);
+
+private:
+  struct Plan {
+    std::vector<size_t> order;
+    // число фактов отношений входов при построении плана
+    std::vector<size_t> sizes;
+  };
+
+  static bool isStale(const Plan &plan, const Rule &rule,
+                      const WorkingDataset &workset);
+  static Plan build(const Rule &rule, size_t deltaPos,
+                    const WorkingDataset &workset);
+
+  // планы правил по номерам входов с новыми фактами
+  std::unordered_map<const Rule *, std::vector<Plan>> m_plans;
+};
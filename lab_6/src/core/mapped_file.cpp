@@ -0,0 +1,35 @@
+#include "mapped_file.h"
+#include <fcntl.h>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::MappedFile(const char *filename) {
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0)
+    throw std::runtime_error(std::string("failed to open ") + filename);
+  struct stat info;
+  if (fstat(fd, &info) != 0) {
+    close(fd);
+    throw std::runtime_error(std::string("failed to stat ") + filename);
+  }
+  m_size = info.st_size;
+  if (m_size != 0) {
+    m_data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (m_data == MAP_FAILED) {
+      m_data = nullptr;
+      close(fd);
+      throw std::runtime_error(std::string("failed to map ") + filename);
+    }
+    // файл читается последовательно
+    madvise(m_data, m_size, MADV_SEQUENTIAL);
+  }
+  close(fd);
+}
+
+MappedFile::~MappedFile() {
+  if (m_data)
+    munmap(m_data, m_size);
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstddef>
+
+// класс файла, отображенного в память только для чтения. При ошибке открытия
+// или отображения конструктор выбрасывает std::runtime_error. Пустой файл не
+// отображается: data() возвращает nullptr
+class MappedFile {
+public:
+  explicit MappedFile(const char *filename);
+  ~MappedFile();
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  const char *data() const { return static_cast<const char *>(m_data); }
+  size_t size() const { return m_size; }
+
+private:
+  void *m_data = nullptr;
+  size_t m_size = 0;
+};
@@ -1,97 +1,116 @@
 #include "mgraph_solver.h"
-#include "channel.h"
-#include "name_allocator.h"
+#include "generator.h"
 #include "solver.h"
 #include "subst.h"
 #include "variable.h"
+#include "work_stealing_pool.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
 #include <memory>
-#include <thread>
+#include <mutex>
+#include <string>
+#include <unordered_map>
 #include <utility>
 
-/**
- * Функция конвертации генератора с обычным типом подстановок (класс Subst) в
- * генератор с расширенным типом подстановок (класс SubstEx).
- *
- * Новый генератор выбрасывает очередное значение полученное от старого
- * генератора вместе со сброшенным флагом отсечения.
- */
-static TaskChanPair<MGraphSolver::SubstEx>
-taskChanPairEx(TaskChanPair<Subst> &&tcp) {
-  // создаем канал для переброса подстановок
-  auto chan = std::make_shared<Channel<MGraphSolver::SubstEx>>();
-  // создаем отдельный поток для работы генератора
-  std::jthread worker([tcp = std::move(tcp), chan]() {
-    while (true) {
-      // получить следующую подстановку
-      auto [subst, ok] = tcp.second->get();
-      if (!ok) {
-        // если старый канал закрылся - закрываем новый
-        chan->close();
-        break;
-      }
-      // перебрасываем подстановку со сброшенным флагом отсечения
-      if (!chan->put({std::move(subst), false}))
-        break; // выходной канал закрылся с другого конца
+// является ли цель отсечением
+static bool isCut(const Atom &atom) {
+  static const Symbol cut("cut"), bang("!");
+  return atom.getArguments().empty() &&
+         (atom.getSymbol() == cut || atom.getSymbol() == bang);
+}
+
+// дописать к ключу варианта терм. Переменные нумеруются в порядке первого
+// вхождения, переменная '_' остается безымянной. path - цепочка
+// термов от корня, по которой обнаруживаются циклические термы
+static void appendVariantKey(const Variable &term,
+                             std::unordered_map<Symbol, size_t> &vars,
+                             std::vector<const Variable *> &path,
+                             std::string &key) {
+  if (term.isVariable()) {
+    static const Symbol anonymous("_");
+    if (term.getSymbol() == anonymous) {
+      key += '_';
+      return;
     }
-    tcp.second->close();
-  });
-  // возвращаем пару (поток, канал) представляющую генератор
-  return std::make_pair(std::move(worker), std::move(chan));
+    auto [iter, _] = vars.emplace(term.getSymbol(), vars.size());
+    key += '?' + std::to_string(iter->second);
+    return;
+  }
+  if (term.isQuoted())
+    key += '"' + term.getValue() + '"';
+  else
+    key += term.getValue();
+  if (!term.isFuncSym())
+    return;
+  if (std::find(path.begin(), path.end(), &term) != path.end()) {
+    key += "(...)";
+    return;
+  }
+  path.push_back(&term);
+  key += '(';
+  for (auto &arg : term.getArguments()) {
+    appendVariantKey(*arg, vars, path, key);
+    key += ',';
+  }
+  key += ')';
+  path.pop_back();
 }
 
-/**
- * Функция переименования переменных в правиле с использованием переданного
- * аллокатора имен (класс NameAllocator).
- *
- * Не изменяет переданное правило, а создает на его основе новое правило.
- */
-static Rule standardize(const Rule &rule, NameAllocator &allocator) {
-  Atom output = rule.getOutput().renamedVars(allocator);
-  std::vector<Atom> inputs;
-  for (auto input : rule.getInputs())
-    inputs.push_back(input.renamedVars(allocator));
-  allocator.commit();
-  return Rule(std::move(inputs), std::move(output));
+// ключ варианта атома: атомы, отличающиеся только именами переменных, имеют
+// общий ключ
+static std::string variantKey(const Atom &atom) {
+  std::unordered_map<Symbol, size_t> vars;
+  std::vector<const Variable *> path;
+  std::string key = atom.getName() + '(';
+  for (auto &arg : atom.getArguments()) {
+    appendVariantKey(*arg, vars, path, key);
+    key += ',';
+  }
+  key += ')';
+  return key;
+}
+
+void MGraphSolver::setOrParallel(OrParallel mode, size_t depth) {
+  m_orParallel = mode;
+  m_parallelDepth = mode == OrParallel::Off ? 0 : depth;
 }
 
 /**
  * Метод обратного поиска в глубину.
  *
  * target - цель, которую необходимо доказать
- * output - канал для передачи результирующих подстановок
  *
- * Запускает метод generateOr и перехватывает генерируемые им подстановки для
- * того, чтобы отфильтровать те переменные, которые не упоминаются в заданной
- * цели target.
+ * Запускает генератор generateOr и для каждого найденного решения строит
+ * подстановку только для тех переменных, которые упоминаются в заданной цели
+ * target.
+ *
+ * Весь перебор выполняется сопрограммами в потоке, вызывающем метод next():
+ * очередная подстановка вычисляется только по запросу, а уничтожение
+ * генератора (метод done) прерывает поиск на всех уровнях дерева.
  */
-void MGraphSolver::solveBackwardThreaded(Atom target, Channel<Subst> &output) {
-  auto [worker, mid] = generateOr(target, Subst(), NameAllocator());
-  while (!output.isClosed()) {
-    auto [substEx, ok] = mid->get();
-    // если канал mid был закрыт, то завершаем работу
-    if (!ok) {
-      output.close();
-      break;
-    }
-    // фильтрация переменных, не относящихся к цели target
-    Subst filtered;
-    for (auto varName : target.getAllVars())
-      filtered.insert(varName,
-                      substEx.subst.apply(Variable::createVariable(varName)));
-    // если выходной канал закрыли с другого конца, то завершаем работу
-    if (!output.put(std::move(filtered)))
-      break;
-  }
-  mid->close();
+Generator<Subst> MGraphSolver::generateBackward(Atom target) {
+  m_bindings = TrailSubst();
+  m_nextVar = 0;
+  m_tables.clear();
+  m_evaluating.clear();
+  m_incomplete.clear();
+  m_tableLow = 0;
+  m_answersAdded = 0;
+  // переменные цели именованные и не совпадают с пронумерованными
+  // переменными правил
+  auto targetVars = target.getAllVars();
+  auto orGen = generateOr(target);
+  while (orGen.next())
+    co_yield m_bindings.toSubst(targetVars);
 }
 
 /**
  * Метод обратного поиска ИЛИ.
  *
  * target - текущая цель, которую необходимо доказать
- * baseSubst - накопленная подстановка к моменту вызова этого метода
- * allocator - контейнер использованных имен (для переименования переменных в
- * правилах)
  *
  * Этот метод является прослойкой перед настоящим методом поиска ИЛИ по базе
  * правил. Он нужен для прозрачной реализации специальных процедур,
@@ -102,208 +121,574 @@ void MGraphSolver::solveBackwardThreaded(Atom target, Channel<Subst> &output) {
  * вызывает его для доказательства цели, иначе - передает управление настоящему
  * методу поиска ИЛИ.
  */
-TaskChanPair<MGraphSolver::SubstEx>
-MGraphSolver::generateOr(Atom target, Subst baseSubst,
-                         NameAllocator allocator) {
+Generator<bool> MGraphSolver::generateOr(const Atom &target) {
   // поиск обработчика специальной процедуры по имени предиката цели
-  if (m_atomHooks.count(target.getName()) == 0)
+  auto iter = m_atomHooks.find(target.getName());
+  if (iter == m_atomHooks.end()) {
     // обработчика нет - вызываем настоящий метод поиска для обхода базы правил
-    return generateOrBasic(std::move(target), std::move(baseSubst),
-                           std::move(allocator));
-  auto hook = m_atomHooks.at(target.getName());
+    // через таблицу ответов, последовательно или параллельно
+    if (m_database->isTabled(target))
+      return generateTabled(target);
+    if (m_parallelDepth > 0 &&
+        canSplit(m_database->getCandidates(target, m_bindings)))
+      return generateOrParallel(target);
+    return generateOrBasic(target);
+  }
   // вызов обработчика для доказательства цели в обход базы правил
-  auto tcp = hook->prove(target.getArguments(), std::move(baseSubst));
-  // конвертация генератора обычных подстановок в расширенные, со сброшенным
-  // флагом отсечения
-  return taskChanPairEx(std::move(tcp));
+  return generateHook(iter->second, target);
+}
+
+/**
+ * Метод доказательства цели обработчиком специальной процедуры.
+ *
+ * hook - обработчик специальной процедуры
+ * target - текущая цель, которую необходимо доказать
+ *
+ * Обработчики работают с обычными подстановками: они получают аргументы цели
+ * с примененными связываниями и пустую подстановку. Связывания из каждой
+ * сгенерированной обработчиком подстановки переносятся в хранилище. Указатель
+ * на обработчик удерживается, пока жив генератор, созданный его методом prove.
+ */
+Generator<bool> MGraphSolver::generateHook(std::shared_ptr<AtomHook> hook,
+                                           Atom target) {
+  auto mark = m_bindings.mark();
+  auto args = m_bindings.resolve(target).getArguments();
+  auto hookGen = hook->prove(std::move(args), Subst());
+  while (auto subst = hookGen.next()) {
+    m_bindings.undo(mark);
+    bool ok = true;
+    for (auto &varName : subst->getVarNames()) {
+      auto var = Variable::createVariable(varName);
+      if (!unify(var, subst->apply(var), m_bindings)) {
+        ok = false;
+        break;
+      }
+    }
+    if (ok)
+      co_yield false;
+  }
+  m_bindings.undo(mark);
+}
+
+/**
+ * Метод доказательства цели табулируемого предиката.
+ *
+ * target - текущая цель, которую необходимо доказать
+ *
+ * Находит таблицу варианта цели с примененными связываниями. Новая или
+ * незавершенная таблица сначала вычисляется (метод evaluateTable). Для
+ * таблицы, которая вычисляется ниже по стеку вызовов, рекурсивного спуска
+ * не происходит: используются уже найденные ответы, а зависимость от таблицы
+ * отмечается в m_tableLow, чтобы вычисление таблицы было повторено.
+ *
+ * Ответы хранятся с пронумерованными переменными (класс NumberedRule), при
+ * использовании получают кадр новых переменных и унифицируются с целью по
+ * порядку. Таблица может
+ * пополниться, пока обрабатывается ее ответ, поэтому обход идет по индексам.
+ * Каждый вариант ответа выдается один раз.
+ */
+Generator<bool> MGraphSolver::generateTabled(Atom target) {
+  auto goal = m_bindings.resolve(target);
+  auto &table = m_tables[variantKey(goal)];
+  if (table.state == Table::State::Evaluating)
+    m_tableLow = std::min(m_tableLow, table.depth);
+  else if (table.state != Table::State::Complete)
+    evaluateTable(table, goal);
+  auto mark = m_bindings.mark();
+  auto frame = m_nextVar;
+  for (size_t i = 0; i < table.answers.size(); ++i) {
+    const auto &answer = table.answers[i].getNumbered();
+    m_nextVar = frame + answer.varsCount;
+    if (unify(target, answer.output.shiftedVars(frame), m_bindings))
+      co_yield false;
+    m_bindings.undo(mark);
+  }
+  m_nextVar = frame;
+}
+
+/**
+ * Метод вычисления таблицы ответов.
+ *
+ * table - таблица варианта цели
+ * goal - цель с примененными связываниями
+ *
+ * Цель доказывается правилами базы (метод generateOrBasic) до исчерпания
+ * решений, новые варианты решений добавляются в таблицу. Доказательство
+ * повторяется, пока на очередном проходе добавляются ответы в какие-либо
+ * таблицы.
+ *
+ * Если при вычислении использовались ответы таблицы, вычисляемой ниже по
+ * стеку, то ответы таблицы могут пополниться на следующем проходе той
+ * таблицы: таблица становится незавершенной и будет вычислена повторно при
+ * следующем вызове. Иначе таблица является ведущей для своей компоненты
+ * взаимно зависимых таблиц и завершает все незавершенные таблицы компоненты.
+ */
+void MGraphSolver::evaluateTable(Table &table, const Atom &goal) {
+  table.state = Table::State::Evaluating;
+  table.depth = m_evaluating.size();
+  m_evaluating.push_back(&table);
+  size_t incomplete = m_incomplete.size();
+  size_t outerLow = m_tableLow;
+  size_t low = table.depth;
+  while (true) {
+    m_tableLow = table.depth;
+    size_t added = m_answersAdded;
+    auto orGen = generateOrBasic(goal);
+    while (orGen.next()) {
+      auto answer = m_bindings.resolve(goal);
+      if (table.keys.insert(variantKey(answer)).second) {
+        table.answers.emplace_back(std::move(answer));
+        ++m_answersAdded;
+      }
+    }
+    low = std::min(low, m_tableLow);
+    if (m_answersAdded == added)
+      break;
+  }
+  m_evaluating.pop_back();
+  if (low < table.depth) {
+    table.state = Table::State::Incomplete;
+    m_incomplete.push_back(&table);
+  } else {
+    table.state = Table::State::Complete;
+    for (size_t i = incomplete; i < m_incomplete.size(); ++i)
+      m_incomplete[i]->state = Table::State::Complete;
+    m_incomplete.resize(incomplete);
+  }
+  m_tableLow = std::min(outerLow, low);
 }
 
 /**
  * Настоящий метод обратного поиска ИЛИ.
  *
  * target - текущая цель, которую необходимо доказать
- * baseSubst - накопленная подстановка к моменту вызова метода
- * allocator - контейнер использованных имен (для переименования переменных в
- * правилах)
  *
- * Производит обход базы правил, выбирая правила, которые могут доказать цель.
+ * Производит обход базы правил, выбирая по индексу правила, которые могут
+ * доказать цель.
  * Для каждого такого правила вызывается метод поиска И для доказательства всех
  * подцелей из атницидента правила.
  *
- * В случае обнаружения сигнала об отсечении (установленный флаг cut в структуре
- * SubstEx) - дальнейший перебор правил прекращается.
+ * В случае обнаружения сигнала об отсечении (значение true от генератора
+ * поиска И) - дальнейший перебор правил прекращается.
  */
-TaskChanPair<MGraphSolver::SubstEx>
-MGraphSolver::generateOrBasic(Atom target, Subst baseSubst,
-                              NameAllocator allocator) {
-  // создаем канал для передачи генерируемых подстановок
-  auto output = std::make_shared<Channel<SubstEx>>();
-  // создаем отдельный поток для работы генератора
-  std::jthread worker([this, target = std::move(target),
-                       baseSubst = std::move(baseSubst),
-                       allocator = std::move(allocator), output]() {
-    for (auto &rule : m_database->getRules()) {
-      // если выходной канал закрыли с другого конца, то завершаем работу
-      if (output->isClosed()) {
-        break;
-      }
-      // копируем контейнер имен и базовую подстановку, чтобы иметь возможность
-      // вернуться к исходному состоянию при переходе к следующему правилу базы
-      // правил (можно сказать, для отката)
-      NameAllocator subAllocator = allocator;
-      Subst subst = baseSubst;
-      // выполняем переименование переменных в правиле
-      Rule stdRule = standardize(rule, subAllocator);
-      // выполняем унификацию цели с выходом правила
-      if (!unify(target, stdRule.getOutput(), subst))
-        continue; // унификация неуспешна - переходим к следующему правилу
-      // если правило на самом деле факт (нет входов), то выбрасываем текущую
-      // подстановку (передаем через выходной канал) и переходим к следующему
-      // правилу в базе.
-      //
-      // В книге эта проверка не делается, а передается пустой список подцелей в
-      // метод поиска И, который уже выбросит эту же подстановку.
-      if (stdRule.isFact()) {
-        // если выходной канал закрыли с другого конца, то завершаем работу
-        if (!output->put({subst, false}))
-          break;
-        // переходим к следующему правилу в базе правил
-        continue;
-      }
-      // формируем список подцелей, применяя текущую подстановку ко всем входам
-      // правила
-      std::vector<Atom> subGoals;
-      for (auto &atom : stdRule.getInputs())
-        subGoals.push_back(subst.apply(atom));
-      // вызываем метод поиска И для списка подцелей. К следующему правилу не
-      // перейдем, пока не обработаем все подстановки, которые будут
-      // сгенерированы здесь. Поэтому получается поиск в глубину
-      auto [worker, mid] = generateAnd(std::move(subGoals), std::move(subst),
-                                       std::move(subAllocator));
-      bool wasCut = false; // флаг обнаружения отсечения
-      while (true) {
-        // ожидаем следующую подстановку из канала
-        auto [subst2, ok] = mid->get();
-        // если канал закрылся, то больше подстановок не будет. Завершаем
-        // внутренний цикл
-        if (!ok)
-          break;
-        if (subst2.cut) {
-          // обнаружено отсечение - запретить дальнейший перебор правил из базы
+Generator<bool> MGraphSolver::generateOrBasic(Atom target) {
+  // перебираем только правила, выход которых может быть унифицирован с целью
+  // (по индексу предиката и первого аргумента базы правил; первый аргумент
+  // может быть переменной, связанной в хранилище). Список
+  // копируется: между возобновлениями генератора база может измениться, и
+  // вектор индекса будет перестроен
+  const auto candidates = m_database->getCandidates(target, m_bindings);
+  for (size_t i = 0; i < candidates.size(); ++i) {
+    // ветвь параллельного поиска отменена - прекращаем перебор
+    if (cancelled())
+      break;
+    // вызываем метод поиска И для правила. К следующему правилу не перейдем,
+    // пока не обработаем все решения, которые будут найдены здесь. Поэтому
+    // получается поиск в глубину
+    auto ruleGen = generateRule(target, *candidates[i]);
+    bool wasCut = false; // флаг обнаружения отсечения
+    while (auto cut = ruleGen.next()) {
+      if (*cut)
+        // обнаружено отсечение - запретить дальнейший перебор правил из базы
+        wasCut = true;
+      else
+        co_yield false;
+    }
+    // прекратить дальнейший перебор правил, если было обнаружено отсечение
+    if (wasCut)
+      break;
+  }
+}
+
+/**
+ * Метод доказательства цели одним правилом базы.
+ *
+ * target - текущая цель, которую необходимо доказать
+ * rule - правило базы, выход которого унифицируется с целью
+ *
+ * Правило применяется в новом кадре переменных: номера пронумерованных
+ * переменных правила (Rule::getNumbered) сдвигаются на начало кадра, так что
+ * переименование не строит имен. Выход правила унифицируется с целью, и только
+ * при успешной унификации строятся подцели правила, для которых вызывается
+ * метод поиска И. По завершении хранилище и счетчик переменных откатываются к
+ * состоянию до вызова.
+ */
+Generator<bool> MGraphSolver::generateRule(Atom target, const Rule &rule) {
+  // точка выбора: состояние хранилища и начало кадра, к которым
+  // откатываемся при переходе к следующему правилу базы правил
+  auto mark = m_bindings.mark();
+  auto frame = m_nextVar;
+  const auto &numbered = rule.getNumbered();
+  m_nextVar += numbered.varsCount;
+  // выполняем унификацию цели с выходом правила (если ветвь параллельного
+  // поиска не отменена)
+  if (!cancelled() &&
+      unify(target, numbered.output.shiftedVars(frame), m_bindings)) {
+    // если правило на самом деле факт (нет входов), то выбрасываем текущее
+    // решение.
+    //
+    // В книге эта проверка не делается, а передается пустой список подцелей в
+    // метод поиска И, который уже выбросит это же решение.
+    if (rule.isFact())
+      co_yield false;
+    else {
+      std::vector<Atom> inputs;
+      inputs.reserve(numbered.inputs.size());
+      for (auto &input : numbered.inputs)
+        inputs.push_back(input.shiftedVars(frame));
+      auto andGen = generateAnd(inputs, 0);
+      bool wasCut = false;
+      while (auto cut = andGen.next()) {
+        if (!*cut)
+          co_yield false;
+        else if (!wasCut) {
           wasCut = true;
-        } else if (!output->put({std::move(subst2.subst), false})) {
-          // выходной канал закрыли с другого конца - закрываем промежуточный
-          // канал (прерываем работу генератора И) и выходим
-          mid->close();
-          return;
+          co_yield true;
         }
       }
-      mid->close();
-      // прекратить дальнейший перебор правил, если было обнаружено отсечение
-      if (wasCut)
-        break;
     }
-    // все правила просмотрены или встречено отсечение - больше подстановок
-    // сгенерировано не будет, поэтому закрываем выходной канал
-    output->close();
-  });
-  // возвращаем пару (поток, канал) представляющую генератор
-  return std::make_pair(std::move(worker), output);
+  }
+  m_bindings.undo(mark);
+  m_nextVar = frame;
+}
+
+/**
+ * Метод поиска ИЛИ для ветви параллельного поиска.
+ *
+ * target - цель с примененными связываниями
+ * rules - часть правил-кандидатов цели, доставшаяся ветви
+ *
+ * В отличие от метода generateOrBasic, сигнал отсечения передается
+ * потребителю, так как отсечение должно отменить ветви следующих правил.
+ */
+Generator<bool> MGraphSolver::generateRules(Atom target,
+                                            std::vector<const Rule *> rules) {
+  for (auto rule : rules) {
+    if (cancelled())
+      break;
+    auto ruleGen = generateRule(target, *rule);
+    bool wasCut = false;
+    while (auto cut = ruleGen.next()) {
+      if (*cut)
+        wasCut = true;
+      co_yield *cut;
+    }
+    if (wasCut)
+      break;
+  }
 }
 
 /**
  * Метод обратного поиска И.
  *
  * targets - список целей для доказательства
- * baseSubst - накопленная подстановка к моменту вызова метода
- * allocator - контейнер использованных имен (для переименования переменных в
- * правилах)
+ * pos - номер первой недоказанной цели в списке
+ *
+ * Если список целей исчерпан - выбрасывает текущее решение.
+ * Иначе если первая цель в списке является отсечением - выбрасывает сигнал
+ * отсечения (который обрабатывается в методе поиска ИЛИ) и вызывает
+ * рекурсивно метод поиска И для оставшихся целей в списке.
+ * Иначе - вызывает метод поиска ИЛИ для первой цели в списке и для каждого
+ * найденного решения вызывает рекурсивно метод поиска И для доказательства
+ * оставшихся целей в списке.
  *
- * Если список целей пуст - выбрасывает накопленную подстановку.
- * Иначе если первая цель в списке является отсечением - выбрасывает пустую
- * подстановку с установленным флагом отсечения (которая обрабатывается в методе
- * поиска ИЛИ) и вызывает рекурсивно метод поиска И для оставшихся целей в
- * списке.
- * Иначе - вызывает метод поиска ИЛИ для первой цели в списке и для каждой
- * сгенерированной подстановки вызывает рекурсивно метод поиска И для
- * доказательства оставшихся целей в списке.
+ * Связывания переменных к целям не применяются: унификация разыменовывает
+ * переменные через хранилище.
  */
-TaskChanPair<MGraphSolver::SubstEx>
-MGraphSolver::generateAnd(std::vector<Atom> targets, Subst baseSubst,
-                          NameAllocator allocator) {
-  // создаем канал для передачи генерируемых подстановок
-  auto output = std::make_shared<Channel<SubstEx>>();
-  // создаем отдельный поток для работы генератора
-  std::jthread worker([this, targets = std::move(targets),
-                       baseSubst = std::move(baseSubst),
-                       allocator = std::move(allocator), output]() {
-    if (targets.empty()) {
-      // если список целей пуст, то выбрасываем текущую подстановку и закрываем
-      // канал
-      output->put({baseSubst, false});
-      output->close();
+Generator<bool> MGraphSolver::generateAnd(const std::vector<Atom> &targets,
+                                          size_t pos) {
+  if (pos == targets.size()) {
+    // если список целей пуст, то выбрасываем текущее решение
+    co_yield false;
+    co_return;
+  }
+  // если первая цель в списке - отсечение, то выбрасываем сигнал отсечения и
+  // рекурсивно обрабатываем оставшиеся цели
+  if (isCut(targets[pos])) {
+    co_yield true;
+    auto andGen = generateAnd(targets, pos + 1);
+    while (auto cut = andGen.next())
+      co_yield *cut;
+    co_return;
+  }
+  // первая цель в списке не является отсечением - вызываем метод поиска ИЛИ
+  auto orGen = generateOr(targets[pos]);
+  while (orGen.next()) {
+    // ветвь параллельного поиска отменена - решения подцелей не нужны
+    if (cancelled())
+      co_return;
+    // рекурсивный вызов метода поиска И для оставшихся подцелей
+    auto andGen = generateAnd(targets, pos + 1);
+    while (auto cut = andGen.next())
+      co_yield *cut;
+  }
+}
+
+// группа ветвей ИЛИ-параллельного поиска. Каждая ветвь доказывает цель своей
+// частью правил-кандидатов в отдельной задаче пула.
+//
+// Ветвь выполняется порциями: задача возобновляет генератор ветви, пока буфер
+// найденных экземпляров цели не заполнится, после чего освобождает поток.
+// Потребитель, разбирая буфер, снова ставит ветвь в очередь пула. Ожидающий
+// потребитель выполняет задачи пула сам
+struct MGraphSolver::OrGroup {
+  static constexpr size_t capacity = 64; // размер буфера ветви
+
+  struct Branch {
+    std::shared_ptr<MGraphSolver> solver;
+    Generator<bool> generator; // уничтожается раньше решателя
+    // найденные экземпляры цели и номер первой свободной переменной ветви
+    // после их нахождения
+    std::deque<std::pair<Atom, Symbol::id_type>> answers;
+    bool scheduled = false;    // задача ветви в очереди пула или выполняется
+    bool done = false;
+    bool cut = false; // ветвь достигла отсечения
+    std::atomic<bool> cancelled = false;
+  };
+
+  OrGroup(Atom target, bool ordered, const std::atomic<bool> *parentCancelled)
+      : target(std::move(target)), ordered(ordered),
+        parentCancelled(parentCancelled) {}
+
+  WorkStealingPool &pool = WorkStealingPool::shared();
+  const Atom target; // цель с примененными связываниями
+  const bool ordered;
+  const std::atomic<bool> *parentCancelled;
+
+  std::vector<std::unique_ptr<Branch>> branches;
+  size_t current = 0; // ветвь, из которой берется следующее решение
+
+  std::mutex mutex;
+  std::condition_variable cond;
+  size_t version = 0; // счетчик изменений состояния ветвей
+  std::exception_ptr error;
+
+  // задачи ставятся в очередь в обратном порядке, чтобы первая ветвь была
+  // выполнена первой в потоке потребителя
+  void start() {
+    std::lock_guard lock(mutex);
+    for (size_t i = branches.size(); i-- > 0;)
+      schedule(i);
+  }
+
+  // вызывается под мьютексом
+  void schedule(size_t i) {
+    auto &branch = *branches[i];
+    if (branch.scheduled || branch.done || branch.cancelled)
       return;
+    branch.scheduled = true;
+    // группа существует, пока у нее есть запланированные ветви (метод
+    // cancelAndWait)
+    pool.submit([this, i]() { step(i); });
+  }
+
+  void cancelFrom(size_t i) {
+    for (; i < branches.size(); ++i)
+      branches[i]->cancelled = true;
+    std::lock_guard lock(mutex);
+    ++version;
+    cond.notify_all();
+  }
+
+  // отменить все ветви и дождаться завершения их задач: после уничтожения
+  // генератора решатели ветвей не должны выполняться. Ожидающий поток
+  // выполняет задачи пула сам
+  void cancelAndWait() {
+    cancelFrom(0);
+    std::unique_lock lock(mutex);
+    auto scheduled = [](auto &branch) { return branch->scheduled; };
+    while (std::ranges::any_of(branches, scheduled)) {
+      auto seen = version;
+      lock.unlock();
+      bool helped = pool.runPending();
+      lock.lock();
+      if (!helped)
+        cond.wait_for(lock, std::chrono::milliseconds(1),
+                      [&]() { return version != seen; });
     }
-    Subst subst = baseSubst;
-    // разбить список целей на голову и хвост, применив к ним текущую
-    // подстановку
-    Atom first = subst.apply(targets.front());
-    std::vector<Atom> rest(targets.begin() + 1, targets.end());
-    for (auto &atom : rest)
-      atom = subst.apply(atom);
-    // если первая цель в списке - отсечение, то выбрасываем специальную
-    // подстановку с флагом отсечения и рекурсивно обрабатываем оставшиеся цели
-    if (first.toString() == "cut" || first.toString() == "!") {
-      output->put({{}, true});
-      auto [worker, andChan] = generateAnd(rest, subst, std::move(allocator));
-      while (true) {
-        // перебрасываем подстановки из промежуточного канала в выходной
-        auto [substEx2, ok2] = andChan->get();
-        // если промежуточный канал закрыт с другого конца - больше подстановок
-        // не будет, завершаем работу
-        if (!ok2)
+  }
+
+  void step(size_t i) {
+    auto &branch = *branches[i];
+    bool finished = false;
+    try {
+      while (!branch.cancelled) {
+        auto cut = branch.generator.next();
+        if (!cut) {
+          finished = true;
           break;
-        if (!output->put({std::move(substEx2.subst), false})) {
-          // если выходной канал закрыли с другого конца - прекращаем работу
-          andChan->close();
-          return;
         }
+        if (*cut) {
+          // отсечение запрещает правила, следующие за правилами ветви
+          cancelFrom(i + 1);
+          std::lock_guard lock(mutex);
+          branch.cut = true;
+          continue;
+        }
+        auto answer = branch.solver->m_bindings.resolve(target);
+        std::lock_guard lock(mutex);
+        branch.answers.emplace_back(std::move(answer),
+                                    branch.solver->m_nextVar);
+        ++version;
+        cond.notify_all();
+        if (branch.answers.size() >= capacity)
+          break;
+      }
+    } catch (...) {
+      std::lock_guard lock(mutex);
+      error = std::current_exception();
+      finished = true;
+    }
+    std::unique_lock lock(mutex);
+    if (finished || branch.cancelled) {
+      // генератор и решатель завершенной ветви уничтожаются вне мьютекса, но
+      // до снятия флага scheduled: после этого группа может быть уничтожена
+      branch.done = true;
+      auto solver = std::move(branch.solver);
+      auto generator = std::move(branch.generator);
+      lock.unlock();
+      generator = {};
+      solver.reset();
+      lock.lock();
+    }
+    branch.scheduled = false;
+    ++version;
+    cond.notify_all();
+  }
+
+  // вызывается под мьютексом
+  std::pair<Atom, Symbol::id_type> pop(size_t i) {
+    auto &branch = *branches[i];
+    auto answer = std::move(branch.answers.front());
+    branch.answers.pop_front();
+    if (branch.answers.size() <= capacity / 2)
+      schedule(i);
+    return answer;
+  }
+
+  std::optional<std::pair<Atom, Symbol::id_type>> next() {
+    std::unique_lock lock(mutex);
+    while (true) {
+      if (error)
+        std::rethrow_exception(std::exchange(error, nullptr));
+      if (parentCancelled && parentCancelled->load()) {
+        lock.unlock();
+        cancelFrom(0);
+        return std::nullopt;
       }
-    } else {
-      // первая цель в списке не является отсечением - вызываем метод поиска ИЛИ
-      auto [orWorker, orChan] = generateOr(std::move(first), subst, allocator);
-      while (true) {
-        // получаем следующую подстановку из промежуточного канала
-        auto [substEx, ok] = orChan->get();
-        if (!ok)
-          break; // канал закрыт, больше подстановок не будет
-        // формируем контейнер использованных имен переменных на основе
-        // полученной подстановки
-        NameAllocator subAllocator = allocator;
-        for (auto &name : substEx.subst.getAllVarNames())
-          subAllocator.allocateName(name);
-        // рекурсивный вызов метода поиска И для оставшихся подцелей
-        auto [andWorker, andChan] =
-            generateAnd(rest, substEx.subst, std::move(subAllocator));
-        while (true) {
-          // перебрасывание генерируемых подстановок из промежуточного канала в
-          // выходной
-          auto [substEx2, ok2] = andChan->get();
-          if (!ok2)
-            break; // канал закрылся, больше подстановок не будет
-          if (!output->put(std::move(substEx2))) {
-            // выходной канал закрыли с другого конца - завершаем работу
-            andChan->close();
-            orChan->close();
-            return;
+      bool pending = false;
+      if (ordered) {
+        // решения ветви выдаются только после всех решений предыдущих ветвей
+        for (; current < branches.size(); ++current) {
+          auto &branch = *branches[current];
+          if (!branch.answers.empty())
+            return pop(current);
+          if (!branch.done && !branch.cancelled) {
+            pending = true;
+            break;
+          }
+          if (branch.cut) {
+            current = branches.size();
+            break;
+          }
+        }
+      } else {
+        for (size_t i = 0; i < branches.size(); ++i) {
+          size_t k = (current + i) % branches.size();
+          auto &branch = *branches[k];
+          if (branch.cancelled)
+            continue;
+          if (!branch.answers.empty()) {
+            current = k + 1;
+            return pop(k);
           }
+          pending = pending || !branch.done;
         }
-        andChan->close();
       }
-      orChan->close();
+      if (!pending)
+        return std::nullopt;
+      // ожидание решений: выполняем задачи пула, а если их нет - ждем
+      // изменения состояния ветвей
+      auto seen = version;
+      lock.unlock();
+      bool helped = pool.runPending();
+      lock.lock();
+      if (!helped)
+        cond.wait_for(lock, std::chrono::milliseconds(1),
+                      [&]() { return version != seen; });
     }
-    output->close();
-  });
-  // возвращаем пару (поток, канал) представляющую генератор
-  return std::make_pair(std::move(worker), output);
+  }
+};
+
+// цель разбивается, если для нее несколько правил-кандидатов. Без сохранения
+// порядка решения ветвей, следующих за правилом с отсечением, могли бы быть
+// выданы до отсечения, поэтому такие цели доказываются последовательно
+bool MGraphSolver::canSplit(const std::vector<const Rule *> &candidates) const {
+  if (candidates.size() < 2)
+    return false;
+  if (m_orParallel == OrParallel::Ordered)
+    return true;
+  for (auto rule : candidates)
+    for (auto &input : rule->getInputs())
+      if (isCut(input))
+        return false;
+  return true;
+}
+
+/**
+ * Метод параллельного поиска ИЛИ.
+ *
+ * target - текущая цель, которую необходимо доказать
+ *
+ * Правила-кандидаты делятся по порядку на части, для каждой части создается
+ * ветвь: отдельный решатель, который доказывает цель с примененными
+ * связываниями только этими правилами (метод generateRules) в задаче пула
+ * потоков. Решатель ветви нумерует новые переменные с первого свободного
+ * номера текущего вывода, поэтому они не совпадают с переменными текущего
+ * вывода. Каждый найденный ветвью экземпляр цели унифицируется с
+ * целью в хранилище.
+ *
+ * Отсечение в правиле ветви отменяет ветви, следующие за ней. Уничтожение
+ * генератора отменяет все ветви группы и ждет завершения их задач.
+ */
+Generator<bool> MGraphSolver::generateOrParallel(Atom target) {
+  auto mark = m_bindings.mark();
+  auto frame = m_nextVar;
+  auto group = std::make_shared<OrGroup>(m_bindings.resolve(target),
+                                         m_orParallel == OrParallel::Ordered,
+                                         m_cancelled);
+  // правила-кандидаты делятся по порядку на части по числу потоков пула (не
+  // менее двух частей)
+  const auto &candidates = m_database->getCandidates(target, m_bindings);
+  size_t count =
+      std::min(candidates.size(), std::max<size_t>(2, group->pool.size()));
+  for (size_t i = 0; i < count; ++i) {
+    std::vector<const Rule *> rules(
+        candidates.begin() + i * candidates.size() / count,
+        candidates.begin() + (i + 1) * candidates.size() / count);
+    auto branch = std::make_unique<OrGroup::Branch>();
+    branch->solver = std::make_shared<MGraphSolver>(m_database, m_atomHooks);
+    branch->solver->m_orParallel = m_orParallel;
+    branch->solver->m_parallelDepth = m_parallelDepth - 1;
+    branch->solver->m_cancelled = &branch->cancelled;
+    branch->solver->m_nextVar = m_nextVar;
+    branch->generator =
+        branch->solver->generateRules(group->target, std::move(rules));
+    group->branches.push_back(std::move(branch));
+  }
+  // отмена ветвей и ожидание их задач при уничтожении генератора
+  struct Guard {
+    std::shared_ptr<OrGroup> group;
+    ~Guard() { group->cancelAndWait(); }
+  } guard{group};
+  group->start();
+  while (auto answer = group->next()) {
+    m_bindings.undo(mark);
+    // переменные, созданные ветвью, становятся переменными текущего вывода
+    m_nextVar = std::max(frame, answer->second);
+    if (unify(target, answer->first, m_bindings))
+      co_yield false;
+  }
+  m_bindings.undo(mark);
+  m_nextVar = frame;
 }
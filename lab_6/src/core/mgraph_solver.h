@@ -1,39 +1,131 @@
 #pragma once
 
 #include "atom_hook.h"
-#include "channel.h"
 #include "database.h"
-#include "name_allocator.h"
+#include "generator.h"
 #include "solver.h"
+#include "trail_subst.h"
+#include <atomic>
 #include <map>
 #include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
+// класс решателя с обратным выводом поиском в глубину по графу И/ИЛИ.
+//
+// Генераторы поиска не передают подстановки друг другу: все связывания
+// переменных записываются в общее хранилище m_bindings с журналом отката.
+// Очередное решение генератора находится в хранилище в момент выдачи значения
+// (true - сигнал отсечения, а не решение). Возобновленный генератор сам
+// откатывает хранилище к своей точке выбора, поэтому потребитель должен
+// возобновлять генераторы в порядке, обратном порядку их создания.
+//
+// В режиме ИЛИ-параллельного поиска альтернативные правила для цели
+// доказываются независимыми задачами общего пула потоков, каждая - своим
+// экземпляром решателя с собственным хранилищем связываний. Найденные задачами
+// экземпляры цели унифицируются с целью в исходном хранилище.
+//
+// Цели табулируемых предикатов базы (Database::setTabled) доказываются через
+// таблицы ответов (линейная табуляция): для каждого варианта цели (цели с
+// точностью до переименования переменных) решения вычисляются один раз и
+// запоминаются. Повторный вызов варианта, который еще вычисляется, получает
+// уже найденные ответы вместо рекурсивного спуска, а вычисление повторяется до
+// неподвижной точки - так завершаются леворекурсивные правила
 class MGraphSolver : public Solver {
 public:
-  // структура подстановки с флагом отсечения
-  struct SubstEx {
-    Subst subst;
-    bool cut;
+  // режим ИЛИ-параллельного поиска
+  enum class OrParallel {
+    Off,       // последовательный поиск в глубину
+    Unordered, // решения выдаются по мере нахождения
+    Ordered,   // решения выдаются в порядке последовательного поиска
   };
 
   MGraphSolver(std::shared_ptr<Database> database,
                std::map<std::string, std::shared_ptr<AtomHook>> atomHooks = {})
       : Solver(std::move(database)), m_atomHooks(std::move(atomHooks)) {}
 
+  // генераторы ссылаются на таблицу обработчиков, поэтому останавливаем поиск
+  // до ее уничтожения
+  ~MGraphSolver() override { done(); }
+
+  // включить ИЛИ-параллельный поиск. Цели разбиваются на задачи, пока
+  // вложенность разбиений не превышает depth; дальше ветви доказываются
+  // последовательно. Без сохранения порядка цели, правила которых содержат
+  // отсечение, не разбиваются
+  void setOrParallel(OrParallel mode, size_t depth = 2);
+
 protected:
-  virtual void solveBackwardThreaded(Atom target,
-                                     Channel<Subst> &output) override;
+  virtual Generator<Subst> generateBackward(Atom target) override;
 
 private:
-  TaskChanPair<SubstEx> generateOr(Atom target, Subst baseSubst,
-                                   NameAllocator allocator);
+  Generator<bool> generateOr(const Atom &target);
+
+  Generator<bool> generateOrBasic(Atom target);
+
+  // доказательство цели одним правилом базы. Сигнал отсечения выдается один
+  // раз, первым значением после достижения отсечения
+  Generator<bool> generateRule(Atom target, const Rule &rule);
 
-  TaskChanPair<SubstEx> generateOrBasic(Atom target, Subst baseSubst,
-                                        NameAllocator allocator);
+  // доказательство цели заданными правилами по порядку для ветви
+  // параллельного поиска. Сигнал отсечения выдается один раз
+  Generator<bool> generateRules(Atom target, std::vector<const Rule *> rules);
 
-  TaskChanPair<SubstEx> generateAnd(std::vector<Atom> targets, Subst baseSubst,
-                                    NameAllocator allocator);
+  // разбить доказательство цели на задачи по правилам-кандидатам
+  Generator<bool> generateOrParallel(Atom target);
+  bool canSplit(const std::vector<const Rule *> &candidates) const;
+
+  Generator<bool> generateHook(std::shared_ptr<AtomHook> hook, Atom target);
+
+  // таблица ответов варианта цели табулируемого предиката
+  struct Table {
+    enum class State {
+      New,        // ответы не вычислялись
+      Evaluating, // вычисляется, вариант есть в стеке m_evaluating
+      Incomplete, // зависит от вычисляемой таблицы, ответы могут добавиться
+      Complete,   // все ответы найдены
+    };
+    State state = State::New;
+    size_t depth = 0;                      // позиция в стеке m_evaluating
+    // ответы в порядке нахождения - факты с пронумерованными переменными
+    std::vector<Rule> answers;
+    std::unordered_set<std::string> keys; // варианты ответов
+  };
+
+  // доказательство цели табулируемого предиката ответами из таблицы
+  Generator<bool> generateTabled(Atom target);
+  // вычислить ответы варианта цели goal (цели с примененными связываниями)
+  void evaluateTable(Table &table, const Atom &goal);
+
+  // targets должен существовать, пока существует генератор
+  Generator<bool> generateAnd(const std::vector<Atom> &targets, size_t pos);
 
   // таблица обработчиков специальных процедур
   std::map<std::string, std::shared_ptr<AtomHook>> m_atomHooks;
+
+  TrailSubst m_bindings; // связывания переменных текущего вывода
+  // номер первой свободной пронумерованной переменной: начало кадра
+  // переменных следующего применения правила
+  Symbol::id_type m_nextVar = 0;
+
+  OrParallel m_orParallel = OrParallel::Off;
+  size_t m_parallelDepth = 0; // допустимая вложенность разбиений
+  // флаг отмены ветви параллельного поиска, которую доказывает решатель
+  const std::atomic<bool> *m_cancelled = nullptr;
+  // ветвь параллельного поиска отменена: перебор прекращается
+  bool cancelled() const {
+    return m_cancelled && m_cancelled->load(std::memory_order_relaxed);
+  }
+
+  // таблицы ответов по ключам вариантов целей
+  std::unordered_map<std::string, Table> m_tables;
+  std::vector<Table *> m_evaluating; // стек вычисляемых таблиц
+  std::vector<Table *> m_incomplete; // незавершенные таблицы компоненты
+  // наименьшая позиция в стеке m_evaluating таблицы, ответы которой
+  // использованы при текущем вычислении
+  size_t m_tableLow = 0;
+  size_t m_answersAdded = 0; // число ответов, добавленных во все таблицы
+
+  struct OrGroup;
 };
@@ -1,5 +1,6 @@
 #include "name_allocator.h"
 #include <algorithm>
+#include <iterator>
 #include <map>
 #include <stdexcept>
 
@@ -7,15 +8,9 @@ bool NameAllocator::allocateName(std::string name) {
   if (name == "_")
     return true;
   auto [base, index] = splitIndexed(std::move(name));
-  if (m_allocated.count(base) == 0) {
-    m_allocated[base] = std::list{index};
-    return true;
-  }
-  auto &indexList = m_allocated[base];
-  auto pos = std::lower_bound(indexList.begin(), indexList.end(), index);
-  if (pos != indexList.end() && *pos == index)
+  if (!m_allocated[base].insert(index))
     return false;
-  indexList.insert(pos, index);
+  m_journal.emplace_back(std::move(base), index);
   return true;
 }
 
@@ -25,35 +20,34 @@ std::string NameAllocator::allocateRenaming(std::string original) {
   if (m_working.count(original) != 0)
     return m_working[original];
   auto [base, index] = splitIndexed(original);
-  if (m_allocated.count(base) == 0) {
-    auto newName = joinIndexed(base, ++index);
-    m_allocated[base] = std::list{index};
-    m_working[original] = newName;
-    return newName;
-  }
-  auto &indexList = m_allocated[base];
-  std::list<int>::iterator pos;
-  do {
-    pos = std::lower_bound(indexList.begin(), indexList.end(), ++index);
-  } while (pos != indexList.end() && *pos == index);
-  indexList.insert(pos, index);
+  auto &indexSet = m_allocated[base];
+  index = indexSet.firstFreeAfter(index);
+  indexSet.insert(index);
   auto newName = joinIndexed(base, index);
   m_working[original] = newName;
+  m_journal.emplace_back(std::move(base), index);
   return newName;
 }
 
 void NameAllocator::commit() { m_working.clear(); }
 
+void NameAllocator::undo(size_t mark) {
+  m_working.clear();
+  while (m_journal.size() > mark) {
+    auto &[base, index] = m_journal.back();
+    m_allocated[base].erase(index);
+    m_journal.pop_back();
+  }
+}
+
 std::string NameAllocator::toString() const {
   std::string res = "{";
   bool first = true;
-  for (auto &[base, indexList] : m_allocated) {
+  for (auto &[base, indexSet] : m_allocated) {
     if (!first)
       res += " ";
     first = false;
-    res += base + ":";
-    for (auto &index : indexList)
-      res += std::to_string(index) + ";";
+    res += base + ":" + indexSet.toString();
   }
   res += "}";
   if (!m_working.empty()) {
@@ -84,3 +78,60 @@ std::pair<std::string, int> NameAllocator::splitIndexed(std::string name) {
 std::string NameAllocator::joinIndexed(std::string name, int index) {
   return name + std::to_string(index);
 }
+
+bool NameAllocator::IndexSet::insert(int index) {
+  auto next = m_runs.upper_bound(index);
+  if (next != m_runs.begin()) {
+    auto prev = std::prev(next);
+    if (prev->second >= index)
+      return false; // номер уже занят
+    if (prev->second == index - 1) {
+      // продлить предыдущий отрезок и, возможно, слить его со следующим
+      prev->second = index;
+      if (next != m_runs.end() && next->first == index + 1) {
+        prev->second = next->second;
+        m_runs.erase(next);
+      }
+      return true;
+    }
+  }
+  if (next != m_runs.end() && next->first == index + 1) {
+    int end = next->second;
+    m_runs.erase(next);
+    m_runs.emplace(index, end);
+    return true;
+  }
+  m_runs.emplace(index, index);
+  return true;
+}
+
+void NameAllocator::IndexSet::erase(int index) {
+  auto next = m_runs.upper_bound(index);
+  if (next == m_runs.begin())
+    return;
+  auto run = std::prev(next);
+  auto [start, end] = *run;
+  if (end < index)
+    return;
+  m_runs.erase(run);
+  if (start < index)
+    m_runs.emplace(start, index - 1);
+  if (index < end)
+    m_runs.emplace(index + 1, end);
+}
+
+int NameAllocator::IndexSet::firstFreeAfter(int index) const {
+  ++index;
+  auto next = m_runs.upper_bound(index);
+  if (next != m_runs.begin() && std::prev(next)->second >= index)
+    return std::prev(next)->second + 1;
+  return index;
+}
+
+std::string NameAllocator::IndexSet::toString() const {
+  std::string res;
+  for (auto [start, end] : m_runs)
+    for (int index = start; index <= end; ++index)
+      res += std::to_string(index) + ";";
+  return res;
+}
@@ -1,8 +1,9 @@
 #pragma once
 
-#include <list>
 #include <map>
 #include <string>
+#include <utility>
+#include <vector>
 
 // класс для хранения использованных имен переменных
 class NameAllocator {
@@ -14,15 +15,36 @@ public:
   // фиксирует все переименования, сделанные методом allocateRenaming
   void commit();
 
+  // метка текущего состояния журнала выделенных имен
+  size_t mark() const { return m_journal.size(); }
+  // освободить все имена, выделенные после получения метки. Используется
+  // при откате к точке выбора вместо копирования всего контейнера
+  void undo(size_t mark);
+
   std::string toString() const;
 
 private:
+  // множество занятых номеров, хранимое отрезками подряд идущих номеров.
+  // Поиск первого свободного номера выполняется за логарифмическое время
+  class IndexSet {
+  public:
+    bool insert(int index);
+    void erase(int index);
+    // наименьший свободный номер, больший index
+    int firstFreeAfter(int index) const;
+    std::string toString() const;
+
+  private:
+    std::map<int, int> m_runs; // начало отрезка -> конец отрезка
+  };
+
   // разделить имя переменной на основу и номер, например x13 -> (x, 13)
   std::pair<std::string, int> splitIndexed(std::string name);
 
   // соединить основу и номер в имя переменной
   std::string joinIndexed(std::string name, int index);
 
-  std::map<std::string, std::list<int>> m_allocated;
+  std::map<std::string, IndexSet> m_allocated;
   std::map<std::string, std::string> m_working;
+  std::vector<std::pair<std::string, int>> m_journal; // выделенные имена
 };
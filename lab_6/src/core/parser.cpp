@@ -1,7 +1,15 @@
 #include "parser.h"
 #include "variable.h"
+#include "work_stealing_pool.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <cstring>
+#include <deque>
+#include <exception>
 #include <memory>
+#include <mutex>
 #include <stdexcept>
 
 /*
@@ -15,7 +23,7 @@
   <arg-list>    ::= IDENT [ ',' <arg-list> ]
 */
 
-Rule RuleParser::ParseRule(const char *str) {
+Rule RuleParser::ParseRule(std::string_view str) {
   m_source = str;
   m_pos = 0;
   Atom firstAtom = ParseAtom();
@@ -44,6 +52,29 @@ Rule RuleParser::ParseRule(const char *str) {
   return Rule(std::move(sources), std::move(target));
 }
 
+Directive RuleParser::ParseDirective(std::string_view str) {
+  m_source = str;
+  m_pos = 0;
+  if (!Eat(":-"))
+    RaiseError("':-' expected");
+  Directive directive;
+  directive.name = ParseIdent();
+  do {
+    std::string name(ParseIdent());
+    if (!Eat("/"))
+      RaiseError("'/' expected");
+    auto arity = ParseIdent();
+    if (arity.find_first_not_of("0123456789") != std::string::npos)
+      RaiseError("arity expected");
+    directive.predicates.emplace_back(std::move(name),
+                                      std::stoul(std::string(arity)));
+  } while (Eat(","));
+  Eat(".");
+  if (SkipWhitespace())
+    RaiseError("directive not fully parsed");
+  return directive;
+}
+
 std::vector<Atom> RuleParser::ParseAtomList() {
   std::vector<Atom> atoms;
   do {
@@ -55,23 +86,23 @@ std::vector<Atom> RuleParser::ParseAtomList() {
 
 Atom RuleParser::ParseAtom() {
   if (Eat("!")) {
-    return Atom("!");
+    return Atom(Intern("!"), {});
   }
-  auto name = ParseIdent();
+  auto name = Intern(ParseIdent());
   if (!Eat("("))
-    return Atom(std::move(name));
+    return Atom(name, {});
   std::vector<Variable::ptr> args;
   do {
     args.push_back(ParseArg());
   } while (Eat(","));
   if (!Eat(")"))
     RaiseError("')' expected");
-  return Atom(std::move(name), std::move(args));
+  return Atom(name, std::move(args));
 }
 
 Variable::ptr RuleParser::ParseArg() {
   if (Peek("\""))
-    return Variable::createString(ParseString());
+    return Constant(ParseString(), true);
   auto name = ParseIdent();
   std::vector<Variable::ptr> args;
   if (Eat("(")) {
@@ -82,63 +113,81 @@ Variable::ptr RuleParser::ParseArg() {
       RaiseError("')' expected");
   }
   if (!args.empty())
-    return Variable::createFuncSym(std::move(name), std::move(args));
+    return Variable::createFuncSym(Intern(name), std::move(args));
   else if (isVar(name))
-    return Variable::createVariable(std::move(name));
+    return Variable::createVariable(Intern(name));
   else
-    return Variable::createConst(std::move(name));
+    return Constant(Intern(name), false);
 }
 
-std::string RuleParser::ParseString() {
+Symbol RuleParser::ParseString() {
   if (!Eat("\""))
     RaiseError("string expected");
-  std::string res;
+  m_buffer.clear();
   size_t size = 0;
-  while (m_source[m_pos + size] && m_source[m_pos + size] != '"') {
-    if (m_source[m_pos + size] == '\\') {
+  while (At(m_pos + size) && At(m_pos + size) != '"') {
+    if (At(m_pos + size) == '\\') {
       size++;
-      if (!m_source[m_pos + size])
+      if (!At(m_pos + size))
         RaiseError("unexpected end of string");
     }
-    res += m_source[m_pos + size];
+    m_buffer += At(m_pos + size);
     size++;
   }
-  if (m_source[m_pos + size] != '"')
+  if (At(m_pos + size) != '"')
     RaiseError("end of string '\"' expected");
   size++;
   m_pos += size;
-  return res;
+  return Intern(m_buffer);
 }
 
-std::string RuleParser::ParseIdent() {
+std::string_view RuleParser::ParseIdent() {
   SkipWhitespace();
   size_t size = 0;
-  while (m_source[m_pos + size] && (std::isalnum(m_source[m_pos + size]) ||
-                                    m_source[m_pos + size] == '_'))
+  while (At(m_pos + size) &&
+         (std::isalnum(At(m_pos + size)) || At(m_pos + size) == '_'))
     size++;
   if (size == 0)
     RaiseError("identifier expected");
-  std::string name(m_source + m_pos, m_source + m_pos + size);
+  auto name = m_source.substr(m_pos, size);
+  // имена вида _G<номер> зарезервированы за пронумерованными переменными
+  if (name.starts_with("_G") && Symbol(name).isNumbered())
+    RaiseError("reserved identifier");
   m_pos += size;
   return name;
 }
 
-bool RuleParser::Peek(const char *expected) {
-  return SkipWhitespace() &&
-         strncmp(m_source + m_pos, expected, strlen(expected)) == 0;
+Symbol RuleParser::Intern(std::string_view name) {
+  if (auto iter = m_symbols.find(name); iter != m_symbols.end())
+    return iter->second;
+  Symbol symbol(name);
+  m_symbols.emplace(symbol.str(), symbol);
+  return symbol;
 }
 
-bool RuleParser::Eat(const char *value) {
+Variable::ptr RuleParser::Constant(Symbol name, bool quoted) {
+  auto &constant = (quoted ? m_strings : m_constants)[name];
+  if (!constant)
+    constant =
+        quoted ? Variable::createString(name) : Variable::createConst(name);
+  return constant;
+}
+
+bool RuleParser::Peek(std::string_view expected) {
+  return SkipWhitespace() && m_source.substr(m_pos).starts_with(expected);
+}
+
+bool RuleParser::Eat(std::string_view value) {
   if (!Peek(value))
     return false;
-  m_pos += std::strlen(value);
+  m_pos += value.size();
   return true;
 }
 
 bool RuleParser::SkipWhitespace() {
-  while (m_source[m_pos] && (m_source[m_pos] == ' ' || m_source[m_pos] == '\t' || m_source[m_pos] == '\n'))
+  while (At(m_pos) == ' ' || At(m_pos) == '\t' || At(m_pos) == '\n')
     m_pos++;
-  return m_source[m_pos] != '\0';
+  return At(m_pos) != '\0';
 }
 
 void RuleParser::RaiseError(const char *message) {
@@ -146,3 +195,162 @@ void RuleParser::RaiseError(const char *message) {
   message_str += " at " + std::to_string(m_pos);
   throw std::runtime_error(message_str);
 }
+
+// часть файла и результат ее разбора
+struct RuleFileParser::Chunk {
+  Chunk(const char *begin, const char *end) : begin(begin), end(end) {}
+
+  const char *begin;
+  const char *end;
+  std::vector<Clause> clauses;
+  size_t lines = 0; // число строк части
+  std::exception_ptr error;
+
+  std::atomic<bool> done = false;
+  std::mutex mutex;
+  std::condition_variable cond;
+
+  void parse();
+  // разобрать часть и сообщить о завершении разбора
+  void run();
+  // дождаться разбора части, выполняя задачи пула
+  void wait(WorkStealingPool &pool);
+};
+
+/**
+ * Метод разбора части файла.
+ *
+ * Части начинаются после строк, заканчивающих предложение, поэтому каждое
+ * предложение целиком лежит в одной части. Однострочные предложения
+ * разбираются прямо из отображенного файла; строки многострочного
+ * предложения склеиваются без разделителя, как при построчном чтении.
+ */
+void RuleFileParser::Chunk::parse() {
+  RuleParser parser;
+  std::string buffer;
+  std::string_view first;
+  bool open = false;      // начато предложение
+  bool multiline = false; // предложение собирается в buffer
+  for (const char *pos = begin; pos != end;) {
+    auto newline = static_cast<const char *>(std::memchr(pos, '\n', end - pos));
+    std::string_view line(pos, (newline ? newline : end) - pos);
+    pos = newline ? newline + 1 : end;
+    lines++;
+    // пропустить пустые строки и комментарии, начинающиеся с символа '#'
+    if (line.empty() || line[0] == '#')
+      continue;
+    if (!open) {
+      first = line;
+      open = true;
+      multiline = false;
+    } else {
+      if (!multiline)
+        buffer.assign(first);
+      multiline = true;
+      buffer += line;
+    }
+    if (line.back() != '.')
+      continue;
+    open = false;
+    std::string_view text = multiline ? std::string_view(buffer) : first;
+    Clause clause{lines, std::nullopt, std::nullopt, {}};
+    try {
+      if (text.starts_with(":-"))
+        clause.directive = parser.ParseDirective(text);
+      else
+        clause.rule = parser.ParseRule(text);
+    } catch (std::exception &err) {
+      clause.error = err.what();
+    }
+    clauses.push_back(std::move(clause));
+  }
+}
+
+void RuleFileParser::Chunk::run() {
+  try {
+    parse();
+  } catch (...) {
+    error = std::current_exception();
+  }
+  std::lock_guard lock(mutex);
+  done = true;
+  cond.notify_all();
+}
+
+void RuleFileParser::Chunk::wait(WorkStealingPool &pool) {
+  while (!done) {
+    if (pool.runPending())
+      continue;
+    std::unique_lock lock(mutex);
+    cond.wait_for(lock, std::chrono::milliseconds(1),
+                  [&]() { return done.load(); });
+  }
+}
+
+RuleFileParser::RuleFileParser(const char *filename, size_t chunkSize)
+    : m_file(filename), m_chunkSize(std::max<size_t>(chunkSize, 1)) {}
+
+const char *RuleFileParser::chunkEnd(const char *from) const {
+  const char *begin = m_file.data();
+  const char *end = begin + m_file.size();
+  while (from < end) {
+    auto newline =
+        static_cast<const char *>(std::memchr(from, '\n', end - from));
+    if (!newline)
+      return end;
+    const char *lineBegin = newline;
+    while (lineBegin != begin && lineBegin[-1] != '\n')
+      lineBegin--;
+    if (newline != lineBegin && *lineBegin != '#' && newline[-1] == '.')
+      return newline + 1;
+    from = newline + 1;
+  }
+  return end;
+}
+
+/**
+ * Метод разбора файла.
+ *
+ * Одновременно разбирается ограниченное число частей, поэтому память под
+ * разобранные, но еще не обработанные предложения не растет с размером
+ * файла. Номера строк предложений части отсчитываются от ее начала и
+ * сдвигаются на число строк предыдущих частей перед передачей обработчику.
+ * Если обработчик выбросил исключение, перед его передачей дожидаются
+ * завершения запущенных задач, так как они читают отображенный файл.
+ */
+void RuleFileParser::parse(const ClauseHandler &handler) {
+  auto &pool = WorkStealingPool::shared();
+  const char *next = m_file.data();
+  const char *end = next + m_file.size();
+  const size_t window = 2 * pool.size() + 1;
+  std::deque<std::shared_ptr<Chunk>> chunks;
+  size_t line = 0;
+  try {
+    while (next != end || !chunks.empty()) {
+      while (next != end && chunks.size() < window) {
+        auto size = std::min<size_t>(m_chunkSize, end - next);
+        auto chunk = std::make_shared<Chunk>(next, chunkEnd(next + size));
+        next = chunk->end;
+        chunks.push_back(chunk);
+        if (chunks.size() == 1 && next == end)
+          chunk->run(); // последняя часть разбирается без пула
+        else
+          pool.submit([chunk]() { chunk->run(); });
+      }
+      auto chunk = std::move(chunks.front());
+      chunks.pop_front();
+      chunk->wait(pool);
+      if (chunk->error)
+        std::rethrow_exception(chunk->error);
+      for (auto &clause : chunk->clauses) {
+        clause.line += line;
+        handler(clause);
+      }
+      line += chunk->lines;
+    }
+  } catch (...) {
+    for (auto &chunk : chunks)
+      chunk->wait(pool);
+    throw;
+  }
+}
@@ -1,7 +1,15 @@
 #pragma once
 
+#include "mapped_file.h"
 #include "rule.h"
+#include "symbol.h"
 #include "variable.h"
+#include <functional>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 /*
@@ -14,25 +22,95 @@
   <atom>        ::= IDENT [ '(' <arg-list> ')' ] | '!'
   <arg-list>    ::= <arg> [ ',' <arg-list> ]
   <arg>         ::= STRING | IDENT [ '(' <arg-list> ')' ]
+
+  EBNF directive grammar:
+
+  <directive>   ::= ':-' IDENT <pred-list> [ '.' ]
+  <pred-list>   ::= IDENT '/' NUMBER [ ',' <pred-list> ]
 */
 
+// директива базы правил, например ':- table path/2.'
+struct Directive {
+  std::string name;
+  std::vector<std::pair<std::string, size_t>> predicates; // имя и арность
+};
+
+// класс разбора правил и директив.
+//
+// Имена интернируются в таблицу символов при разборе. Объект парсера
+// запоминает уже встреченные имена и константы, поэтому при разборе многих
+// предложений одним объектом глобальные таблицы символов и термов
+// затрагиваются только для новых имен
 class RuleParser {
 public:
-  Rule ParseRule(const char *str);
+  Rule ParseRule(std::string_view str);
+  Directive ParseDirective(std::string_view str);
 
 private:
   std::vector<Atom> ParseAtomList();
   Atom ParseAtom();
   Variable::ptr ParseArg();
 
-  std::string ParseString();
-  std::string ParseIdent();
+  Symbol ParseString();
+  std::string_view ParseIdent();
 
-  bool Peek(const char *expected);
-  bool Eat(const char *value);
+  Symbol Intern(std::string_view name);
+  Variable::ptr Constant(Symbol name, bool quoted);
+
+  char At(size_t pos) const {
+    return pos < m_source.size() ? m_source[pos] : '\0';
+  }
+  bool Peek(std::string_view expected);
+  bool Eat(std::string_view value);
   bool SkipWhitespace();
   void RaiseError(const char *message);
 
-  const char *m_source = nullptr;
+  std::string_view m_source;
   size_t m_pos = 0;
+  std::string m_buffer; // строка с раскрытыми escape-последовательностями
+  // ключи - строки таблицы символов, которые не освобождаются
+  std::unordered_map<std::string_view, Symbol> m_symbols;
+  std::unordered_map<Symbol, Variable::ptr> m_constants, m_strings;
+};
+
+// класс потокового разбора файла базы правил.
+//
+// Файл отображается в память и делится на части по границам строк, которыми
+// заканчиваются предложения. Части разбираются параллельно в общем пуле
+// потоков, а предложения передаются обработчику в порядке файла. Предложение
+// может занимать несколько строк и заканчивается строкой, последний символ
+// которой - точка; пустые строки и строки, начинающиеся с '#', пропускаются.
+// Строки, начинающиеся с ':-', являются директивами. Незавершенное
+// предложение в конце файла не разбирается
+class RuleFileParser {
+public:
+  // предложение файла: правило, директива или текст ошибки разбора
+  struct Clause {
+    size_t line; // номер последней строки предложения, начиная с 1
+    std::optional<Rule> rule;
+    std::optional<Directive> directive;
+    std::string error;
+  };
+
+  using ClauseHandler = std::function<void(Clause &)>;
+
+  // размер части по умолчанию
+  static constexpr size_t defaultChunkSize = 4 << 20;
+
+  // при ошибке открытия файла выбрасывает std::runtime_error. Размер части
+  // chunkSize - приблизительный: часть продлевается до конца предложения
+  explicit RuleFileParser(const char *filename,
+                          size_t chunkSize = defaultChunkSize);
+
+  void parse(const ClauseHandler &handler);
+
+private:
+  struct Chunk;
+
+  // начало первой строки после строки, заканчивающей предложение, не раньше
+  // from, или конец файла
+  const char *chunkEnd(const char *from) const;
+
+  MappedFile m_file;
+  size_t m_chunkSize;
 };
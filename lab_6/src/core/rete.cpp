@@ -0,0 +1,354 @@
+#include "rete.h"
+#include "solver.h"
+#include <algorithm>
+#include <map>
+#include <set>
+
+// ключ шаблона входа с точностью до имен переменных: переменные нумеруются в
+// порядке первого вхождения, анонимные переменные всегда различны
+static void patternKey(const Variable::ptr &var,
+                       std::map<std::string, size_t> &names, size_t &anonymous,
+                       std::string &key) {
+  if (var->isVariable()) {
+    if (var->getValue() == "_") {
+      key += "_a" + std::to_string(anonymous++);
+      return;
+    }
+    auto iter = names.try_emplace(var->getValue(), names.size()).first;
+    key += "_" + std::to_string(iter->second);
+    return;
+  }
+  if (!var->isFuncSym()) {
+    key += var->toString();
+    return;
+  }
+  key += var->getValue() + '(';
+  for (auto &arg : var->getArguments()) {
+    patternKey(arg, names, anonymous, key);
+    key += ',';
+  }
+  key += ')';
+}
+
+static std::string patternKey(const Atom &atom) {
+  std::map<std::string, size_t> names;
+  size_t anonymous = 0;
+  std::string key = atom.getName() + '(';
+  for (auto &arg : atom.getArguments()) {
+    patternKey(arg, names, anonymous, key);
+    key += ',';
+  }
+  return key + ')';
+}
+
+void ReteNetwork::addRule(const Rule &rule) {
+  if (rule.isFact()) {
+    assertFact(rule.getOutput());
+    return;
+  }
+  auto &prod = m_productions.emplace_back();
+  prod.rule = rule;
+  const auto &inputs = rule.getInputs();
+  for (size_t pos = 0; pos < inputs.size(); ++pos) {
+    auto alpha = alphaMemoryFor(inputs[pos]);
+    alpha->successors.emplace_back(&prod, pos);
+    prod.alphas.push_back(alpha);
+  }
+  prod.memories.resize(inputs.size() + 1);
+  // токены уровня индексируются по переменной, которая связана предыдущими
+  // входами и является аргументом следующего входа
+  std::set<std::string> bound;
+  for (size_t level = 1; level < inputs.size(); ++level) {
+    auto vars = inputs[level - 1].getAllVars();
+    bound.insert(vars.begin(), vars.end());
+    const auto &args = inputs[level].getArguments();
+    for (size_t i = 0; i < args.size(); ++i) {
+      if (args[i]->isVariable() && args[i]->getValue() != "_" &&
+          bound.count(args[i]->getValue())) {
+        prod.memories[level].joinArg = i;
+        prod.memories[level].joinVar = args[i];
+        break;
+      }
+    }
+  }
+  // корневой токен с пустой подстановкой соединяется с уже имеющимися фактами
+  auto &root = prod.memories[0].tokens.emplace_back();
+  root.production = &prod;
+  root.level = 0;
+  root.parent = nullptr;
+  root.fact = nullptr;
+  root.self = prod.memories[0].tokens.begin();
+  leftActivate(root);
+  processAgenda();
+}
+
+bool ReteNetwork::assertFact(const Atom &fact) {
+  auto &entry = factEntry(fact);
+  if (entry.asserted)
+    return false;
+  entry.asserted = true;
+  enqueue(entry);
+  processAgenda();
+  return true;
+}
+
+bool ReteNetwork::retractFact(const Atom &fact) {
+  auto iter = m_facts.find(fact);
+  if (iter == m_facts.end() || !iter->second.asserted)
+    return false;
+  iter->second.asserted = false;
+
+  // удалить факт и все факты, поддержка которых уменьшилась, - даже если
+  // они еще имеют другие выводы (эти выводы могут быть циклическими)
+  std::vector<Fact *> worklist = {&iter->second};
+  std::vector<Fact *> deleted;
+  while (!worklist.empty()) {
+    auto fact = worklist.back();
+    worklist.pop_back();
+    if (!fact->present)
+      continue;
+    deactivate(*fact, worklist);
+    deleted.push_back(fact);
+  }
+  // восстановить факты, оставшиеся выводимыми из оставшейся рабочей памяти
+  for (auto fact : deleted)
+    enqueue(*fact);
+  processAgenda();
+
+  for (auto fact : deleted) {
+    if (fact->present || fact->asserted || fact->support > 0)
+      continue;
+    Atom atom = fact->atom;
+    m_facts.erase(atom);
+  }
+  return true;
+}
+
+bool ReteNetwork::hasFact(const Atom &fact) const {
+  auto iter = m_facts.find(fact);
+  return iter != m_facts.end() && iter->second.present;
+}
+
+bool ReteNetwork::forEachFact(const Atom &pattern,
+                              const FactHandler &handler) const {
+  auto iter = m_byPredicate.find(ClauseIndex<Rule>::predicateKey(pattern));
+  if (iter == m_byPredicate.end())
+    return true;
+  for (auto fact : iter->second)
+    if (!handler(fact->atom))
+      return false;
+  return true;
+}
+
+ReteNetwork::Fact &ReteNetwork::factEntry(const Atom &atom) {
+  auto [iter, inserted] = m_facts.try_emplace(atom);
+  if (inserted)
+    iter->second.atom = atom;
+  return iter->second;
+}
+
+ReteNetwork::AlphaMemory *ReteNetwork::alphaMemoryFor(const Atom &pattern) {
+  auto &alpha = m_alphas[patternKey(pattern)];
+  if (alpha)
+    return alpha.get();
+  alpha = std::make_unique<AlphaMemory>();
+  alpha->pattern = pattern;
+  alpha->byArg.resize(pattern.getArguments().size());
+  alpha->wildcards.resize(pattern.getArguments().size());
+  auto predicate = ClauseIndex<Rule>::predicateKey(pattern);
+  m_alphasByPredicate[predicate].push_back(alpha.get());
+  // заполнить новую альфа-память уже имеющимися фактами
+  for (auto fact : m_byPredicate[predicate]) {
+    Subst subst;
+    if (Solver::unify(pattern, fact->atom, subst))
+      addToAlpha(*alpha, *fact);
+  }
+  return alpha.get();
+}
+
+void ReteNetwork::addToAlpha(AlphaMemory &alpha, Fact &fact) {
+  auto &positions = alpha.positions[&fact];
+  positions.push_back(alpha.facts.insert(alpha.facts.end(), &fact));
+  const auto &args = fact.atom.getArguments();
+  for (size_t i = 0; i < args.size(); ++i) {
+    auto &list = args[i]->hasVars() ? alpha.wildcards[i] : alpha.byArg[i][args[i]];
+    positions.push_back(list.insert(list.end(), &fact));
+  }
+  fact.alphas.push_back(&alpha);
+}
+
+void ReteNetwork::removeFromAlpha(AlphaMemory &alpha, Fact &fact) {
+  auto node = alpha.positions.extract(&fact);
+  auto &positions = node.mapped();
+  alpha.facts.erase(positions[0]);
+  const auto &args = fact.atom.getArguments();
+  for (size_t i = 0; i < args.size(); ++i) {
+    if (args[i]->hasVars()) {
+      alpha.wildcards[i].erase(positions[i + 1]);
+      continue;
+    }
+    auto bucket = alpha.byArg[i].find(args[i]);
+    bucket->second.erase(positions[i + 1]);
+    if (bucket->second.empty())
+      alpha.byArg[i].erase(bucket);
+  }
+}
+
+void ReteNetwork::enqueue(Fact &fact) {
+  if (fact.queued)
+    return;
+  fact.queued = true;
+  m_agenda.push_back(&fact);
+}
+
+void ReteNetwork::processAgenda() {
+  while (!m_agenda.empty()) {
+    auto fact = m_agenda.front();
+    m_agenda.pop_front();
+    fact->queued = false;
+    if (!fact->present && (fact->asserted || fact->support > 0))
+      activate(*fact);
+  }
+}
+
+void ReteNetwork::activate(Fact &fact) {
+  fact.present = true;
+  m_factsCount++;
+  auto &facts = m_byPredicate[ClauseIndex<Rule>::predicateKey(fact.atom)];
+  fact.predicateIter = facts.insert(facts.end(), &fact);
+
+  // сначала факт добавляется во все подходящие альфа-памяти, затем
+  // выполняются соединения
+  std::vector<std::pair<Production *, size_t>> joins;
+  auto alphasIter =
+      m_alphasByPredicate.find(ClauseIndex<Rule>::predicateKey(fact.atom));
+  if (alphasIter != m_alphasByPredicate.end()) {
+    for (auto alpha : alphasIter->second) {
+      Subst subst;
+      if (!Solver::unify(alpha->pattern, fact.atom, subst))
+        continue;
+      addToAlpha(*alpha, fact);
+      joins.insert(joins.end(), alpha->successors.begin(),
+                   alpha->successors.end());
+    }
+  }
+  // входы одного правила обрабатываются от последнего к первому. Иначе
+  // соединение факта с самим собой (например, для входов path(x, y) и
+  // path(y, z)) было бы построено дважды: один раз при присоединении к
+  // токену, содержащему этот же факт, и один раз при левой активации
+  std::sort(joins.begin(), joins.end(), [](const auto &left, const auto &right) {
+    return left.first != right.first ? left.first < right.first
+                                     : left.second > right.second;
+  });
+  for (auto [prod, pos] : joins)
+    rightActivate(*prod, pos, fact);
+}
+
+void ReteNetwork::deactivate(Fact &fact, std::vector<Fact *> &affected) {
+  fact.present = false;
+  m_factsCount--;
+  m_byPredicate[ClauseIndex<Rule>::predicateKey(fact.atom)].erase(
+      fact.predicateIter);
+  for (auto alpha : fact.alphas)
+    removeFromAlpha(*alpha, fact);
+  fact.alphas.clear();
+  while (!fact.tokens.empty())
+    deleteToken(*fact.tokens.back(), affected);
+}
+
+void ReteNetwork::leftActivate(Token &token) {
+  auto &alpha = *token.production->alphas[token.level];
+  auto pattern =
+      token.subst.apply(token.production->rule.getInputs()[token.level]);
+  // выбрать связанный аргумент с наименьшим числом подходящих фактов
+  const std::list<Fact *> *bucket = &alpha.facts;
+  const std::list<Fact *> *wildcards = nullptr;
+  const auto &args = pattern.getArguments();
+  for (size_t i = 0; i < args.size(); ++i) {
+    if (args[i]->hasVars())
+      continue;
+    auto iter = alpha.byArg[i].find(args[i]);
+    const auto &candidates =
+        iter == alpha.byArg[i].end() ? m_emptyFacts : iter->second;
+    if (candidates.size() + alpha.wildcards[i].size() <
+        bucket->size() + (wildcards ? wildcards->size() : 0)) {
+      bucket = &candidates;
+      wildcards = &alpha.wildcards[i];
+    }
+  }
+  for (auto fact : *bucket)
+    join(token, *fact);
+  if (wildcards)
+    for (auto fact : *wildcards)
+      join(token, *fact);
+}
+
+void ReteNetwork::rightActivate(Production &prod, size_t pos, Fact &fact) {
+  auto &memory = prod.memories[pos];
+  if (!memory.joinArg ||
+      fact.atom.getArguments()[*memory.joinArg]->hasVars()) {
+    for (auto &token : memory.tokens)
+      join(token, fact);
+    return;
+  }
+  auto iter = memory.byKey.find(fact.atom.getArguments()[*memory.joinArg]);
+  if (iter != memory.byKey.end())
+    for (auto token : iter->second)
+      join(*token, fact);
+  for (auto token : memory.unkeyed)
+    join(*token, fact);
+}
+
+void ReteNetwork::join(Token &token, Fact &fact) {
+  auto prod = token.production;
+  auto pattern = token.subst.apply(prod->rule.getInputs()[token.level]);
+  Subst subst = token.subst;
+  if (!Solver::unify(pattern, fact.atom, subst))
+    return;
+
+  auto &memory = prod->memories[token.level + 1];
+  auto &child = memory.tokens.emplace_back();
+  child.production = prod;
+  child.level = token.level + 1;
+  child.parent = &token;
+  child.fact = &fact;
+  child.subst = std::move(subst);
+  child.self = std::prev(memory.tokens.end());
+  if (memory.joinArg) {
+    auto key = child.subst.apply(memory.joinVar);
+    child.bucket = key->hasVars() ? &memory.unkeyed : &memory.byKey[key];
+    child.bucketIter = child.bucket->insert(child.bucket->end(), &child);
+  }
+  child.parentIter = token.children.insert(token.children.end(), &child);
+  child.factIter = fact.tokens.insert(fact.tokens.end(), &child);
+
+  if (child.level < prod->alphas.size()) {
+    leftActivate(child);
+    return;
+  }
+  // все входы правила соединены: вывести факт. Активация выведенного факта
+  // откладывается до обработки очереди
+  auto derived = child.subst.apply(prod->rule.getOutput());
+  auto &entry = factEntry(derived);
+  entry.support++;
+  child.derived = &entry;
+  enqueue(entry);
+}
+
+void ReteNetwork::deleteToken(Token &token, std::vector<Fact *> &affected) {
+  while (!token.children.empty())
+    deleteToken(*token.children.back(), affected);
+  if (token.derived) {
+    token.derived->support--;
+    affected.push_back(token.derived);
+  }
+  token.parent->children.erase(token.parentIter);
+  token.fact->tokens.erase(token.factIter);
+  auto &memory = token.production->memories[token.level];
+  if (token.bucket) {
+    token.bucket->erase(token.bucketIter);
+    if (token.bucket != &memory.unkeyed && token.bucket->empty())
+      memory.byKey.erase(token.subst.apply(memory.joinVar));
+  }
+  memory.tokens.erase(token.self);
+}
@@ -0,0 +1,157 @@
+#pragma once
+
+#include "atom.h"
+#include "clause_index.h"
+#include "rule.h"
+#include "subst.h"
+#include <deque>
+#include <functional>
+#include <list>
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// класс сети Rete для инкрементального прямого вывода.
+//
+// Каждый вход правила связан с альфа-памятью - множеством фактов рабочей
+// памяти, сопоставимых с шаблоном входа. Одинаковые (с точностью до имен
+// переменных) шаблоны разделяют одну альфа-память. Для каждого правила
+// строится цепочка бета-памятей: на уровне i хранятся токены - частичные
+// соединения первых i входов правила с фактами. Токены последнего уровня
+// выводят новые факты.
+//
+// При утверждении факта вычисляются только новые соединения с его участием.
+// Для каждого выведенного факта хранится число выводящих его токенов. При
+// отзыве факта удаляются все зависящие от него токены и выведенные через них
+// факты, после чего восстанавливаются факты, оставшиеся выводимыми другими
+// способами (алгоритм DRed). Это корректно и для рекурсивных правил, где
+// выведенный факт может косвенно поддерживать сам себя.
+class ReteNetwork {
+public:
+  using FactHandler = std::function<bool(const Atom &)>;
+
+  ReteNetwork() = default;
+  ReteNetwork(const ReteNetwork &) = delete;
+  ReteNetwork &operator=(const ReteNetwork &) = delete;
+
+  // добавить правило в сеть. Правило без входов утверждается как факт
+  void addRule(const Rule &rule);
+
+  // утвердить факт. Возвращает false, если факт уже был утвержден
+  bool assertFact(const Atom &fact);
+
+  // отозвать утвержденный факт вместе с выводами, которые без него более не
+  // выводимы. Возвращает false, если факт не был утвержден
+  bool retractFact(const Atom &fact);
+
+  // находится ли факт в рабочей памяти (утвержден или выведен)
+  bool hasFact(const Atom &fact) const;
+  size_t factsCount() const { return m_factsCount; }
+
+  // перебрать факты рабочей памяти с тем же предикатом, что и у шаблона.
+  // Перебор прекращается, если обработчик вернул false; в этом случае метод
+  // также возвращает false
+  bool forEachFact(const Atom &pattern, const FactHandler &handler) const;
+
+private:
+  struct AlphaMemory;
+  struct Production;
+  struct Token;
+
+  // факт рабочей памяти
+  struct Fact {
+    Atom atom;
+    bool asserted = false; // факт утвержден явно
+    bool present = false;  // факт находится в рабочей памяти
+    bool queued = false;   // факт ожидает активации в очереди
+    size_t support = 0;    // число токенов, выводящих факт
+    std::list<Fact *>::iterator predicateIter;
+    std::vector<AlphaMemory *> alphas; // альфа-памяти, содержащие факт
+    std::list<Token *> tokens; // токены, последним фактом которых он является
+  };
+
+  using TermIndex = std::unordered_map<Variable::ptr, std::list<Fact *>,
+                                       TermHash, TermEqual>;
+
+  // альфа-память входа. Факты индексируются по значениям аргументов, факты с
+  // переменной в аргументе подходят под любое значение этого аргумента
+  struct AlphaMemory {
+    Atom pattern;
+    std::list<Fact *> facts;
+    std::vector<TermIndex> byArg;
+    std::vector<std::list<Fact *>> wildcards;
+    std::vector<std::pair<Production *, size_t>> successors;
+    // позиции факта в списках альфа-памяти для удаления за O(1)
+    std::unordered_map<Fact *, std::vector<std::list<Fact *>::iterator>>
+        positions;
+  };
+
+  // бета-память уровня правила. Токены индексируются по значению переменной,
+  // связывающей уровень со следующим входом правила
+  struct BetaMemory {
+    std::list<Token> tokens;
+    std::optional<size_t> joinArg; // аргумент входа, равный joinVar
+    Variable::ptr joinVar;
+    std::unordered_map<Variable::ptr, std::list<Token *>, TermHash, TermEqual>
+        byKey;
+    std::list<Token *> unkeyed; // токены с несвязанным значением joinVar
+  };
+
+  // откомпилированное правило с цепочкой бета-памятей
+  struct Production {
+    Rule rule;
+    std::vector<AlphaMemory *> alphas; // альфа-память каждого входа
+    std::vector<BetaMemory> memories;  // бета-память каждого уровня
+  };
+
+  // частичное соединение входов правила
+  struct Token {
+    Production *production;
+    size_t level;
+    Token *parent;
+    Fact *fact; // факт, присоединенный на этом уровне
+    Subst subst;
+    std::list<Token *> children;
+    Fact *derived = nullptr; // факт, выведенный токеном последнего уровня
+    // позиции токена в списках для удаления за O(1)
+    std::list<Token>::iterator self;
+    std::list<Token *>::iterator parentIter;
+    std::list<Token *>::iterator factIter;
+    std::list<Token *> *bucket = nullptr; // список индекса бета-памяти
+    std::list<Token *>::iterator bucketIter;
+  };
+
+  struct AtomHash {
+    size_t operator()(const Atom &atom) const { return atom.hash(); }
+  };
+
+  Fact &factEntry(const Atom &atom);
+  AlphaMemory *alphaMemoryFor(const Atom &pattern);
+
+  void enqueue(Fact &fact);
+  void processAgenda();
+
+  void activate(Fact &fact);
+  void deactivate(Fact &fact, std::vector<Fact *> &affected);
+
+  void addToAlpha(AlphaMemory &alpha, Fact &fact);
+  void removeFromAlpha(AlphaMemory &alpha, Fact &fact);
+
+  void leftActivate(Token &token);
+  void rightActivate(Production &prod, size_t pos, Fact &fact);
+  void join(Token &token, Fact &fact);
+  void deleteToken(Token &token, std::vector<Fact *> &affected);
+
+  std::unordered_map<Atom, Fact, AtomHash> m_facts;
+  // факты рабочей памяти по предикатам в порядке добавления
+  std::unordered_map<ClauseIndex<Rule>::Key, std::list<Fact *>> m_byPredicate;
+  std::unordered_map<std::string, std::unique_ptr<AlphaMemory>> m_alphas;
+  std::unordered_map<ClauseIndex<Rule>::Key, std::vector<AlphaMemory *>>
+      m_alphasByPredicate;
+  std::list<Production> m_productions;
+  std::deque<Fact *> m_agenda; // факты, ожидающие активации
+  size_t m_factsCount = 0;
+  const std::list<Fact *> m_emptyFacts;
+};
@@ -1,9 +1,23 @@
 #include "rule.h"
 
+static std::shared_ptr<const NumberedRule>
+numberRule(const std::vector<Atom> &inputs, const Atom &output) {
+  auto numbered = std::make_shared<NumberedRule>();
+  std::unordered_map<Symbol, Symbol::id_type> numbers;
+  numbered->output = output.numberedVars(numbers);
+  numbered->inputs.reserve(inputs.size());
+  for (auto &input : inputs)
+    numbered->inputs.push_back(input.numberedVars(numbers));
+  numbered->varsCount = numbers.size();
+  return numbered;
+}
+
 Rule::Rule(std::vector<Atom> inputs, Atom output)
-    : m_inputs(std::move(inputs)), m_output(std::move(output)) {}
+    : m_inputs(std::move(inputs)), m_output(std::move(output)),
+      m_numbered(numberRule(m_inputs, m_output)) {}
 
-Rule::Rule(Atom output) : m_output(std::move(output)) {}
+Rule::Rule(Atom output)
+    : m_output(std::move(output)), m_numbered(numberRule(m_inputs, m_output)) {}
 
 bool Rule::mightProve(const Atom &target) const {
   return m_output.getName() == target.getName() &&
@@ -1,6 +1,18 @@
 #pragma once
 
 #include "atom.h"
+#include <memory>
+
+// правило с пронумерованными переменными: переменные правила заменены
+// переменными Symbol::variable(0), ..., Symbol::variable(varsCount - 1) в
+// порядке первого вхождения. Каждое применение правила при обратном выводе
+// получает кадр из varsCount новых переменных, и переименование переменных
+// сводится к сдвигу номеров на начало кадра (метод Atom::shiftedVars)
+struct NumberedRule {
+  std::vector<Atom> inputs;
+  Atom output;
+  Symbol::id_type varsCount = 0;
+};
 
 class Rule {
 public:
@@ -11,6 +23,9 @@ public:
   const std::vector<Atom> &getInputs() const { return m_inputs; }
   const Atom &getOutput() const { return m_output; }
 
+  // правило с пронумерованными переменными, построенное при создании правила
+  const NumberedRule &getNumbered() const { return *m_numbered; }
+
   bool isFact() const { return m_inputs.empty(); }
   bool mightProve(const Atom &target) const;
 
@@ -19,6 +34,7 @@ public:
 private:
   std::vector<Atom> m_inputs;
   Atom m_output;
+  std::shared_ptr<const NumberedRule> m_numbered;
 };
 
 namespace std {
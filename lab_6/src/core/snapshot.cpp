@@ -0,0 +1,276 @@
+#include "snapshot.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string_view>
+
+namespace {
+
+constexpr char snapshotMagic[8] = {'E', 'S', 'D', 'S', 'N', 'A', 'P', '\0'};
+constexpr std::uint32_t snapshotVersion = 1;
+
+// слова заголовка после сигнатуры
+enum HeaderWord {
+  Version = 2,
+  SymbolsCount,
+  StringsWords,
+  TermsCount,
+  ArgsCount,
+  AtomsCount,
+  RulesCount,
+  TabledCount,
+  HeaderWords,
+};
+
+// виды термов и размеры записей секций в словах. Запись терма: вид, символ,
+// начало и число аргументов; атома: символ, начало и число аргументов;
+// правила: номер атома выхода и число входов; табулируемого предиката:
+// символ и арность
+enum TermKind : std::uint32_t { Const, String, Var, FuncSym };
+constexpr size_t termWords = 4;
+constexpr size_t atomWords = 3;
+constexpr size_t ruleWords = 2;
+constexpr size_t tabledWords = 2;
+
+std::runtime_error invalidSnapshot(const std::string &what) {
+  return std::runtime_error("invalid snapshot: " + what);
+}
+
+} // namespace
+
+void SnapshotWriter::addRule(const Rule &rule) {
+  m_rules.push_back(m_atoms.size() / atomWords);
+  m_rules.push_back(rule.getInputs().size());
+  addAtom(rule.getOutput());
+  for (auto &input : rule.getInputs())
+    addAtom(input);
+}
+
+void SnapshotWriter::addTabled(Symbol name, size_t arity) {
+  m_tabled.push_back(symbolIndex(name));
+  m_tabled.push_back(arity);
+}
+
+std::uint32_t SnapshotWriter::symbolIndex(Symbol symbol) {
+  auto [iter, inserted] = m_symbols.emplace(symbol, m_symbols.size());
+  if (inserted) {
+    m_strings += symbol.str();
+    m_offsets.push_back(m_strings.size());
+  }
+  return iter->second;
+}
+
+/**
+ * Метод получения номера терма в снимке.
+ *
+ * Аргументы записываются раньше терма, поэтому при чтении терм строится из
+ * уже построенных аргументов. Один и тот же объект терма (в частности, любой
+ * основной терм, так как они хешируются по структуре) записывается один раз.
+ */
+std::uint32_t SnapshotWriter::termIndex(const Variable::ptr &term) {
+  if (auto iter = m_termIndex.find(term.get()); iter != m_termIndex.end())
+    return iter->second;
+  std::vector<std::uint32_t> args;
+  for (auto &arg : term->getArguments())
+    args.push_back(termIndex(arg));
+  TermKind kind = term->isFuncSym()    ? FuncSym
+                  : term->isVariable() ? Var
+                  : term->isQuoted()   ? String
+                                       : Const;
+  auto index = static_cast<std::uint32_t>(m_terms.size() / termWords);
+  m_terms.insert(m_terms.end(),
+                 {kind, symbolIndex(term->getSymbol()),
+                  static_cast<std::uint32_t>(m_args.size()),
+                  static_cast<std::uint32_t>(args.size())});
+  m_args.insert(m_args.end(), args.begin(), args.end());
+  m_termIndex.emplace(term.get(), index);
+  return index;
+}
+
+void SnapshotWriter::addAtom(const Atom &atom) {
+  std::vector<std::uint32_t> args;
+  for (auto &arg : atom.getArguments())
+    args.push_back(termIndex(arg));
+  m_atoms.insert(m_atoms.end(), {symbolIndex(atom.getSymbol()),
+                                 static_cast<std::uint32_t>(m_args.size()),
+                                 static_cast<std::uint32_t>(args.size())});
+  m_args.insert(m_args.end(), args.begin(), args.end());
+}
+
+void SnapshotWriter::write(const char *filename) const {
+  std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+  if (!file.is_open())
+    throw std::runtime_error(std::string("failed to open ") + filename);
+  auto strings = m_strings;
+  strings.resize((strings.size() + 3) / 4 * 4, '\0');
+  std::uint32_t header[HeaderWords] = {};
+  std::memcpy(header, snapshotMagic, sizeof(snapshotMagic));
+  header[Version] = snapshotVersion;
+  header[SymbolsCount] = m_offsets.size() - 1;
+  header[StringsWords] = strings.size() / 4;
+  header[TermsCount] = m_terms.size() / termWords;
+  header[ArgsCount] = m_args.size();
+  header[AtomsCount] = m_atoms.size() / atomWords;
+  header[RulesCount] = m_rules.size() / ruleWords;
+  header[TabledCount] = m_tabled.size() / tabledWords;
+  auto writeWords = [&](const std::uint32_t *data, size_t size) {
+    file.write(reinterpret_cast<const char *>(data),
+               size * sizeof(std::uint32_t));
+  };
+  writeWords(header, HeaderWords);
+  writeWords(m_offsets.data() + 1, m_offsets.size() - 1);
+  file.write(strings.data(), strings.size());
+  writeWords(m_terms.data(), m_terms.size());
+  writeWords(m_args.data(), m_args.size());
+  writeWords(m_atoms.data(), m_atoms.size());
+  writeWords(m_rules.data(), m_rules.size());
+  writeWords(m_tabled.data(), m_tabled.size());
+  file.close();
+  if (!file)
+    throw std::runtime_error(std::string("failed to write ") + filename);
+}
+
+SnapshotReader::SnapshotReader(const char *filename) : m_file(filename) {
+  if (m_file.size() < HeaderWords * 4)
+    throw invalidSnapshot(std::string(filename) + " is too short");
+  mapSections();
+  validate();
+  m_symbols.reserve(m_header.data[SymbolsCount]);
+  auto strings = reinterpret_cast<const char *>(m_strings.data);
+  for (size_t i = 0, begin = 0; i < m_offsets.size; ++i) {
+    m_symbols.emplace_back(
+        std::string_view(strings + begin, m_offsets.data[i] - begin));
+    begin = m_offsets.data[i];
+  }
+}
+
+bool SnapshotReader::isSnapshot(const char *filename) {
+  std::ifstream file(filename, std::ios::binary);
+  char magic[sizeof(snapshotMagic)];
+  return file.read(magic, sizeof(magic)) &&
+         std::memcmp(magic, snapshotMagic, sizeof(magic)) == 0;
+}
+
+size_t SnapshotReader::rulesCount() const { return m_header.data[RulesCount]; }
+
+void SnapshotReader::mapSections() {
+  auto words = reinterpret_cast<const std::uint32_t *>(m_file.data());
+  if (std::memcmp(words, snapshotMagic, sizeof(snapshotMagic)) != 0)
+    throw invalidSnapshot("bad signature");
+  if (words[Version] != snapshotVersion)
+    throw invalidSnapshot("unsupported version");
+  // секции следуют одна за другой сразу после заголовка
+  size_t offset = 0;
+  auto section = [&](Section &section, size_t size) {
+    section = {words + offset, size};
+    offset += size;
+  };
+  section(m_header, HeaderWords);
+  section(m_offsets, words[SymbolsCount]);
+  section(m_strings, words[StringsWords]);
+  section(m_terms, size_t(words[TermsCount]) * termWords);
+  section(m_args, words[ArgsCount]);
+  section(m_atoms, size_t(words[AtomsCount]) * atomWords);
+  section(m_rules, size_t(words[RulesCount]) * ruleWords);
+  section(m_tabled, size_t(words[TabledCount]) * tabledWords);
+  if (offset * 4 != m_file.size())
+    throw invalidSnapshot("bad size");
+}
+
+/**
+ * Метод проверки снимка.
+ *
+ * Проверяется, что все номера символов, термов и атомов указывают внутрь
+ * своих секций, а аргументы терма записаны раньше него. Поэтому чтение
+ * поврежденного снимка не выходит за границы отображенного файла.
+ */
+void SnapshotReader::validate() const {
+  size_t symbols = m_offsets.size;
+  for (size_t i = 0, prev = 0; i < symbols; ++i) {
+    if (m_offsets.data[i] < prev || m_offsets.data[i] > m_strings.size * 4)
+      throw invalidSnapshot("bad symbol table");
+    prev = m_offsets.data[i];
+  }
+  // аргументы [first, first + count) существуют и являются термами с
+  // номерами меньше limit
+  auto checkArgs = [&](size_t first, size_t count, size_t limit) {
+    if (first + count > m_args.size)
+      return false;
+    return std::all_of(m_args.data + first, m_args.data + first + count,
+                       [&](std::uint32_t arg) { return arg < limit; });
+  };
+  for (size_t i = 0; i < m_terms.size / termWords; ++i) {
+    auto term = m_terms.data + i * termWords;
+    bool simple = term[0] != FuncSym;
+    if (term[0] > FuncSym || term[1] >= symbols ||
+        simple != (term[3] == 0) || !checkArgs(term[2], term[3], i))
+      throw invalidSnapshot("bad term " + std::to_string(i));
+  }
+  for (size_t i = 0; i < m_atoms.size / atomWords; ++i) {
+    auto atom = m_atoms.data + i * atomWords;
+    if (atom[0] >= symbols ||
+        !checkArgs(atom[1], atom[2], m_terms.size / termWords))
+      throw invalidSnapshot("bad atom " + std::to_string(i));
+  }
+  for (size_t i = 0; i < m_rules.size / ruleWords; ++i) {
+    auto rule = m_rules.data + i * ruleWords;
+    if (size_t(rule[0]) + rule[1] >= m_atoms.size / atomWords)
+      throw invalidSnapshot("bad rule " + std::to_string(i));
+  }
+  for (size_t i = 0; i < m_tabled.size / tabledWords; ++i)
+    if (m_tabled.data[i * tabledWords] >= symbols)
+      throw invalidSnapshot("bad tabled predicate");
+}
+
+void SnapshotReader::forEachRule(
+    const std::function<void(Rule)> &handler) const {
+  std::vector<Variable::ptr> terms;
+  terms.reserve(m_terms.size / termWords);
+  std::vector<Variable::ptr> args;
+  for (size_t i = 0; i < m_terms.size / termWords; ++i) {
+    auto term = m_terms.data + i * termWords;
+    auto symbol = m_symbols[term[1]];
+    switch (term[0]) {
+    case Const:
+      terms.push_back(Variable::createConst(symbol));
+      break;
+    case String:
+      terms.push_back(Variable::createString(symbol));
+      break;
+    case Var:
+      terms.push_back(Variable::createVariable(symbol));
+      break;
+    default:
+      args.clear();
+      for (size_t j = 0; j < term[3]; ++j)
+        args.push_back(terms[m_args.data[term[2] + j]]);
+      terms.push_back(Variable::createFuncSym(symbol, args));
+    }
+  }
+  for (size_t i = 0; i < m_rules.size / ruleWords; ++i) {
+    auto rule = m_rules.data + i * ruleWords;
+    std::vector<Atom> inputs;
+    inputs.reserve(rule[1]);
+    for (size_t j = 1; j <= rule[1]; ++j)
+      inputs.push_back(buildAtom(rule[0] + j, terms));
+    handler(Rule(std::move(inputs), buildAtom(rule[0], terms)));
+  }
+}
+
+void SnapshotReader::forEachTabled(
+    const std::function<void(Symbol name, size_t arity)> &handler) const {
+  for (size_t i = 0; i < m_tabled.size / tabledWords; ++i)
+    handler(m_symbols[m_tabled.data[i * tabledWords]],
+            m_tabled.data[i * tabledWords + 1]);
+}
+
+Atom SnapshotReader::buildAtom(size_t index,
+                               const std::vector<Variable::ptr> &terms) const {
+  auto atom = m_atoms.data + index * atomWords;
+  std::vector<Variable::ptr> args;
+  args.reserve(atom[2]);
+  for (size_t j = 0; j < atom[2]; ++j)
+    args.push_back(terms[m_args.data[atom[1] + j]]);
+  return Atom(m_symbols[atom[0]], std::move(args));
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "atom.h"
+#include "mapped_file.h"
+#include "rule.h"
+#include "symbol.h"
+#include "variable.h"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// двоичный снимок базы правил.
+//
+// Файл снимка состоит из заголовка и секций 32-битных чисел в порядке байтов
+// машины: таблица символов (смещения имен и строки имен), плоский массив
+// термов, в котором аргументы терма записаны раньше самого терма, массив
+// номеров аргументов термов, массив атомов (выход правила и следом его
+// входы), массив правил и табулируемые предикаты. Одинаковые термы
+// записываются один раз. Снимок читается из отображенного в память файла без
+// разбора текста
+
+// класс построения снимка базы правил
+class SnapshotWriter {
+public:
+  void addRule(const Rule &rule);
+  void addTabled(Symbol name, size_t arity);
+
+  // записать снимок в файл. При ошибке записи выбрасывает std::runtime_error
+  void write(const char *filename) const;
+
+private:
+  std::uint32_t symbolIndex(Symbol symbol);
+  std::uint32_t termIndex(const Variable::ptr &term);
+  void addAtom(const Atom &atom);
+
+  std::vector<std::uint32_t> m_offsets{0}; // смещения концов имен
+  std::string m_strings;
+  std::unordered_map<Symbol, std::uint32_t> m_symbols;
+  std::unordered_map<const Variable *, std::uint32_t> m_termIndex;
+  // секции снимка: записи термов, номера аргументов, записи атомов, правил и
+  // табулируемых предикатов
+  std::vector<std::uint32_t> m_terms;
+  std::vector<std::uint32_t> m_args;
+  std::vector<std::uint32_t> m_atoms;
+  std::vector<std::uint32_t> m_rules;
+  std::vector<std::uint32_t> m_tabled;
+};
+
+// класс чтения снимка из отображенного в память файла. При ошибке открытия
+// или повреждении файла конструктор выбрасывает std::runtime_error
+class SnapshotReader {
+public:
+  explicit SnapshotReader(const char *filename);
+
+  // является ли файл снимком (проверяется только сигнатура)
+  static bool isSnapshot(const char *filename);
+
+  size_t rulesCount() const;
+
+  // перебрать правила снимка в порядке записи. Каждый терм строится один раз
+  // и разделяется всеми правилами, в которых встречается
+  void forEachRule(const std::function<void(Rule)> &handler) const;
+  void forEachTabled(
+      const std::function<void(Symbol name, size_t arity)> &handler) const;
+
+private:
+  // секция снимка: начало и число 32-битных слов
+  struct Section {
+    const std::uint32_t *data = nullptr;
+    size_t size = 0;
+  };
+
+  // разметить секции по заголовку; проверить содержимое секций
+  void mapSections();
+  void validate() const;
+  Atom buildAtom(size_t index, const std::vector<Variable::ptr> &terms) const;
+
+  MappedFile m_file;
+  Section m_header, m_offsets, m_strings, m_terms, m_args, m_atoms, m_rules,
+      m_tabled;
+  std::vector<Symbol> m_symbols; // символы таблицы снимка в этом процессе
+};
@@ -1,19 +1,110 @@
 #include "solver.h"
 #include "channel.h"
 #include "database.h"
+#include "join_planner.h"
 #include "subst.h"
+#include "work_stealing_pool.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
 #include <memory>
+#include <mutex>
 #include <optional>
 #include <thread>
+#include <unordered_set>
+
+namespace {
+
+// отношения с меньшим числом новых фактов не делятся между задачами
+constexpr size_t minPartSize = 256;
+
+struct AtomPtrHash {
+  size_t operator()(const Atom *atom) const { return atom->hash(); }
+};
+
+struct AtomPtrEqual {
+  bool operator()(const Atom *left, const Atom *right) const {
+    return *left == *right;
+  }
+};
+
+// задача соединения входов правила на одной итерации прямого вывода
+struct JoinTask {
+  const Rule *rule;
+  size_t deltaPos;
+  std::vector<size_t> order;
+  WorkingDataset::Part part;
+  // выведенные факты, которых нет в рабочей памяти, без повторов внутри
+  // задачи. Повторы между задачами отбрасываются при слиянии
+  std::deque<Atom> facts;
+  std::unordered_set<const Atom *, AtomPtrHash, AtomPtrEqual> seen;
+
+  void addFact(Atom fact) {
+    if (seen.count(&fact) != 0)
+      return;
+    facts.push_back(std::move(fact));
+    seen.insert(&facts.back());
+  }
+};
+
+// выполнить задачи в пуле и дождаться их завершения. Ожидающий поток сам
+// выполняет задачи пула; исключение задачи передается вызывающему потоку
+void runJoinTasks(WorkStealingPool &pool, std::vector<JoinTask> &tasks,
+                  const std::function<void(JoinTask &)> &run) {
+  if (tasks.size() == 1 || pool.size() < 2) {
+    for (auto &task : tasks)
+      run(task);
+    return;
+  }
+  struct State {
+    std::atomic<size_t> remaining;
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::exception_ptr error;
+  };
+  auto state = std::make_shared<State>();
+  state->remaining = tasks.size();
+  for (auto &task : tasks) {
+    pool.submit([state, &task, &run]() {
+      try {
+        run(task);
+      } catch (...) {
+        std::lock_guard lock(state->mutex);
+        if (!state->error)
+          state->error = std::current_exception();
+      }
+      if (--state->remaining == 0) {
+        std::lock_guard lock(state->mutex);
+        state->cond.notify_all();
+      }
+    });
+  }
+  while (state->remaining != 0) {
+    if (pool.runPending())
+      continue;
+    std::unique_lock lock(state->mutex);
+    state->cond.wait_for(lock, std::chrono::milliseconds(1),
+                         [&]() { return state->remaining == 0; });
+  }
+  if (state->error)
+    std::rethrow_exception(state->error);
+}
+
+} // namespace
 
 Solver::Solver(std::shared_ptr<Database> database)
-    : m_database(std::move(database)) {}
+    : m_database(std::move(database)), m_pool(&WorkStealingPool::shared()) {}
 
 Solver::~Solver() { done(); }
 
 void Solver::solveForward(Atom target) {
   done();
-  m_channel = std::make_shared<Channel<Subst>>();
+  // в отличие от небуферизованного канала поток вывода не ждет каждого
+  // чтения и может опередить потребителя на емкость канала (64 ответа)
+  m_channel = std::make_shared<RingChannel<Subst>>();
   m_solverThread = std::thread(
       [this, lock = shared_from_this(), target = std::move(target)]() {
         solveForwardThreaded(std::move(target), *m_channel);
@@ -23,15 +114,12 @@ void Solver::solveForward(Atom target) {
 
 void Solver::solveBackward(Atom target) {
   done();
-  m_channel = std::make_shared<Channel<Subst>>();
-  m_solverThread = std::thread(
-      [this, lock = shared_from_this(), target = std::move(target)]() {
-        solveBackwardThreaded(std::move(target), *m_channel);
-        m_channel->close();
-      });
+  m_generator = generateBackward(std::move(target));
 }
 
 std::optional<Subst> Solver::next() {
+  if (m_generator)
+    return m_generator.next();
   if (!m_channel)
     return std::nullopt;
   auto [subst, ok] = m_channel->get();
@@ -39,20 +127,35 @@ std::optional<Subst> Solver::next() {
 }
 
 void Solver::done() {
+  // уничтожение генератора прерывает обратный вывод
+  m_generator = {};
   if (m_solverThread.joinable()) {
     m_channel->close();
     m_solverThread.join();
   }
 }
 
-void Solver::solveForwardThreaded(Atom target, Channel<Subst> &output) {
+void Solver::solveForwardThreaded(Atom target,
+                                  RingChannel<Subst> &output) {
+  if (auto rete = m_database->getRete()) {
+    // рабочая память сети Rete уже содержит все выводимые факты
+    rete->forEachFact(target, [&](const Atom &fact) {
+      Subst subst;
+      if (!unify(fact, target, subst))
+        return true;
+      bool wasEmpty = subst.empty();
+      return output.put(std::move(subst)) && !wasEmpty;
+    });
+    return;
+  }
   WorkingDataset workset;
+  JoinPlanner planner;
   for (auto &rule : m_database->getRules()) {
     if (!rule.isFact())
       continue;
     // проверить, находится ли цель среди фактов в базе правил
     Subst subst;
-    if (unify(rule.getOutput(), target, subst)) {
+    if (rule.mightProve(target) && unify(rule.getOutput(), target, subst)) {
       bool wasEmpty = subst.empty();
       if (!output.put(std::move(subst)))
         return;
@@ -62,81 +165,92 @@ void Solver::solveForwardThreaded(Atom target, Channel<Subst> &output) {
     }
     workset.addFact(rule.getOutput());
   }
+  auto &pool = *m_pool;
   bool newAdded = true;
   while (newAdded) {
     newAdded = false;
     workset.nextIteration(); // обновить счетчик шага
+    // каждый вход правила, для которого есть факты с предыдущего шага,
+    // по очереди сопоставляется только с этими новыми фактами. Порядок
+    // соединения входов выбирает планировщик, а новые факты большого
+    // отношения делятся между несколькими задачами
+    std::vector<JoinTask> tasks;
     for (auto &rule : m_database->getRules()) {
-      // проверить, что входы правила содержат атом из доказанных на
-      // предыдущем шаге
-      bool hasNewFacts = false;
-      for (auto &input : rule.getInputs())
-        if ((hasNewFacts = workset.hasNewFactFor(input)))
-          break;
-      // пропустить правило, если для него нет новых фактов
-      if (!hasNewFacts)
+      if (rule.isFact())
         continue;
-      // проверить покрытие входов из доказанных фактов
-      auto [worker, channel] = unifyInputs(rule, workset);
-      while (true) {
-        // перебираем все возможные подстановки
-        auto [subst, ok] = channel->get();
-        if (!ok)
-          break;
-        auto newFact = subst.apply(rule.getOutput());
-        // проверить, что факт действительно новый
-        if (workset.hasFact(newFact))
+      const auto &inputs = rule.getInputs();
+      for (size_t deltaPos = 0; deltaPos < inputs.size(); ++deltaPos) {
+        size_t delta = workset.rangeSize(
+            inputs[deltaPos], WorkingDataset::Range::delta);
+        if (delta == 0)
+          continue;
+        const auto &order = planner.plan(rule, deltaPos, workset);
+        size_t parts = std::clamp<size_t>(delta / minPartSize, 1, pool.size());
+        for (size_t i = 0; i < parts; ++i)
+          tasks.push_back({&rule, deltaPos, order, {i, parts}, {}, {}});
+      }
+    }
+    // во время выполнения задач рабочее множество только читается:
+    // выведенные факты собираются в буферы задач
+    runJoinTasks(pool, tasks, [&](JoinTask &task) {
+      const auto &rule = *task.rule;
+      joinInputs(
+          rule.getInputs(), task.order, 0, task.deltaPos, workset, Subst(),
+          [&](const Subst &subst) {
+            auto newFact = subst.apply(rule.getOutput());
+            if (!workset.hasFact(newFact))
+              task.addFact(std::move(newFact));
+            return !output.isClosed();
+          },
+          task.part);
+    });
+    // слияние буферов в порядке задач: факты добавляются и выдаются в том
+    // же порядке, что и при последовательном выводе. Факт, выведенный
+    // несколькими задачами, добавляется и выдается только первым из них.
+    // Ответы итерации выдаются после ее завершения всеми задачами
+    for (auto &task : tasks) {
+      for (auto &newFact : task.facts) {
+        if (!workset.addFact(newFact))
           continue;
-        // проверить, что новый факт удовлетворяет цели
-        Subst res;
-        if (unify(newFact, target, res)) {
-          if (!output.put(std::move(res))) {
-            channel->close();
-            return;
-          }
-        }
-        workset.addFact(newFact);
         newAdded = true;
+        Subst res;
+        if (unify(newFact, target, res) && !output.put(std::move(res)))
+          return; // выходной канал закрыт с другого конца
       }
-      channel->close();
     }
+    if (output.isClosed())
+      return;
   }
 }
 
-void Solver::solveBackwardThreaded(Atom target, Channel<Subst> &output) {}
-
-TaskChanPair<Subst> Solver::unifyInputs(const Rule &rule,
-                                        WorkingDataset &workset) {
-  auto channel = std::make_shared<Channel<Subst>>();
-  std::jthread worker([&rule, &workset, channel]() {
-    auto inputs = rule.getInputs();
-    unifyRest(inputs.begin(), inputs.end(), workset, Subst(), *channel);
-    channel->close();
-  });
-  return std::make_pair(std::move(worker), channel);
-}
+Generator<Subst> Solver::generateBackward(Atom target) { co_return; }
 
-bool Solver::unifyRest(std::vector<Atom>::const_iterator begin,
-                       std::vector<Atom>::const_iterator end,
-                       WorkingDataset &workset, const Subst &prev,
-                       Channel<Subst> &channel, bool wasNewFact) {
-  if (begin == end)
-    return !wasNewFact || (!channel.isClosed() && channel.put(prev));
-  // проверить все возможные факты для данного атома, если нашли совпадение -
-  // проверяем следующие атомы
-  auto &curr = *begin++;
-  for (const auto &fact : workset.getFacts(curr.getName())) {
-    Subst subst = prev;
-    if (unify(curr, fact, subst))
-      if (!unifyRest(begin, end, workset, subst, channel,
-                     wasNewFact || workset.factIsNew(fact)))
-        return false;
-  }
-  return true;
+bool Solver::joinInputs(const std::vector<Atom> &inputs,
+                        const std::vector<size_t> &order, size_t pos,
+                        size_t deltaPos, const WorkingDataset &workset,
+                        const Subst &prev, const SubstHandler &handler,
+                        WorkingDataset::Part deltaPart) {
+  if (pos == order.size())
+    return handler(prev);
+  size_t input = order[pos];
+  auto range = WorkingDataset::joinRange(input, deltaPos);
+  // проверить все подходящие факты для данного атома, если нашли совпадение -
+  // проверяем следующие атомы. Кандидаты выбираются по индексу, поэтому к
+  // атому предварительно применяется накопленная подстановка
+  auto pattern = prev.apply(inputs[input]);
+  return workset.forEachFact(
+      pattern, range,
+      [&](const Atom &fact) {
+        Subst subst = prev;
+        return !unify(pattern, fact, subst) ||
+               joinInputs(inputs, order, pos + 1, deltaPos, workset, subst,
+                          handler, deltaPart);
+      },
+      input == deltaPos ? deltaPart : WorkingDataset::Part{});
 }
 
 bool Solver::unify(const Atom &left, const Atom &right, Subst &subst) {
-  if (left.getName() != right.getName())
+  if (left.getSymbol() != right.getSymbol())
     return false;
   auto &args1 = left.getArguments();
   auto &args2 = right.getArguments();
@@ -149,17 +263,19 @@ bool Solver::unify(const Atom &left, const Atom &right, Subst &subst) {
 }
 
 bool Solver::unify(Variable::ptr left, Variable::ptr right, Subst &subst) {
+  if (left == right)
+    return true;
   if (left->isConst() && right->isConst())
-    return left->getValue() == right->getValue();
+    return left->getSymbol() == right->getSymbol();
   if (left->isVariable() && !right->isVariable())
-    return subst.insert(left->getValue(), right);
+    return subst.insert(left->getSymbol(), right);
   if (!left->isVariable() && right->isVariable())
-    return subst.insert(right->getValue(), left);
+    return subst.insert(right->getSymbol(), left);
   if (left->isVariable() && right->isVariable())
-    return left->getValue() == right->getValue() ||
-           subst.link(left->getValue(), right->getValue());
+    return left->getSymbol() == right->getSymbol() ||
+           subst.link(left->getSymbol(), right->getSymbol());
   // унификация функциональных символов
-  if (left->getValue() != right->getValue())
+  if (left->getSymbol() != right->getSymbol())
     return false;
   const auto &args1 = left->getArguments();
   const auto &args2 = right->getArguments();
@@ -170,3 +286,90 @@ bool Solver::unify(Variable::ptr left, Variable::ptr right, Subst &subst) {
       return false;
   return true;
 }
+
+// пары термов, уже сопоставленных после разыменования переменных. Повторная
+// встреча пары означает циклические связывания, которые считаются
+// унифицируемыми. Как в WamSolver::unify, пары запоминаются только после
+// visitThreshold шагов: обычные термы унифицируются раньше без затрат на
+// множество, а для циклических завершение по-прежнему гарантировано
+struct UnifyVisited {
+  using Pair = std::pair<const Variable *, const Variable *>;
+  struct PairHash {
+    size_t operator()(const Pair &pair) const {
+      std::hash<const Variable *> hash;
+      return hash(pair.first) * 31 + hash(pair.second);
+    }
+  };
+  static constexpr size_t visitThreshold = 1 << 12;
+
+  // false, если пара уже встречалась
+  bool visit(const Variable *left, const Variable *right) {
+    return ++steps <= visitThreshold || pairs.emplace(left, right).second;
+  }
+
+  size_t steps = 0;
+  std::unordered_set<Pair, PairHash> pairs;
+};
+
+static bool unifyTerms(Variable::ptr left, Variable::ptr right,
+                       TrailSubst &subst, UnifyVisited &visited) {
+  bool bound = left->isVariable() || right->isVariable();
+  left = subst.deref(std::move(left));
+  right = subst.deref(std::move(right));
+  if (left == right)
+    return true;
+  if (left->isVariable() && right->isVariable()) {
+    if (left->getSymbol() == right->getSymbol())
+      return true;
+    // представителем класса связанных переменных становится наименьшая
+    // переменная, как в кольце связей класса Subst
+    if (Symbol::precedes(left->getSymbol(), right->getSymbol()))
+      subst.bind(right->getSymbol(), std::move(left));
+    else
+      subst.bind(left->getSymbol(), std::move(right));
+    return true;
+  }
+  if (left->isVariable()) {
+    subst.bind(left->getSymbol(), std::move(right));
+    return true;
+  }
+  if (right->isVariable()) {
+    subst.bind(right->getSymbol(), std::move(left));
+    return true;
+  }
+  if (left->isConst() && right->isConst())
+    return left->getSymbol() == right->getSymbol();
+  const auto &args1 = left->getArguments();
+  const auto &args2 = right->getArguments();
+  if (left->getSymbol() != right->getSymbol() || args1.size() != args2.size())
+    return false;
+  if (bound && !left->isGround() && !right->isGround() &&
+      !visited.visit(left.get(), right.get()))
+    return true;
+  for (size_t i = 0; i < args1.size(); ++i)
+    if (!unifyTerms(args1[i], args2[i], subst, visited))
+      return false;
+  return true;
+}
+
+bool Solver::unify(const Atom &left, const Atom &right, TrailSubst &subst) {
+  const auto &args1 = left.getArguments();
+  const auto &args2 = right.getArguments();
+  if (left.getSymbol() != right.getSymbol() || args1.size() != args2.size())
+    return false;
+  auto mark = subst.mark();
+  UnifyVisited visited;
+  for (size_t i = 0; i < args1.size(); ++i) {
+    if (!unifyTerms(args1[i], args2[i], subst, visited)) {
+      subst.undo(mark);
+      return false;
+    }
+  }
+  return true;
+}
+
+bool Solver::unify(Variable::ptr left, Variable::ptr right,
+                   TrailSubst &subst) {
+  UnifyVisited visited;
+  return unifyTerms(std::move(left), std::move(right), subst, visited);
+}
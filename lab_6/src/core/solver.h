@@ -3,15 +3,16 @@
 #include "atom.h"
 #include "channel.h"
 #include "database.h"
+#include "generator.h"
 #include "subst.h"
+#include "trail_subst.h"
 #include "variable.h"
+#include "work_stealing_pool.h"
+#include <functional>
 #include <memory>
 #include <optional>
 #include <thread>
 
-template <typename T>
-using TaskChanPair = std::pair<std::jthread, std::shared_ptr<Channel<T>>>;
-
 class Solver : public std::enable_shared_from_this<Solver> {
 public:
   Solver(std::shared_ptr<Database> database);
@@ -27,25 +28,47 @@ public:
   // принудительно остановить поиск новых решений
   void done();
 
+  // пул, в задачах которого прямой вывод соединяет входы правил. По
+  // умолчанию - общий пул WorkStealingPool::shared(); пул из одного потока
+  // дает последовательный вывод
+  void setPool(WorkStealingPool &pool) { m_pool = &pool; }
+
   static bool unify(const Atom &left, const Atom &right, Subst &subst);
   static bool unify(Variable::ptr left, Variable::ptr right, Subst &subst);
 
+  // унификация со связыванием переменных в хранилище с журналом отката. При
+  // неуспешной унификации атомов сделанные связывания снимаются
+  static bool unify(const Atom &left, const Atom &right, TrailSubst &subst);
+  static bool unify(Variable::ptr left, Variable::ptr right,
+                    TrailSubst &subst);
+
 protected:
-  virtual void solveForwardThreaded(Atom target, Channel<Subst> &output);
-  virtual void solveBackwardThreaded(Atom target, Channel<Subst> &output);
+  virtual void solveForwardThreaded(Atom target,
+                                    RingChannel<Subst> &output);
+
+  // построить генератор подстановок обратного вывода. Генератор выполняется
+  // лениво в потоке, вызывающем метод next()
+  virtual Generator<Subst> generateBackward(Atom target);
 
-  // проверить покрытие входов правила фактами из рабочей памяти. Дополнительно
-  // вернуть флаг использования факта полученного на предыдущей итерации
-  static TaskChanPair<Subst> unifyInputs(const Rule &rule,
-                                         WorkingDataset &workset);
+  using SubstHandler = std::function<bool(const Subst &)>;
 
-  static bool unifyRest(std::vector<Atom>::const_iterator begin,
-                        std::vector<Atom>::const_iterator end,
-                        WorkingDataset &workset, const Subst &prev,
-                        Channel<Subst> &channel, bool wasNewFact = false);
+  // семи-наивное соединение входов правила с фактами рабочей памяти в порядке
+  // order (номера входов), начиная с позиции pos этого порядка. Вход deltaPos
+  // сопоставляется только с фактами предыдущей итерации, входы до него в
+  // правиле - с более старыми фактами, входы после него - со всеми. Для каждой
+  // полной подстановки вызывается обработчик; если он вернул false, перебор
+  // прекращается и метод возвращает false. Вход deltaPos перебирает только
+  // часть deltaPart своих фактов
+  static bool joinInputs(const std::vector<Atom> &inputs,
+                         const std::vector<size_t> &order, size_t pos,
+                         size_t deltaPos, const WorkingDataset &workset,
+                         const Subst &prev, const SubstHandler &handler,
+                         WorkingDataset::Part deltaPart = {});
 
   std::thread m_solverThread;
-  std::shared_ptr<Channel<Subst>> m_channel;
+  std::shared_ptr<RingChannel<Subst>> m_channel;
+  Generator<Subst> m_generator; // генератор текущего обратного вывода
   bool m_stopRequest;
   std::shared_ptr<Database> m_database;
+  WorkStealingPool *m_pool;
 };
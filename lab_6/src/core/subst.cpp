@@ -3,218 +3,246 @@
 #include <algorithm>
 #include <vector>
 
-template <typename T>
-static bool set_overlaps(const std::set<T> &set1, const std::set<T> &set2) {
-  std::set<T> ref;
-  std::set_intersection(set1.begin(), set1.end(), set2.begin(), set2.end(),
-                        std::inserter(ref, ref.end()), std::less());
-  return !ref.empty();
-}
-
-Subst::Subst(const Subst &other) : m_links(other.m_links) {
-  for (auto &[name, value] : other.m_pairs)
-    insert(name, value->clone());
+static bool sameValue(const Variable::ptr &left, const Variable::ptr &right) {
+  return left == right || left->equals(*right);
 }
 
 std::optional<Subst> Subst::operator+(const Subst &other) const {
-  if (m_pairs.empty() && m_links.empty())
+  if (m_nodes.empty())
     return other;
-  if (other.m_pairs.empty() && other.m_links.empty())
+  if (other.m_nodes.empty())
     return *this;
   // start building combined substitution
   Subst newSubst = *this;
-  for (const auto &[var, value] : other.m_pairs) {
-    if (m_pairs.count(var) != 0 &&
-        m_pairs.at(var)->toString() != value->toString()) {
+  for (std::uint32_t i = 0; i < other.m_nodes.size(); ++i) {
+    auto var = other.m_nodes[i].var;
+    if (!other.m_nodes[other.find(i)].value)
+      continue;
+    auto value = other.apply(Variable::createVariable(var));
+    auto mine = findSlot(var);
+    auto current = mine && m_nodes[find(*mine)].value
+                       ? apply(Variable::createVariable(var))
+                       : nullptr;
+    if (current && !sameValue(current, value)) {
       // попытка унификации двух термов с возможной генерацией новой
       // подстановки
       Subst auxSubst;
-      if (!Solver::unify(m_pairs.at(var), value,
+      if (!Solver::unify(current, value,
                          auxSubst)) // унификация невозможна - конфликт
         return std::nullopt;
       newSubst.insert(var, auxSubst.apply(value));
     } else if (!newSubst.insert(var, value))
       return std::nullopt;
   }
-  for (const auto &otherRing : other.m_links) {
-    bool intersected = false;
-    for (auto &ring : newSubst.m_links) {
-      if (set_overlaps(ring, otherRing)) {
-        ring.insert(otherRing.begin(), otherRing.end());
-        if (!ringValid(ring))
-          return std::nullopt;
-        intersected = true;
-        break;
-      }
-    }
-    if (!intersected) {
-      if (!ringValid(otherRing))
-        return std::nullopt;
-      newSubst.m_links.push_back(otherRing);
-    }
+  // объединяем классы связанных переменных
+  for (std::uint32_t i = 0; i < other.m_nodes.size(); ++i) {
+    auto root = other.find(i);
+    if (root != i && !newSubst.link(other.m_nodes[i].var,
+                                    other.m_nodes[root].var))
+      return std::nullopt;
   }
-  // solve recursive references
-  for (auto &[var, value] : newSubst.m_pairs)
-    newSubst.solveRecursion(value);
   return newSubst;
 }
 
 bool Subst::insert(const std::string &var, Variable::ptr value) {
-  if (var == "_" || value->getValue() == "_")
+  return insert(Symbol(var), std::move(value));
+}
+
+bool Subst::insert(Symbol var, Variable::ptr value) {
+  static const Symbol anonymous("_");
+  if (var == anonymous || value->getSymbol() == anonymous)
     return true;
-  if (m_pairs.count(var) > 0) {
-    return m_pairs[var]->toString() == value->toString();
-  }
-  m_pairs[var] = value;
-  // to avoid check assigment does not conflicts with linked variables
-  // propagate value to all linked variables
-  for (auto &ring : m_links)
-    if (ring.count(var) > 0)
-      for (const auto &linkedVar : ring)
-        m_pairs[linkedVar] = value;
-  for (auto &[varName, varValue] : m_pairs)
-    solveRecursion(varValue);
+  auto root = compress(slot(var));
+  if (m_nodes[root].value)
+    return sameValue(apply(Variable::createVariable(var)), apply(value));
+  // значение хранится в корне и сразу относится ко всем связанным переменным.
+  // Значения других переменных не просматриваются: связывание подставляется
+  // в них при применении подстановки
+  m_nodes[root].value = std::move(value);
   return true;
 }
 
 bool Subst::link(const std::string &var1, const std::string &var2) {
-  if (var1 == "_" || var2 == "_")
+  return link(Symbol(var1), Symbol(var2));
+}
+
+bool Subst::link(Symbol var1, Symbol var2) {
+  static const Symbol anonymous("_");
+  if (var1 == anonymous || var2 == anonymous)
     return true;
-  if (m_pairs.count(var1) > 0 && m_pairs.count(var2) > 0) {
-    if (m_pairs.at(var1) != m_pairs.at(var2))
-      return false;
-  }
-  // linking two rings is not supported here
-  for (auto &ring : m_links) {
-    if (ring.count(var1) > 0) {
-      ring.insert(var2);
-      if (m_pairs.count(var1) > 0)
-        m_pairs[var2] = m_pairs[var1];
-      return true;
-    } else if (ring.count(var2) > 0) {
-      ring.insert(var1);
-      if (m_pairs.count(var2) > 0)
-        m_pairs[var1] = m_pairs[var2];
-      return true;
-    }
-  }
-  m_links.push_back({var1, var2});
-  if (m_pairs.count(var1) > 0)
-    m_pairs[var2] = m_pairs[var1];
-  else if (m_pairs.count(var2) > 0)
-    m_pairs[var1] = m_pairs[var2];
-  return true;
+  auto slot1 = slot(var1);
+  return unite(slot1, slot(var2));
+}
+
+Variable::ptr Subst::apply(const Variable::ptr &term) const {
+  return apply(term, nullptr);
 }
 
-Variable::ptr Subst::apply(const Variable::ptr &term) {
+// expanding - список раскрываемых в данный момент термов. Повторная встреча
+// терма или переменной означает циклическое связывание, такой терм не
+// раскрывается: для x = f(x) получается f(x)
+Variable::ptr Subst::apply(const Variable::ptr &term,
+                           const VariableListNode *expanding) const {
   if (term == nullptr)
     return nullptr;
-  if (term->isConst())
+  if (term->isConst() || term->isGround())
     return term;
+  for (auto node = expanding; node; node = node->prev)
+    if (node->var == term.get() ||
+        (term->isVariable() && node->var->isVariable() &&
+         node->var->getSymbol() == term->getSymbol()))
+      return term;
   if (term->isVariable()) {
-    if (m_pairs.count(term->getValue()) > 0)
-      return m_pairs[term->getValue()];
-    // проверяем наличие переменной в связанном кольце неозначенных переменных
-    for (auto &ring : m_links)
-      if (ring.count(term->getValue()) > 0)
-        return Variable::createVariable(*ring.begin());
+    auto slot = findSlot(term->getSymbol());
+    if (!slot)
+      return term;
+    const auto &root = m_nodes[find(*slot)];
+    if (root.value) {
+      VariableListNode next = {term.get(), expanding};
+      return apply(root.value, &next);
+    }
+    // неозначенная связанная переменная заменяется представителем класса
+    if (root.size > 1)
+      return Variable::createVariable(m_nodes[root.first].var);
     return term;
   }
   // если term - функциональный символ - выполняем все остальное
   if (!term->hasVars())
     return term;
-  auto name = term->getValue();
+  VariableListNode next = {term.get(), expanding};
   std::vector<Variable::ptr> args;
-  for (auto arg : term->getArguments())
-    args.push_back(apply(arg));
-  return Variable::createFuncSym(std::move(name), std::move(args));
+  for (auto &arg : term->getArguments())
+    args.push_back(apply(arg, &next));
+  return Variable::createFuncSym(term->getSymbol(), std::move(args));
 }
 
-Atom Subst::apply(Atom atom) {
+Atom Subst::apply(const Atom &atom) const {
   std::vector<Variable::ptr> newArgs;
   for (const auto &arg : atom.getArguments())
     newArgs.push_back(apply(arg));
-  return Atom(atom.getName(), std::move(newArgs));
+  return Atom(atom.getSymbol(), std::move(newArgs));
 }
 
 std::string Subst::toString() const {
-  std::set<std::string> accounted;
+  // классы связанных переменных по наименьшему имени и одиночные переменные
+  std::map<std::string, std::pair<std::uint32_t, std::set<std::string>>> rings;
+  std::map<std::string, std::uint32_t> pairs;
+  for (std::uint32_t i = 0; i < m_nodes.size(); ++i) {
+    auto root = find(i);
+    const auto &name = m_nodes[i].var.str();
+    if (m_nodes[root].size > 1) {
+      auto &ring = rings[m_nodes[m_nodes[root].first].var.str()];
+      ring.first = root;
+      ring.second.insert(name);
+    } else if (m_nodes[root].value)
+      pairs.emplace(name, i);
+  }
   std::string res = "{";
   bool first = true;
-  for (const auto &ring : m_links) {
+  for (const auto &[key, ring] : rings) {
     if (!first)
       res += ", ";
     first = false;
-    for (const auto &var : ring) {
+    for (const auto &var : ring.second)
       res += var + "=";
-      accounted.insert(var);
-    }
-    if (m_pairs.count(*ring.begin()) > 0)
-      res += m_pairs.at(*ring.begin())->toString();
+    if (m_nodes[ring.first].value)
+      res += apply(Variable::createVariable(m_nodes[ring.first].var))
+                 ->toString();
   }
-  for (const auto &[var, value] : m_pairs) {
-    if (accounted.count(var) == 0) {
-      if (!first)
-        res += ", ";
-      first = false;
-      res += var + "=" + value->toString();
-    }
+  for (const auto &[var, slot] : pairs) {
+    if (!first)
+      res += ", ";
+    first = false;
+    res += var + "=" +
+           apply(Variable::createVariable(m_nodes[slot].var))->toString();
   }
   res += "}";
   return res;
 }
 
+bool Subst::empty() const {
+  for (const auto &node : m_nodes)
+    if (node.value)
+      return false;
+  return true;
+}
+
 std::set<std::string> Subst::getVarNames() const {
   std::set<std::string> names;
-  for (auto &ring : m_links)
-    names.insert(ring.begin(), ring.end());
-  for (auto &[name, value] : m_pairs)
-    names.insert(name);
+  for (const auto &node : m_nodes)
+    names.insert(node.var.str());
   return names;
 }
 
 std::set<std::string> Subst::getAllVarNames() const {
   std::set<std::string> names;
-  for (auto &ring : m_links)
-    names.insert(ring.begin(), ring.end());
-  for (auto &[name, value] : m_pairs) {
-    names.insert(name);
-    value->getAllVarsRecursive(names);
+  for (const auto &node : m_nodes) {
+    names.insert(node.var.str());
+    if (node.value)
+      apply(node.value)->getAllVarsRecursive(names);
   }
   return names;
 }
 
-bool Subst::ringValid(const std::set<std::string> &ring) const {
-  if (m_pairs.count(*ring.begin()) == 0) {
-    // all other items also must not have value
-    for (const auto &item : ring) {
-      if (m_pairs.count(item) != 0)
-        return false;
-    }
-    return true;
-  }
-  auto firstValue = m_pairs.at(*ring.begin())->toString();
-  for (const auto &item : ring) {
-    if (m_pairs.count(item) == 0)
-      return false;
-    if (m_pairs.at(item)->toString() != firstValue)
-      return false;
-  }
-  return true;
+std::optional<std::uint32_t> Subst::findSlot(Symbol var) const {
+  auto iter = m_slots.find(var);
+  if (iter == m_slots.end())
+    return std::nullopt;
+  return iter->second;
 }
 
-void Subst::solveRecursion(Variable::ptr &value, int depth) {
-  if (depth > 10)
-    return;
-  if (value->isFuncSym()) {
-    auto args = value->getArguments();
-    for (size_t i = 0; i < args.size(); ++i) {
-      if (args[i]->isVariable()) {
-        value->updateArgument(i, apply(args[i]));
-      } else if (args[i]->isFuncSym()) {
-        solveRecursion(args[i], depth + 1);
-        value->updateArgument(i, args[i]);
-      }
-    }
+// номер переменной в подстановке; новая переменная образует отдельный класс
+std::uint32_t Subst::slot(Symbol var) {
+  auto [iter, inserted] = m_slots.emplace(var, m_nodes.size());
+  if (inserted)
+    m_nodes.push_back({var, iter->second, 0, 1, iter->second, nullptr});
+  return iter->second;
+}
+
+// корень класса переменной. Объединение по рангу ограничивает высоту дерева
+// логарифмом размера класса, поэтому константный поиск пути не сжимает
+std::uint32_t Subst::find(std::uint32_t slot) const {
+  while (m_nodes[slot].parent != slot)
+    slot = m_nodes[slot].parent;
+  return slot;
+}
+
+// корень класса переменной со сжатием пути
+std::uint32_t Subst::compress(std::uint32_t slot) {
+  auto root = find(slot);
+  while (m_nodes[slot].parent != root) {
+    auto next = m_nodes[slot].parent;
+    m_nodes[slot].parent = root;
+    slot = next;
   }
+  return root;
+}
+
+// объединение классов по рангу. Классы с различными значениями не
+// объединяются
+bool Subst::unite(std::uint32_t slot1, std::uint32_t slot2) {
+  auto root1 = compress(slot1);
+  auto root2 = compress(slot2);
+  if (root1 == root2)
+    return true;
+  auto &value1 = m_nodes[root1].value;
+  auto &value2 = m_nodes[root2].value;
+  if (value1 && value2 &&
+      !sameValue(apply(Variable::createVariable(m_nodes[root1].var)),
+                 apply(Variable::createVariable(m_nodes[root2].var))))
+    return false;
+  if (m_nodes[root1].rank < m_nodes[root2].rank)
+    std::swap(root1, root2);
+  auto &parent = m_nodes[root1];
+  auto &child = m_nodes[root2];
+  child.parent = root1;
+  if (parent.rank == child.rank)
+    ++parent.rank;
+  parent.size += child.size;
+  if (Symbol::precedes(m_nodes[child.first].var, m_nodes[parent.first].var))
+    parent.first = child.first;
+  if (!parent.value)
+    parent.value = std::move(child.value);
+  child.value = nullptr;
+  return true;
 }
@@ -1,28 +1,47 @@
 #pragma once
 
 #include "atom.h"
+#include "symbol.h"
 #include "variable.h"
+#include <cstdint>
+#include <list>
 #include <map>
 #include <optional>
 #include <set>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
+// класс подстановки.
+//
+// Связанные между собой переменные образуют классы эквивалентности, которые
+// хранятся в системе непересекающихся множеств (union-find) со сжатием путей и
+// объединением по рангу. Переменные нумеруются в порядке появления в
+// подстановке по номерам их символов, значение класса хранится только в его
+// корне. Поэтому связывание переменных и поиск значения выполняются почти за
+// константное время.
+//
+// Значения хранятся в том виде, в котором были связаны, и не изменяются:
+// переменные, связанные позднее, подставляются в них при применении
+// подстановки. Константные методы ничего не изменяют, так что одну
+// подстановку можно читать из нескольких потоков
 class Subst {
 public:
-  Subst() = default;
-  Subst(const Subst &other);
 
   bool insert(const std::string &var, Variable::ptr value);
+  bool insert(Symbol var, Variable::ptr value);
   bool link(const std::string &var1, const std::string &var2);
+  bool link(Symbol var1, Symbol var2);
 
   std::optional<Subst> operator+(const Subst &other) const;
 
-  Variable::ptr apply(const Variable::ptr &term);
-  Atom apply(Atom atom);
+  Variable::ptr apply(const Variable::ptr &term) const;
+  Atom apply(const Atom &atom) const;
 
   std::string toString() const;
 
-  bool empty() const { return m_pairs.empty(); }
+  // нет ни одной переменной со значением
+  bool empty() const;
 
   // get shallow var names
   std::set<std::string> getVarNames() const;
@@ -30,12 +49,26 @@ public:
   std::set<std::string> getAllVarNames() const;
 
 private:
-  bool ringValid(const std::set<std::string> &ring) const;
-  void solveRecursion(Variable::ptr &value, int depth = 0);
+  struct Node {
+    Symbol var;
+    std::uint32_t parent;         // родитель в дереве класса
+    std::uint32_t rank = 0;       // ранг корня
+    std::uint32_t size = 1;       // число переменных в классе (в корне)
+    std::uint32_t first;          // наименьшая переменная класса
+    Variable::ptr value;          // значение класса (в корне)
+  };
+
+  std::optional<std::uint32_t> findSlot(Symbol var) const;
+  std::uint32_t slot(Symbol var);
+  std::uint32_t find(std::uint32_t slot) const;
+  std::uint32_t compress(std::uint32_t slot);
+  bool unite(std::uint32_t slot1, std::uint32_t slot2);
+  Variable::ptr apply(const Variable::ptr &term,
+                      const VariableListNode *expanding) const;
 
 private:
-  std::map<std::string, Variable::ptr> m_pairs;
-  std::list<std::set<std::string>> m_links;
+  std::vector<Node> m_nodes;
+  std::unordered_map<Symbol, std::uint32_t> m_slots;
 };
 
 namespace std {
@@ -0,0 +1,130 @@
+#include "symbol.h"
+#include <array>
+#include <atomic>
+#include <charconv>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace {
+
+// таблица символов. Строки хранятся блоками фиксированного размера, поэтому
+// чтение имени по номеру не требует блокировки: блок публикуется до того, как
+// номер символа становится известен другим потокам
+class SymbolTable {
+public:
+  static SymbolTable &instance() {
+    static SymbolTable table;
+    return table;
+  }
+
+  Symbol::id_type intern(std::string_view name) {
+    if (auto number = parseNumbered(name))
+      return Symbol::numberedBase + *number;
+    std::lock_guard lock(m_mutex);
+    if (auto iter = m_ids.find(name); iter != m_ids.end())
+      return iter->second;
+    auto id = static_cast<Symbol::id_type>(m_count.load());
+    if (id == maxSymbols)
+      throw std::length_error("symbol table overflow");
+    auto &block = m_blocks[id / blockSize];
+    if (!block)
+      block.reset(new std::string[blockSize]);
+    auto &str = block[id % blockSize];
+    str = name;
+    m_ids.emplace(str, id);
+    m_count.store(id + 1);
+    return id;
+  }
+
+  const std::string &name(Symbol::id_type id) {
+    if (id >= Symbol::numberedBase)
+      return numberedName(id - Symbol::numberedBase);
+    return m_blocks[id / blockSize][id % blockSize];
+  }
+
+  size_t count() const { return m_count.load(); }
+
+private:
+  static constexpr size_t blockSize = 1 << 16;
+  static constexpr size_t blocksCount = Symbol::numberedBase / blockSize;
+  static constexpr size_t maxSymbols = blockSize * blocksCount - 1;
+  static constexpr std::string_view numberedPrefix = "_G";
+
+  SymbolTable() { intern(""); }
+
+  // номер пронумерованной переменной по имени _G<номер> без ведущих нулей
+  static std::optional<Symbol::id_type> parseNumbered(std::string_view name) {
+    if (!name.starts_with(numberedPrefix))
+      return std::nullopt;
+    auto digits = name.substr(numberedPrefix.size());
+    if (digits.empty() || (digits.size() > 1 && digits[0] == '0'))
+      return std::nullopt;
+    Symbol::id_type number = 0;
+    auto [end, error] =
+        std::from_chars(digits.data(), digits.data() + digits.size(), number);
+    if (error != std::errc() || end != digits.data() + digits.size() ||
+        number >= Symbol::numberedBase)
+      return std::nullopt;
+    return number;
+  }
+
+  // имена пронумерованных переменных строятся при первом обращении и
+  // хранятся блоками, как имена таблицы. Блоки и имена публикуются
+  // сравнением с обменом, поэтому чтение имени не требует блокировки; поток,
+  // проигравший гонку, удаляет свою копию
+  const std::string &numberedName(Symbol::id_type number) {
+    auto &blockPtr = m_numberedBlocks[number / blockSize];
+    auto *block = blockPtr.load(std::memory_order_acquire);
+    if (!block) {
+      auto *fresh = new NumberedBlock[blockSize]();
+      if (blockPtr.compare_exchange_strong(block, fresh,
+                                           std::memory_order_acq_rel))
+        block = fresh;
+      else
+        delete[] fresh;
+    }
+    auto &namePtr = block[number % blockSize];
+    auto *name = namePtr.load(std::memory_order_acquire);
+    if (!name) {
+      auto *fresh =
+          new std::string(std::string(numberedPrefix) + std::to_string(number));
+      if (namePtr.compare_exchange_strong(name, fresh,
+                                          std::memory_order_acq_rel))
+        name = fresh;
+      else
+        delete fresh;
+    }
+    return *name;
+  }
+
+  std::mutex m_mutex;
+  std::unordered_map<std::string_view, Symbol::id_type> m_ids;
+  std::array<std::unique_ptr<std::string[]>, blocksCount> m_blocks;
+  std::atomic<size_t> m_count = 0;
+
+  using NumberedBlock = std::atomic<const std::string *>;
+  std::array<std::atomic<NumberedBlock *>, blocksCount> m_numberedBlocks{};
+};
+
+} // namespace
+
+Symbol::Symbol() : m_id(0) {}
+
+Symbol::Symbol(std::string_view name)
+    : m_id(SymbolTable::instance().intern(name)) {}
+
+const std::string &Symbol::str() const {
+  return SymbolTable::instance().name(m_id);
+}
+
+size_t Symbol::count() { return SymbolTable::instance().count(); }
+
+bool Symbol::precedes(Symbol left, Symbol right) {
+  if (left.isNumbered() || right.isNumbered())
+    return !left.isNumbered() ||
+           (right.isNumbered() && left.id() < right.id());
+  return left.str() < right.str();
+}
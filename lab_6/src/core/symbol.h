@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+
+// класс символа - имени константы, переменной, функтора или предиката.
+//
+// Все имена хранятся в глобальной таблице символов и представляются 32-битным
+// номером, поэтому сравнение и хеширование символов не затрагивают строки.
+// Таблица только растет; строки, возвращаемые методом str(), остаются
+// действительными до завершения программы. Таблица потокобезопасна.
+//
+// Пронумерованные переменные (метод variable) не хранятся в таблице: номер
+// переменной кодируется в номере символа, а имя вида _G<номер> строится
+// только при обращении к нему. Конструктор по такому имени возвращает ту же
+// переменную
+class Symbol {
+public:
+  using id_type = std::uint32_t;
+
+  // номера символов пронумерованных переменных начинаются с numberedBase
+  static constexpr id_type numberedBase = id_type(1) << 31;
+
+  Symbol(); // пустое имя
+  explicit Symbol(std::string_view name);
+
+  id_type id() const { return m_id; }
+  const std::string &str() const;
+
+  bool operator==(const Symbol &other) const { return m_id == other.m_id; }
+  bool operator!=(const Symbol &other) const { return m_id != other.m_id; }
+
+  // число символов в таблице
+  static size_t count();
+
+  // пронумерованная переменная с номером number
+  static Symbol variable(id_type number) {
+    return fromId(numberedBase + number);
+  }
+  bool isNumbered() const { return m_id >= numberedBase; }
+  // номер пронумерованной переменной
+  id_type number() const { return m_id - numberedBase; }
+
+  // порядок переменных при выборе представителя класса связанных переменных:
+  // именованные переменные упорядочены по именам и предшествуют
+  // пронумерованным, пронумерованные упорядочены по номерам
+  static bool precedes(Symbol left, Symbol right);
+
+  // символ по номеру, полученному методом id()
+  static Symbol fromId(id_type id) {
+    Symbol symbol;
+    symbol.m_id = id;
+    return symbol;
+  }
+
+private:
+  id_type m_id;
+};
+
+namespace std {
+template <> struct hash<Symbol> {
+  size_t operator()(const Symbol &symbol) const {
+    return std::hash<Symbol::id_type>()(symbol.id());
+  }
+};
+} // namespace std
@@ -0,0 +1,102 @@
+#include "trail_subst.h"
+#include <algorithm>
+
+static Symbol anonymousSymbol() {
+  static const Symbol symbol("_");
+  return symbol;
+}
+
+void TrailSubst::bind(Symbol var, Variable::ptr value) {
+  if (var == anonymousSymbol() ||
+      (value->isVariable() && value->getSymbol() == anonymousSymbol()))
+    return;
+  auto &cells = var.isNumbered() ? m_numberedCells : m_cells;
+  size_t index = var.isNumbered() ? var.number() : var.id();
+  if (index >= cells.size())
+    cells.resize(std::max<size_t>(index + 1, cells.size() * 2));
+  cells[index] = std::move(value);
+  m_trail.push_back(var);
+}
+
+const Variable::ptr &TrailSubst::lookup(Symbol var) const {
+  static const Variable::ptr unbound;
+  const auto &cells = var.isNumbered() ? m_numberedCells : m_cells;
+  size_t index = var.isNumbered() ? var.number() : var.id();
+  return index < cells.size() ? cells[index] : unbound;
+}
+
+Variable::ptr TrailSubst::deref(Variable::ptr term) const {
+  while (term->isVariable()) {
+    const auto &value = lookup(term->getSymbol());
+    if (!value)
+      break;
+    term = value;
+  }
+  return term;
+}
+
+void TrailSubst::undo(size_t mark) {
+  while (m_trail.size() > mark) {
+    auto var = m_trail.back();
+    if (var.isNumbered())
+      m_numberedCells[var.number()] = nullptr;
+    else
+      m_cells[var.id()] = nullptr;
+    m_trail.pop_back();
+  }
+}
+
+Variable::ptr TrailSubst::resolve(const Variable::ptr &term) const {
+  std::vector<Symbol> expanding;
+  return resolve(term, expanding);
+}
+
+Atom TrailSubst::resolve(const Atom &atom) const {
+  std::vector<Symbol> expanding;
+  std::vector<Variable::ptr> args;
+  args.reserve(atom.getArguments().size());
+  for (const auto &arg : atom.getArguments())
+    args.push_back(resolve(arg, expanding));
+  return Atom(atom.getSymbol(), std::move(args));
+}
+
+Subst TrailSubst::toSubst(const std::set<std::string> &vars) const {
+  Subst subst;
+  for (const auto &var : vars)
+    subst.insert(var, resolve(Variable::createVariable(var)));
+  return subst;
+}
+
+Variable::ptr TrailSubst::resolve(const Variable::ptr &term,
+                                  std::vector<Symbol> &expanding) const {
+  if (term->isGround())
+    return term;
+  if (term->isVariable()) {
+    const auto &value = lookup(term->getSymbol());
+    if (!value)
+      return term;
+    if (!value->isFuncSym() || value->isGround())
+      return resolve(value, expanding);
+    // значение переменной уже разрешается выше по стеку - связывание
+    // циклическое, и цикл обрывается самой переменной. Терм со ссылкой на
+    // себя не строится: счетчик ссылок не дал бы его освободить
+    if (std::find(expanding.begin(), expanding.end(), term->getSymbol()) !=
+        expanding.end())
+      return term;
+    expanding.push_back(term->getSymbol());
+    auto res = resolve(value, expanding);
+    expanding.pop_back();
+    return res;
+  }
+  // функциональный символ с переменными
+  std::vector<Variable::ptr> args;
+  args.reserve(term->getArguments().size());
+  bool changed = false;
+  for (const auto &arg : term->getArguments()) {
+    args.push_back(resolve(arg, expanding));
+    changed = changed || args.back() != arg;
+  }
+  if (!changed)
+    return term;
+  return Variable::createFuncSym(term->getSymbol(), std::move(args));
+}
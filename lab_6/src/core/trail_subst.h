@@ -0,0 +1,57 @@
+#pragma once
+
+#include "atom.h"
+#include "subst.h"
+#include "symbol.h"
+#include "variable.h"
+#include <set>
+#include <string>
+#include <vector>
+
+// класс хранилища связываний переменных с журналом отката (trail, как в WAM).
+//
+// Связывание переменной записывается в ячейку, соответствующую номеру ее
+// символа, без копирования остальных связываний. Номер каждой связанной
+// переменной заносится в журнал, поэтому при откате к метке (метод undo)
+// снимаются все связывания, сделанные после ее получения. Связывания не
+// применяются к термам: значение переменной находится разыменованием цепочки
+// связываний (метод deref) в момент обращения.
+//
+// Переменная '_' никогда не связывается, а связывание с ней игнорируется, как
+// и в классе Subst
+class TrailSubst {
+public:
+  // связать несвязанную переменную со значением
+  void bind(Symbol var, Variable::ptr value);
+
+  // значение переменной или nullptr, если переменная не связана
+  const Variable::ptr &lookup(Symbol var) const;
+
+  // разыменовать терм: для связанной переменной вернуть конец цепочки
+  // связываний, для остальных термов - сам терм
+  Variable::ptr deref(Variable::ptr term) const;
+
+  // метка текущего состояния журнала
+  size_t mark() const { return m_trail.size(); }
+  // снять все связывания, сделанные после получения метки
+  void undo(size_t mark);
+
+  // построить терм с примененными связываниями. Циклическое связывание
+  // обрывается на повторном вхождении переменной: для x = f(x) терм x
+  // разрешается в f(x)
+  Variable::ptr resolve(const Variable::ptr &term) const;
+  Atom resolve(const Atom &atom) const;
+
+  // построить обычную подстановку для заданных переменных
+  Subst toSubst(const std::set<std::string> &vars) const;
+
+private:
+  // expanding - переменные, значения которых разрешаются в данный момент
+  Variable::ptr resolve(const Variable::ptr &term,
+                        std::vector<Symbol> &expanding) const;
+
+  std::vector<Variable::ptr> m_cells; // значения переменных по номерам символов
+  // значения пронумерованных переменных (Symbol::variable) по их номерам
+  std::vector<Variable::ptr> m_numberedCells;
+  std::vector<Symbol> m_trail;        // журнал связанных переменных
+};
@@ -1,31 +1,117 @@
 
 #include "variable.h"
 #include <algorithm>
+#include <array>
 #include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_map>
+
+Variable::Variable(bool isConst, bool isQuoted, Symbol value,
+                   std::vector<Variable::ptr> arguments)
+    : m_isConst(isConst), m_isQuoted(isQuoted), m_ground(false),
+      m_symbol(value), m_arguments(std::move(arguments)) {
+  bool ground = m_isConst || !m_arguments.empty();
+  for (auto &arg : m_arguments)
+    ground = ground && arg->m_ground;
+  if (ground) {
+    m_hash = hash(nullptr);
+    m_ground = true;
+  }
+}
 
 Variable::Variable(bool isConst, bool isQuoted, std::string value,
                    std::vector<Variable::ptr> arguments)
-    : m_isConst(isConst), m_isQuoted(isQuoted), m_value(std::move(value)),
-      m_arguments(std::move(arguments)) {}
+    : Variable(isConst, isQuoted, Symbol(value), std::move(arguments)) {}
+
+namespace {
+
+// таблица основных термов. Хранит слабые ссылки, поэтому не продлевает время
+// жизни термов; устаревшие записи удаляются при росте таблицы. Таблица
+// разделена на части по хешу терма, каждая со своим мьютексом, чтобы потоки,
+// строящие разные термы, не ждали друг друга
+struct InternShard {
+  std::mutex mutex;
+  std::unordered_multimap<size_t, std::weak_ptr<Variable>> terms;
+  size_t sweepSize = 256;
+};
+
+constexpr size_t internShards = 64;
+
+InternShard &internShard(size_t hash) {
+  static std::array<InternShard, internShards> table;
+  // хеши констант - малые числа, поэтому перед выбором части они
+  // перемешиваются
+  return table[(hash * 0x9e3779b97f4a7c15ull >> 32) % internShards];
+}
+
+} // namespace
+
+Variable::ptr Variable::intern(ptr term) {
+  if (!term->m_ground)
+    return term;
+  auto &shard = internShard(term->m_hash);
+  std::lock_guard lock(shard.mutex);
+  auto [begin, end] = shard.terms.equal_range(term->m_hash);
+  for (auto iter = begin; iter != end; ++iter)
+    if (auto existing = iter->second.lock();
+        existing && existing->shallowEquals(*term))
+      return existing;
+  if (shard.terms.size() >= shard.sweepSize) {
+    std::erase_if(shard.terms,
+                  [](const auto &item) { return item.second.expired(); });
+    shard.sweepSize = std::max<size_t>(256, shard.terms.size() * 2);
+  }
+  term->m_interned = true;
+  shard.terms.emplace(term->m_hash, term);
+  return term;
+}
+
+bool Variable::shallowEquals(const Variable &other) const {
+  if (m_isConst != other.m_isConst || m_isQuoted != other.m_isQuoted ||
+      m_symbol != other.m_symbol ||
+      m_arguments.size() != other.m_arguments.size())
+    return false;
+  for (size_t i = 0; i < m_arguments.size(); ++i)
+    if (m_arguments[i] != other.m_arguments[i] &&
+        !m_arguments[i]->equals(*other.m_arguments[i]))
+      return false;
+  return true;
+}
 
 Variable::ptr Variable::createConst(std::string value) {
-  return std::make_shared<Variable>(true, false, std::move(value),
-                                    std::vector<ptr>{});
+  return createConst(Symbol(value));
+}
+
+Variable::ptr Variable::createConst(Symbol value) {
+  return intern(
+      std::make_shared<Variable>(true, false, value, std::vector<ptr>{}));
 }
 
 Variable::ptr Variable::createString(std::string value) {
-  return std::make_shared<Variable>(true, true, std::move(value),
-                                    std::vector<ptr>{});
+  return createString(Symbol(value));
+}
+
+Variable::ptr Variable::createString(Symbol value) {
+  return intern(
+      std::make_shared<Variable>(true, true, value, std::vector<ptr>{}));
 }
 
 Variable::ptr Variable::createVariable(std::string name) {
-  return std::make_shared<Variable>(false, false, std::move(name),
-                                    std::vector<ptr>{});
+  return createVariable(Symbol(name));
+}
+
+Variable::ptr Variable::createVariable(Symbol name) {
+  return std::make_shared<Variable>(false, false, name, std::vector<ptr>{});
 }
 
 Variable::ptr Variable::createFuncSym(std::string name, std::vector<ptr> args) {
-  return std::make_shared<Variable>(false, false, std::move(name),
-                                    std::move(args));
+  return createFuncSym(Symbol(name), std::move(args));
+}
+
+Variable::ptr Variable::createFuncSym(Symbol name, std::vector<ptr> args) {
+  return intern(
+      std::make_shared<Variable>(false, false, name, std::move(args)));
 }
 
 bool Variable::isConst() const { return m_isConst; }
@@ -33,7 +119,7 @@ bool Variable::isVariable() const { return !m_isConst && m_arguments.empty(); }
 bool Variable::isFuncSym() const { return !m_arguments.empty(); }
 
 bool Variable::hasVars(const VariableListNode *vlist) const {
-  if (hasSelf(vlist))
+  if (m_ground || hasSelf(vlist))
     return false;
   if (!m_isConst && m_arguments.empty())
     return true;
@@ -48,31 +134,51 @@ void Variable::commitVarNames(NameAllocator &allocator) const {
   if (m_isConst)
     return;
   if (m_arguments.empty())
-    allocator.allocateName(m_value);
+    allocator.allocateName(m_symbol.str());
   else
     for (auto &arg : m_arguments)
       arg->commitVarNames(allocator);
 }
 
-Variable::ptr Variable::renamedVars(NameAllocator &allocator) {
-  // does not work for recursive functions for now!!!
-  if (m_isConst)
+Variable::ptr
+Variable::numberedVars(std::unordered_map<Symbol, Symbol::id_type> &numbers) {
+  static const Symbol anonymous("_");
+  if (m_ground || m_isConst)
     return shared_from_this();
-  if (m_arguments.empty())
-    return createVariable(allocator.allocateRenaming(m_value));
+  if (m_arguments.empty()) {
+    if (m_symbol == anonymous)
+      return shared_from_this();
+    auto [iter, _] = numbers.try_emplace(m_symbol, numbers.size());
+    return createVariable(Symbol::variable(iter->second));
+  }
+  std::vector<Variable::ptr> arguments;
+  arguments.reserve(m_arguments.size());
+  for (auto &arg : m_arguments)
+    arguments.push_back(arg->numberedVars(numbers));
+  return createFuncSym(m_symbol, std::move(arguments));
+}
+
+Variable::ptr Variable::shiftedVars(Symbol::id_type offset) {
+  if (m_ground || m_isConst)
+    return shared_from_this();
+  if (m_arguments.empty()) {
+    if (!m_symbol.isNumbered())
+      return shared_from_this();
+    return createVariable(Symbol::variable(m_symbol.number() + offset));
+  }
   std::vector<Variable::ptr> arguments;
-  std::transform(
-      m_arguments.begin(), m_arguments.end(), std::back_inserter(arguments),
-      [&allocator](auto &var) { return var->renamedVars(allocator); });
-  return createFuncSym(m_value, std::move(arguments));
+  arguments.reserve(m_arguments.size());
+  for (auto &arg : m_arguments)
+    arguments.push_back(arg->shiftedVars(offset));
+  return createFuncSym(m_symbol, std::move(arguments));
 }
 
 void Variable::getAllVarsRecursive(std::set<std::string> &vars,
                                    const VariableListNode *vlist) const {
-  if (m_isConst || hasSelf(vlist))
+  if (m_ground || hasSelf(vlist))
     return;
   if (m_arguments.empty()) {
-    vars.insert(m_value);
+    vars.insert(m_symbol.str());
     return;
   }
   VariableListNode next = {this, vlist};
@@ -80,15 +186,20 @@ void Variable::getAllVarsRecursive(std::set<std::string> &vars,
     arg->getAllVarsRecursive(vars, &next);
 }
 
-const std::string &Variable::getValue() const { return m_value; }
-const std::vector<Variable::ptr> Variable::getArguments() const {
+const std::string &Variable::getValue() const { return m_symbol.str(); }
+const std::vector<Variable::ptr> &Variable::getArguments() const {
   return m_arguments;
 }
 
-void Variable::updateArgument(size_t i, ptr value) { m_arguments[i] = value; }
+void Variable::updateArgument(size_t i, ptr value) {
+  // основные термы разделяются между всеми их вхождениями
+  if (m_ground)
+    throw std::logic_error("ground term " + toString() + " is immutable");
+  m_arguments[i] = value;
+}
 
 Variable::ptr Variable::clone(std::map<Variable *, ptr> *varMap) {
-  if (m_isConst || m_arguments.empty())
+  if (m_ground || m_arguments.empty())
     return shared_from_this(); // safe omit clone
   if (varMap == nullptr) {
     std::map<Variable *, ptr> defaultVarMap;
@@ -107,15 +218,61 @@ Variable::ptr Variable::clone(std::map<Variable *, ptr> *varMap) {
   }
 }
 
+size_t Variable::hash() const { return hash(nullptr); }
+
+bool Variable::equals(const Variable &other) const {
+  if (this == &other)
+    return true;
+  // различные представители основных термов всегда не равны
+  if (m_interned && other.m_interned)
+    return false;
+  return equals(other, nullptr, nullptr);
+}
+
+size_t Variable::hash(const VariableListNode *vlist) const {
+  // рекурсивная ссылка печатается как "...", поэтому хешируется константой
+  if (m_ground)
+    return m_hash;
+  if (hasSelf(vlist))
+    return 0x2e2e2e;
+  size_t res = std::hash<Symbol>()(m_symbol);
+  res = res * 31 + (m_isConst ? 1 : 0) + (m_isQuoted ? 2 : 0);
+  VariableListNode next = {this, vlist};
+  for (auto &arg : m_arguments)
+    res = res * 1000003 ^ arg->hash(&next);
+  return res;
+}
+
+bool Variable::equals(const Variable &other, const VariableListNode *vlist,
+                      const VariableListNode *otherVlist) const {
+  bool self = hasSelf(vlist);
+  bool otherSelf = other.hasSelf(otherVlist);
+  if (self || otherSelf)
+    return self && otherSelf;
+  if (m_interned && other.m_interned)
+    return this == &other;
+  if (m_isConst != other.m_isConst || m_isQuoted != other.m_isQuoted ||
+      m_symbol != other.m_symbol ||
+      m_arguments.size() != other.m_arguments.size())
+    return false;
+  VariableListNode next = {this, vlist};
+  VariableListNode otherNext = {&other, otherVlist};
+  for (size_t i = 0; i < m_arguments.size(); ++i)
+    if (m_arguments[i] != other.m_arguments[i] &&
+        !m_arguments[i]->equals(*other.m_arguments[i], &next, &otherNext))
+      return false;
+  return true;
+}
+
 std::string Variable::toString() const { return toString(nullptr); }
 
 std::string Variable::toString(const VariableListNode *vlist) const {
   if (hasSelf(vlist))
     return "...";
   if (m_arguments.empty())
-    return m_isQuoted ? '\"' + m_value + '\"' : m_value;
+    return m_isQuoted ? '\"' + m_symbol.str() + '\"' : m_symbol.str();
   VariableListNode next = {this, vlist};
-  std::string res = m_value;
+  std::string res = m_symbol.str();
   if (!m_arguments.empty()) {
     res += '(';
     bool first = true;
@@ -2,9 +2,12 @@
 #pragma once
 
 #include "name_allocator.h"
+#include "symbol.h"
 #include <memory>
 #include <set>
 #include <string>
+#include <string_view>
+#include <unordered_map>
 #include <vector>
 
 class Variable;
@@ -14,50 +17,102 @@ struct VariableListNode {
   const VariableListNode *prev;
 };
 
-static inline bool isVar(const std::string &name) {
+static inline bool isVar(std::string_view name) {
   return name == "_" ||
          name.size() > 0 && std::isalpha(name[0]) && !std::isupper(name[0]);
 }
 
+// класс терма: константы, строки, переменной или функционального символа.
+//
+// Имена хранятся как символы глобальной таблицы. Основные (не содержащие
+// переменных) термы, созданные методами create*, хешируются по структуре
+// (hash-consing): равные основные термы представлены одним объектом, поэтому
+// их сравнение сводится к сравнению указателей. Основные термы неизменяемы
 class Variable : public std::enable_shared_from_this<Variable> {
 public:
   using ptr = std::shared_ptr<Variable>;
 
+  Variable(bool isConst, bool isQuoted, Symbol value,
+           std::vector<Variable::ptr> arguments);
   Variable(bool isConst, bool isQuoted, std::string value,
            std::vector<Variable::ptr> arguments);
 
   static ptr createConst(std::string value);
+  static ptr createConst(Symbol value);
   static ptr createString(std::string value);
+  static ptr createString(Symbol value);
   static ptr createVariable(std::string name);
+  static ptr createVariable(Symbol name);
   static ptr createFuncSym(std::string name, std::vector<ptr> args);
+  static ptr createFuncSym(Symbol name, std::vector<ptr> args);
 
   bool isConst() const;
+  bool isQuoted() const { return m_isQuoted; }
   bool isVariable() const;
   bool isFuncSym() const;
 
+  // терм построен без переменных и не может быть изменен. Для термов,
+  // ставших основными после updateArgument, возвращает false
+  bool isGround() const { return m_ground; }
+  // терм является единственным представителем своего значения
+  bool isInterned() const { return m_interned; }
+
   bool hasVars(const VariableListNode *vlist = nullptr) const;
   void commitVarNames(NameAllocator &allocator) const;
-  Variable::ptr renamedVars(NameAllocator &allocator);
+
+  // терм, в котором переменные заменены пронумерованными переменными
+  // (Symbol::variable). Номера выдаются в порядке первого вхождения и
+  // запоминаются в numbers; переменная '_' не нумеруется
+  Variable::ptr
+  numberedVars(std::unordered_map<Symbol, Symbol::id_type> &numbers);
+  // терм, в котором номера пронумерованных переменных увеличены на offset.
+  // Основные подтермы не копируются
+  Variable::ptr shiftedVars(Symbol::id_type offset);
 
   void getAllVarsRecursive(std::set<std::string> &vars,
                            const VariableListNode *vlist = nullptr) const;
 
   const std::string &getValue() const;
-  const std::vector<Variable::ptr> getArguments() const;
+  Symbol getSymbol() const { return m_symbol; }
+  const std::vector<Variable::ptr> &getArguments() const;
 
   void updateArgument(size_t i, Variable::ptr value);
 
   Variable::ptr clone(std::map<Variable *, Variable::ptr> *varMap = nullptr);
 
+  // структурные хеш и равенство термов, согласованные с методом toString()
+  size_t hash() const;
+  bool equals(const Variable &other) const;
+
   std::string toString() const;
 
 private:
   std::string toString(const VariableListNode *vlist) const;
+  size_t hash(const VariableListNode *vlist) const;
+  bool equals(const Variable &other, const VariableListNode *vlist,
+              const VariableListNode *otherVlist) const;
 
   bool hasSelf(const VariableListNode *list) const;
 
+  static ptr intern(ptr term);
+  bool shallowEquals(const Variable &other) const;
+
   bool m_isConst;
   bool m_isQuoted;
-  std::string m_value;
+  bool m_ground;
+  bool m_interned = false;
+  Symbol m_symbol;
+  size_t m_hash = 0; // хеш основного терма
   std::vector<Variable::ptr> m_arguments;
 };
+
+// функциональные объекты для хеш-таблиц с ключами-термами
+struct TermHash {
+  size_t operator()(const Variable::ptr &term) const { return term->hash(); }
+};
+
+struct TermEqual {
+  bool operator()(const Variable::ptr &left, const Variable::ptr &right) const {
+    return left == right || left->equals(*right);
+  }
+};
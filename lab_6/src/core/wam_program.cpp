@@ -0,0 +1,340 @@
+#include "wam_program.h"
+#include <algorithm>
+#include <deque>
+#include <sstream>
+
+namespace {
+
+// является ли цель отсечением
+bool isCut(const Atom &atom) {
+  static const Symbol cut("cut"), bang("!");
+  return atom.getArguments().empty() &&
+         (atom.getSymbol() == cut || atom.getSymbol() == bang);
+}
+
+bool isAnonymous(const Variable &term) {
+  static const Symbol anonymous("_");
+  return term.isVariable() && term.getSymbol() == anonymous;
+}
+
+} // namespace
+
+// класс компиляции одного правила в команды программы.
+//
+// Правило делится на участки: заголовок с подцелями до первого вызова
+// включительно и далее по одному вызову. Переменная, встречающаяся в
+// нескольких участках, становится переменной окружения (Y), остальные
+// переменные живут во временных регистрах (X). Аргументы вызовов занимают
+// регистры с номерами меньше наибольшей арности атомов правила, временные
+// регистры выделяются после них, поэтому построение аргументов не затирает
+// значения временных переменных
+class WamClauseCompiler {
+public:
+  using Op = WamProgram::Op;
+
+  WamClauseCompiler(WamProgram &program, const Rule &rule)
+      : m_program(program), m_rule(rule) {}
+
+  void compile() {
+    const auto &body = m_rule.getInputs();
+    size_t calls = 0;
+    size_t chunk = 0;
+    size_t maxArity = m_rule.getOutput().getArguments().size();
+    bool cutAfterCall = false;
+    collectVars(m_rule.getOutput(), chunk);
+    for (auto &goal : body) {
+      if (isCut(goal)) {
+        cutAfterCall = cutAfterCall || calls > 0;
+        continue;
+      }
+      maxArity = std::max(maxArity, goal.getArguments().size());
+      collectVars(goal, chunk);
+      calls++;
+      chunk++;
+    }
+    // окружение нужно, если после первого вызова есть другие цели
+    m_hasEnv = calls > 1 || (calls == 1 && cutAfterCall);
+    m_nextTemp = maxArity;
+    uint32_t permanent = 0;
+    for (auto symbol : m_order) {
+      auto &info = m_vars.at(symbol);
+      if (info.permanent)
+        info.index = permanent++;
+      else
+        info.index = m_nextTemp++;
+    }
+
+    if (m_hasEnv)
+      emit(Op::Allocate, permanent);
+    compileHead(m_rule.getOutput());
+    size_t callsLeft = calls;
+    for (auto &goal : body) {
+      if (isCut(goal)) {
+        emit(Op::Cut, m_hasEnv ? 1 : 0);
+        continue;
+      }
+      for (size_t i = 0; i < goal.getArguments().size(); ++i)
+        putArgument(goal.getArguments()[i], i);
+      auto functor = m_program.functorIndex(goal.getSymbol(),
+                                            goal.getArguments().size());
+      if (--callsLeft == 0 && &goal == &body.back()) {
+        // последний вызов правила передает ему продолжение правила
+        if (m_hasEnv)
+          emit(Op::Deallocate);
+        emit(Op::Execute, functor);
+        finish();
+        return;
+      }
+      emit(Op::Call, functor);
+    }
+    if (m_hasEnv)
+      emit(Op::Deallocate);
+    emit(Op::Proceed);
+    finish();
+  }
+
+private:
+  struct VarInfo {
+    size_t chunk = 0;       // участок первого вхождения
+    bool permanent = false; // встречается в нескольких участках
+    bool seen = false;      // первое вхождение уже скомпилировано
+    uint32_t index = 0;     // номер регистра или переменной окружения
+  };
+
+  void collectVars(const Atom &atom, size_t chunk) {
+    for (auto &arg : atom.getArguments())
+      collectVars(*arg, chunk);
+  }
+
+  void collectVars(const Variable &term, size_t chunk) {
+    if (term.isVariable()) {
+      if (isAnonymous(term))
+        return;
+      auto [iter, inserted] = m_vars.try_emplace(term.getSymbol());
+      if (inserted) {
+        iter->second.chunk = chunk;
+        m_order.push_back(term.getSymbol());
+      } else if (iter->second.chunk != chunk) {
+        iter->second.permanent = true;
+      }
+      return;
+    }
+    for (auto &arg : term.getArguments())
+      collectVars(*arg, chunk);
+  }
+
+  void compileHead(const Atom &head) {
+    // вложенные структуры сопоставляются после аргументов, которые их
+    // содержат: сначала они попадают во временные регистры
+    std::deque<std::pair<uint32_t, const Variable *>> nested;
+    const auto &args = head.getArguments();
+    for (uint32_t i = 0; i < args.size(); ++i) {
+      const auto &arg = *args[i];
+      if (isAnonymous(arg))
+        continue;
+      if (arg.isVariable()) {
+        auto &info = m_vars.at(arg.getSymbol());
+        if (info.permanent)
+          emit(info.seen ? Op::GetValueY : Op::GetVariableY, info.index, i);
+        else
+          emit(info.seen ? Op::GetValueX : Op::GetVariableX, info.index, i);
+        info.seen = true;
+      } else if (arg.isConst()) {
+        emit(arg.isQuoted() ? Op::GetString : Op::GetConstant,
+             arg.getSymbol().id(), i);
+      } else {
+        nested.emplace_back(i, &arg);
+      }
+    }
+    while (!nested.empty()) {
+      auto [reg, term] = nested.front();
+      nested.pop_front();
+      emit(Op::GetStructure,
+           m_program.functorIndex(term->getSymbol(),
+                                  term->getArguments().size()),
+           reg);
+      for (auto &arg : term->getArguments()) {
+        if (arg->isFuncSym()) {
+          auto temp = m_nextTemp++;
+          emit(Op::UnifyVariableX, temp);
+          nested.emplace_back(temp, arg.get());
+        } else {
+          unifyArgument(*arg);
+        }
+      }
+    }
+  }
+
+  // аргумент структуры, не являющийся структурой
+  void unifyArgument(const Variable &arg) {
+    if (isAnonymous(arg)) {
+      emit(Op::UnifyAnonymous);
+    } else if (arg.isVariable()) {
+      auto &info = m_vars.at(arg.getSymbol());
+      if (info.permanent)
+        emit(info.seen ? Op::UnifyValueY : Op::UnifyVariableY, info.index);
+      else
+        emit(info.seen ? Op::UnifyValueX : Op::UnifyVariableX, info.index);
+      info.seen = true;
+    } else {
+      emit(arg.isQuoted() ? Op::UnifyString : Op::UnifyConstant,
+           arg.getSymbol().id());
+    }
+  }
+
+  void putArgument(const Variable::ptr &arg, uint32_t i) {
+    if (isAnonymous(*arg)) {
+      emit(Op::PutAnonymous, 0, i);
+    } else if (arg->isVariable()) {
+      auto &info = m_vars.at(arg->getSymbol());
+      if (info.permanent)
+        emit(info.seen ? Op::PutValueY : Op::PutVariableY, info.index, i);
+      else
+        emit(info.seen ? Op::PutValueX : Op::PutVariableX, info.index, i);
+      info.seen = true;
+    } else if (arg->isConst()) {
+      emit(arg->isQuoted() ? Op::PutString : Op::PutConstant,
+           arg->getSymbol().id(), i);
+    } else {
+      buildStructure(*arg, i);
+    }
+  }
+
+  // построить структуру в регистре reg. Вложенные структуры строятся раньше
+  // содержащей их структуры, каждая в своем временном регистре
+  void buildStructure(const Variable &term, uint32_t reg) {
+    std::vector<uint32_t> temps;
+    for (auto &arg : term.getArguments()) {
+      if (!arg->isFuncSym())
+        continue;
+      temps.push_back(m_nextTemp++);
+      buildStructure(*arg, temps.back());
+    }
+    emit(Op::PutStructure,
+         m_program.functorIndex(term.getSymbol(), term.getArguments().size()),
+         reg);
+    size_t temp = 0;
+    for (auto &arg : term.getArguments()) {
+      if (arg->isFuncSym())
+        emit(Op::UnifyValueX, temps[temp++]);
+      else
+        unifyArgument(*arg);
+    }
+  }
+
+  void emit(Op op, uint32_t r = 0, uint32_t a = 0) {
+    m_program.m_code.push_back({op, r, a});
+  }
+
+  void finish() {
+    m_program.m_registers = std::max<size_t>(m_program.m_registers, m_nextTemp);
+  }
+
+  WamProgram &m_program;
+  const Rule &m_rule;
+  std::unordered_map<Symbol, VarInfo> m_vars;
+  std::vector<Symbol> m_order; // переменные в порядке первого вхождения
+  bool m_hasEnv = false;
+  uint32_t m_nextTemp = 0;
+};
+
+WamProgram::WamProgram(const std::list<Rule> &rules) {
+  m_code.push_back({Op::Halt, 0, 0});
+  for (auto &rule : rules)
+    compileClause(rule);
+}
+
+std::int64_t WamProgram::findFunctor(Symbol symbol, size_t arity) const {
+  auto iter =
+      m_functorIndex.find(ClauseIndex<Clause>::predicateKey(symbol, arity));
+  if (iter == m_functorIndex.end())
+    return -1;
+  return iter->second;
+}
+
+std::uint32_t WamProgram::functorIndex(Symbol symbol, size_t arity) {
+  auto key = ClauseIndex<Clause>::predicateKey(symbol, arity);
+  auto [iter, inserted] = m_functorIndex.emplace(key, m_functors.size());
+  if (inserted)
+    m_functors.push_back({symbol, static_cast<std::uint32_t>(arity), key});
+  return iter->second;
+}
+
+void WamProgram::compileClause(const Rule &rule) {
+  const auto &head = rule.getOutput();
+  functorIndex(head.getSymbol(), head.getArguments().size());
+  m_clauses.push_back({static_cast<std::uint32_t>(m_code.size()), &rule});
+  WamClauseCompiler(*this, rule).compile();
+  m_index.insert(head, &m_clauses.back());
+}
+
+std::string WamProgram::toString() const {
+  static const char *names[] = {
+      "get_variable_x", "get_variable_y", "get_value_x",    "get_value_y",
+      "get_constant",   "get_string",     "get_structure",  "put_variable_x",
+      "put_variable_y", "put_value_x",    "put_value_y",    "put_constant",
+      "put_string",     "put_anonymous",  "put_structure",  "unify_variable_x",
+      "unify_variable_y", "unify_value_x", "unify_value_y", "unify_constant",
+      "unify_string",   "unify_anonymous", "allocate",      "deallocate",
+      "call",           "execute",        "proceed",        "cut",
+      "halt",
+  };
+  std::stringstream s;
+  for (size_t pc = 0; pc < m_code.size(); ++pc) {
+    const auto &instr = m_code[pc];
+    s << pc << ": " << names[static_cast<size_t>(instr.op)];
+    switch (instr.op) {
+    case Op::GetConstant:
+    case Op::GetString:
+    case Op::PutConstant:
+    case Op::PutString:
+      s << " " << Symbol::fromId(instr.r).str() << ", A" << instr.a;
+      break;
+    case Op::UnifyConstant:
+    case Op::UnifyString:
+      s << " " << Symbol::fromId(instr.r).str();
+      break;
+    case Op::GetStructure:
+    case Op::PutStructure:
+      s << " " << m_functors[instr.r].symbol.str() << "/"
+        << m_functors[instr.r].arity << ", X" << instr.a;
+      break;
+    case Op::Call:
+    case Op::Execute:
+      s << " " << m_functors[instr.r].symbol.str() << "/"
+        << m_functors[instr.r].arity;
+      break;
+    case Op::GetVariableX:
+    case Op::GetValueX:
+    case Op::PutVariableX:
+    case Op::PutValueX:
+      s << " X" << instr.r << ", A" << instr.a;
+      break;
+    case Op::GetVariableY:
+    case Op::GetValueY:
+    case Op::PutVariableY:
+    case Op::PutValueY:
+      s << " Y" << instr.r << ", A" << instr.a;
+      break;
+    case Op::PutAnonymous:
+      s << " A" << instr.a;
+      break;
+    case Op::UnifyVariableX:
+    case Op::UnifyValueX:
+      s << " X" << instr.r;
+      break;
+    case Op::UnifyVariableY:
+    case Op::UnifyValueY:
+      s << " Y" << instr.r;
+      break;
+    case Op::Allocate:
+    case Op::Cut:
+      s << " " << instr.r;
+      break;
+    default:
+      break;
+    }
+    s << "\n";
+  }
+  return s.str();
+}
@@ -0,0 +1,143 @@
+#pragma once
+
+#include "clause_index.h"
+#include "rule.h"
+#include "symbol.h"
+#include <cstdint>
+#include <list>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// ячейка памяти абстрактной машины (куча, регистры, переменные окружений)
+struct WamCell {
+  enum class Tag : std::uint32_t {
+    Ref,       // ссылка на ячейку кучи; несвязанная переменная ссылается сама
+               // на себя
+    Str,       // ссылка на ячейку Functor структуры в куче
+    Functor,   // заголовок структуры: номер функтора программы, за ним в куче
+               // следуют аргументы
+    Const,     // константа: номер символа
+    String,    // строка в кавычках: номер символа
+    Anonymous, // переменная '_', которая унифицируется со всем без связывания
+  };
+
+  Tag tag;
+  std::uint32_t value;
+
+  bool operator==(const WamCell &other) const = default;
+};
+
+// класс программы абстрактной машины Уоррена (WAM), в которую компилируются
+// правила базы.
+//
+// Каждое правило компилируется в последовательность команд: команды get/unify
+// сопоставляют аргументы цели в регистрах с заголовком правила, команды
+// put/unify строят в регистрах аргументы подцелей, команды call/execute
+// вызывают предикаты, а proceed возвращает управление продолжению. Переменные
+// правила, которые используются после вызова подцели, хранятся в окружении
+// (команды allocate/deallocate), остальные - во временных регистрах.
+//
+// Переменные правил не переименовываются: каждая активация правила создает
+// свои ячейки в куче. Предложения предиката выбираются по индексу первого
+// аргумента, как и в классе Database
+class WamProgram {
+public:
+  enum class Op : std::uint8_t {
+    // сопоставление аргумента a с заголовком правила
+    GetVariableX,  // X[r] = A[a]
+    GetVariableY,  // Y[r] = A[a]
+    GetValueX,     // унифицировать X[r] и A[a]
+    GetValueY,     // унифицировать Y[r] и A[a]
+    GetConstant,   // унифицировать A[a] с константой r
+    GetString,     // унифицировать A[a] со строкой r
+    GetStructure,  // унифицировать A[a] со структурой функтора r
+    // построение аргумента a подцели
+    PutVariableX,  // новая переменная в X[r] и A[a]
+    PutVariableY,  // новая переменная в Y[r] и A[a]
+    PutValueX,     // A[a] = X[r]
+    PutValueY,     // A[a] = Y[r]
+    PutConstant,   // A[a] = константа r
+    PutString,     // A[a] = строка r
+    PutAnonymous,  // A[a] = '_'
+    PutStructure,  // A[a] = новая структура функтора r
+    // аргументы структуры в режиме чтения или записи
+    UnifyVariableX,
+    UnifyVariableY,
+    UnifyValueX,
+    UnifyValueY,
+    UnifyConstant,
+    UnifyString,
+    UnifyAnonymous,
+    // управление
+    Allocate,   // создать окружение из r переменных
+    Deallocate, // удалить окружение
+    Call,       // вызвать предикат r, продолжение - следующая команда
+    Execute,    // вызвать предикат r с продолжением текущего правила
+    Proceed,    // перейти к продолжению
+    Cut,        // отсечение; r != 0 - точка отсечения сохранена в окружении
+    Halt,       // решение запроса найдено
+  };
+
+  struct Instr {
+    Op op;
+    std::uint32_t r; // регистр, переменная окружения, символ или функтор
+    std::uint32_t a; // номер аргумента
+  };
+
+  // предложение программы
+  struct Clause {
+    std::uint32_t entry; // адрес первой команды
+    const Rule *rule;    // исходное правило базы
+  };
+
+  // функтор структуры или предикат
+  struct Functor {
+    Symbol symbol;
+    std::uint32_t arity;
+    ClauseIndex<Clause>::Key key; // ключ предиката в индексе
+  };
+
+  // адрес команды Halt - продолжение запроса
+  static constexpr std::uint32_t haltAddress = 0;
+
+  // скомпилировать правила в порядке их следования
+  explicit WamProgram(const std::list<Rule> &rules);
+
+  const std::vector<Instr> &getCode() const { return m_code; }
+  const Functor &getFunctor(std::uint32_t index) const {
+    return m_functors[index];
+  }
+  size_t functorsCount() const { return m_functors.size(); }
+
+  // номер функтора или -1, если функтор в программе не встречается
+  std::int64_t findFunctor(Symbol symbol, size_t arity) const;
+
+  // число регистров, используемых программой
+  size_t registersCount() const { return m_registers; }
+
+  // предложения предиката functor, первый аргумент которых может быть
+  // унифицирован с термом с ключом firstArg (std::nullopt для переменной)
+  const std::vector<const Clause *> &
+  lookup(std::uint32_t functor,
+         std::optional<ClauseIndex<Clause>::Key> firstArg) const {
+    return m_index.lookup(m_functors[functor].key, firstArg);
+  }
+
+  // текстовое представление команд программы (для отладки)
+  std::string toString() const;
+
+private:
+  std::uint32_t functorIndex(Symbol symbol, size_t arity);
+  void compileClause(const Rule &rule);
+
+  std::vector<Instr> m_code;
+  std::vector<Functor> m_functors;
+  std::unordered_map<ClauseIndex<Clause>::Key, std::uint32_t> m_functorIndex;
+  std::list<Clause> m_clauses;
+  ClauseIndex<Clause> m_index;
+  size_t m_registers = 0;
+
+  friend class WamClauseCompiler;
+};
@@ -0,0 +1,630 @@
+#include "wam_solver.h"
+#include "mgraph_solver.h"
+#include <algorithm>
+#include <unordered_set>
+
+namespace {
+
+const Symbol &anonymousSymbol() {
+  static const Symbol symbol("_");
+  return symbol;
+}
+
+} // namespace
+
+/**
+ * Метод обратного поиска на абстрактной машине.
+ *
+ * target - цель, которую необходимо доказать
+ *
+ * Аргументы цели размещаются в куче и регистрах, после чего машина выполняет
+ * вызов предиката цели с продолжением Halt. Достижение команды Halt означает
+ * найденное решение: строится подстановка для переменных цели. Следующее
+ * решение ищется откатом к последней точке выбора.
+ *
+ * Машина не поддерживает таблицы, поэтому для базы с табулируемыми
+ * предикатами поиск передается решателю MGraphSolver.
+ */
+Generator<Subst> WamSolver::generateBackward(Atom target) {
+  if (m_database->hasTabled()) {
+    auto solver = std::make_shared<MGraphSolver>(m_database, m_atomHooks);
+    solver->solveBackward(std::move(target));
+    while (auto subst = solver->next())
+      co_yield std::move(*subst);
+    solver->done();
+    co_return;
+  }
+  if (!start(target))
+    co_return;
+  while (run()) {
+    co_yield answer();
+    if (!backtrack())
+      break;
+  }
+}
+
+bool WamSolver::start(const Atom &target) {
+  m_program = m_database->getProgram();
+  m_code = m_program->getCode().data();
+  m_hooks.assign(m_program->functorsCount(), nullptr);
+  for (size_t i = 0; i < m_hooks.size(); ++i) {
+    auto iter = m_atomHooks.find(m_program->getFunctor(i).symbol.str());
+    if (iter != m_atomHooks.end())
+      m_hooks[i] = iter->second.get();
+  }
+  m_heap.clear();
+  m_stack.clear();
+  m_choices.clear();
+  m_savedArgs.clear();
+  m_trail.clear();
+  m_hookGens.clear();
+  m_queryVars.clear();
+  m_extraFunctors.clear();
+  m_extraIndex.clear();
+  m_env = none;
+  m_cutBarrier = {};
+  const auto &args = target.getArguments();
+  m_regs.assign(std::max(m_program->registersCount(), args.size()),
+                Cell{Tag::Anonymous, 0});
+
+  // переменные цели занимают первые ячейки кучи в порядке имен, поэтому
+  // представителем связанных переменных цели становится переменная с
+  // наименьшим именем, как и в классе MGraphSolver
+  std::unordered_map<Symbol, Cell> vars;
+  for (auto &name : target.getAllVars()) {
+    auto cell = newVariable();
+    vars.emplace(Symbol(name), cell);
+    m_queryVars.emplace_back(name, cell.value);
+  }
+  for (size_t i = 0; i < args.size(); ++i)
+    m_regs[i] = encode(args[i], vars);
+
+  auto functor = m_program->findFunctor(target.getSymbol(), args.size());
+  if (functor >= 0) {
+    if (call(functor, WamProgram::haltAddress))
+      return true;
+    return backtrack();
+  }
+  // предиката нет в базе правил - это может быть специальная процедура
+  auto iter = m_atomHooks.find(target.getName());
+  if (iter == m_atomHooks.end())
+    return false;
+  return callHook(*iter->second, args.size(), WamProgram::haltAddress) ||
+         backtrack();
+}
+
+/**
+ * Основной цикл машины.
+ *
+ * Выполняет команды, начиная с m_pc. Неудача унификации или вызова приводит к
+ * откату к последней точке выбора; если точек выбора нет, решений больше нет.
+ */
+bool WamSolver::run() {
+  while (true) {
+    const auto &instr = m_code[m_pc++];
+    bool ok = true;
+    switch (instr.op) {
+    case Op::GetVariableX:
+      m_regs[instr.r] = m_regs[instr.a];
+      break;
+    case Op::GetVariableY:
+      envVar(instr.r) = m_regs[instr.a];
+      break;
+    case Op::GetValueX:
+      ok = unify(m_regs[instr.r], m_regs[instr.a]);
+      break;
+    case Op::GetValueY:
+      ok = unify(envVar(instr.r), m_regs[instr.a]);
+      break;
+    case Op::GetConstant:
+    case Op::GetString: {
+      Cell value{instr.op == Op::GetConstant ? Tag::Const : Tag::String,
+                 instr.r};
+      auto cell = deref(m_regs[instr.a]);
+      if (cell.tag == Tag::Ref)
+        bind(cell.value, value);
+      else
+        ok = cell == value || cell.tag == Tag::Anonymous;
+      break;
+    }
+    case Op::GetStructure: {
+      auto cell = deref(m_regs[instr.a]);
+      if (cell.tag == Tag::Str) {
+        ok = m_heap[cell.value].value == instr.r;
+        m_structPtr = cell.value + 1;
+        m_writeMode = false;
+      } else if (cell.tag == Tag::Ref || cell.tag == Tag::Anonymous) {
+        // структура строится в куче; для '_' она ни с чем не связывается
+        auto addr = static_cast<std::uint32_t>(m_heap.size());
+        m_heap.push_back({Tag::Functor, instr.r});
+        if (cell.tag == Tag::Ref)
+          bind(cell.value, {Tag::Str, addr});
+        m_writeMode = true;
+      } else {
+        ok = false;
+      }
+      break;
+    }
+    case Op::PutVariableX:
+      m_regs[instr.r] = m_regs[instr.a] = newVariable();
+      break;
+    case Op::PutVariableY:
+      envVar(instr.r) = m_regs[instr.a] = newVariable();
+      break;
+    case Op::PutValueX:
+      m_regs[instr.a] = m_regs[instr.r];
+      break;
+    case Op::PutValueY:
+      m_regs[instr.a] = envVar(instr.r);
+      break;
+    case Op::PutConstant:
+      m_regs[instr.a] = {Tag::Const, instr.r};
+      break;
+    case Op::PutString:
+      m_regs[instr.a] = {Tag::String, instr.r};
+      break;
+    case Op::PutAnonymous:
+      m_regs[instr.a] = {Tag::Anonymous, 0};
+      break;
+    case Op::PutStructure:
+      m_regs[instr.a] = {Tag::Str, static_cast<std::uint32_t>(m_heap.size())};
+      m_heap.push_back({Tag::Functor, instr.r});
+      m_writeMode = true;
+      break;
+    case Op::UnifyVariableX:
+    case Op::UnifyVariableY: {
+      Cell cell;
+      if (m_writeMode)
+        cell = newVariable();
+      else
+        cell = m_heap[m_structPtr++];
+      (instr.op == Op::UnifyVariableX ? m_regs[instr.r] : envVar(instr.r)) =
+          cell;
+      break;
+    }
+    case Op::UnifyValueX:
+    case Op::UnifyValueY: {
+      auto cell =
+          instr.op == Op::UnifyValueX ? m_regs[instr.r] : envVar(instr.r);
+      if (m_writeMode)
+        m_heap.push_back(cell);
+      else
+        ok = unify(cell, m_heap[m_structPtr++]);
+      break;
+    }
+    case Op::UnifyConstant:
+    case Op::UnifyString: {
+      Cell value{instr.op == Op::UnifyConstant ? Tag::Const : Tag::String,
+                 instr.r};
+      if (m_writeMode) {
+        m_heap.push_back(value);
+        break;
+      }
+      auto cell = deref(m_heap[m_structPtr++]);
+      if (cell.tag == Tag::Ref)
+        bind(cell.value, value);
+      else
+        ok = cell == value || cell.tag == Tag::Anonymous;
+      break;
+    }
+    case Op::UnifyAnonymous:
+      if (m_writeMode)
+        m_heap.push_back({Tag::Anonymous, 0});
+      else
+        m_structPtr++;
+      break;
+    case Op::Allocate:
+      m_env = allocate(instr.r);
+      break;
+    case Op::Deallocate:
+      m_cont = m_stack[m_env + 1].value;
+      m_env = m_stack[m_env].value;
+      break;
+    case Op::Call:
+      ok = call(instr.r, m_pc);
+      break;
+    case Op::Execute:
+      ok = call(instr.r, m_cont);
+      break;
+    case Op::Proceed:
+      m_pc = m_cont;
+      break;
+    case Op::Cut:
+      if (instr.r != 0)
+        cut({m_stack[m_env + 2].value, m_stack[m_env + 3].value});
+      else
+        cut(m_cutBarrier);
+      break;
+    case Op::Halt:
+      return true;
+    }
+    if (!ok && !backtrack())
+      return false;
+  }
+}
+
+/**
+ * Метод вызова предиката.
+ *
+ * functor - номер предиката в программе
+ * cont - продолжение
+ *
+ * Специальная процедура вызывается обработчиком. Для предиката базы правила
+ * выбираются по индексу первого аргумента; если их несколько, создается точка
+ * выбора, которая становится точкой отсечения вызванного правила.
+ */
+bool WamSolver::call(std::uint32_t functor, std::uint32_t cont) {
+  if (auto hook = m_hooks[functor])
+    return callHook(*hook, m_program->getFunctor(functor).arity, cont);
+  std::uint32_t arity = m_program->getFunctor(functor).arity;
+  const auto &clauses = m_program->lookup(
+      functor, arity == 0 ? std::nullopt : argKey(m_regs[0]));
+  if (clauses.empty())
+    return false;
+  m_cont = cont;
+  if (clauses.size() == 1) {
+    m_cutBarrier = {};
+  } else {
+    pushChoice(&clauses, 1, arity, cont);
+    m_cutBarrier = {static_cast<std::uint32_t>(m_choices.size() - 1),
+                    m_choices.back().serial};
+  }
+  m_pc = clauses.front()->entry;
+  return true;
+}
+
+/**
+ * Метод вызова специальной процедуры.
+ *
+ * Аргументы из регистров преобразуются в термы; несвязанные переменные
+ * становятся пронумерованными переменными с номерами ячеек, по которым
+ * связывания из подстановок
+ * обработчика переносятся в кучу. Генератор обработчика сохраняется в точке
+ * выбора, чтобы при откате получить следующее решение.
+ */
+bool WamSolver::callHook(AtomHook &hook, std::uint32_t arity,
+                         std::uint32_t cont) {
+  std::vector<Variable::ptr> args;
+  args.reserve(arity);
+  for (std::uint32_t i = 0; i < arity; ++i)
+    args.push_back(decode(m_regs[i], false));
+  m_hookGens.push_back(hook.prove(std::move(args), Subst()));
+  pushChoice(nullptr, m_hookGens.size() - 1, 0, cont);
+  return resumeHook(m_choices.size() - 1);
+}
+
+bool WamSolver::resumeHook(size_t choice) {
+  auto &gen = m_hookGens[m_choices[choice].next];
+  while (auto subst = gen.next()) {
+    restore(m_choices[choice]);
+    bool ok = true;
+    std::unordered_map<Symbol, Cell> vars;
+    for (auto &varName : subst->getVarNames()) {
+      auto var = Variable::createVariable(varName);
+      auto addr = cellOf(var->getSymbol());
+      Cell cell = addr != none ? Cell{Tag::Ref, addr} : encode(var, vars);
+      if (!unify(cell, encode(subst->apply(var), vars))) {
+        ok = false;
+        break;
+      }
+    }
+    if (ok) {
+      m_pc = m_cont;
+      return true;
+    }
+  }
+  restore(m_choices[choice]);
+  popChoice();
+  return false;
+}
+
+/**
+ * Метод отката.
+ *
+ * Восстанавливает состояние машины из последней точки выбора и переходит к
+ * следующему правилу предиката или следующему решению специальной
+ * процедуры. Исчерпанные точки выбора удаляются. Возвращает false, если точек
+ * выбора не осталось.
+ */
+bool WamSolver::backtrack() {
+  while (!m_choices.empty()) {
+    auto &choice = m_choices.back();
+    if (!choice.clauses) {
+      if (resumeHook(m_choices.size() - 1))
+        return true;
+      continue;
+    }
+    if (choice.next >= choice.clauses->size()) {
+      // все правила перебраны или было отсечение
+      restore(choice);
+      popChoice();
+      continue;
+    }
+    restore(choice);
+    const auto *clause = (*choice.clauses)[choice.next++];
+    m_cutBarrier = {static_cast<std::uint32_t>(m_choices.size() - 1),
+                    choice.serial};
+    if (choice.next == choice.clauses->size()) {
+      // последнее правило: точка выбора больше не нужна
+      popChoice();
+      m_cutBarrier = {};
+    }
+    m_pc = clause->entry;
+    return true;
+  }
+  return false;
+}
+
+void WamSolver::pushChoice(
+    const std::vector<const WamProgram::Clause *> *clauses, std::uint32_t next,
+    std::uint32_t arity, std::uint32_t cont) {
+  Choice choice;
+  choice.clauses = clauses;
+  choice.next = next;
+  choice.heapTop = m_heap.size();
+  choice.trailTop = m_trail.size();
+  choice.stackTop = stackTop();
+  choice.env = m_env;
+  choice.cont = cont;
+  choice.argsTop = m_savedArgs.size();
+  choice.arity = arity;
+  choice.serial = m_serial++;
+  m_savedArgs.insert(m_savedArgs.end(), m_regs.begin(),
+                     m_regs.begin() + arity);
+  m_choices.push_back(choice);
+}
+
+void WamSolver::restore(const Choice &choice) {
+  while (m_trail.size() > choice.trailTop) {
+    auto addr = m_trail.back();
+    m_heap[addr] = {Tag::Ref, addr};
+    m_trail.pop_back();
+  }
+  m_heap.resize(choice.heapTop);
+  m_env = choice.env;
+  m_cont = choice.cont;
+  std::copy(m_savedArgs.begin() + choice.argsTop,
+            m_savedArgs.begin() + choice.argsTop + choice.arity,
+            m_regs.begin());
+}
+
+void WamSolver::popChoice() {
+  m_savedArgs.resize(m_choices.back().argsTop);
+  if (!m_choices.back().clauses)
+    m_hookGens.pop_back();
+  m_choices.pop_back();
+}
+
+// отсечение запрещает перебор оставшихся правил предиката. Точки выбора
+// подцелей, доказанных до отсечения, сохраняются
+void WamSolver::cut(CutBarrier barrier) {
+  if (barrier.index >= m_choices.size() ||
+      m_choices[barrier.index].serial != barrier.serial)
+    return; // правило было последним
+  auto &choice = m_choices[barrier.index];
+  choice.next = choice.clauses->size();
+  if (barrier.index + 1 == m_choices.size())
+    popChoice();
+}
+
+// вершина стека окружений: над текущим окружением и окружениями, защищенными
+// точками выбора
+std::uint32_t WamSolver::stackTop() const {
+  std::uint32_t top = 0;
+  if (m_env != none)
+    top = m_env + frameHeader + m_stack[m_env + 4].value;
+  if (!m_choices.empty())
+    top = std::max(top, m_choices.back().stackTop);
+  return top;
+}
+
+std::uint32_t WamSolver::allocate(std::uint32_t size) {
+  auto top = stackTop();
+  if (m_stack.size() < top + frameHeader + size)
+    m_stack.resize(top + frameHeader + size);
+  m_stack[top] = {Tag::Ref, m_env};
+  m_stack[top + 1] = {Tag::Ref, m_cont};
+  m_stack[top + 2] = {Tag::Ref, m_cutBarrier.index};
+  m_stack[top + 3] = {Tag::Ref, m_cutBarrier.serial};
+  m_stack[top + 4] = {Tag::Ref, size};
+  return top;
+}
+
+WamCell WamSolver::newVariable() {
+  auto addr = static_cast<std::uint32_t>(m_heap.size());
+  m_heap.push_back({Tag::Ref, addr});
+  return m_heap.back();
+}
+
+WamCell WamSolver::deref(Cell cell) const {
+  while (cell.tag == Tag::Ref) {
+    const auto &next = m_heap[cell.value];
+    if (next.tag == Tag::Ref && next.value == cell.value)
+      break;
+    cell = next;
+  }
+  return cell;
+}
+
+void WamSolver::bind(std::uint32_t addr, Cell value) {
+  m_heap[addr] = value;
+  // связывания ячеек, созданных после последней точки выбора, снимаются
+  // усечением кучи и в журнал не попадают
+  if (!m_choices.empty() && addr < m_choices.back().heapTop)
+    m_trail.push_back(addr);
+}
+
+/**
+ * Метод унификации ячеек.
+ *
+ * Переменные связываются в сторону более старых ячеек кучи. '_' унифицируется
+ * с любым термом без связывания. Проверка вхождения не выполняется, как и в
+ * остальных решателях, поэтому при унификации возможны циклические термы:
+ * после большого числа шагов запоминаются уже сопоставленные пары структур,
+ * что гарантирует завершение.
+ */
+bool WamSolver::unify(Cell left, Cell right) {
+  constexpr size_t visitThreshold = 1 << 12;
+  std::vector<std::pair<Cell, Cell>> pending{{left, right}};
+  std::unordered_set<std::uint64_t> visited;
+  size_t steps = 0;
+  while (!pending.empty()) {
+    auto [a, b] = pending.back();
+    pending.pop_back();
+    a = deref(a);
+    b = deref(b);
+    if (a == b || a.tag == Tag::Anonymous || b.tag == Tag::Anonymous)
+      continue;
+    if (a.tag == Tag::Ref && b.tag == Tag::Ref) {
+      if (a.value < b.value)
+        bind(b.value, a);
+      else
+        bind(a.value, b);
+      continue;
+    }
+    if (a.tag == Tag::Ref) {
+      bind(a.value, b);
+      continue;
+    }
+    if (b.tag == Tag::Ref) {
+      bind(b.value, a);
+      continue;
+    }
+    if (a.tag != Tag::Str || b.tag != Tag::Str)
+      return false; // различные константы, строки или константа и структура
+    auto functor = m_heap[a.value].value;
+    if (functor != m_heap[b.value].value)
+      return false;
+    if (++steps > visitThreshold &&
+        !visited.insert(std::uint64_t(a.value) << 32 | b.value).second)
+      continue;
+    std::uint32_t arity = getFunctor(functor).arity;
+    for (std::uint32_t i = arity; i > 0; --i)
+      pending.emplace_back(m_heap[a.value + i], m_heap[b.value + i]);
+  }
+  return true;
+}
+
+std::optional<ClauseIndex<WamProgram::Clause>::Key>
+WamSolver::argKey(Cell cell) const {
+  using Index = ClauseIndex<WamProgram::Clause>;
+  cell = deref(cell);
+  switch (cell.tag) {
+  case Tag::Const:
+  case Tag::String:
+    return Index::constantKey(Symbol::fromId(cell.value),
+                              cell.tag == Tag::String);
+  case Tag::Str: {
+    const auto &functor = getFunctor(m_heap[cell.value].value);
+    return Index::functorKey(functor.symbol, functor.arity);
+  }
+  default:
+    return std::nullopt;
+  }
+}
+
+WamCell WamSolver::encode(const Variable::ptr &term,
+                          std::unordered_map<Symbol, Cell> &vars) {
+  if (term->isVariable()) {
+    if (term->getSymbol() == anonymousSymbol())
+      return {Tag::Anonymous, 0};
+    auto addr = cellOf(term->getSymbol());
+    if (addr != none)
+      return {Tag::Ref, addr};
+    auto iter = vars.find(term->getSymbol());
+    if (iter == vars.end())
+      iter = vars.emplace(term->getSymbol(), newVariable()).first;
+    return iter->second;
+  }
+  if (term->isConst())
+    return {term->isQuoted() ? Tag::String : Tag::Const,
+            term->getSymbol().id()};
+  const auto &args = term->getArguments();
+  std::vector<Cell> cells;
+  cells.reserve(args.size());
+  for (auto &arg : args)
+    cells.push_back(encode(arg, vars));
+  auto addr = static_cast<std::uint32_t>(m_heap.size());
+  auto functor = functorIndex(term->getSymbol(), args.size());
+  m_heap.push_back({Tag::Functor, functor});
+  m_heap.insert(m_heap.end(), cells.begin(), cells.end());
+  return {Tag::Str, addr};
+}
+
+Variable::ptr WamSolver::decode(Cell cell, bool queryNames) {
+  std::vector<DecodeFrame> frames;
+  return decode(cell, queryNames, frames);
+}
+
+// построить терм по ячейке. Циклические структуры порождают циклический
+// терм, как в методе TrailSubst::resolve
+Variable::ptr WamSolver::decode(Cell cell, bool queryNames,
+                                std::vector<DecodeFrame> &frames) {
+  cell = deref(cell);
+  switch (cell.tag) {
+  case Tag::Ref:
+    if (queryNames && cell.value < m_queryVars.size())
+      return Variable::createVariable(m_queryVars[cell.value].first);
+    return Variable::createVariable(Symbol::variable(cell.value));
+  case Tag::Anonymous:
+    return Variable::createVariable(anonymousSymbol());
+  case Tag::Const:
+    return Variable::createConst(Symbol::fromId(cell.value));
+  case Tag::String:
+    return Variable::createString(Symbol::fromId(cell.value));
+  default:
+    break;
+  }
+  for (auto &frame : frames) {
+    if (frame.addr == cell.value) {
+      frame.cyclic = true;
+      return frame.node;
+    }
+  }
+  const auto &functor = getFunctor(m_heap[cell.value].value);
+  std::vector<Variable::ptr> placeholders(
+      functor.arity, Variable::createVariable(anonymousSymbol()));
+  frames.push_back({cell.value,
+                    std::make_shared<Variable>(false, false, functor.symbol,
+                                               std::move(placeholders)),
+                    false});
+  auto node = frames.back().node;
+  for (std::uint32_t i = 0; i < functor.arity; ++i)
+    node->updateArgument(
+        i, decode(m_heap[cell.value + 1 + i], queryNames, frames));
+  bool cyclic = frames.back().cyclic;
+  frames.pop_back();
+  if (cyclic)
+    return node;
+  return Variable::createFuncSym(functor.symbol, node->getArguments());
+}
+
+Subst WamSolver::answer() {
+  Subst subst;
+  for (std::uint32_t i = 0; i < m_queryVars.size(); ++i)
+    subst.insert(m_queryVars[i].first, decode({Tag::Ref, i}, true));
+  return subst;
+}
+
+std::uint32_t WamSolver::cellOf(Symbol var) {
+  return var.isNumbered() ? var.number() : none;
+}
+
+const WamProgram::Functor &WamSolver::getFunctor(std::uint32_t index) const {
+  if (index < m_program->functorsCount())
+    return m_program->getFunctor(index);
+  return m_extraFunctors[index - m_program->functorsCount()];
+}
+
+std::uint32_t WamSolver::functorIndex(Symbol symbol, size_t arity) {
+  auto index = m_program->findFunctor(symbol, arity);
+  if (index >= 0)
+    return index;
+  auto key = ClauseIndex<WamProgram::Clause>::predicateKey(symbol, arity);
+  auto [iter, inserted] = m_extraIndex.emplace(
+      key, m_program->functorsCount() + m_extraFunctors.size());
+  if (inserted)
+    m_extraFunctors.push_back(
+        {symbol, static_cast<std::uint32_t>(arity), key});
+  return iter->second;
+}
@@ -0,0 +1,157 @@
+#pragma once
+
+#include "atom_hook.h"
+#include "database.h"
+#include "generator.h"
+#include "solver.h"
+#include "wam_program.h"
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+// класс решателя с обратным выводом на абстрактной машине Уоррена.
+//
+// Правила базы компилируются в программу (класс WamProgram, см.
+// Database::getProgram), которую выполняет регистровая машина с кучей,
+// стеком окружений, стеком точек выбора и журналом отката. Поиск решений
+// совпадает с поиском в глубину класса MGraphSolver: правила перебираются в
+// порядке базы, отсечение запрещает перебор следующих правил предиката, а
+// цели перед отсечением по-прежнему могут давать другие решения. Специальные
+// процедуры (AtomHook) вызываются по имени предиката.
+//
+// Табулирование предикатов (Database::setTabled) машиной не поддерживается:
+// если в базе есть табулируемые предикаты, поиск выполняется классом
+// MGraphSolver, иначе леворекурсивные табулируемые правила не завершались бы.
+// Несвязанные переменные решений, не являющиеся переменными цели, становятся
+// пронумерованными переменными (Symbol::variable) с номерами ячеек кучи
+class WamSolver : public Solver {
+public:
+  WamSolver(std::shared_ptr<Database> database,
+            std::map<std::string, std::shared_ptr<AtomHook>> atomHooks = {})
+      : Solver(std::move(database)), m_atomHooks(std::move(atomHooks)) {}
+
+  // генератор обращается к состоянию машины, поэтому останавливаем поиск до
+  // ее уничтожения
+  ~WamSolver() override { done(); }
+
+protected:
+  virtual Generator<Subst> generateBackward(Atom target) override;
+
+private:
+  using Cell = WamCell;
+  using Tag = WamCell::Tag;
+  using Op = WamProgram::Op;
+
+  static constexpr std::uint32_t none = UINT32_MAX;
+  // служебные слова окружения: предыдущее окружение, продолжение, точка
+  // отсечения (номер и порядковый номер) и число переменных
+  static constexpr std::uint32_t frameHeader = 5;
+
+  // точка выбора: состояние машины до вызова предиката и следующая
+  // альтернатива - предложение предиката или решение специальной процедуры
+  struct Choice {
+    // предложения предиката или nullptr для специальной процедуры
+    const std::vector<const WamProgram::Clause *> *clauses;
+    std::uint32_t next;     // номер следующего предложения или генератора
+    std::uint32_t heapTop;  // вершина кучи
+    std::uint32_t trailTop; // вершина журнала
+    std::uint32_t stackTop; // вершина стека окружений
+    std::uint32_t env;      // текущее окружение
+    std::uint32_t cont;     // продолжение
+    std::uint32_t argsTop;  // начало сохраненных аргументов в m_savedArgs
+    std::uint32_t arity;
+    std::uint32_t serial; // порядковый номер, отличающий точки выбора
+  };
+
+  // точка отсечения: точка выбора предиката, предложения которого
+  // выполняются
+  struct CutBarrier {
+    std::uint32_t index = none;
+    std::uint32_t serial = 0;
+  };
+
+  // начать выполнение запроса. Возвращает false, если предикат цели не
+  // определен
+  bool start(const Atom &target);
+  // выполнять команды до нахождения решения (true) или исчерпания точек
+  // выбора (false)
+  bool run();
+  // вызвать предикат; cont - продолжение
+  bool call(std::uint32_t functor, std::uint32_t cont);
+  bool callHook(AtomHook &hook, std::uint32_t arity, std::uint32_t cont);
+  // откат к последней точке выбора и переход к ее альтернативе
+  bool backtrack();
+  bool resumeHook(size_t choice);
+  void pushChoice(const std::vector<const WamProgram::Clause *> *clauses,
+                  std::uint32_t next, std::uint32_t arity, std::uint32_t cont);
+  void restore(const Choice &choice);
+  void popChoice();
+  void cut(CutBarrier barrier);
+
+  // окружение: служебные слова и переменные Y
+  std::uint32_t stackTop() const;
+  std::uint32_t allocate(std::uint32_t size);
+  Cell &envVar(std::uint32_t index) {
+    return m_stack[m_env + frameHeader + index];
+  }
+
+  Cell newVariable();
+  Cell deref(Cell cell) const;
+  void bind(std::uint32_t addr, Cell value);
+  bool unify(Cell left, Cell right);
+  std::optional<ClauseIndex<WamProgram::Clause>::Key> argKey(Cell cell) const;
+
+  // преобразование термов в ячейки кучи и обратно
+  Cell encode(const Variable::ptr &term,
+              std::unordered_map<Symbol, Cell> &vars);
+  struct DecodeFrame {
+    std::uint32_t addr; // адрес разбираемой структуры
+    Variable::ptr node; // строящийся терм
+    bool cyclic;        // на терм есть ссылка из его аргументов
+  };
+  Variable::ptr decode(Cell cell, bool queryNames);
+  Variable::ptr decode(Cell cell, bool queryNames,
+                       std::vector<DecodeFrame> &frames);
+  Subst answer();
+
+  // функторы программы и функторы термов запроса и специальных процедур,
+  // которых нет в программе
+  const WamProgram::Functor &getFunctor(std::uint32_t index) const;
+  std::uint32_t functorIndex(Symbol symbol, size_t arity);
+
+  // номер ячейки кучи, обозначаемой пронумерованной переменной
+  // (Symbol::variable), или none
+  static std::uint32_t cellOf(Symbol var);
+
+  // таблица обработчиков специальных процедур
+  std::map<std::string, std::shared_ptr<AtomHook>> m_atomHooks;
+
+  std::shared_ptr<const WamProgram> m_program;
+  const WamProgram::Instr *m_code = nullptr;
+  std::vector<AtomHook *> m_hooks; // обработчики по номерам функторов
+  std::vector<WamProgram::Functor> m_extraFunctors;
+  std::unordered_map<ClauseIndex<WamProgram::Clause>::Key, std::uint32_t>
+      m_extraIndex;
+
+  std::vector<Cell> m_heap;
+  std::vector<Cell> m_regs;   // регистры аргументов и временных переменных
+  std::vector<Cell> m_stack;  // окружения
+  std::vector<Choice> m_choices;
+  std::vector<Cell> m_savedArgs; // аргументы, сохраненные в точках выбора
+  std::vector<std::uint32_t> m_trail;
+  // генераторы специальных процедур, решения которых еще не перебраны
+  std::vector<Generator<Subst>> m_hookGens;
+
+  std::uint32_t m_pc = 0;     // адрес текущей команды
+  std::uint32_t m_cont = 0;   // продолжение
+  std::uint32_t m_env = none; // текущее окружение
+  std::uint32_t m_structPtr = 0; // следующий аргумент структуры (режим чтения)
+  bool m_writeMode = false;
+  CutBarrier m_cutBarrier;
+  std::uint32_t m_serial = 0;
+
+  // переменные цели и их ячейки в порядке имен
+  std::vector<std::pair<std::string, std::uint32_t>> m_queryVars;
+};
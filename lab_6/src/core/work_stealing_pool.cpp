@@ -0,0 +1,117 @@
+#include "work_stealing_pool.h"
+#include <algorithm>
+
+namespace {
+
+// пул и номер очереди текущего рабочего потока
+thread_local const WorkStealingPool *currentPool = nullptr;
+thread_local size_t currentQueue = 0;
+
+} // namespace
+
+WorkStealingPool::WorkStealingPool(size_t threads) {
+  if (threads == 0)
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  for (size_t i = 0; i < threads; ++i)
+    m_queues.push_back(std::make_unique<Queue>());
+  for (size_t i = 0; i < threads; ++i)
+    m_threads.emplace_back([this, i]() { run(i); });
+}
+
+WorkStealingPool::~WorkStealingPool() {
+  {
+    std::lock_guard lock(m_sleepMutex);
+    m_stop = true;
+  }
+  m_wake.notify_all();
+  for (auto &thread : m_threads)
+    thread.join();
+}
+
+WorkStealingPool &WorkStealingPool::shared() {
+  static WorkStealingPool pool;
+  return pool;
+}
+
+void WorkStealingPool::submit(Task task) {
+  auto self = currentIndex();
+  auto &queue = self ? *m_queues[*self] : m_injector;
+  {
+    // счетчик увеличивается до добавления задачи, чтобы не уйти в минус при
+    // ее немедленном перехвате, и под мьютексом ожидания, чтобы не потерять
+    // пробуждение
+    std::lock_guard lock(m_sleepMutex);
+    ++m_pending;
+  }
+  {
+    std::lock_guard lock(queue.mutex);
+    queue.tasks.push_back(std::move(task));
+  }
+  m_wake.notify_one();
+}
+
+bool WorkStealingPool::runPending() {
+  auto task = take(currentIndex());
+  if (!task)
+    return false;
+  (*task)();
+  return true;
+}
+
+std::optional<size_t> WorkStealingPool::currentIndex() const {
+  if (currentPool != this)
+    return std::nullopt;
+  return currentQueue;
+}
+
+std::optional<WorkStealingPool::Task>
+WorkStealingPool::take(std::optional<size_t> self) {
+  if (m_pending.load() == 0)
+    return std::nullopt;
+  auto pop = [this](Queue &queue, bool back) -> std::optional<Task> {
+    std::lock_guard lock(queue.mutex);
+    if (queue.tasks.empty())
+      return std::nullopt;
+    Task task;
+    if (back) {
+      task = std::move(queue.tasks.back());
+      queue.tasks.pop_back();
+    } else {
+      task = std::move(queue.tasks.front());
+      queue.tasks.pop_front();
+    }
+    --m_pending;
+    return task;
+  };
+  // сначала последняя задача своей очереди
+  if (self)
+    if (auto task = pop(*m_queues[*self], true))
+      return task;
+  if (auto task = pop(m_injector, false))
+    return task;
+  // перехват самой старой задачи из очередей других потоков
+  size_t start = self ? *self + 1 : 0;
+  for (size_t i = 0; i < m_queues.size(); ++i) {
+    size_t victim = (start + i) % m_queues.size();
+    if (self && victim == *self)
+      continue;
+    if (auto task = pop(*m_queues[victim], false))
+      return task;
+  }
+  return std::nullopt;
+}
+
+void WorkStealingPool::run(size_t index) {
+  currentPool = this;
+  currentQueue = index;
+  while (true) {
+    if (auto task = take(index)) {
+      (*task)();
+      continue;
+    }
+    std::unique_lock lock(m_sleepMutex);
+    m_wake.wait(lock, [this]() { return m_stop || m_pending.load() > 0; });
+    if (m_stop)
+      return;
+  }
+}
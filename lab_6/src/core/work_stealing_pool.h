@@ -0,0 +1,62 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+// класс пула потоков с перехватом задач (work stealing).
+//
+// У каждого рабочего потока своя очередь задач. Поток берет задачи с конца
+// своей очереди, а при ее опустошении перехватывает задачи из начала очередей
+// других потоков. Задачи, добавленные из потоков вне пула, попадают в общую
+// очередь. Поток, ожидающий результата задачи, может выполнять задачи пула
+// сам (метод runPending), поэтому ожидание внутри задачи не блокирует пул
+class WorkStealingPool {
+public:
+  using Task = std::function<void()>;
+
+  // число потоков по умолчанию - число аппаратных потоков
+  explicit WorkStealingPool(size_t threads = 0);
+  ~WorkStealingPool();
+
+  WorkStealingPool(const WorkStealingPool &) = delete;
+  WorkStealingPool &operator=(const WorkStealingPool &) = delete;
+
+  // добавить задачу в очередь вызывающего рабочего потока или в общую очередь
+  void submit(Task task);
+
+  // выполнить одну ожидающую задачу в вызывающем потоке. Возвращает false,
+  // если задач в очередях нет
+  bool runPending();
+
+  size_t size() const { return m_threads.size(); }
+
+  // общий пул, размер которого равен числу аппаратных потоков
+  static WorkStealingPool &shared();
+
+private:
+  struct Queue {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+  };
+
+  // номер очереди вызывающего потока или std::nullopt для потоков вне пула
+  std::optional<size_t> currentIndex() const;
+  std::optional<Task> take(std::optional<size_t> self);
+  void run(size_t index);
+
+  std::vector<std::unique_ptr<Queue>> m_queues; // очереди рабочих потоков
+  Queue m_injector;                             // общая очередь
+  std::vector<std::thread> m_threads;
+
+  std::atomic<size_t> m_pending = 0; // число задач в очередях
+  std::mutex m_sleepMutex;
+  std::condition_variable m_wake;
+  bool m_stop = false;
+};
@@ -100,3 +100,80 @@ TEST(ChannelTest, inOtherThread) {
 
   future.wait();
 }
+
+TEST(ChannelTest, ringInOtherThread) {
+  RingChannel<int> chan(2);
+
+  auto future = std::async(std::launch::async, [&chan]() {
+    for (int i = 0; i < 100; ++i)
+      EXPECT_TRUE(chan.put(i));
+    chan.close();
+    EXPECT_FALSE(chan.put(100));
+  });
+
+  // значения, записанные до закрытия, читаются по порядку
+  for (int i = 0; i < 100; ++i) {
+    auto [val, ok] = chan.get();
+    EXPECT_TRUE(ok);
+    EXPECT_EQ(val, i);
+  }
+  auto [val, ok] = chan.get();
+  EXPECT_FALSE(ok);
+
+  future.wait();
+}
+
+TEST(ChannelTest, ringMultiPutGet) {
+  RingChannel<int> chan(8);
+
+  std::atomic<int> sum = 0;
+  std::vector<std::future<void>> futurePuts;
+  for (int i = 0; i < 4; ++i) {
+    futurePuts.emplace_back(std::async(std::launch::async, [&chan]() {
+      std::vector<int> batch;
+      for (int i = 0; i < 100; ++i)
+        batch.push_back(i);
+      EXPECT_EQ(chan.putMany(std::move(batch)), 100);
+    }));
+  }
+  std::vector<std::future<void>> futureGets;
+  for (int i = 0; i < 4; ++i) {
+    futureGets.emplace_back(std::async(std::launch::async, [&chan, &sum]() {
+      while (true) {
+        auto batch = chan.getMany(16);
+        if (batch.empty())
+          return;
+        for (int val : batch)
+          sum += val;
+      }
+    }));
+  }
+
+  for (auto &fut : futurePuts)
+    fut.wait();
+  chan.close();
+  for (auto &fut : futureGets)
+    fut.wait();
+  EXPECT_EQ(sum, 4 * (0 + 99) * 100 / 2);
+}
+
+TEST(ChannelTest, ringBatchOrder) {
+  RingChannel<int> chan(4);
+
+  EXPECT_EQ(chan.putMany({1, 2, 3}), 3);
+  EXPECT_EQ(chan.getMany(2), (std::vector<int>{1, 2}));
+  // пачка переходит через конец кольцевого буфера
+  auto writer = std::async(std::launch::async,
+                           [&chan]() { return chan.putMany({4, 5, 6, 7, 8}); });
+  std::vector<int> got;
+  while (got.size() < 6) {
+    auto batch = chan.getMany(8);
+    got.insert(got.end(), batch.begin(), batch.end());
+  }
+  EXPECT_EQ(writer.get(), 5);
+  EXPECT_EQ(got, (std::vector<int>{3, 4, 5, 6, 7, 8}));
+
+  chan.close();
+  EXPECT_TRUE(chan.getMany(8).empty());
+  EXPECT_EQ(chan.putMany({9}), 0);
+}
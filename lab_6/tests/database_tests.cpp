@@ -0,0 +1,200 @@
+#include "database.h"
+#include "parser.h"
+#include "solver.h"
+#include <filesystem>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <initializer_list>
+#include <memory>
+#include <string>
+#include <unistd.h>
+
+static std::shared_ptr<Database>
+buildDatabase(std::initializer_list<const char *> rules) {
+  auto database = std::make_shared<Database>();
+  for (auto &rule : rules)
+    database->addRule(RuleParser().ParseRule(rule));
+  return database;
+}
+
+static Atom parseGoal(const char *str) {
+  return RuleParser().ParseRule(str).getOutput();
+}
+
+static std::string candidatesString(const Database &database,
+                                    const char *goal) {
+  std::string res;
+  for (auto *rule : database.getCandidates(parseGoal(goal))) {
+    if (!res.empty())
+      res += "; ";
+    res += rule->toString();
+  }
+  return res;
+}
+
+TEST(DatabaseTest, candidatesByPredicate) {
+  auto database = buildDatabase({
+      "p(A)",
+      "q(A)",
+      "p(A, B)",
+      "p(B)",
+  });
+
+  EXPECT_EQ(candidatesString(*database, "p(x)"), "p(A); p(B)");
+  EXPECT_EQ(candidatesString(*database, "p(x, y)"), "p(A, B)");
+  EXPECT_EQ(candidatesString(*database, "r(x)"), "");
+}
+
+TEST(DatabaseTest, candidatesByFirstArg) {
+  auto database = buildDatabase({
+      "len(Nil, 0)",
+      "len(cons(_, x), succ(n)) :- len(x, n)",
+      "len(y, z) :- fail",
+      "len(Nil, 1)",
+      "len(cons(A, B, C), 3)",
+  });
+
+  EXPECT_EQ(candidatesString(*database, "len(Nil, n)"),
+            "len(Nil, 0); len(y1, z1) :- fail; len(Nil, 1)");
+  EXPECT_EQ(candidatesString(*database, "len(cons(A, Nil), n)"),
+            "len(cons(_, x1), succ(n1)) :- len(x1, n1); len(y1, z1) :- fail");
+  EXPECT_EQ(candidatesString(*database, "len(Other, n)"),
+            "len(y1, z1) :- fail");
+  EXPECT_EQ(candidatesString(*database, "len(\"Nil\", n)"),
+            "len(y1, z1) :- fail");
+  EXPECT_EQ(candidatesString(*database, "len(x, n)"),
+            "len(Nil, 0); len(cons(_, x1), succ(n1)) :- len(x1, n1); "
+            "len(y1, z1) :- fail; len(Nil, 1); len(cons(A, B, C), 3)");
+}
+
+TEST(DatabaseTest, candidatesOfBoundGoal) {
+  auto database = std::make_shared<Database>();
+  for (int i = 0; i < 20; ++i)
+    database->addRule(RuleParser().ParseRule(
+        ("f(C" + std::to_string(i) + ", D" + std::to_string(i) + ")")
+            .c_str()));
+  database->addRule(RuleParser().ParseRule("g(x, y) :- f(x, y)"));
+
+  // подцель правила после унификации его выхода с целью: первый аргумент -
+  // переменная, связанная в хранилище, и по индексу выбирается один факт
+  auto goal = parseGoal("g(C5, y)");
+  const auto &numbered = database->getCandidates(goal).front()->getNumbered();
+  TrailSubst bindings;
+  ASSERT_TRUE(Solver::unify(goal, numbered.output, bindings));
+  const auto &body = numbered.inputs.front();
+  EXPECT_EQ(database->getCandidates(body).size(), 20);
+  ASSERT_EQ(database->getCandidates(body, bindings).size(), 1);
+  EXPECT_EQ(database->getCandidates(body, bindings).front()->toString(),
+            "f(C5, D5)");
+}
+
+TEST(DatabaseTest, tabledPredicates) {
+  auto database = buildDatabase({"path(x, y) :- edge(x, y)"});
+  database->addDirective(RuleParser().ParseDirective(":- table path/2."));
+
+  EXPECT_TRUE(database->isTabled(parseGoal("path(x, B)")));
+  EXPECT_FALSE(database->isTabled(parseGoal("path(x)")));
+  EXPECT_FALSE(database->isTabled(parseGoal("edge(x, y)")));
+  EXPECT_THROW(
+      database->addDirective(RuleParser().ParseDirective(":- dynamic p/1")),
+      std::runtime_error);
+}
+
+static std::string rulesString(const Database &database) {
+  std::string res;
+  for (auto &rule : database.getRules()) {
+    if (!res.empty())
+      res += "; ";
+    res += rule.toString();
+  }
+  return res;
+}
+
+// тест с собственным временным файлом снимка. Имя файла включает имя теста и
+// номер процесса, поэтому тесты, запущенные параллельно, не мешают друг другу
+class SnapshotFileTest : public ::testing::Test {
+protected:
+  void SetUp() override {
+    auto info = ::testing::UnitTest::GetInstance()->current_test_info();
+    path = std::filesystem::temp_directory_path() /
+           ("lab6_" + std::string(info->name()) + "_" +
+            std::to_string(getpid()) + ".snap");
+  }
+
+  void TearDown() override { std::filesystem::remove(path); }
+
+  std::filesystem::path path;
+};
+
+TEST_F(SnapshotFileTest, snapshotRoundTrip) {
+  auto database = buildDatabase({
+      "len(Nil, 0)",
+      "len(cons(_, x), succ(n)) :- len(x, n)",
+      "name(\"Nil\", cons(A, cons(A, Nil)))",
+      "path(x, y) :- edge(x, y), !",
+  });
+  database->setTabled("path", 2);
+  database->saveSnapshot(path.c_str());
+
+  Database loaded(path.c_str());
+  EXPECT_EQ(rulesString(loaded), rulesString(*database));
+  EXPECT_TRUE(loaded.isTabled(parseGoal("path(x, y)")));
+  EXPECT_EQ(candidatesString(loaded, "len(Nil, n)"), "len(Nil, 0)");
+  EXPECT_EQ(candidatesString(loaded, "name(Nil, x)"), "");
+  // имена переменных снимка заняты для правил, добавленных после загрузки
+  EXPECT_EQ(loaded.addRule(RuleParser().ParseRule("len(x, y) :- fail"))
+                .toString(),
+            database->addRule(RuleParser().ParseRule("len(x, y) :- fail"))
+                .toString());
+}
+
+TEST_F(SnapshotFileTest, corruptedSnapshot) {
+  auto database = buildDatabase({"edge(A, f(B))"});
+  database->saveSnapshot(path.c_str());
+  auto size = std::filesystem::file_size(path);
+
+  // усеченный снимок
+  std::filesystem::resize_file(path, size - 4);
+  EXPECT_THROW(Database().loadSnapshot(path.c_str()), std::runtime_error);
+
+  // номер аргумента за пределами массива термов
+  database->saveSnapshot(path.c_str());
+  {
+    std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+    file.seekp(size - 4 * 6);
+    std::uint32_t bad = 100;
+    file.write(reinterpret_cast<const char *>(&bad), sizeof(bad));
+  }
+  EXPECT_THROW(Database().loadSnapshot(path.c_str()), std::runtime_error);
+}
+
+TEST(DatabaseTest, factRangeParts) {
+  WorkingDataset workset;
+  workset.addFact(parseGoal("p(A)"));
+  workset.nextIteration();
+  for (int i = 0; i < 10; ++i)
+    workset.addFact(parseGoal(("p(N" + std::to_string(i) + ")").c_str()));
+  workset.nextIteration();
+  EXPECT_EQ(workset.rangeSize(parseGoal("p(x)"), WorkingDataset::Range::delta),
+            10);
+
+  // части диапазона не пересекаются и вместе покрывают весь диапазон
+  std::vector<std::string> facts;
+  for (size_t i = 0; i < 3; ++i) {
+    size_t count = 0;
+    workset.forEachFact(
+        parseGoal("p(x)"), WorkingDataset::Range::delta,
+        [&](const Atom &fact) {
+          facts.push_back(fact.toString());
+          ++count;
+          return true;
+        },
+        {i, 3});
+    EXPECT_GE(count, 3);
+    EXPECT_LE(count, 4);
+  }
+  std::vector<std::string> expected;
+  for (int i = 0; i < 10; ++i)
+    expected.push_back("p(N" + std::to_string(i) + ")");
+  EXPECT_EQ(facts, expected);
+}
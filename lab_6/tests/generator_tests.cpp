@@ -0,0 +1,58 @@
+#include "generator.h"
+#include <gtest/gtest.h>
+#include <string>
+
+static Generator<int> range(int start, int end) {
+  for (int i = start; i < end; ++i)
+    co_yield i;
+}
+
+static Generator<std::string> nested(int count) {
+  auto gen = range(0, count);
+  while (auto value = gen.next())
+    co_yield std::to_string(*value);
+}
+
+TEST(GeneratorTest, simple) {
+  auto gen = range(0, 3);
+
+  EXPECT_EQ(gen.next(), 0);
+  EXPECT_EQ(gen.next(), 1);
+  EXPECT_EQ(gen.next(), 2);
+  EXPECT_FALSE(gen.next());
+  EXPECT_FALSE(gen.next());
+}
+
+TEST(GeneratorTest, nested) {
+  auto gen = nested(2);
+
+  EXPECT_EQ(gen.next(), "0");
+  EXPECT_EQ(gen.next(), "1");
+  EXPECT_FALSE(gen.next());
+}
+
+TEST(GeneratorTest, earlyDestroy) {
+  int destroyed = 0;
+  struct Guard {
+    int &counter;
+    ~Guard() { counter++; }
+  };
+  {
+    auto gen = [](int &counter) -> Generator<int> {
+      Guard guard{counter};
+      for (int i = 0;; ++i)
+        co_yield i;
+    }(destroyed);
+    EXPECT_EQ(gen.next(), 0);
+    EXPECT_EQ(gen.next(), 1);
+  }
+
+  EXPECT_EQ(destroyed, 1);
+}
+
+TEST(GeneratorTest, empty) {
+  Generator<int> gen;
+
+  EXPECT_FALSE(gen);
+  EXPECT_FALSE(gen.next());
+}
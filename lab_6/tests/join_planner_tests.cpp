@@ -0,0 +1,48 @@
+#include "database.h"
+#include "join_planner.h"
+#include "parser.h"
+#include <gtest/gtest.h>
+
+static Atom parseAtom(const std::string &atom) {
+  return RuleParser().ParseRule(atom.c_str()).getOutput();
+}
+
+TEST(JoinPlannerTest, smallRelationFirst) {
+  auto rule = RuleParser().ParseRule(
+      "American(x) & Weapon(y) & Sells(x, y, z) & Hostile(z) -> Criminal(x)");
+  WorkingDataset workset;
+  for (int i = 0; i < 100; ++i)
+    workset.addFact(parseAtom("American(P" + std::to_string(i) + ")"));
+  for (int i = 0; i < 20; ++i)
+    workset.addFact(parseAtom("Weapon(W" + std::to_string(i) + ")"));
+  workset.addFact(parseAtom("Sells(P1, W1, Nono)"));
+  workset.addFact(parseAtom("Hostile(Nono)"));
+  workset.nextIteration();
+
+  JoinPlanner planner;
+  // сначала соединяются маленькие отношения, затем отношения со связанными
+  // аргументами
+  EXPECT_EQ(planner.plan(rule, 0, workset), (std::vector<size_t>{2, 0, 1, 3}));
+
+  // новые факты входа deltaPos соединяются первыми
+  workset.addFact(parseAtom("Weapon(W100)"));
+  workset.nextIteration();
+  EXPECT_EQ(planner.plan(rule, 1, workset), (std::vector<size_t>{1, 2, 0, 3}));
+}
+
+TEST(JoinPlannerTest, replanWhenRelationGrows) {
+  auto rule = RuleParser().ParseRule("p(x) & q(x) -> r(x)");
+  WorkingDataset workset;
+  workset.addFact(parseAtom("p(A)"));
+  for (int i = 0; i < 10; ++i)
+    workset.addFact(parseAtom("q(Q" + std::to_string(i) + ")"));
+  workset.nextIteration();
+
+  JoinPlanner planner;
+  EXPECT_EQ(planner.plan(rule, 0, workset), (std::vector<size_t>{0, 1}));
+
+  for (int i = 0; i < 100; ++i)
+    workset.addFact(parseAtom("p(P" + std::to_string(i) + ")"));
+  workset.nextIteration();
+  EXPECT_EQ(planner.plan(rule, 0, workset), (std::vector<size_t>{1, 0}));
+}
@@ -1,5 +1,9 @@
 #include "parser.h"
+#include <filesystem>
+#include <fstream>
 #include <gtest/gtest.h>
+#include <string>
+#include <unistd.h>
 
 TEST(ParserTest, Fact) {
   Atom fact;
@@ -19,3 +23,79 @@ TEST(ParserTest, Rule) {
 
   EXPECT_EQ(rule.toString(), "P(x, y) :- P(x, A), G(B, y)");
 }
+
+TEST(ParserTest, Directive) {
+  Directive directive;
+
+  ASSERT_NO_FATAL_FAILURE(
+      directive = RuleParser().ParseDirective(":- table path/2, reach/1."));
+
+  EXPECT_EQ(directive.name, "table");
+  ASSERT_EQ(directive.predicates.size(), 2);
+  EXPECT_EQ(directive.predicates[0], std::make_pair(std::string("path"), 2ul));
+  EXPECT_EQ(directive.predicates[1], std::make_pair(std::string("reach"), 1ul));
+  EXPECT_THROW(RuleParser().ParseDirective(":- table path"),
+               std::runtime_error);
+}
+
+TEST(ParserTest, ReservedNames) {
+  // имена пронумерованных переменных не могут встречаться в тексте базы
+  EXPECT_THROW(RuleParser().ParseRule("P(_G1)"), std::runtime_error);
+  EXPECT_THROW(RuleParser().ParseRule("_G0(A)"), std::runtime_error);
+  EXPECT_EQ(RuleParser().ParseRule("P(_G, _G01, _Gx)").toString(),
+            "P(_G, _G01, _Gx)");
+}
+
+// разобрать файл с содержимым content частями размера chunkSize и вернуть
+// строки вида "номер строки: предложение или ошибка". Имя временного файла
+// включает имя теста и номер процесса, поэтому тесты, запущенные
+// параллельно, не мешают друг другу
+static std::vector<std::string> parseFile(const std::string &content,
+                                          size_t chunkSize) {
+  auto info = ::testing::UnitTest::GetInstance()->current_test_info();
+  auto path = std::filesystem::temp_directory_path() /
+              ("lab6_" + std::string(info->name()) + "_" +
+               std::to_string(getpid()) + ".txt");
+  std::ofstream(path) << content;
+  struct Remove {
+    std::filesystem::path path;
+    ~Remove() { std::filesystem::remove(path); }
+  } remove{path};
+  std::vector<std::string> clauses;
+  RuleFileParser(path.c_str(), chunkSize)
+      .parse([&](RuleFileParser::Clause &clause) {
+        auto text = !clause.error.empty() ? "error"
+                    : clause.directive    ? clause.directive->name
+                                          : clause.rule->toString();
+        clauses.push_back(std::to_string(clause.line) + ": " + text);
+      });
+  return clauses;
+}
+
+TEST(ParserTest, RuleFile) {
+  std::string content = "# comment.\n"
+                        "p(A).\n"
+                        "\n"
+                        "q(x) :-\n"
+                        "# comment inside a rule\n"
+                        "  p(x).\n"
+                        "bad(.\n"
+                        ":- table q/1.\n"
+                        "r(\"a b\").\n"
+                        "unfinished(";
+  std::vector<std::string> expected = {
+      "2: p(A)", "6: q(x) :- p(x)", "7: error", "8: table", "9: r(\"a b\")",
+  };
+
+  // результат не зависит от разбиения файла на части
+  for (size_t chunkSize : {1, 8, 1 << 20})
+    EXPECT_EQ(parseFile(content, chunkSize), expected) << chunkSize;
+
+  std::string facts;
+  for (int i = 0; i < 1000; ++i)
+    facts += "edge(N" + std::to_string(i) + ", N" + std::to_string(i + 1) +
+             ").\n";
+  auto clauses = parseFile(facts, 256);
+  ASSERT_EQ(clauses.size(), 1000);
+  EXPECT_EQ(clauses[999], "1000: edge(N999, N1000)");
+}
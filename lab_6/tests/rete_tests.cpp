@@ -0,0 +1,104 @@
+#include "database.h"
+#include "parser.h"
+#include "rete.h"
+#include "solver.h"
+#include <gtest/gtest.h>
+#include <initializer_list>
+#include <memory>
+#include <set>
+#include <string>
+
+static Atom parseGoal(const char *str) {
+  return RuleParser().ParseRule(str).getOutput();
+}
+
+static void addRules(ReteNetwork &network,
+                     std::initializer_list<const char *> rules) {
+  for (auto &rule : rules)
+    network.addRule(RuleParser().ParseRule(rule));
+}
+
+static std::set<std::string> factsOf(const ReteNetwork &network,
+                                     const char *pattern) {
+  std::set<std::string> facts;
+  network.forEachFact(parseGoal(pattern), [&](const Atom &fact) {
+    facts.insert(fact.toString());
+    return true;
+  });
+  return facts;
+}
+
+TEST(ReteTest, incrementalAssert) {
+  ReteNetwork network;
+  addRules(network, {
+                        "path(x, y) :- edge(x, y)",
+                        "path(x, z) :- path(x, y), path(y, z)",
+                        "edge(A, B)",
+                    });
+
+  EXPECT_EQ(factsOf(network, "path(x, y)"),
+            std::set<std::string>({"path(A, B)"}));
+
+  EXPECT_TRUE(network.assertFact(parseGoal("edge(B, C)")));
+  EXPECT_FALSE(network.assertFact(parseGoal("edge(B, C)")));
+  EXPECT_EQ(factsOf(network, "path(x, y)"),
+            std::set<std::string>({"path(A, B)", "path(B, C)", "path(A, C)"}));
+  EXPECT_EQ(network.factsCount(), 5);
+}
+
+TEST(ReteTest, retractCyclicSupport) {
+  ReteNetwork network;
+  addRules(network, {
+                        "path(x, y) :- edge(x, y)",
+                        "path(x, z) :- path(x, y), edge(y, z)",
+                        "edge(A, B)",
+                        "edge(B, A)",
+                        "edge(C, A)",
+                    });
+  EXPECT_TRUE(network.hasFact(parseGoal("path(A, A)")));
+  EXPECT_TRUE(network.hasFact(parseGoal("path(C, B)")));
+
+  // path(A, A) и path(A, B) поддерживают друг друга через цикл A-B-A, но
+  // после удаления ребра B-A ни один из путей, ведущих в A, не выводим
+  EXPECT_TRUE(network.retractFact(parseGoal("edge(B, A)")));
+  EXPECT_FALSE(network.retractFact(parseGoal("edge(B, A)")));
+  EXPECT_EQ(factsOf(network, "path(x, y)"),
+            std::set<std::string>({"path(A, B)", "path(C, A)", "path(C, B)"}));
+
+  EXPECT_TRUE(network.assertFact(parseGoal("edge(B, A)")));
+  EXPECT_TRUE(network.hasFact(parseGoal("path(B, B)")));
+  EXPECT_EQ(factsOf(network, "path(x, y)").size(), 6);
+}
+
+TEST(ReteTest, matchesSemiNaive) {
+  auto database = std::make_shared<Database>();
+  for (auto rule : {
+           "parent(Tom, Bob)",
+           "parent(Bob, Ann)",
+           "parent(Ann, Joe)",
+           "parent(Tom, Liz)",
+           "ancestor(x, y) :- parent(x, y)",
+           "ancestor(x, z) :- parent(x, y), ancestor(y, z)",
+       })
+    database->addRule(RuleParser().ParseRule(rule));
+
+  auto solve = [&]() {
+    auto solver = std::make_shared<Solver>(database);
+    solver->solveForward(parseGoal("ancestor(x, y)"));
+    std::set<std::string> answers;
+    while (auto res = solver->next())
+      answers.insert(res->toString());
+    solver->done();
+    return answers;
+  };
+
+  auto expected = solve();
+  database->enableRete();
+  EXPECT_EQ(solve(), expected);
+
+  EXPECT_TRUE(database->removeFact(parseGoal("parent(Bob, Ann)")));
+  EXPECT_FALSE(database->removeFact(parseGoal("parent(Bob, Ann)")));
+  auto incremental = solve();
+  EXPECT_EQ(incremental.size(), 3);
+  EXPECT_EQ(incremental.count("{x=Tom, y=Ann}"), 0);
+}
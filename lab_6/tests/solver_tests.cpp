@@ -2,10 +2,12 @@
 #include "mgraph_solver.h"
 #include "parser.h"
 #include "solver.h"
+#include "work_stealing_pool.h"
 #include <gtest/gtest.h>
 #include <initializer_list>
 #include <iostream>
 #include <memory>
+#include <set>
 #include <unistd.h>
 
 static std::shared_ptr<Database>
@@ -82,6 +84,21 @@ TEST(SolverTest, unifyWithSubst) {
             "{y=y2=y3=, h=A, r=Nil, x3=cons(A, Nil), x5=Nil}");
 }
 
+TEST(SolverTest, mergeLinkedRings) {
+  Subst subst;
+  ASSERT_TRUE(subst.link("a", "b"));
+  ASSERT_TRUE(subst.link("d", "c"));
+  ASSERT_TRUE(subst.link("e", "f"));
+  EXPECT_EQ(subst.toString(), "{a=b=, c=d=, e=f=}");
+  EXPECT_EQ(subst.apply(Variable::createVariable("d"))->toString(), "c");
+
+  ASSERT_TRUE(subst.link("b", "d"));
+  ASSERT_TRUE(subst.insert("c", Variable::createConst("A")));
+  ASSERT_TRUE(subst.insert("e", Variable::createConst("B")));
+  EXPECT_FALSE(subst.link("a", "f"));
+  EXPECT_EQ(subst.toString(), "{a=b=c=d=A, e=f=B}");
+}
+
 TEST(SolverTest, transitivity) {
   auto database = buildDatabase({
       "Less(x, y) & Less(y, z) -> Less(x, z)",
@@ -100,6 +117,105 @@ TEST(SolverTest, transitivity) {
   EXPECT_TRUE(res);
 }
 
+TEST(SolverTest, transitiveClosureSemiNaive) {
+  constexpr int chainLength = 40;
+  auto database = buildDatabase({
+      "path(x, y) :- edge(x, y)",
+      "path(x, z) :- path(x, y), edge(y, z)",
+  });
+  for (int i = 0; i < chainLength; ++i)
+    database->addRule(RuleParser().ParseRule(
+        ("edge(N" + std::to_string(i) + ", N" + std::to_string(i + 1) + ")")
+            .c_str()));
+
+  auto target = RuleParser().ParseRule("path(N0, x)").getOutput();
+  auto solver = std::make_shared<Solver>(database);
+  solver->solveForward(target);
+
+  std::set<std::string> answers;
+  while (auto res = solver->next())
+    answers.insert(res->toString());
+  solver->done();
+
+  EXPECT_EQ(answers.size(), chainLength);
+  EXPECT_EQ(answers.count("{x=N" + std::to_string(chainLength) + "}"), 1);
+}
+
+TEST(SolverTest, parallelForwardJoin) {
+  // новых фактов больше, чем нужно для деления отношения между задачами
+  constexpr int factsCount = 2000;
+  auto database = buildDatabase({
+      "q(x, y) :- p(x), r(x, y)",
+      "s(x) :- r(x, y)",
+  });
+  for (int i = 0; i < factsCount; ++i) {
+    auto n = std::to_string(i);
+    database->addRule(RuleParser().ParseRule(("p(N" + n + ")").c_str()));
+    database->addRule(RuleParser().ParseRule(("r(N" + n + ", A)").c_str()));
+    database->addRule(RuleParser().ParseRule(("r(N" + n + ", B)").c_str()));
+  }
+  WorkStealingPool sequential(1);
+  WorkStealingPool parallel(4);
+  auto forward = [&](WorkStealingPool &pool, const char *goal) {
+    auto solver = std::make_shared<Solver>(database);
+    solver->setPool(pool);
+    solver->solveForward(RuleParser().ParseRule(goal).getOutput());
+    std::vector<std::string> answers;
+    while (auto res = solver->next())
+      answers.push_back(res->toString());
+    solver->done();
+    return answers;
+  };
+
+  auto pairs = forward(parallel, "q(x, y)");
+  EXPECT_EQ(pairs.size(), 2 * factsCount);
+  EXPECT_EQ(pairs, forward(sequential, "q(x, y)"));
+  // правило выводит каждый факт s дважды, но выдается он один раз
+  auto singles = forward(parallel, "s(x)");
+  EXPECT_EQ(singles.size(), factsCount);
+  EXPECT_EQ(std::set(singles.begin(), singles.end()).size(), factsCount);
+  EXPECT_EQ(singles, forward(sequential, "s(x)"));
+}
+
+TEST(SolverTest, tabledLeftRecursion) {
+  auto database = buildDatabase({
+      "edge(1, 2)",
+      "edge(2, 3)",
+      "edge(3, 1)",
+      "edge(3, 4)",
+      "path(x, z) :- path(x, y), edge(y, z)",
+      "path(x, y) :- edge(x, y)",
+      "same(x, y) :- same(y, x)",
+      "same(A, B)",
+  });
+  database->setTabled("path", 2);
+  database->setTabled("same", 2);
+  auto solver = std::make_shared<MGraphSolver>(database);
+
+  // без таблиц левая рекурсия не завершается
+  solver->solveBackward(RuleParser().ParseRule("path(1, x)").getOutput());
+  // мультимножество: повторный ответ не должен скрываться
+  std::multiset<std::string> answers;
+  while (auto res = solver->next())
+    answers.insert(res->toString());
+  EXPECT_EQ(answers, (std::multiset<std::string>{"{x=1}", "{x=2}", "{x=3}",
+                                                 "{x=4}"}));
+
+  solver->solveBackward(RuleParser().ParseRule("path(x, 4)").getOutput());
+  answers.clear();
+  while (auto res = solver->next())
+    answers.insert(res->toString());
+  EXPECT_EQ(answers, (std::multiset<std::string>{"{x=1}", "{x=2}", "{x=3}"}));
+
+  // каждый вариант ответа выдается один раз
+  solver->solveBackward(RuleParser().ParseRule("same(x, y)").getOutput());
+  std::vector<std::string> pairs;
+  while (auto res = solver->next())
+    pairs.push_back(res->toString());
+  solver->done();
+  EXPECT_EQ(pairs, (std::vector<std::string>{"{x=A, y=B}", "{x=B, y=A}"}));
+}
+
 TEST(SolverTest, backtrackMax3) {
   auto database = buildDatabase({
       "max(a, b, c, a) :- less(b, a), less(c, a)",
@@ -210,6 +326,21 @@ TEST(SolverTest, listReverse) {
   EXPECT_EQ(res->toString(), "{x=cons(C, cons(B, cons(A, Nil)))}");
 }
 
+TEST(SolverTest, substLateBinding) {
+  Subst subst;
+  ASSERT_TRUE(subst.insert(
+      "x", Variable::createFuncSym("f", {Variable::createVariable("y")})));
+  ASSERT_TRUE(subst.link("y", "z"));
+  ASSERT_TRUE(subst.insert("z", Variable::createConst("A")));
+  // значение x не перестраивается при связывании z, но применяется с ним
+  EXPECT_EQ(subst.apply(Variable::createVariable("x"))->toString(), "f(A)");
+  EXPECT_EQ(subst.toString(), "{y=z=A, x=f(A)}");
+  EXPECT_TRUE(subst.insert(
+      "x", Variable::createFuncSym("f", {Variable::createConst("A")})));
+  EXPECT_FALSE(subst.insert(
+      "x", Variable::createFuncSym("f", {Variable::createConst("B")})));
+}
+
 TEST(SolverTest, recursiveFuncSym) {
   auto database = buildDatabase({
       "link(x, x)",
@@ -223,7 +354,7 @@ TEST(SolverTest, recursiveFuncSym) {
   solver->done();
 
   ASSERT_TRUE(res);
-  EXPECT_EQ(res->toString(), "{x=cons(A, ...)}");
+  EXPECT_EQ(res->toString(), "{x=cons(A, x)}");
 }
 
 TEST(SolverTest, properCut) {
@@ -294,3 +425,128 @@ TEST(SolverTest, primes) {
 
   ASSERT_FALSE(res2);
 }
+
+TEST(SolverTest, orParallelOrdered) {
+  auto database = buildDatabase({
+      "max(a, b, c, a) :- less(b, a), less(c, a)",
+      "max(_, b, c, b) :- less(c, b)",
+      "max(_, _, c, c)",
+      "less(1, 2)",
+      "less(1, 3)",
+      "less(2, 3)",
+      "less(1, 4)",
+      "less(2, 4)",
+      "less(1, 5)",
+      "less(2, 5)",
+      "p(A) :- !",
+      "p(B)",
+      "p(C)",
+  });
+  auto allAnswers = [&](MGraphSolver::OrParallel mode) {
+    auto solver = std::make_shared<MGraphSolver>(database);
+    solver->setOrParallel(mode);
+    solver->solveBackward(
+        RuleParser().ParseRule("max(1, x, 2, x)").getOutput());
+    std::vector<std::string> answers;
+    while (auto res = solver->next())
+      answers.push_back(res->toString());
+    return answers;
+  };
+  // порядок решений совпадает с последовательным поиском
+  EXPECT_EQ(allAnswers(MGraphSolver::OrParallel::Ordered),
+            allAnswers(MGraphSolver::OrParallel::Off));
+
+  auto solver = std::make_shared<MGraphSolver>(database);
+  solver->setOrParallel(MGraphSolver::OrParallel::Ordered);
+
+  // отсечение отменяет ветви следующих правил
+  solver->solveBackward(RuleParser().ParseRule("p(x)").getOutput());
+  auto res1 = solver->next();
+  auto res2 = solver->next();
+  solver->done();
+
+  ASSERT_TRUE(res1);
+  EXPECT_EQ(res1->toString(), "{x=A}");
+  EXPECT_FALSE(res2);
+}
+
+TEST(SolverTest, orParallelUnordered) {
+  auto database = buildDatabase({
+      "edge(1, 2)",
+      "edge(2, 3)",
+      "edge(3, 4)",
+      "edge(2, 5)",
+      "path(x, y) :- edge(x, y)",
+      "path(x, y) :- edge(x, z), path(z, y)",
+      "divisible(x, y) :- mul(y, z, x), mul(y, z, x), !",
+      "composite(x) :- in_range(v, 2, x), divisible(x, v), !",
+      "prime(1) :- !, fail",
+      "prime(x) :- composite(x), !, fail",
+      "prime(_)",
+  });
+  auto solver = std::make_shared<MGraphSolver>(database, buildPredefinedHooks());
+  solver->setOrParallel(MGraphSolver::OrParallel::Unordered);
+
+  solver->solveBackward(RuleParser().ParseRule("path(1, x)").getOutput());
+  std::set<std::string> answers;
+  while (auto res = solver->next())
+    answers.insert(res->toString());
+  EXPECT_EQ(answers,
+            (std::set<std::string>{"{x=2}", "{x=3}", "{x=4}", "{x=5}"}));
+
+  // цели с отсечением в правилах доказываются последовательно
+  solver->solveBackward(RuleParser().ParseRule("prime(5)").getOutput());
+  EXPECT_TRUE(solver->next());
+  solver->solveBackward(RuleParser().ParseRule("prime(12)").getOutput());
+  EXPECT_FALSE(solver->next());
+  solver->done();
+}
+
+TEST(SolverTest, orParallelInfiniteTeardown) {
+  auto database = buildDatabase({
+      "nat(Z)",
+      "nat(s(x)) :- nat(x)",
+  });
+  for (auto mode : {MGraphSolver::OrParallel::Unordered,
+                    MGraphSolver::OrParallel::Ordered}) {
+    auto solver = std::make_shared<MGraphSolver>(database);
+    solver->setOrParallel(mode);
+    solver->solveBackward(RuleParser().ParseRule("nat(x)").getOutput());
+    ASSERT_TRUE(solver->next());
+    // уничтожение решателя дожидается задач ветвей бесконечного перебора:
+    // решатели ветвей, ссылающиеся на базу, уничтожены
+    solver.reset();
+    EXPECT_EQ(database.use_count(), 1);
+  }
+}
+
+TEST(SolverTest, removeFactDuringSearch) {
+  auto database = buildDatabase({
+      "p(A)",
+      "p(B)",
+      "p(C)",
+  });
+  auto solver = std::make_shared<MGraphSolver>(database);
+  solver->solveBackward(RuleParser().ParseRule("p(x)").getOutput());
+  auto res1 = solver->next();
+  // удаление фактов не затрагивает уже начатый перебор
+  EXPECT_TRUE(database->removeFact(RuleParser().ParseRule("p(B)").getOutput()));
+  EXPECT_TRUE(database->removeFact(RuleParser().ParseRule("p(A)").getOutput()));
+  auto res2 = solver->next();
+  auto res3 = solver->next();
+  auto res4 = solver->next();
+  solver->done();
+
+  ASSERT_TRUE(res1 && res2 && res3);
+  EXPECT_EQ(res1->toString(), "{x=A}");
+  EXPECT_EQ(res2->toString(), "{x=B}");
+  EXPECT_EQ(res3->toString(), "{x=C}");
+  EXPECT_FALSE(res4);
+
+  solver->solveBackward(RuleParser().ParseRule("p(x)").getOutput());
+  auto res = solver->next();
+  ASSERT_TRUE(res);
+  EXPECT_EQ(res->toString(), "{x=C}");
+  EXPECT_FALSE(solver->next());
+  solver->done();
+}
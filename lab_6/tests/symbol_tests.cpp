@@ -0,0 +1,106 @@
+#include "atom.h"
+#include "parser.h"
+#include "symbol.h"
+#include "variable.h"
+#include <gtest/gtest.h>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+TEST(SymbolTest, interning) {
+  Symbol first("Tom");
+  Symbol second(std::string("To") + "m");
+
+  EXPECT_EQ(first, second);
+  EXPECT_EQ(first.id(), second.id());
+  EXPECT_EQ(first.str(), "Tom");
+  EXPECT_NE(first, Symbol("Bob"));
+  EXPECT_EQ(Symbol().str(), "");
+}
+
+TEST(SymbolTest, groundTermsShared) {
+  auto first = Variable::createFuncSym(
+      "f", {Variable::createConst("A"), Variable::createString("B")});
+  auto second = Variable::createFuncSym(
+      "f", {Variable::createConst("A"), Variable::createString("B")});
+  auto other = Variable::createFuncSym(
+      "f", {Variable::createConst("A"), Variable::createConst("B")});
+
+  EXPECT_TRUE(first->isGround());
+  EXPECT_EQ(first, second);
+  EXPECT_NE(first, other);
+  EXPECT_FALSE(first->equals(*other));
+  EXPECT_EQ(Atom("p", {first}), Atom("p", {second}));
+  // разделяемый основной терм изменить нельзя
+  EXPECT_THROW(first->updateArgument(0, Variable::createConst("C")),
+               std::logic_error);
+  EXPECT_EQ(second->toString(), "f(A, \"B\")");
+}
+
+TEST(SymbolTest, groundTermsSharedAcrossThreads) {
+  std::vector<Variable::ptr> terms(8);
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < terms.size(); ++t)
+    threads.emplace_back([&terms, t]() {
+      for (int i = 0; i < 1000; ++i)
+        terms[t] = Variable::createFuncSym(
+            "g", {Variable::createConst(std::to_string(i % 10))});
+    });
+  for (auto &thread : threads)
+    thread.join();
+  for (auto &term : terms)
+    EXPECT_EQ(term, terms[0]);
+}
+
+TEST(SymbolTest, nonGroundTermsNotShared) {
+  auto first =
+      Variable::createFuncSym("f", {Variable::createVariable("x")});
+  auto second =
+      Variable::createFuncSym("f", {Variable::createVariable("x")});
+
+  EXPECT_FALSE(first->isGround());
+  EXPECT_NE(first, second);
+  EXPECT_TRUE(first->equals(*second));
+  EXPECT_EQ(first->hash(), second->hash());
+}
+
+TEST(SymbolTest, numberedVariables) {
+  auto var = Symbol::variable(12);
+
+  EXPECT_TRUE(var.isNumbered());
+  EXPECT_EQ(var.number(), 12);
+  EXPECT_EQ(var.str(), "_G12");
+  EXPECT_EQ(Symbol("_G12"), var);
+  EXPECT_FALSE(Symbol("_G012").isNumbered());
+  EXPECT_FALSE(Symbol("x12").isNumbered());
+
+  // имя строится один раз, даже при одновременном обращении
+  std::vector<const std::string *> names(8);
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < names.size(); ++t)
+    threads.emplace_back([&names, t]() {
+      names[t] = &Symbol::variable(100000 + 7).str();
+    });
+  for (auto &thread : threads)
+    thread.join();
+  for (auto name : names) {
+    EXPECT_EQ(name, names[0]);
+    EXPECT_EQ(*name, "_G100007");
+  }
+}
+
+TEST(SymbolTest, numberedRule) {
+  auto rule = RuleParser().ParseRule(
+      "len(cons(_, x), succ(n)) :- len(x, n), eq(A, A)");
+  const auto &numbered = rule.getNumbered();
+
+  EXPECT_EQ(numbered.varsCount, 2);
+  EXPECT_EQ(numbered.output.toString(), "len(cons(_, _G0), succ(_G1))");
+  EXPECT_EQ(numbered.inputs[0].toString(), "len(_G0, _G1)");
+  // основные подтермы не копируются при сдвиге
+  auto shifted = numbered.inputs[1].shiftedVars(10);
+  EXPECT_EQ(shifted.getArguments()[0], rule.getInputs()[1].getArguments()[0]);
+  EXPECT_EQ(numbered.output.shiftedVars(10).toString(),
+            "len(cons(_, _G10), succ(_G11))");
+}
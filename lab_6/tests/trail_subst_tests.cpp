@@ -0,0 +1,78 @@
+#include "parser.h"
+#include "solver.h"
+#include "trail_subst.h"
+#include <gtest/gtest.h>
+#include <memory>
+
+static Atom parseGoal(const char *str) {
+  return RuleParser().ParseRule(str).getOutput();
+}
+
+TEST(TrailSubstTest, undoBindings) {
+  TrailSubst subst;
+  auto mark = subst.mark();
+
+  ASSERT_TRUE(Solver::unify(parseGoal("p(x, f(y))"), parseGoal("p(A, f(B))"),
+                            subst));
+  EXPECT_EQ(subst.resolve(parseGoal("q(x, y)")).toString(), "q(A, B)");
+
+  subst.undo(mark);
+  EXPECT_EQ(subst.resolve(parseGoal("q(x, y)")).toString(), "q(x, y)");
+}
+
+TEST(TrailSubstTest, failedUnifyLeavesNoBindings) {
+  TrailSubst subst;
+
+  EXPECT_FALSE(Solver::unify(parseGoal("p(x, x)"), parseGoal("p(A, B)"),
+                             subst));
+  EXPECT_EQ(subst.mark(), 0);
+  EXPECT_TRUE(Solver::unify(parseGoal("p(x, x)"), parseGoal("p(f(y), f(A))"),
+                            subst));
+  EXPECT_EQ(subst.resolve(parseGoal("q(x, y)")).toString(), "q(f(A), A)");
+}
+
+TEST(TrailSubstTest, linkedVariables) {
+  TrailSubst subst;
+
+  ASSERT_TRUE(Solver::unify(parseGoal("p(y, z, _)"), parseGoal("p(x, y, A)"),
+                            subst));
+  EXPECT_EQ(subst.toSubst({"x", "y", "z"}).toString(), "{x=x, y=x, z=x}");
+  ASSERT_TRUE(Solver::unify(parseGoal("q(z)"), parseGoal("q(C)"), subst));
+  EXPECT_EQ(subst.toSubst({"x", "y", "z"}).toString(), "{x=C, y=C, z=C}");
+}
+
+TEST(TrailSubstTest, numberedRepresentative) {
+  // Subst и TrailSubst выбирают представителя класса одинаково:
+  // _G9 предшествует _G10, хотя "_G10" < "_G9" как строки
+  auto g9 = Variable::createVariable(Symbol::variable(9));
+  auto g10 = Variable::createVariable(Symbol::variable(10));
+  for (bool reversed : {false, true}) {
+    Subst subst;
+    TrailSubst trail;
+    ASSERT_TRUE(reversed ? subst.link("_G9", "_G10")
+                         : subst.link("_G10", "_G9"));
+    ASSERT_TRUE(reversed ? Solver::unify(g9, g10, trail)
+                         : Solver::unify(g10, g9, trail));
+    EXPECT_EQ(subst.apply(g10)->toString(), "_G9");
+    EXPECT_EQ(trail.resolve(g10)->toString(), "_G9");
+  }
+}
+
+TEST(TrailSubstTest, cyclicBinding) {
+  TrailSubst subst;
+
+  ASSERT_TRUE(Solver::unify(parseGoal("p(x, x)"), parseGoal("p(y, cons(A, y))"),
+                            subst));
+  EXPECT_EQ(subst.toSubst({"x"}).toString(), "{x=cons(A, x)}");
+  // цикл обрывается переменной, терм не ссылается на себя и освобождается
+  std::weak_ptr<Variable> weak;
+  {
+    auto term = subst.resolve(Variable::createVariable("x"));
+    EXPECT_EQ(term->toString(), "cons(A, x)");
+    weak = term;
+  }
+  EXPECT_TRUE(weak.expired());
+  // унификация двух циклических термов завершается
+  EXPECT_TRUE(Solver::unify(parseGoal("q(x, z)"), parseGoal("q(z, cons(A, z))"),
+                            subst));
+}
@@ -0,0 +1,164 @@
+#include "database.h"
+#include "mgraph_solver.h"
+#include "parser.h"
+#include "wam_solver.h"
+#include <gtest/gtest.h>
+#include <initializer_list>
+#include <memory>
+
+static std::shared_ptr<Database>
+buildDatabase(std::initializer_list<const char *> rules) {
+  auto database = std::make_shared<Database>();
+  for (auto &rule : rules)
+    database->addRule(RuleParser().ParseRule(rule));
+  return database;
+}
+
+static std::map<std::string, std::shared_ptr<AtomHook>> buildPredefinedHooks() {
+  return {
+      {"add", std::make_shared<IntAddHook>()},
+      {"mul", std::make_shared<IntMulHook>()},
+      {"leq", std::make_shared<LeqHook>()},
+      {"in_range", std::make_shared<InRangeHook>()},
+  };
+}
+
+static std::vector<std::string> allAnswers(std::shared_ptr<Solver> solver,
+                                           const char *query) {
+  solver->solveBackward(RuleParser().ParseRule(query).getOutput());
+  std::vector<std::string> answers;
+  while (auto res = solver->next())
+    answers.push_back(res->toString());
+  solver->done();
+  return answers;
+}
+
+TEST(WamTest, compileClauses) {
+  auto database = buildDatabase({
+      "app(Nil, x, x)",
+      "app(cons(h, t), y, cons(h, r)) :- app(t, y, r)",
+  });
+  auto program = database->getProgram();
+
+  EXPECT_EQ(program->toString(), "0: halt\n"
+                                 "1: get_constant Nil, A0\n"
+                                 "2: get_variable_x X3, A1\n"
+                                 "3: get_value_x X3, A2\n"
+                                 "4: proceed\n"
+                                 "5: get_variable_x X5, A1\n"
+                                 "6: get_structure cons/2, X0\n"
+                                 "7: unify_variable_x X3\n"
+                                 "8: unify_variable_x X4\n"
+                                 "9: get_structure cons/2, X2\n"
+                                 "10: unify_value_x X3\n"
+                                 "11: unify_variable_x X6\n"
+                                 "12: put_value_x X4, A0\n"
+                                 "13: put_value_x X5, A1\n"
+                                 "14: put_value_x X6, A2\n"
+                                 "15: execute app/3\n");
+
+  // программа перекомпилируется после изменения базы
+  database->addRule(RuleParser().ParseRule("app(A, B, C)"));
+  EXPECT_NE(database->getProgram(), program);
+}
+
+TEST(WamTest, sameAnswersAsMGraph) {
+  auto database = buildDatabase({
+      "concat(Nil, x, x)",
+      "concat(cons(h, t), y, cons(h, r)) :- concat(t, y, r)",
+      "reverse(Nil, Nil) :- cut",
+      "reverse(  x,   y) :- reverse_helper(x, y, Nil)",
+      "reverse_helper(Nil, x, x)",
+      "reverse_helper(cons(h, r), x, y) :- reverse_helper(r, x, cons(h, y))",
+      "len(Nil, 0) :- cut",
+      "len(cons(_, x), succ(n)) :- len(x, n)",
+      "max(a, b, c, a) :- less(b, a), less(c, a)",
+      "max(_, b, c, b) :- less(c, b)",
+      "max(_, _, c, c)",
+      "less(1, 2)",
+      "less(1, 3)",
+      "less(2, 3)",
+  });
+  auto wam = std::make_shared<WamSolver>(database);
+  auto mgraph = std::make_shared<MGraphSolver>(database);
+
+  for (auto query : {
+           "concat(x, y, cons(A, cons(B, cons(C, Nil))))",
+           "reverse(cons(A, cons(B, cons(C, Nil))), x)",
+           "len(cons(A, cons(B, Nil)), x)",
+           "len(x, succ(succ(0)))",
+           "max(1, x, 2, x)",
+           "max(x, y, z, 3)",
+           "undefined(x)",
+       })
+    EXPECT_EQ(allAnswers(wam, query), allAnswers(mgraph, query)) << query;
+}
+
+TEST(WamTest, properCut) {
+  auto database = buildDatabase({
+      "q(A)",
+      "q(B)",
+      "q(C)",
+      "p(A) :- !",
+      "p(x) :- q(x), !, fail",
+      "p(_)",
+      "r(A) :- !",
+      "r(B)",
+      "s(x, y) :- q(x), r(y)",
+  });
+  auto solver = std::make_shared<WamSolver>(database);
+
+  EXPECT_TRUE(allAnswers(solver, "p(B)").empty());
+  EXPECT_EQ(allAnswers(solver, "p(A)"), std::vector<std::string>{"{}"});
+  // отсечение в r не отменяет решения цели q перед ним
+  EXPECT_EQ(allAnswers(solver, "s(x, y)"),
+            (std::vector<std::string>{"{x=A, y=A}", "{x=B, y=A}",
+                                      "{x=C, y=A}"}));
+}
+
+TEST(WamTest, primes) {
+  auto database = buildDatabase({
+      "divisible(x, y) :- mul(y, z, x), mul(y, z, x), !",
+      "composite(x) :- in_range(v, 2, x), divisible(x, v), !",
+      "prime(1) :- !, fail",
+      "prime(x) :- composite(x), !, fail",
+      "prime(_)",
+      "sum(x, y, z) :- add(x, y, z)",
+  });
+  auto solver = std::make_shared<WamSolver>(database, buildPredefinedHooks());
+
+  EXPECT_EQ(allAnswers(solver, "prime(97)").size(), 1);
+  EXPECT_TRUE(allAnswers(solver, "prime(12)").empty());
+  EXPECT_EQ(allAnswers(solver, "sum(2, 3, x)"),
+            std::vector<std::string>{"{x=5}"});
+  EXPECT_EQ(allAnswers(solver, "add(x, 3, 5)"),
+            std::vector<std::string>{"{x=2}"});
+}
+
+TEST(WamTest, recursiveFuncSym) {
+  auto database = buildDatabase({
+      "link(x, x)",
+  });
+  auto solver = std::make_shared<WamSolver>(database);
+
+  EXPECT_EQ(allAnswers(solver, "link(cons(A, x), x)"),
+            std::vector<std::string>{"{x=cons(A, ...)}"});
+}
+
+TEST(WamTest, tabledFallback) {
+  auto database = buildDatabase({
+      "edge(1, 2)",
+      "edge(2, 3)",
+      "edge(3, 1)",
+      "path(x, z) :- path(x, y), edge(y, z)",
+      "path(x, y) :- edge(x, y)",
+  });
+  database->addDirective(RuleParser().ParseDirective(":- table path/2"));
+
+  // леворекурсивный табулируемый предикат решается через таблицы
+  auto answers =
+      allAnswers(std::make_shared<WamSolver>(database), "path(1, x)");
+  EXPECT_EQ(answers,
+            allAnswers(std::make_shared<MGraphSolver>(database), "path(1, x)"));
+  EXPECT_EQ(answers.size(), 3);
+}
@@ -0,0 +1,33 @@
+#include "work_stealing_pool.h"
+#include <atomic>
+#include <gtest/gtest.h>
+
+TEST(WorkStealingPoolTest, runsAllTasks) {
+  WorkStealingPool pool(4);
+  std::atomic<int> counter = 0;
+
+  for (int i = 0; i < 1000; ++i)
+    pool.submit([&counter]() { ++counter; });
+  while (counter < 1000)
+    pool.runPending();
+
+  EXPECT_EQ(counter, 1000);
+}
+
+TEST(WorkStealingPoolTest, nestedTasks) {
+  WorkStealingPool pool(2);
+  std::atomic<int> counter = 0;
+
+  // задачи, добавленные из рабочего потока, попадают в его очередь и могут
+  // быть перехвачены другими потоками
+  for (int i = 0; i < 10; ++i)
+    pool.submit([&pool, &counter]() {
+      for (int j = 0; j < 10; ++j)
+        pool.submit([&counter]() { ++counter; });
+    });
+  while (counter < 100)
+    pool.runPending();
+
+  EXPECT_EQ(counter, 100);
+  EXPECT_FALSE(pool.runPending());
+}